@@ -247,6 +247,8 @@ typedef struct Type
     int template_param_index;
     TemplateConstraintKind template_constraint_kind;
     struct Type *template_default_type;
+    struct Type *interned; /* sema: hash-consed representative, see type_equal */
+    int is_canonical;      /* sema: imports below this node are fully resolved */
 } Type;
 
 typedef struct ModulePath
@@ -354,6 +356,20 @@ typedef struct
 
 void diag_set_use_ansi(int enable);
 void diag_set_data_log(int enable);
+
+/* Text of diagnostics the calling thread buffered instead of printing. */
+typedef struct
+{
+    char *text;
+    size_t len;
+    size_t cap;
+} DiagCapture;
+
+/* Routes the calling thread's diagnostics into `capture` (NULL restores
+   stderr) and returns the previous target. */
+DiagCapture *diag_capture_set(DiagCapture *capture);
+void diag_capture_print(const DiagCapture *capture, size_t from, size_t to);
+void diag_capture_free(DiagCapture *capture);
 void diag_error_at(const SourceBuffer *src, int line, int col, const char *fmt, ...);
 void diag_warning_at(const SourceBuffer *src, int line, int col, const char *fmt, ...);
 void diag_note_at(const SourceBuffer *src, int line, int col, const char *fmt, ...);
@@ -446,6 +462,11 @@ struct Node
     int inline_recursive;
     const struct Node *inline_expr;
     int inline_needs_body;
+    int profile_site; /* sema: 1-based if/call number within its function, for --profile-* */
+    int new_on_stack; /* sema: ND_NEW whose result never escapes, or the ND_DELETE releasing it */
+    int null_check_elided; /* sema: ref? deref/member access whose operand is proven non-null */
+    int is_unreachable; /* driver: function/global dropped by --whole-program reachability */
+    int loop_unroll; /* parser: [Unroll(N)] on a while/for loop, 0 when absent */
     
     const char *str_data;
     int str_len;
@@ -499,6 +520,8 @@ struct Node
     int is_entrypoint;
     int is_jump_target;
     int is_preserve;
+    int is_eval;       /* [Eval] / constant fun: callable from global initializers */
+    int eval_checked;  /* sema: body checked, safe for the compile-time evaluator */
     
     const char *field_name;
     int field_index;
@@ -611,9 +634,15 @@ typedef struct
     const struct Symbol *imported_globals;
     int imported_global_count;
     int opt_level;
+    const char *profile_generate; /* profile file written by instrumented code, or NULL */
+    const char *opt_passes;       /* comma-separated pass list replacing the -O pipeline, or NULL */
+    const char *disabled_passes;  /* comma-separated passes to skip, or NULL */
+    bool share_constants;         /* pool constant bytes across every unit of the invocation */
+    const char *ccbin_output_path; /* also write the module as ccbin here when it can be encoded directly, or NULL */
 } CodegenOptions;
 
 int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts);
+int codegen_ccb_opt_pass_known(const char *name, size_t len);
 int codegen_ccb_resolve_module_path(const CodegenOptions *opts, char *buffer, size_t bufsz);
 
 
@@ -621,6 +650,8 @@ void *xmalloc(size_t sz);
 void *xcalloc(size_t n, size_t sz);
 char *xstrdup(const char *s);
 
+const char *xintern(const char *s);
+
 
 
 void diag_error_at(const SourceBuffer *src, int line, int col, const char *fmt,
@@ -682,6 +713,8 @@ const Symbol *symtab_get(SymTable *st, const char *name);
 
 struct Scope; 
 struct ImportedFunctionSet;
+struct SemaTask;
+struct SemaParallelJob;
 
 typedef struct
 {
@@ -697,6 +730,8 @@ typedef struct
     int loop_depth;
     int switch_depth;
     int lambda_counter;
+    struct SemaTask *task;             /* set while a check is recorded for a later merge */
+    struct SemaParallelJob *merge_job; /* set while merging those records */
 } SemaContext;
 
 SemaContext *sema_create(void);
@@ -711,5 +746,8 @@ void sema_set_allow_implicit_voidp(int enable);
 void sema_set_allow_implicit_sizeof(int enable);
 void sema_set_allow_implicit_void_function(int enable);
 int sema_get_allow_implicit_void_function(void);
+void sema_set_parallel_jobs(int jobs);
+void sema_set_share_template_instances(int enable);
+void sema_set_eval_budget(long long steps, long long memory_bytes);
 
 #endif 
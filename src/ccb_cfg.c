@@ -0,0 +1,399 @@
+#include "ccb_cfg.h"
+#include "ast.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const char *label;
+    int block;
+} CcbCfgLabel;
+
+static int ccb_cfg_label_cmp(const void *a, const void *b)
+{
+    uintptr_t la = (uintptr_t)((const CcbCfgLabel *)a)->label;
+    uintptr_t lb = (uintptr_t)((const CcbCfgLabel *)b)->label;
+    return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+static int ccb_cfg_find_label(const CcbCfgLabel *labels, int count, const char *label)
+{
+    CcbCfgLabel key = {label, -1};
+    const CcbCfgLabel *hit = (const CcbCfgLabel *)bsearch(&key, labels, (size_t)count, sizeof(CcbCfgLabel),
+                                                          ccb_cfg_label_cmp);
+    return hit ? hit->block : -1;
+}
+
+static bool ccb_cfg_is_terminator(CcbOpcode op)
+{
+    return op == CCB_OP_JUMP || op == CCB_OP_BRANCH || op == CCB_OP_RET || op == CCB_OP_JUMP_INDIRECT;
+}
+
+static int ccb_cfg_intersect(const CcbCfg *cfg, int a, int b)
+{
+    while (a != b)
+    {
+        while (cfg->blocks[a].rpo > cfg->blocks[b].rpo)
+            a = cfg->blocks[a].idom;
+        while (cfg->blocks[b].rpo > cfg->blocks[a].rpo)
+            b = cfg->blocks[b].idom;
+    }
+    return a;
+}
+
+static void ccb_cfg_compute_rpo(CcbCfg *cfg)
+{
+    int n = cfg->block_count;
+    int *stack = (int *)xmalloc((size_t)n * sizeof(int));
+    int *next_succ = (int *)xcalloc((size_t)n, sizeof(int));
+    bool *seen = (bool *)xcalloc((size_t)n, sizeof(bool));
+    int *post = (int *)xmalloc((size_t)n * sizeof(int));
+    int post_count = 0;
+    int sp = 0;
+    stack[sp++] = 0;
+    seen[0] = true;
+    while (sp > 0)
+    {
+        int b = stack[sp - 1];
+        if (next_succ[b] < cfg->blocks[b].succ_count)
+        {
+            int s = cfg->blocks[b].succ[next_succ[b]++];
+            if (!seen[s])
+            {
+                seen[s] = true;
+                stack[sp++] = s;
+            }
+            continue;
+        }
+        post[post_count++] = b;
+        sp--;
+    }
+    cfg->rpo = (int *)xmalloc((size_t)(post_count ? post_count : 1) * sizeof(int));
+    cfg->rpo_count = post_count;
+    for (int i = 0; i < post_count; ++i)
+    {
+        cfg->rpo[i] = post[post_count - 1 - i];
+        cfg->blocks[cfg->rpo[i]].rpo = i;
+    }
+    free(post);
+    free(seen);
+    free(next_succ);
+    free(stack);
+}
+
+static void ccb_cfg_compute_idom(CcbCfg *cfg)
+{
+    CcbBlock *blocks = cfg->blocks;
+    blocks[0].idom = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 1; i < cfg->rpo_count; ++i)
+        {
+            CcbBlock *blk = &blocks[cfg->rpo[i]];
+            int new_idom = -1;
+            for (int p = 0; p < blk->pred_count; ++p)
+            {
+                int pred = blk->preds[p];
+                if (blocks[pred].idom < 0)
+                    continue;
+                new_idom = new_idom < 0 ? pred : ccb_cfg_intersect(cfg, pred, new_idom);
+            }
+            if (new_idom != blk->idom)
+            {
+                blk->idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+    blocks[0].idom = -1;
+}
+
+/* With `counts` set, counts each block's frontier; otherwise appends to
+   the frontier slices sized by the counting pass. */
+static void ccb_cfg_frontier_pass(CcbCfg *cfg, int *last_added, int *counts)
+{
+    CcbBlock *blocks = cfg->blocks;
+    for (int b = 0; b < cfg->block_count; ++b)
+        last_added[b] = -1;
+    for (int b = 0; b < cfg->block_count; ++b)
+    {
+        if (blocks[b].rpo < 0 || blocks[b].pred_count < 2)
+            continue;
+        for (int p = 0; p < blocks[b].pred_count; ++p)
+        {
+            int runner = blocks[b].preds[p];
+            if (blocks[runner].rpo < 0)
+                continue;
+            while (runner >= 0 && runner != blocks[b].idom)
+            {
+                if (last_added[runner] != b)
+                {
+                    last_added[runner] = b;
+                    if (counts)
+                        counts[runner]++;
+                    else
+                        blocks[runner].frontier[blocks[runner].frontier_count++] = b;
+                }
+                runner = blocks[runner].idom;
+            }
+        }
+    }
+}
+
+bool ccb_cfg_build(CcbCfg *cfg, const CcbInsn *insns, size_t count)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    if (count == 0)
+        return false;
+
+    bool *leader = (bool *)xcalloc(count + 1, sizeof(bool));
+    leader[0] = true;
+    int block_count = 0;
+    int label_count = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (insns[i].op == CCB_OP_JUMP_INDIRECT)
+        {
+            free(leader);
+            return false;
+        }
+        if (insns[i].op == CCB_OP_LABEL)
+        {
+            leader[i] = true;
+            label_count++;
+        }
+        if (ccb_cfg_is_terminator(insns[i].op))
+            leader[i + 1] = true;
+    }
+    for (size_t i = 0; i < count; ++i)
+        block_count += leader[i];
+
+    CcbBlock *blocks = (CcbBlock *)xcalloc((size_t)block_count, sizeof(CcbBlock));
+    CcbCfgLabel *labels = (CcbCfgLabel *)xmalloc((size_t)(label_count ? label_count : 1) * sizeof(CcbCfgLabel));
+    int b = -1;
+    int l = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (leader[i])
+        {
+            if (b >= 0)
+                blocks[b].end = i;
+            blocks[++b].start = i;
+            blocks[b].idom = -1;
+            blocks[b].rpo = -1;
+        }
+        if (insns[i].op == CCB_OP_LABEL)
+        {
+            labels[l].label = insns[i].symbol;
+            labels[l++].block = b;
+        }
+    }
+    blocks[b].end = count;
+    free(leader);
+    qsort(labels, (size_t)label_count, sizeof(CcbCfgLabel), ccb_cfg_label_cmp);
+
+    cfg->blocks = blocks;
+    cfg->block_count = block_count;
+    int edge_count = 0;
+    for (b = 0; b < block_count; ++b)
+    {
+        const CcbInsn *last = &insns[blocks[b].end - 1];
+        int targets[2];
+        int target_count = 0;
+        if (last->op == CCB_OP_JUMP)
+            targets[target_count++] = ccb_cfg_find_label(labels, label_count, last->symbol);
+        else if (last->op == CCB_OP_BRANCH)
+        {
+            targets[target_count++] = ccb_cfg_find_label(labels, label_count, last->symbol);
+            if (last->symbol2 != last->symbol)
+                targets[target_count++] = ccb_cfg_find_label(labels, label_count, last->symbol2);
+        }
+        else if (last->op != CCB_OP_RET && b + 1 < block_count)
+            targets[target_count++] = b + 1;
+        for (int t = 0; t < target_count; ++t)
+        {
+            if (targets[t] < 0)
+            {
+                free(labels);
+                ccb_cfg_free(cfg);
+                return false;
+            }
+            blocks[b].succ[blocks[b].succ_count++] = targets[t];
+            blocks[targets[t]].pred_count++;
+            edge_count++;
+        }
+    }
+    free(labels);
+
+    /* preds and dominator children each need at most one slot per edge or
+       block; frontiers are sized after counting. */
+    cfg->storage = (int *)xmalloc((size_t)(edge_count + block_count + 1) * sizeof(int));
+    int used = 0;
+    for (b = 0; b < block_count; ++b)
+    {
+        blocks[b].preds = cfg->storage + used;
+        used += blocks[b].pred_count;
+        blocks[b].pred_count = 0;
+    }
+    for (b = 0; b < block_count; ++b)
+    {
+        for (int s = 0; s < blocks[b].succ_count; ++s)
+        {
+            CcbBlock *succ = &blocks[blocks[b].succ[s]];
+            succ->preds[succ->pred_count++] = b;
+        }
+    }
+
+    ccb_cfg_compute_rpo(cfg);
+    ccb_cfg_compute_idom(cfg);
+
+    for (b = 0; b < block_count; ++b)
+    {
+        if (blocks[b].idom >= 0)
+            blocks[blocks[b].idom].child_count++;
+    }
+    for (b = 0; b < block_count; ++b)
+    {
+        blocks[b].children = cfg->storage + used;
+        used += blocks[b].child_count;
+        blocks[b].child_count = 0;
+    }
+    for (int i = 0; i < cfg->rpo_count; ++i)
+    {
+        int child = cfg->rpo[i];
+        int parent = blocks[child].idom;
+        if (parent >= 0)
+            blocks[parent].children[blocks[parent].child_count++] = child;
+    }
+
+    /* Dominance frontiers (Cooper, Harvey and Kennedy): count, then fill. */
+    int *last_added = (int *)xmalloc((size_t)block_count * sizeof(int));
+    int *counts = (int *)xcalloc((size_t)block_count, sizeof(int));
+    ccb_cfg_frontier_pass(cfg, last_added, counts);
+    int frontier_total = 0;
+    for (b = 0; b < block_count; ++b)
+        frontier_total += counts[b];
+    cfg->frontier_storage = (int *)xmalloc((size_t)(frontier_total ? frontier_total : 1) * sizeof(int));
+    used = 0;
+    for (b = 0; b < block_count; ++b)
+    {
+        blocks[b].frontier = cfg->frontier_storage + used;
+        used += counts[b];
+    }
+    ccb_cfg_frontier_pass(cfg, last_added, NULL);
+    free(counts);
+    free(last_added);
+    return true;
+}
+
+void ccb_cfg_free(CcbCfg *cfg)
+{
+    if (!cfg)
+        return;
+    free(cfg->storage);
+    free(cfg->frontier_storage);
+    free(cfg->rpo);
+    free(cfg->blocks);
+    memset(cfg, 0, sizeof(*cfg));
+}
+
+bool ccb_cfg_dominates(const CcbCfg *cfg, int a, int b)
+{
+    if (!cfg || a < 0 || b < 0 || cfg->blocks[b].rpo < 0)
+        return false;
+    while (b >= 0)
+    {
+        if (b == a)
+            return true;
+        b = cfg->blocks[b].idom;
+    }
+    return false;
+}
+
+static int ccb_cfg_loop_cmp(const void *a, const void *b)
+{
+    const CcbLoop *la = (const CcbLoop *)a;
+    const CcbLoop *lb = (const CcbLoop *)b;
+    if (la->block_count != lb->block_count)
+        return la->block_count < lb->block_count ? -1 : 1;
+    return la->header < lb->header ? -1 : (la->header > lb->header ? 1 : 0);
+}
+
+int ccb_cfg_find_loops(const CcbCfg *cfg, CcbLoop **loops)
+{
+    *loops = NULL;
+    int n = cfg->block_count;
+    int loop_count = 0;
+    bool *in_loop = (bool *)xcalloc((size_t)(n ? n : 1), sizeof(bool));
+    int *work = (int *)xmalloc((size_t)(n ? n : 1) * sizeof(int));
+    for (int h = 0; h < n; ++h)
+    {
+        const CcbBlock *hdr = &cfg->blocks[h];
+        if (hdr->rpo < 0)
+            continue;
+        int sp = 0;
+        bool has_back_edge = false;
+        memset(in_loop, 0, (size_t)n * sizeof(bool));
+        in_loop[h] = true;
+        for (int p = 0; p < hdr->pred_count; ++p)
+        {
+            int latch = hdr->preds[p];
+            if (!ccb_cfg_dominates(cfg, h, latch))
+                continue;
+            has_back_edge = true;
+            if (in_loop[latch])
+                continue;
+            in_loop[latch] = true;
+            work[sp++] = latch;
+        }
+        if (!has_back_edge)
+            continue;
+        while (sp > 0)
+        {
+            const CcbBlock *blk = &cfg->blocks[work[--sp]];
+            for (int p = 0; p < blk->pred_count; ++p)
+            {
+                int pred = blk->preds[p];
+                if (in_loop[pred] || cfg->blocks[pred].rpo < 0)
+                    continue;
+                in_loop[pred] = true;
+                work[sp++] = pred;
+            }
+        }
+        CcbLoop *grown = (CcbLoop *)realloc(*loops, (size_t)(loop_count + 1) * sizeof(CcbLoop));
+        if (!grown)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        *loops = grown;
+        CcbLoop *loop = &grown[loop_count++];
+        loop->header = h;
+        loop->block_count = 0;
+        for (int b = 0; b < n; ++b)
+            loop->block_count += in_loop[b];
+        loop->blocks = (int *)xmalloc((size_t)loop->block_count * sizeof(int));
+        for (int b = 0, at = 0; b < n; ++b)
+        {
+            if (in_loop[b])
+                loop->blocks[at++] = b;
+        }
+    }
+    free(work);
+    free(in_loop);
+    if (loop_count > 1)
+        qsort(*loops, (size_t)loop_count, sizeof(CcbLoop), ccb_cfg_loop_cmp);
+    return loop_count;
+}
+
+void ccb_cfg_free_loops(CcbLoop *loops, int count)
+{
+    for (int i = 0; i < count; ++i)
+        free(loops[i].blocks);
+    free(loops);
+}
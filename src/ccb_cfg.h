@@ -0,0 +1,61 @@
+#ifndef CHANCE_CCB_CFG_H
+#define CHANCE_CCB_CFG_H
+
+#include "ccb_ir.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Basic blocks, dominators and dominance frontiers of a decoded ccb
+   function body. Blocks start at labels and after jumps, branches and
+   returns; a block whose last instruction is none of those falls through
+   into the next one. Unreachable blocks keep idom == -1 and rpo == -1. */
+
+typedef struct
+{
+    size_t start;    /* first instruction */
+    size_t end;      /* one past the last instruction */
+    int succ[2];
+    int succ_count;
+    int *preds;
+    int pred_count;
+    int idom;        /* -1 for the entry block and unreachable blocks */
+    int rpo;         /* position in CcbCfg.rpo, -1 when unreachable */
+    int *frontier;   /* dominance frontier */
+    int frontier_count;
+    int *children;   /* dominator tree */
+    int child_count;
+} CcbBlock;
+
+typedef struct
+{
+    CcbBlock *blocks;
+    int block_count;
+    int *rpo;        /* reachable blocks in reverse postorder */
+    int rpo_count;
+    int *storage;    /* backs preds and children */
+    int *frontier_storage;
+} CcbCfg;
+
+/* Returns false (leaving cfg empty) when the body has an indirect jump or
+   a branch to a label it does not define. */
+bool ccb_cfg_build(CcbCfg *cfg, const CcbInsn *insns, size_t count);
+void ccb_cfg_free(CcbCfg *cfg);
+
+bool ccb_cfg_dominates(const CcbCfg *cfg, int a, int b);
+
+typedef struct
+{
+    int header;
+    int *blocks;     /* ascending, header included */
+    int block_count;
+} CcbLoop;
+
+/* Natural loops: every back edge (to a block that dominates its source)
+   together with the blocks that reach it without passing the header; back
+   edges to one header form one loop. Ordered so that a loop comes before
+   any loop enclosing it. Returns the count; *loops is NULL when zero. */
+int ccb_cfg_find_loops(const CcbCfg *cfg, CcbLoop **loops);
+void ccb_cfg_free_loops(CcbLoop *loops, int count);
+
+#endif
@@ -0,0 +1,878 @@
+#include "ccb_gvn.h"
+#include "ccb_cfg.h"
+#include "ast.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    uint8_t op;
+    uint8_t sub;
+    uint8_t is_unsigned;
+    uint8_t type;
+    uint8_t to_type;
+    int32_t index;
+    int32_t a;
+    int32_t b;
+    const char *symbol;
+    uint64_t imm;
+} CcbGvnKey;
+
+typedef struct
+{
+    int vn;
+    size_t start;
+    size_t end;
+    bool pure;  /* computed by a contiguous run of pure instructions */
+    bool heavy; /* reads memory or calls */
+} CcbGvnValue;
+
+typedef struct
+{
+    size_t start;
+    size_t end;
+    int vn;
+    int block;
+    bool is_reuse;
+    int leader;       /* temp reuse: index of the leading record, else -1 */
+    CcbOpcode load;   /* slot reuse */
+    int slot;
+    int uses;         /* leader: temp reuses that depend on it */
+    size_t undo_mark;
+} CcbGvnRecord;
+
+enum
+{
+    CCB_GVN_UNDO_CUR,
+    CCB_GVN_UNDO_AVAIL,
+    CCB_GVN_UNDO_HOLDER
+};
+
+typedef struct
+{
+    int kind;
+    int key;
+    int old;
+} CcbGvnUndo;
+
+typedef struct
+{
+    const CcbInsn *insns;
+    size_t count;
+    CcbCfg cfg;
+    CcbGvnPureCallFn is_pure_call;
+    void *ctx;
+
+    int param_count;
+    int var_count; /* params, then locals, then memory */
+    int mem_var;
+    bool *addr_taken;
+    int *cur;
+
+    CcbGvnKey *keys;
+    int *key_vns;
+    size_t key_capacity;
+    size_t key_count;
+
+    int vn_count;
+    int vn_capacity;
+    CCValueType *vn_type;
+    int *avail;  /* vn -> leading record */
+    int *holder; /* vn -> var last stored with it */
+
+    CcbGvnValue *stack;
+    size_t stack_count;
+    size_t stack_capacity;
+
+    CcbGvnRecord *records;
+    size_t record_count;
+    size_t record_capacity;
+
+    CcbGvnUndo *undo;
+    size_t undo_count;
+    size_t undo_capacity;
+
+    int *phi_start; /* per block, into phi_vars; block_count + 1 entries */
+    int *phi_vars;
+} CcbGvn;
+
+static void *ccb_gvn_grow(void *items, size_t *capacity, size_t needed, size_t item_size)
+{
+    if (needed <= *capacity)
+        return items;
+    size_t cap = *capacity ? *capacity * 2 : 64;
+    while (cap < needed)
+        cap *= 2;
+    void *grown = realloc(items, cap * item_size);
+    if (!grown)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    *capacity = cap;
+    return grown;
+}
+
+static int ccb_gvn_new_vn(CcbGvn *g, CCValueType type)
+{
+    if (g->vn_count == g->vn_capacity)
+    {
+        size_t cap = (size_t)g->vn_capacity;
+        size_t new_cap = cap;
+        g->vn_type = (CCValueType *)ccb_gvn_grow(g->vn_type, &new_cap, cap + 1, sizeof(CCValueType));
+        new_cap = cap;
+        g->avail = (int *)ccb_gvn_grow(g->avail, &new_cap, cap + 1, sizeof(int));
+        new_cap = cap;
+        g->holder = (int *)ccb_gvn_grow(g->holder, &new_cap, cap + 1, sizeof(int));
+        g->vn_capacity = (int)new_cap;
+    }
+    int vn = g->vn_count++;
+    g->vn_type[vn] = type;
+    g->avail[vn] = -1;
+    g->holder[vn] = -1;
+    return vn;
+}
+
+static uint64_t ccb_gvn_hash(const CcbGvnKey *key)
+{
+    const unsigned char *p = (const unsigned char *)key;
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < sizeof(*key); ++i)
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void ccb_gvn_rehash(CcbGvn *g)
+{
+    size_t old_cap = g->key_capacity;
+    CcbGvnKey *old_keys = g->keys;
+    int *old_vns = g->key_vns;
+    g->key_capacity = old_cap ? old_cap * 2 : 256;
+    g->keys = (CcbGvnKey *)xmalloc(g->key_capacity * sizeof(CcbGvnKey));
+    g->key_vns = (int *)xmalloc(g->key_capacity * sizeof(int));
+    for (size_t i = 0; i < g->key_capacity; ++i)
+        g->key_vns[i] = -1;
+    for (size_t i = 0; i < old_cap; ++i)
+    {
+        if (old_vns[i] < 0)
+            continue;
+        size_t slot = (size_t)ccb_gvn_hash(&old_keys[i]) & (g->key_capacity - 1);
+        while (g->key_vns[slot] >= 0)
+            slot = (slot + 1) & (g->key_capacity - 1);
+        g->keys[slot] = old_keys[i];
+        g->key_vns[slot] = old_vns[i];
+    }
+    free(old_keys);
+    free(old_vns);
+}
+
+/* Value number of `key`, creating one of `type` on first sight. */
+static int ccb_gvn_lookup(CcbGvn *g, const CcbGvnKey *key, CCValueType type)
+{
+    if ((g->key_count + 1) * 2 > g->key_capacity)
+        ccb_gvn_rehash(g);
+    size_t slot = (size_t)ccb_gvn_hash(key) & (g->key_capacity - 1);
+    while (g->key_vns[slot] >= 0)
+    {
+        if (memcmp(&g->keys[slot], key, sizeof(*key)) == 0)
+            return g->key_vns[slot];
+        slot = (slot + 1) & (g->key_capacity - 1);
+    }
+    g->keys[slot] = *key;
+    g->key_vns[slot] = ccb_gvn_new_vn(g, type);
+    g->key_count++;
+    return g->key_vns[slot];
+}
+
+static void ccb_gvn_log(CcbGvn *g, int kind, int key, int old)
+{
+    g->undo = (CcbGvnUndo *)ccb_gvn_grow(g->undo, &g->undo_capacity, g->undo_count + 1, sizeof(CcbGvnUndo));
+    g->undo[g->undo_count].kind = kind;
+    g->undo[g->undo_count].key = key;
+    g->undo[g->undo_count].old = old;
+    g->undo_count++;
+}
+
+static void ccb_gvn_undo_to(CcbGvn *g, size_t mark)
+{
+    while (g->undo_count > mark)
+    {
+        const CcbGvnUndo *u = &g->undo[--g->undo_count];
+        if (u->kind == CCB_GVN_UNDO_CUR)
+            g->cur[u->key] = u->old;
+        else if (u->kind == CCB_GVN_UNDO_AVAIL)
+            g->avail[u->key] = u->old;
+        else
+            g->holder[u->key] = u->old;
+    }
+}
+
+static void ccb_gvn_set_cur(CcbGvn *g, int var, int vn)
+{
+    ccb_gvn_log(g, CCB_GVN_UNDO_CUR, var, g->cur[var]);
+    g->cur[var] = vn;
+}
+
+static void ccb_gvn_push(CcbGvn *g, CcbGvnValue value)
+{
+    g->stack = (CcbGvnValue *)ccb_gvn_grow(g->stack, &g->stack_capacity, g->stack_count + 1, sizeof(CcbGvnValue));
+    g->stack[g->stack_count++] = value;
+}
+
+/* Values left on the stack by a predecessor are unknown. */
+static CcbGvnValue ccb_gvn_pop(CcbGvn *g)
+{
+    if (g->stack_count > 0)
+        return g->stack[--g->stack_count];
+    CcbGvnValue unknown = {ccb_gvn_new_vn(g, CC_TYPE_INVALID), 0, 0, false, false};
+    return unknown;
+}
+
+static void ccb_gvn_push_opaque(CcbGvn *g, size_t i, CCValueType type)
+{
+    CcbGvnValue value = {ccb_gvn_new_vn(g, type), i, i, false, false};
+    ccb_gvn_push(g, value);
+}
+
+static int ccb_gvn_slot_var(const CcbGvn *g, const CcbInsn *insn)
+{
+    bool is_param = insn->op == CCB_OP_LOAD_PARAM || insn->op == CCB_OP_STORE_PARAM || insn->op == CCB_OP_ADDR_PARAM;
+    return is_param ? insn->index : g->param_count + insn->index;
+}
+
+static CCValueType ccb_gvn_result_type(const CcbInsn *insn)
+{
+    switch (insn->op)
+    {
+    case CCB_OP_CONVERT:
+        return insn->to_type;
+    case CCB_OP_COMPARE:
+    case CCB_OP_TEST_NULL:
+        return CC_TYPE_I1;
+    case CCB_OP_ADDR_LOCAL:
+    case CCB_OP_ADDR_PARAM:
+    case CCB_OP_ADDR_GLOBAL:
+        return CC_TYPE_PTR;
+    default:
+        return insn->type;
+    }
+}
+
+/* Drops the records made for sub-expressions of a span that is about to be
+   replaced as a whole. */
+static void ccb_gvn_cancel_nested(CcbGvn *g, int block, size_t start)
+{
+    size_t mark = g->undo_count;
+    while (g->record_count > 0)
+    {
+        CcbGvnRecord *rec = &g->records[g->record_count - 1];
+        if (rec->block != block || rec->start < start)
+            break;
+        if (rec->is_reuse && rec->leader >= 0)
+            g->records[rec->leader].uses--;
+        mark = rec->undo_mark;
+        g->record_count--;
+    }
+    ccb_gvn_undo_to(g, mark);
+}
+
+static CcbGvnRecord *ccb_gvn_add_record(CcbGvn *g, int block, size_t start, size_t end, int vn)
+{
+    g->records = (CcbGvnRecord *)ccb_gvn_grow(g->records, &g->record_capacity, g->record_count + 1,
+                                              sizeof(CcbGvnRecord));
+    CcbGvnRecord *rec = &g->records[g->record_count++];
+    memset(rec, 0, sizeof(*rec));
+    rec->start = start;
+    rec->end = end;
+    rec->vn = vn;
+    rec->block = block;
+    rec->leader = -1;
+    rec->undo_mark = g->undo_count;
+    return rec;
+}
+
+/* Pushes the value of a pure instruction at `i` computed from `operands`,
+   recording it as a leader or as a reuse of an available value. */
+static void ccb_gvn_push_pure(CcbGvn *g, int block, size_t i, CcbGvnKey *key, const CcbGvnValue *operands,
+                              int operand_count, bool heavy)
+{
+    const CcbInsn *insn = &g->insns[i];
+    CCValueType type = ccb_gvn_result_type(insn);
+    int vn = ccb_gvn_lookup(g, key, type);
+    CcbGvnValue value = {vn, i, i, true, heavy};
+    for (int k = operand_count - 1; k >= 0; --k)
+    {
+        if (!operands[k].pure || operands[k].end + 1 != value.start)
+        {
+            value.pure = false;
+            break;
+        }
+        value.start = operands[k].start;
+        value.heavy = value.heavy || operands[k].heavy;
+    }
+    if (operand_count == 0 || !value.pure || type == CC_TYPE_INVALID || type == CC_TYPE_VOID)
+    {
+        ccb_gvn_push(g, value);
+        return;
+    }
+
+    size_t len = i - value.start + 1;
+    int held = g->holder[vn];
+    if (held >= 0 && g->cur[held] == vn && len >= 2)
+    {
+        ccb_gvn_cancel_nested(g, block, value.start);
+        CcbGvnRecord *rec = ccb_gvn_add_record(g, block, value.start, i, vn);
+        rec->is_reuse = true;
+        rec->load = held < g->param_count ? CCB_OP_LOAD_PARAM : CCB_OP_LOAD_LOCAL;
+        rec->slot = held < g->param_count ? held : held - g->param_count;
+    }
+    else if (g->avail[vn] >= 0 && (len >= 3 || value.heavy))
+    {
+        ccb_gvn_cancel_nested(g, block, value.start);
+        int leader = g->avail[vn];
+        CcbGvnRecord *rec = ccb_gvn_add_record(g, block, value.start, i, vn);
+        rec->is_reuse = true;
+        rec->leader = leader;
+        g->records[leader].uses++;
+    }
+    else if (g->avail[vn] < 0)
+    {
+        ccb_gvn_add_record(g, block, value.start, i, vn);
+        ccb_gvn_log(g, CCB_GVN_UNDO_AVAIL, vn, -1);
+        g->avail[vn] = (int)(g->record_count - 1);
+    }
+    ccb_gvn_push(g, value);
+}
+
+static void ccb_gvn_kill_memory(CcbGvn *g)
+{
+    ccb_gvn_set_cur(g, g->mem_var, ccb_gvn_new_vn(g, CC_TYPE_INVALID));
+}
+
+static void ccb_gvn_block(CcbGvn *g, int block)
+{
+    const CcbBlock *blk = &g->cfg.blocks[block];
+    for (int p = g->phi_start[block]; p < g->phi_start[block + 1]; ++p)
+        ccb_gvn_set_cur(g, g->phi_vars[p], ccb_gvn_new_vn(g, CC_TYPE_INVALID));
+    g->stack_count = 0;
+
+    for (size_t i = blk->start; i < blk->end; ++i)
+    {
+        const CcbInsn *insn = &g->insns[i];
+        CcbGvnKey key;
+        memset(&key, 0, sizeof(key));
+        key.op = (uint8_t)insn->op;
+        CcbGvnValue ops[2];
+        switch (insn->op)
+        {
+        case CCB_OP_CONST:
+            key.type = (uint8_t)insn->type;
+            if (insn->has_imm)
+                key.imm = insn->imm;
+            else
+                memcpy(&key.imm, &insn->fimm, sizeof(key.imm));
+            {
+                CcbGvnValue value = {ccb_gvn_lookup(g, &key, insn->type), i, i, true, false};
+                ccb_gvn_push(g, value);
+            }
+            break;
+        case CCB_OP_CONST_STR:
+        {
+            CcbGvnValue value = {ccb_gvn_new_vn(g, CC_TYPE_PTR), i, i, true, false};
+            ccb_gvn_push(g, value);
+            break;
+        }
+        case CCB_OP_LOAD_LOCAL:
+        case CCB_OP_LOAD_PARAM:
+        {
+            int var = ccb_gvn_slot_var(g, insn);
+            CcbGvnValue value = {g->cur[var], i, i, true, false};
+            if (g->addr_taken[var])
+            {
+                key.index = var;
+                key.a = g->cur[g->mem_var];
+                value.vn = ccb_gvn_lookup(g, &key, CC_TYPE_INVALID);
+                value.heavy = true;
+            }
+            ccb_gvn_push(g, value);
+            break;
+        }
+        case CCB_OP_ADDR_LOCAL:
+        case CCB_OP_ADDR_PARAM:
+        case CCB_OP_ADDR_GLOBAL:
+        case CCB_OP_LOAD_GLOBAL:
+        {
+            key.index = insn->op == CCB_OP_ADDR_GLOBAL || insn->op == CCB_OP_LOAD_GLOBAL ? 0 : ccb_gvn_slot_var(g, insn);
+            key.symbol = insn->symbol;
+            if (insn->op == CCB_OP_LOAD_GLOBAL)
+                key.a = g->cur[g->mem_var];
+            CcbGvnValue value = {ccb_gvn_lookup(g, &key, CC_TYPE_INVALID), i, i, true,
+                                 insn->op == CCB_OP_LOAD_GLOBAL};
+            ccb_gvn_push(g, value);
+            break;
+        }
+        case CCB_OP_STORE_LOCAL:
+        case CCB_OP_STORE_PARAM:
+        {
+            int var = ccb_gvn_slot_var(g, insn);
+            CcbGvnValue value = ccb_gvn_pop(g);
+            if (g->addr_taken[var])
+            {
+                ccb_gvn_kill_memory(g);
+                break;
+            }
+            ccb_gvn_set_cur(g, var, value.vn);
+            ccb_gvn_log(g, CCB_GVN_UNDO_HOLDER, value.vn, g->holder[value.vn]);
+            g->holder[value.vn] = var;
+            break;
+        }
+        case CCB_OP_STORE_GLOBAL:
+            ccb_gvn_pop(g);
+            ccb_gvn_kill_memory(g);
+            break;
+        case CCB_OP_STORE_INDIRECT:
+            ccb_gvn_pop(g);
+            ccb_gvn_pop(g);
+            ccb_gvn_kill_memory(g);
+            break;
+        case CCB_OP_LOAD_INDIRECT:
+            ops[0] = ccb_gvn_pop(g);
+            key.type = (uint8_t)insn->type;
+            key.a = ops[0].vn;
+            key.b = g->cur[g->mem_var];
+            ccb_gvn_push_pure(g, block, i, &key, ops, 1, true);
+            break;
+        case CCB_OP_BINOP:
+        case CCB_OP_COMPARE:
+        {
+            ops[1] = ccb_gvn_pop(g);
+            ops[0] = ccb_gvn_pop(g);
+            key.sub = insn->sub;
+            key.is_unsigned = insn->is_unsigned;
+            key.type = (uint8_t)insn->type;
+            key.a = ops[0].vn;
+            key.b = ops[1].vn;
+            bool commutative = insn->op == CCB_OP_BINOP
+                                   ? (insn->sub == CCB_BINOP_ADD || insn->sub == CCB_BINOP_MUL ||
+                                      insn->sub == CCB_BINOP_AND || insn->sub == CCB_BINOP_OR ||
+                                      insn->sub == CCB_BINOP_XOR)
+                                   : (insn->sub == CCB_CMP_EQ || insn->sub == CCB_CMP_NE);
+            if (commutative && key.a > key.b)
+            {
+                key.a = ops[1].vn;
+                key.b = ops[0].vn;
+            }
+            ccb_gvn_push_pure(g, block, i, &key, ops, 2, false);
+            break;
+        }
+        case CCB_OP_UNOP:
+        case CCB_OP_CONVERT:
+        case CCB_OP_TEST_NULL:
+            ops[0] = ccb_gvn_pop(g);
+            key.sub = insn->sub;
+            key.type = (uint8_t)insn->type;
+            key.to_type = (uint8_t)insn->to_type;
+            key.a = ops[0].vn;
+            ccb_gvn_push_pure(g, block, i, &key, ops, 1, false);
+            break;
+        case CCB_OP_CALL:
+        case CCB_OP_CALL_INDIRECT:
+        {
+            bool pure = insn->op == CCB_OP_CALL && !insn->is_varargs && g->is_pure_call &&
+                        g->is_pure_call(insn->symbol, g->ctx);
+            /* Arguments fold into one value number, left to right. */
+            int args_vn = -1;
+            size_t args_start = i;
+            bool args_pure = true;
+            size_t expect_end = i - 1;
+            for (int k = 0; k < insn->arg_count; ++k)
+            {
+                CcbGvnValue arg = ccb_gvn_pop(g);
+                if (!arg.pure || arg.end != expect_end)
+                    args_pure = false;
+                expect_end = arg.start - 1;
+                args_start = arg.start;
+                CcbGvnKey link;
+                memset(&link, 0, sizeof(link));
+                link.op = CCB_OP_COUNT;
+                link.a = arg.vn;
+                link.b = args_vn;
+                args_vn = ccb_gvn_lookup(g, &link, CC_TYPE_INVALID);
+            }
+            if (insn->op == CCB_OP_CALL_INDIRECT)
+                ccb_gvn_pop(g);
+            if (!pure)
+            {
+                ccb_gvn_kill_memory(g);
+                if (insn->type != CC_TYPE_VOID && insn->type != CC_TYPE_INVALID)
+                    ccb_gvn_push_opaque(g, i, insn->type);
+                break;
+            }
+            if (insn->type == CC_TYPE_VOID || insn->type == CC_TYPE_INVALID)
+                break;
+            key.symbol = insn->symbol;
+            key.type = (uint8_t)insn->type;
+            key.index = insn->arg_count;
+            key.a = args_vn;
+            if (insn->arg_count == 0)
+            {
+                CcbGvnValue value = {ccb_gvn_lookup(g, &key, insn->type), i, i, true, true};
+                ccb_gvn_push(g, value);
+                break;
+            }
+            ops[0].vn = args_vn;
+            ops[0].start = args_start;
+            ops[0].end = i - 1;
+            ops[0].pure = args_pure;
+            ops[0].heavy = false;
+            ccb_gvn_push_pure(g, block, i, &key, ops, 1, true);
+            break;
+        }
+        case CCB_OP_DROP:
+        case CCB_OP_BRANCH:
+            ccb_gvn_pop(g);
+            break;
+        case CCB_OP_DUP:
+        {
+            CcbGvnValue value = ccb_gvn_pop(g);
+            ccb_gvn_push(g, value);
+            value.pure = false;
+            ccb_gvn_push(g, value);
+            break;
+        }
+        case CCB_OP_STACK_ALLOC:
+            ccb_gvn_push_opaque(g, i, CC_TYPE_PTR);
+            break;
+        case CCB_OP_RET:
+            if (insn->type != CC_TYPE_VOID)
+                ccb_gvn_pop(g);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/* Marks which blocks need a phi for each variable (iterated dominance
+   frontier of the blocks that define it). */
+static void ccb_gvn_place_phis(CcbGvn *g)
+{
+    int block_count = g->cfg.block_count;
+    int var_count = g->var_count;
+    int *def_start = (int *)xcalloc((size_t)var_count + 1, sizeof(int));
+    size_t def_total = 0;
+    int *last_def = (int *)xmalloc((size_t)var_count * sizeof(int));
+    for (int v = 0; v < var_count; ++v)
+        last_def[v] = -1;
+
+    /* (var, block) definition pairs, deduplicated per block. */
+    int *def_var = NULL;
+    int *def_block = NULL;
+    size_t def_capacity = 0;
+    for (int b = 0; b < block_count; ++b)
+    {
+        const CcbBlock *blk = &g->cfg.blocks[b];
+        if (blk->rpo < 0)
+            continue;
+        for (size_t i = blk->start; i < blk->end; ++i)
+        {
+            const CcbInsn *insn = &g->insns[i];
+            int var = -1;
+            switch (insn->op)
+            {
+            case CCB_OP_STORE_LOCAL:
+            case CCB_OP_STORE_PARAM:
+                var = ccb_gvn_slot_var(g, insn);
+                if (g->addr_taken[var])
+                    var = g->mem_var;
+                break;
+            case CCB_OP_STORE_GLOBAL:
+            case CCB_OP_STORE_INDIRECT:
+            case CCB_OP_CALL:
+            case CCB_OP_CALL_INDIRECT:
+                var = g->mem_var;
+                break;
+            default:
+                break;
+            }
+            if (var < 0 || last_def[var] == b)
+                continue;
+            last_def[var] = b;
+            size_t cap = def_capacity;
+            def_var = (int *)ccb_gvn_grow(def_var, &cap, def_total + 1, sizeof(int));
+            cap = def_capacity;
+            def_block = (int *)ccb_gvn_grow(def_block, &cap, def_total + 1, sizeof(int));
+            def_capacity = cap;
+            def_var[def_total] = var;
+            def_block[def_total] = b;
+            def_total++;
+            def_start[var]++;
+        }
+    }
+    for (int v = 0, at = 0; v <= var_count; ++v)
+    {
+        int n = v < var_count ? def_start[v] : 0;
+        def_start[v] = at;
+        at += n;
+    }
+    int *defs = (int *)xmalloc((def_total ? def_total : 1) * sizeof(int));
+    int *fill = (int *)xcalloc((size_t)var_count, sizeof(int));
+    for (size_t d = 0; d < def_total; ++d)
+        defs[def_start[def_var[d]] + fill[def_var[d]]++] = def_block[d];
+    free(fill);
+    free(def_var);
+    free(def_block);
+    free(last_def);
+
+    int *has_phi = (int *)xmalloc((size_t)block_count * sizeof(int));
+    int *queued = (int *)xmalloc((size_t)block_count * sizeof(int));
+    int *work = (int *)xmalloc((size_t)block_count * sizeof(int));
+    for (int b = 0; b < block_count; ++b)
+        has_phi[b] = queued[b] = -1;
+    int *phi_block = NULL;
+    int *phi_var = NULL;
+    size_t phi_count = 0;
+    size_t phi_capacity = 0;
+    for (int v = 0; v < var_count; ++v)
+    {
+        int work_count = 0;
+        for (int d = def_start[v]; d < def_start[v + 1]; ++d)
+        {
+            queued[defs[d]] = v;
+            work[work_count++] = defs[d];
+        }
+        while (work_count > 0)
+        {
+            const CcbBlock *blk = &g->cfg.blocks[work[--work_count]];
+            for (int f = 0; f < blk->frontier_count; ++f)
+            {
+                int y = blk->frontier[f];
+                if (has_phi[y] == v)
+                    continue;
+                has_phi[y] = v;
+                size_t cap = phi_capacity;
+                phi_block = (int *)ccb_gvn_grow(phi_block, &cap, phi_count + 1, sizeof(int));
+                cap = phi_capacity;
+                phi_var = (int *)ccb_gvn_grow(phi_var, &cap, phi_count + 1, sizeof(int));
+                phi_capacity = cap;
+                phi_block[phi_count] = y;
+                phi_var[phi_count++] = v;
+                if (queued[y] != v)
+                {
+                    queued[y] = v;
+                    work[work_count++] = y;
+                }
+            }
+        }
+    }
+    free(work);
+    free(queued);
+    free(has_phi);
+    free(defs);
+    free(def_start);
+
+    g->phi_start = (int *)xcalloc((size_t)block_count + 1, sizeof(int));
+    g->phi_vars = (int *)xmalloc((phi_count ? phi_count : 1) * sizeof(int));
+    for (size_t p = 0; p < phi_count; ++p)
+        g->phi_start[phi_block[p] + 1]++;
+    for (int b = 0; b < block_count; ++b)
+        g->phi_start[b + 1] += g->phi_start[b];
+    int *at = (int *)xmalloc(((size_t)block_count + 1) * sizeof(int));
+    memcpy(at, g->phi_start, ((size_t)block_count + 1) * sizeof(int));
+    for (size_t p = 0; p < phi_count; ++p)
+        g->phi_vars[at[phi_block[p]]++] = phi_var[p];
+    free(at);
+    free(phi_block);
+    free(phi_var);
+}
+
+static int ccb_gvn_reuse_cmp(const void *a, const void *b)
+{
+    size_t sa = ((const CcbGvnReuse *)a)->start;
+    size_t sb = ((const CcbGvnReuse *)b)->start;
+    return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+static int ccb_gvn_save_cmp(const void *a, const void *b)
+{
+    size_t sa = ((const CcbGvnSave *)a)->after;
+    size_t sb = ((const CcbGvnSave *)b)->after;
+    return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+static void ccb_gvn_build_plan(CcbGvn *g, CcbGvnPlan *plan)
+{
+    int *vn_temp = (int *)xmalloc((size_t)(g->vn_count ? g->vn_count : 1) * sizeof(int));
+    for (int v = 0; v < g->vn_count; ++v)
+        vn_temp[v] = -1;
+    size_t reuse_count = 0;
+    size_t save_count = 0;
+    for (size_t r = 0; r < g->record_count; ++r)
+    {
+        const CcbGvnRecord *rec = &g->records[r];
+        if (rec->is_reuse)
+            reuse_count++;
+        else if (rec->uses > 0)
+        {
+            save_count++;
+            if (vn_temp[rec->vn] < 0)
+                vn_temp[rec->vn] = plan->temp_count++;
+        }
+    }
+    plan->reuses = (CcbGvnReuse *)xmalloc((reuse_count ? reuse_count : 1) * sizeof(CcbGvnReuse));
+    plan->saves = (CcbGvnSave *)xmalloc((save_count ? save_count : 1) * sizeof(CcbGvnSave));
+    plan->temp_types = (CCValueType *)xmalloc((size_t)(plan->temp_count ? plan->temp_count : 1) * sizeof(CCValueType));
+    for (int v = 0; v < g->vn_count; ++v)
+    {
+        if (vn_temp[v] >= 0)
+            plan->temp_types[vn_temp[v]] = g->vn_type[v];
+    }
+    for (size_t r = 0; r < g->record_count; ++r)
+    {
+        const CcbGvnRecord *rec = &g->records[r];
+        if (rec->is_reuse)
+        {
+            CcbGvnReuse *reuse = &plan->reuses[plan->reuse_count++];
+            reuse->start = rec->start;
+            reuse->end = rec->end;
+            reuse->temp = rec->leader >= 0 ? vn_temp[rec->vn] : -1;
+            reuse->load = rec->load;
+            reuse->slot = rec->slot;
+        }
+        else if (rec->uses > 0)
+        {
+            plan->saves[plan->save_count].after = rec->end;
+            plan->saves[plan->save_count++].temp = vn_temp[rec->vn];
+        }
+    }
+    qsort(plan->reuses, plan->reuse_count, sizeof(CcbGvnReuse), ccb_gvn_reuse_cmp);
+    qsort(plan->saves, plan->save_count, sizeof(CcbGvnSave), ccb_gvn_save_cmp);
+    free(vn_temp);
+}
+
+bool ccb_gvn_plan(const CcbInsn *insns, size_t count, CcbGvnPureCallFn is_pure_call, void *ctx,
+                  CcbGvnPlan *plan)
+{
+    memset(plan, 0, sizeof(*plan));
+    int max_param = -1;
+    int max_local = -1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        switch (insns[i].op)
+        {
+        case CCB_OP_OTHER:
+        case CCB_OP_PHI:
+        case CCB_OP_SELECT:
+        case CCB_OP_JUMP_INDIRECT:
+            return false;
+        case CCB_OP_LOAD_PARAM:
+        case CCB_OP_STORE_PARAM:
+        case CCB_OP_ADDR_PARAM:
+            if (insns[i].index > max_param)
+                max_param = insns[i].index;
+            break;
+        case CCB_OP_LOAD_LOCAL:
+        case CCB_OP_STORE_LOCAL:
+        case CCB_OP_ADDR_LOCAL:
+            if (insns[i].index > max_local)
+                max_local = insns[i].index;
+            break;
+        default:
+            break;
+        }
+    }
+
+    CcbGvn g;
+    memset(&g, 0, sizeof(g));
+    if (!ccb_cfg_build(&g.cfg, insns, count))
+        return false;
+    g.insns = insns;
+    g.count = count;
+    g.is_pure_call = is_pure_call;
+    g.ctx = ctx;
+    g.param_count = max_param + 1;
+    g.var_count = max_param + 1 + max_local + 1 + 1;
+    g.mem_var = g.var_count - 1;
+    g.addr_taken = (bool *)xcalloc((size_t)g.var_count, sizeof(bool));
+    g.cur = (int *)xmalloc((size_t)g.var_count * sizeof(int));
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (insns[i].op == CCB_OP_ADDR_LOCAL || insns[i].op == CCB_OP_ADDR_PARAM)
+            g.addr_taken[ccb_gvn_slot_var(&g, &insns[i])] = true;
+    }
+    for (int v = 0; v < g.var_count; ++v)
+        g.cur[v] = ccb_gvn_new_vn(&g, CC_TYPE_INVALID);
+    ccb_gvn_place_phis(&g);
+
+    /* Walk the dominator tree; each frame undoes its block's state. */
+    typedef struct
+    {
+        int block;
+        int next_child;
+        size_t undo_mark;
+    } Frame;
+    Frame *frames = (Frame *)xmalloc((size_t)g.cfg.block_count * sizeof(Frame));
+    int depth = 0;
+    frames[depth].block = 0;
+    frames[depth].next_child = 0;
+    frames[depth].undo_mark = g.undo_count;
+    ccb_gvn_block(&g, 0);
+    depth++;
+    while (depth > 0)
+    {
+        Frame *top = &frames[depth - 1];
+        const CcbBlock *blk = &g.cfg.blocks[top->block];
+        if (top->next_child < blk->child_count)
+        {
+            int child = blk->children[top->next_child++];
+            frames[depth].block = child;
+            frames[depth].next_child = 0;
+            frames[depth].undo_mark = g.undo_count;
+            ccb_gvn_block(&g, child);
+            depth++;
+            continue;
+        }
+        ccb_gvn_undo_to(&g, top->undo_mark);
+        depth--;
+    }
+    free(frames);
+
+    ccb_gvn_build_plan(&g, plan);
+
+    free(g.phi_start);
+    free(g.phi_vars);
+    free(g.undo);
+    free(g.records);
+    free(g.stack);
+    free(g.keys);
+    free(g.key_vns);
+    free(g.vn_type);
+    free(g.avail);
+    free(g.holder);
+    free(g.cur);
+    free(g.addr_taken);
+    ccb_cfg_free(&g.cfg);
+
+    if (plan->reuse_count == 0)
+    {
+        ccb_gvn_plan_free(plan);
+        return false;
+    }
+    return true;
+}
+
+void ccb_gvn_plan_free(CcbGvnPlan *plan)
+{
+    if (!plan)
+        return;
+    free(plan->reuses);
+    free(plan->saves);
+    free(plan->temp_types);
+    memset(plan, 0, sizeof(*plan));
+}
@@ -0,0 +1,56 @@
+#ifndef CHANCE_CCB_GVN_H
+#define CHANCE_CCB_GVN_H
+
+#include "ccb_ir.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Dominator-based global value numbering over a decoded ccb function body.
+
+   Local and parameter slots whose address is never taken are renamed into
+   SSA form (phis at the iterated dominance frontier of their stores); all
+   of memory is one more such variable, redefined by indirect and global
+   stores and by calls. A pure expression tree whose value number is
+   already available in a dominating block, or earlier in the same block,
+   is reported as a reuse: either of a slot that still holds the value or
+   of a temp that the planner asks to be saved at the leading occurrence.
+   The body itself is not changed. */
+
+typedef struct
+{
+    size_t start;     /* first instruction of the redundant expression */
+    size_t end;       /* its last instruction */
+    int temp;         /* >= 0: reload this temp */
+    CcbOpcode load;   /* otherwise CCB_OP_LOAD_LOCAL or CCB_OP_LOAD_PARAM */
+    int slot;
+} CcbGvnReuse;
+
+typedef struct
+{
+    size_t after;     /* store the value on top of the stack after this instruction */
+    int temp;
+} CcbGvnSave;
+
+typedef struct
+{
+    CcbGvnReuse *reuses;
+    size_t reuse_count;
+    CcbGvnSave *saves;
+    size_t save_count;
+    CCValueType *temp_types;
+    int temp_count;
+} CcbGvnPlan;
+
+/* Answers whether a direct call to `callee` neither reads nor writes
+   memory, so two calls with equal arguments return equal values. */
+typedef bool (*CcbGvnPureCallFn)(const char *callee, void *ctx);
+
+/* Fills `plan` (reuses and saves in instruction order). Returns false and
+   leaves the plan empty when the body has instructions the planner does
+   not model or no redundancy was found. */
+bool ccb_gvn_plan(const CcbInsn *insns, size_t count, CcbGvnPureCallFn is_pure_call, void *ctx,
+                  CcbGvnPlan *plan);
+void ccb_gvn_plan_free(CcbGvnPlan *plan);
+
+#endif
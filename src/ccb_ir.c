@@ -0,0 +1,522 @@
+#include "ccb_ir.h"
+#include "ast.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const char *name;
+    CcbOpcode op;
+} CcbIrMnemonic;
+
+static const CcbIrMnemonic ccb_ir_mnemonics[] = {
+    {"label", CCB_OP_LABEL},
+    {"jump", CCB_OP_JUMP},
+    {"jump_indirect", CCB_OP_JUMP_INDIRECT},
+    {"branch", CCB_OP_BRANCH},
+    {"const", CCB_OP_CONST},
+    {"const_str", CCB_OP_CONST_STR},
+    {"load_local", CCB_OP_LOAD_LOCAL},
+    {"store_local", CCB_OP_STORE_LOCAL},
+    {"addr_local", CCB_OP_ADDR_LOCAL},
+    {"load_param", CCB_OP_LOAD_PARAM},
+    {"store_param", CCB_OP_STORE_PARAM},
+    {"addr_param", CCB_OP_ADDR_PARAM},
+    {"load_global", CCB_OP_LOAD_GLOBAL},
+    {"store_global", CCB_OP_STORE_GLOBAL},
+    {"addr_global", CCB_OP_ADDR_GLOBAL},
+    {"load_indirect", CCB_OP_LOAD_INDIRECT},
+    {"store_indirect", CCB_OP_STORE_INDIRECT},
+    {"binop", CCB_OP_BINOP},
+    {"unop", CCB_OP_UNOP},
+    {"compare", CCB_OP_COMPARE},
+    {"convert", CCB_OP_CONVERT},
+    {"test_null", CCB_OP_TEST_NULL},
+    {"call", CCB_OP_CALL},
+    {"call_indirect", CCB_OP_CALL_INDIRECT},
+    {"ret", CCB_OP_RET},
+    {"drop", CCB_OP_DROP},
+    {"dup", CCB_OP_DUP},
+    {"stack_alloc", CCB_OP_STACK_ALLOC},
+    {"nop", CCB_OP_NOP},
+    {"phi", CCB_OP_PHI},
+    {"select", CCB_OP_SELECT},
+};
+
+static const char *const ccb_ir_binop_names[CCB_BINOP_COUNT] = {"add", "sub", "mul", "div", "mod",
+                                                                "and", "or",  "xor", "shl", "shr"};
+static const char *const ccb_ir_compare_names[CCB_CMP_COUNT] = {"eq", "ne", "lt", "le", "gt", "ge"};
+static const char *const ccb_ir_unop_names[CCB_UNOP_COUNT] = {"neg", "not", "bitnot"};
+
+static const struct
+{
+    const char *name;
+    CCConvertKind kind;
+} ccb_ir_convert_names[] = {
+    {"trunc", CC_CONVERT_TRUNC}, {"sext", CC_CONVERT_SEXT}, {"zext", CC_CONVERT_ZEXT},
+    {"f2i", CC_CONVERT_F2I},     {"i2f", CC_CONVERT_I2F},   {"bitcast", CC_CONVERT_BITCAST},
+};
+
+static const struct
+{
+    const char *name;
+    CCValueType type;
+} ccb_ir_type_names[] = {
+    {"i1", CC_TYPE_I1},   {"i8", CC_TYPE_I8},   {"u8", CC_TYPE_U8},   {"i16", CC_TYPE_I16},
+    {"u16", CC_TYPE_U16}, {"i32", CC_TYPE_I32}, {"u32", CC_TYPE_U32}, {"i64", CC_TYPE_I64},
+    {"u64", CC_TYPE_U64}, {"f32", CC_TYPE_F32}, {"f64", CC_TYPE_F64}, {"ptr", CC_TYPE_PTR},
+    {"void", CC_TYPE_VOID},
+};
+
+const char *ccb_ir_type_name(CCValueType ty)
+{
+    for (size_t i = 0; i < sizeof(ccb_ir_type_names) / sizeof(ccb_ir_type_names[0]); ++i)
+    {
+        if (ccb_ir_type_names[i].type == ty)
+            return ccb_ir_type_names[i].name;
+    }
+    return "?";
+}
+
+CCValueType ccb_ir_type_from_name(const char *name, size_t len)
+{
+    for (size_t i = 0; name && i < sizeof(ccb_ir_type_names) / sizeof(ccb_ir_type_names[0]); ++i)
+    {
+        if (strlen(ccb_ir_type_names[i].name) == len && memcmp(ccb_ir_type_names[i].name, name, len) == 0)
+            return ccb_ir_type_names[i].type;
+    }
+    return CC_TYPE_INVALID;
+}
+
+unsigned ccb_ir_type_bits(CCValueType ty)
+{
+    switch (ty)
+    {
+    case CC_TYPE_I1:
+        return 1;
+    case CC_TYPE_I8:
+    case CC_TYPE_U8:
+        return 8;
+    case CC_TYPE_I16:
+    case CC_TYPE_U16:
+        return 16;
+    case CC_TYPE_I32:
+    case CC_TYPE_U32:
+    case CC_TYPE_F32:
+        return 32;
+    case CC_TYPE_I64:
+    case CC_TYPE_U64:
+    case CC_TYPE_F64:
+    case CC_TYPE_PTR:
+        return 64;
+    default:
+        return 0;
+    }
+}
+
+bool ccb_ir_type_is_signed(CCValueType ty)
+{
+    return ty == CC_TYPE_I1 || ty == CC_TYPE_I8 || ty == CC_TYPE_I16 || ty == CC_TYPE_I32 || ty == CC_TYPE_I64;
+}
+
+bool ccb_ir_type_is_integer(CCValueType ty)
+{
+    return ccb_ir_type_is_signed(ty) || ty == CC_TYPE_U8 || ty == CC_TYPE_U16 || ty == CC_TYPE_U32 ||
+           ty == CC_TYPE_U64;
+}
+
+const char *ccb_ir_binop_name(CcbBinop op)
+{
+    return (unsigned)op < CCB_BINOP_COUNT ? ccb_ir_binop_names[op] : "?";
+}
+
+const char *ccb_ir_compare_name(CcbCompare op)
+{
+    return (unsigned)op < CCB_CMP_COUNT ? ccb_ir_compare_names[op] : "?";
+}
+
+const char *ccb_ir_unop_name(CcbUnop op)
+{
+    return (unsigned)op < CCB_UNOP_COUNT ? ccb_ir_unop_names[op] : "?";
+}
+
+const char *ccb_ir_convert_name(CCConvertKind kind)
+{
+    for (size_t i = 0; i < sizeof(ccb_ir_convert_names) / sizeof(ccb_ir_convert_names[0]); ++i)
+    {
+        if (ccb_ir_convert_names[i].kind == kind)
+            return ccb_ir_convert_names[i].name;
+    }
+    return "?";
+}
+
+static uint64_t ccb_ir_mask(unsigned bits)
+{
+    return bits >= 64 ? UINT64_MAX : ((UINT64_C(1) << bits) - 1);
+}
+
+int64_t ccb_insn_imm_signed(const CcbInsn *insn)
+{
+    unsigned bits = ccb_ir_type_bits(insn->type);
+    if (!ccb_ir_type_is_signed(insn->type) || bits == 0 || bits >= 64)
+        return (int64_t)insn->imm;
+    uint64_t sign = UINT64_C(1) << (bits - 1);
+    return (int64_t)((insn->imm ^ sign) - sign);
+}
+
+typedef struct
+{
+    const char *start;
+    size_t len;
+} CcbIrToken;
+
+static const char *ccb_ir_skip_ws(const char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        ++s;
+    return s;
+}
+
+static const char *ccb_ir_next_token(const char *s, CcbIrToken *tok)
+{
+    s = ccb_ir_skip_ws(s);
+    tok->start = s;
+    while (*s && !isspace((unsigned char)*s))
+        ++s;
+    tok->len = (size_t)(s - tok->start);
+    return s;
+}
+
+static bool ccb_ir_token_is(const CcbIrToken *tok, const char *text)
+{
+    return tok->len == strlen(text) && memcmp(tok->start, text, tok->len) == 0;
+}
+
+static const char *ccb_ir_intern_token(const CcbIrToken *tok)
+{
+    if (tok->len == 0)
+        return NULL;
+    char stack_buf[256];
+    char *buf = tok->len < sizeof(stack_buf) ? stack_buf : (char *)xmalloc(tok->len + 1);
+    memcpy(buf, tok->start, tok->len);
+    buf[tok->len] = '\0';
+    const char *interned = xintern(buf);
+    if (buf != stack_buf)
+        free(buf);
+    return interned;
+}
+
+static bool ccb_ir_parse_int(const CcbIrToken *tok, int *out)
+{
+    char buf[32];
+    if (tok->len == 0 || tok->len >= sizeof(buf))
+        return false;
+    memcpy(buf, tok->start, tok->len);
+    buf[tok->len] = '\0';
+    char *end = NULL;
+    long value = strtol(buf, &end, 10);
+    if (end == buf || *end != '\0')
+        return false;
+    *out = (int)value;
+    return true;
+}
+
+static void ccb_ir_decode_const(const char *rest, CcbInsn *out)
+{
+    CcbIrToken ty_tok, val_tok;
+    rest = ccb_ir_next_token(rest, &ty_tok);
+    ccb_ir_next_token(rest, &val_tok);
+    out->type = ccb_ir_type_from_name(ty_tok.start, ty_tok.len);
+    char value[128];
+    if (out->type == CC_TYPE_INVALID || val_tok.len == 0 || val_tok.len >= sizeof(value))
+        return;
+    memcpy(value, val_tok.start, val_tok.len);
+    value[val_tok.len] = '\0';
+
+    char *end = NULL;
+    errno = 0;
+    if (out->type == CC_TYPE_F32 || out->type == CC_TYPE_F64)
+    {
+        out->fimm = strtod(value, &end);
+        return;
+    }
+    if (out->type == CC_TYPE_PTR && strcmp(value, "null") == 0)
+    {
+        out->imm = 0;
+        out->has_imm = 1;
+        return;
+    }
+    uint64_t bits;
+    if (ccb_ir_type_is_signed(out->type))
+        bits = (uint64_t)strtoll(value, &end, 0);
+    else
+        bits = (uint64_t)strtoull(value, &end, 0);
+    if (end == value || *end != '\0' || errno == ERANGE)
+        return;
+    out->imm = bits & ccb_ir_mask(ccb_ir_type_bits(out->type));
+    out->has_imm = 1;
+}
+
+static void ccb_ir_decode_call(const char *rest, CcbInsn *out, bool indirect)
+{
+    CcbIrToken tok;
+    if (!indirect)
+    {
+        rest = ccb_ir_next_token(rest, &tok);
+        out->symbol = ccb_ir_intern_token(&tok);
+    }
+    rest = ccb_ir_next_token(rest, &tok);
+    out->type = ccb_ir_type_from_name(tok.start, tok.len);
+    rest = ccb_ir_next_token(rest, &tok);
+    if (tok.len >= 2 && tok.start[0] == '(')
+    {
+        out->args = ccb_ir_intern_token(&tok);
+        out->arg_count = 0;
+        if (tok.len > 2)
+        {
+            out->arg_count = 1;
+            for (size_t i = 1; i + 1 < tok.len; ++i)
+                out->arg_count += tok.start[i] == ',';
+        }
+        ccb_ir_next_token(rest, &tok);
+    }
+    out->is_varargs = ccb_ir_token_is(&tok, "varargs");
+}
+
+void ccb_insn_decode(const char *line, CcbInsn *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!line)
+        return;
+    CcbIrToken mn;
+    const char *rest = ccb_ir_next_token(line, &mn);
+    if (mn.len == 0)
+        return;
+    if (mn.start[0] == '.')
+    {
+        out->op = CCB_OP_DIRECTIVE;
+        return;
+    }
+    out->op = CCB_OP_OTHER;
+    for (size_t i = 0; i < sizeof(ccb_ir_mnemonics) / sizeof(ccb_ir_mnemonics[0]); ++i)
+    {
+        if (ccb_ir_token_is(&mn, ccb_ir_mnemonics[i].name))
+        {
+            out->op = ccb_ir_mnemonics[i].op;
+            break;
+        }
+    }
+
+    CcbIrToken a, b, c;
+    switch (out->op)
+    {
+    case CCB_OP_LABEL:
+    case CCB_OP_JUMP:
+    case CCB_OP_LOAD_GLOBAL:
+    case CCB_OP_STORE_GLOBAL:
+    case CCB_OP_ADDR_GLOBAL:
+        ccb_ir_next_token(rest, &a);
+        out->symbol = ccb_ir_intern_token(&a);
+        if (!out->symbol)
+            out->op = CCB_OP_OTHER;
+        break;
+    case CCB_OP_BRANCH:
+        rest = ccb_ir_next_token(rest, &a);
+        ccb_ir_next_token(rest, &b);
+        out->symbol = ccb_ir_intern_token(&a);
+        out->symbol2 = ccb_ir_intern_token(&b);
+        if (!out->symbol || !out->symbol2)
+            out->op = CCB_OP_OTHER;
+        break;
+    case CCB_OP_CONST:
+        ccb_ir_decode_const(rest, out);
+        break;
+    case CCB_OP_LOAD_LOCAL:
+    case CCB_OP_STORE_LOCAL:
+    case CCB_OP_ADDR_LOCAL:
+    case CCB_OP_LOAD_PARAM:
+    case CCB_OP_STORE_PARAM:
+    case CCB_OP_ADDR_PARAM:
+        ccb_ir_next_token(rest, &a);
+        if (!ccb_ir_parse_int(&a, &out->index))
+            out->op = CCB_OP_OTHER;
+        break;
+    case CCB_OP_LOAD_INDIRECT:
+    case CCB_OP_STORE_INDIRECT:
+    case CCB_OP_DROP:
+    case CCB_OP_DUP:
+    case CCB_OP_RET:
+    case CCB_OP_TEST_NULL:
+        ccb_ir_next_token(rest, &a);
+        out->type = ccb_ir_type_from_name(a.start, a.len);
+        break;
+    case CCB_OP_BINOP:
+    case CCB_OP_COMPARE:
+    case CCB_OP_UNOP:
+    {
+        rest = ccb_ir_next_token(rest, &a);
+        rest = ccb_ir_next_token(rest, &b);
+        ccb_ir_next_token(rest, &c);
+        const char *const *names = out->op == CCB_OP_BINOP    ? ccb_ir_binop_names
+                                   : out->op == CCB_OP_COMPARE ? ccb_ir_compare_names
+                                                               : ccb_ir_unop_names;
+        int count = out->op == CCB_OP_BINOP ? CCB_BINOP_COUNT : out->op == CCB_OP_COMPARE ? CCB_CMP_COUNT : CCB_UNOP_COUNT;
+        int found = -1;
+        for (int i = 0; i < count; ++i)
+        {
+            if (ccb_ir_token_is(&a, names[i]))
+                found = i;
+        }
+        out->type = ccb_ir_type_from_name(b.start, b.len);
+        if (found < 0 || out->type == CC_TYPE_INVALID)
+        {
+            out->op = CCB_OP_OTHER;
+            break;
+        }
+        out->sub = (uint8_t)found;
+        out->is_unsigned = out->op != CCB_OP_UNOP && ccb_ir_token_is(&c, "unsigned");
+        break;
+    }
+    case CCB_OP_CONVERT:
+    {
+        rest = ccb_ir_next_token(rest, &a);
+        rest = ccb_ir_next_token(rest, &b);
+        ccb_ir_next_token(rest, &c);
+        int found = -1;
+        for (size_t i = 0; i < sizeof(ccb_ir_convert_names) / sizeof(ccb_ir_convert_names[0]); ++i)
+        {
+            if (ccb_ir_token_is(&a, ccb_ir_convert_names[i].name))
+                found = (int)ccb_ir_convert_names[i].kind;
+        }
+        out->type = ccb_ir_type_from_name(b.start, b.len);
+        out->to_type = ccb_ir_type_from_name(c.start, c.len);
+        if (found < 0 || out->type == CC_TYPE_INVALID || out->to_type == CC_TYPE_INVALID)
+            out->op = CCB_OP_OTHER;
+        else
+            out->sub = (uint8_t)found;
+        break;
+    }
+    case CCB_OP_CALL:
+        ccb_ir_decode_call(rest, out, false);
+        if (!out->symbol)
+            out->op = CCB_OP_OTHER;
+        break;
+    case CCB_OP_CALL_INDIRECT:
+        ccb_ir_decode_call(rest, out, true);
+        break;
+    case CCB_OP_STACK_ALLOC:
+        rest = ccb_ir_next_token(rest, &a);
+        ccb_ir_next_token(rest, &b);
+        if (!ccb_ir_parse_int(&a, &out->index) || !ccb_ir_parse_int(&b, &out->align))
+            out->op = CCB_OP_OTHER;
+        break;
+    default:
+        break;
+    }
+}
+
+bool ccb_insn_format(const CcbInsn *insn, char *buf, size_t bufsz)
+{
+    if (!insn || !buf || bufsz == 0)
+        return false;
+    const char *ty = ccb_ir_type_name(insn->type);
+    int n = -1;
+    switch (insn->op)
+    {
+    case CCB_OP_LABEL:
+        n = snprintf(buf, bufsz, "label %s", insn->symbol);
+        break;
+    case CCB_OP_JUMP:
+        n = snprintf(buf, bufsz, "  jump %s", insn->symbol);
+        break;
+    case CCB_OP_BRANCH:
+        n = snprintf(buf, bufsz, "  branch %s %s", insn->symbol, insn->symbol2);
+        break;
+    case CCB_OP_CONST:
+        if (insn->type == CC_TYPE_F32 || insn->type == CC_TYPE_F64)
+            n = snprintf(buf, bufsz, "  const %s %.17g", ty, insn->fimm);
+        else if (insn->type == CC_TYPE_PTR && insn->imm == 0)
+            n = snprintf(buf, bufsz, "  const ptr null");
+        else if (ccb_ir_type_is_signed(insn->type))
+            n = snprintf(buf, bufsz, "  const %s %" PRId64, ty, ccb_insn_imm_signed(insn));
+        else
+            n = snprintf(buf, bufsz, "  const %s %" PRIu64, ty, insn->imm);
+        break;
+    case CCB_OP_LOAD_LOCAL:
+    case CCB_OP_STORE_LOCAL:
+    case CCB_OP_ADDR_LOCAL:
+    case CCB_OP_LOAD_PARAM:
+    case CCB_OP_STORE_PARAM:
+    case CCB_OP_ADDR_PARAM:
+        for (size_t i = 0; i < sizeof(ccb_ir_mnemonics) / sizeof(ccb_ir_mnemonics[0]); ++i)
+        {
+            if (ccb_ir_mnemonics[i].op == insn->op)
+                n = snprintf(buf, bufsz, "  %s %d", ccb_ir_mnemonics[i].name, insn->index);
+        }
+        break;
+    case CCB_OP_LOAD_GLOBAL:
+        n = snprintf(buf, bufsz, "  load_global %s", insn->symbol);
+        break;
+    case CCB_OP_STORE_GLOBAL:
+        n = snprintf(buf, bufsz, "  store_global %s", insn->symbol);
+        break;
+    case CCB_OP_ADDR_GLOBAL:
+        n = snprintf(buf, bufsz, "  addr_global %s", insn->symbol);
+        break;
+    case CCB_OP_LOAD_INDIRECT:
+        n = snprintf(buf, bufsz, "  load_indirect %s", ty);
+        break;
+    case CCB_OP_STORE_INDIRECT:
+        n = snprintf(buf, bufsz, "  store_indirect %s", ty);
+        break;
+    case CCB_OP_DROP:
+        n = snprintf(buf, bufsz, "  drop %s", ty);
+        break;
+    case CCB_OP_DUP:
+        n = snprintf(buf, bufsz, "  dup %s", ty);
+        break;
+    case CCB_OP_BINOP:
+        n = snprintf(buf, bufsz, "  binop %s %s%s", ccb_ir_binop_name((CcbBinop)insn->sub), ty,
+                     insn->is_unsigned ? " unsigned" : "");
+        break;
+    case CCB_OP_COMPARE:
+        n = snprintf(buf, bufsz, "  compare %s %s%s", ccb_ir_compare_name((CcbCompare)insn->sub), ty,
+                     insn->is_unsigned ? " unsigned" : "");
+        break;
+    case CCB_OP_UNOP:
+        n = snprintf(buf, bufsz, "  unop %s %s", ccb_ir_unop_name((CcbUnop)insn->sub), ty);
+        break;
+    case CCB_OP_CONVERT:
+        n = snprintf(buf, bufsz, "  convert %s %s %s", ccb_ir_convert_name((CCConvertKind)insn->sub), ty,
+                     ccb_ir_type_name(insn->to_type));
+        break;
+    case CCB_OP_TEST_NULL:
+        n = snprintf(buf, bufsz, "  test_null");
+        break;
+    case CCB_OP_CALL:
+        n = snprintf(buf, bufsz, "  call %s %s %s%s", insn->symbol, ty, insn->args ? insn->args : "()",
+                     insn->is_varargs ? " varargs" : "");
+        break;
+    case CCB_OP_CALL_INDIRECT:
+        n = snprintf(buf, bufsz, "  call_indirect %s %s%s", ty, insn->args ? insn->args : "()",
+                     insn->is_varargs ? " varargs" : "");
+        break;
+    case CCB_OP_RET:
+        n = insn->type == CC_TYPE_INVALID ? snprintf(buf, bufsz, "  ret") : snprintf(buf, bufsz, "  ret %s", ty);
+        break;
+    case CCB_OP_STACK_ALLOC:
+        n = snprintf(buf, bufsz, "  stack_alloc %d %d", insn->index, insn->align);
+        break;
+    case CCB_OP_NOP:
+        n = snprintf(buf, bufsz, "  nop");
+        break;
+    default:
+        return false;
+    }
+    return n >= 0 && (size_t)n < bufsz;
+}
@@ -0,0 +1,132 @@
+#ifndef CHANCE_CCB_IR_H
+#define CHANCE_CCB_IR_H
+
+#include "cc/bytecode.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Typed form of one ccb function-body line.
+
+   Codegen keeps emitting text, but function bodies decode every line once
+   as it is stored, so optimizer passes match on opcodes and operands
+   instead of re-parsing strings. ccb_insn_format renders an instruction
+   the way codegen spells it, so a pass can build an instruction and store
+   its text. Debug locations stay in the owning list's debug arrays. */
+
+typedef enum
+{
+    CCB_OP_NONE = 0,  /* blank line */
+    CCB_OP_DIRECTIVE, /* `.`-prefixed line */
+    CCB_OP_OTHER,     /* instruction the decoder does not model */
+    CCB_OP_LABEL,
+    CCB_OP_JUMP,
+    CCB_OP_JUMP_INDIRECT,
+    CCB_OP_BRANCH,
+    CCB_OP_CONST,
+    CCB_OP_CONST_STR,
+    CCB_OP_LOAD_LOCAL,
+    CCB_OP_STORE_LOCAL,
+    CCB_OP_ADDR_LOCAL,
+    CCB_OP_LOAD_PARAM,
+    CCB_OP_STORE_PARAM,
+    CCB_OP_ADDR_PARAM,
+    CCB_OP_LOAD_GLOBAL,
+    CCB_OP_STORE_GLOBAL,
+    CCB_OP_ADDR_GLOBAL,
+    CCB_OP_LOAD_INDIRECT,
+    CCB_OP_STORE_INDIRECT,
+    CCB_OP_BINOP,
+    CCB_OP_UNOP,
+    CCB_OP_COMPARE,
+    CCB_OP_CONVERT,
+    CCB_OP_TEST_NULL,
+    CCB_OP_CALL,
+    CCB_OP_CALL_INDIRECT,
+    CCB_OP_RET,
+    CCB_OP_DROP,
+    CCB_OP_DUP,
+    CCB_OP_STACK_ALLOC,
+    CCB_OP_NOP,
+    CCB_OP_PHI,
+    CCB_OP_SELECT,
+    CCB_OP_COUNT
+} CcbOpcode;
+
+typedef enum
+{
+    CCB_BINOP_ADD,
+    CCB_BINOP_SUB,
+    CCB_BINOP_MUL,
+    CCB_BINOP_DIV,
+    CCB_BINOP_MOD,
+    CCB_BINOP_AND,
+    CCB_BINOP_OR,
+    CCB_BINOP_XOR,
+    CCB_BINOP_SHL,
+    CCB_BINOP_SHR,
+    CCB_BINOP_COUNT
+} CcbBinop;
+
+typedef enum
+{
+    CCB_CMP_EQ,
+    CCB_CMP_NE,
+    CCB_CMP_LT,
+    CCB_CMP_LE,
+    CCB_CMP_GT,
+    CCB_CMP_GE,
+    CCB_CMP_COUNT
+} CcbCompare;
+
+typedef enum
+{
+    CCB_UNOP_NEG,
+    CCB_UNOP_NOT,
+    CCB_UNOP_BITNOT,
+    CCB_UNOP_COUNT
+} CcbUnop;
+
+typedef struct
+{
+    CcbOpcode op;
+    uint8_t sub;         /* CcbBinop, CcbCompare, CcbUnop or CCConvertKind */
+    uint8_t is_unsigned; /* binop/compare `unsigned` hint */
+    uint8_t has_imm;     /* const with an integer or null pointer value */
+    uint8_t is_varargs;  /* call ... varargs */
+    CCValueType type;    /* operand or result type; convert source */
+    CCValueType to_type; /* convert target */
+    int index;           /* local/param index, stack_alloc size */
+    int align;           /* stack_alloc alignment */
+    int arg_count;       /* call/call_indirect */
+    uint64_t imm;        /* const bits, masked to the type width */
+    double fimm;         /* f32/f64 const */
+    const char *symbol;  /* interned label, jump or branch-true target, global, callee */
+    const char *symbol2; /* interned branch-false target */
+    const char *args;    /* interned call parameter list "(i32,ptr)" */
+} CcbInsn;
+
+/* Decodes a line; anything unrecognised becomes CCB_OP_OTHER and keeps
+   its meaning only in the text. */
+void ccb_insn_decode(const char *line, CcbInsn *out);
+
+/* Renders the canonical text. Returns false when the instruction cannot
+   be expressed (CCB_OP_OTHER/DIRECTIVE/CONST_STR carry no operands). */
+bool ccb_insn_format(const CcbInsn *insn, char *buf, size_t bufsz);
+
+const char *ccb_ir_type_name(CCValueType ty);
+CCValueType ccb_ir_type_from_name(const char *name, size_t len);
+unsigned ccb_ir_type_bits(CCValueType ty);
+bool ccb_ir_type_is_signed(CCValueType ty);
+bool ccb_ir_type_is_integer(CCValueType ty);
+
+const char *ccb_ir_binop_name(CcbBinop op);
+const char *ccb_ir_compare_name(CcbCompare op);
+const char *ccb_ir_unop_name(CcbUnop op);
+const char *ccb_ir_convert_name(CCConvertKind kind);
+
+/* Sign-extended value of an integer const. */
+int64_t ccb_insn_imm_signed(const CcbInsn *insn);
+
+#endif
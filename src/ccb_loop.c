@@ -0,0 +1,1063 @@
+#include "ccb_loop.h"
+#include "ccb_cfg.h"
+#include "ast.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CCB_LOOP_MAX_TEMPS 16
+#define CCB_LOOP_MAX_SCALE (INT64_C(1) << 32)
+#define CCB_LOOP_UNROLL_MAX_INSNS 4096
+
+typedef struct
+{
+    size_t start;
+    size_t end;
+    bool pure;       /* start..end is a contiguous run computing exactly this value */
+    bool invariant;
+    bool heavy;      /* reads memory */
+    int iv;          /* >= 0: ivs[iv] * scale, plus base when has_base */
+    bool widened;    /* 64 bits wide */
+    int64_t scale;
+    bool has_base;
+    size_t base_start;
+    size_t base_end;
+} CcbLoopValue;
+
+typedef struct
+{
+    int var;
+    size_t store;       /* its only store in the loop */
+    int64_t step;
+    bool wide;          /* 64-bit counter */
+    bool bounded;       /* 32-bit counter the header keeps from wrapping */
+    bool bounded_unsigned;
+} CcbLoopIv;
+
+typedef struct
+{
+    size_t start;
+    size_t end;
+    bool reduce;
+    int iv;
+    int64_t scale;
+} CcbLoopCand;
+
+typedef struct
+{
+    const CcbInsn *insns;
+    CcbCfg cfg;
+    int header;
+    bool *in_loop;    /* per block */
+    size_t guard_at;  /* the header's exit compare, or SIZE_MAX */
+    int param_count;
+    int var_count;
+    bool *addr_taken;
+    int *stores;      /* per var, stores inside the loop */
+    size_t *store_at;
+    int *iv_of;       /* per var, index into ivs or -1 */
+    CcbLoopIv *ivs;
+    int iv_count;
+    bool writes_memory;
+    CcbLoop *loops;
+    int loop_count;
+
+    int guard_iv;        /* counter the header's exit test compares, or -1 */
+    bool guard_up;       /* the loop continues while counter < bound, else counter > bound */
+    bool guard_unsigned;
+    size_t counter_at;   /* the header's load of that counter */
+    size_t bound_start;  /* the bound's span in the header */
+    size_t bound_end;
+
+    CcbLoopValue *stack;
+    size_t stack_count;
+    size_t stack_capacity;
+    CcbLoopCand *cands;
+    size_t cand_count;
+    size_t cand_capacity;
+} CcbLoopCtx;
+
+static void *ccb_loop_grow(void *items, size_t *capacity, size_t needed, size_t item_size)
+{
+    if (needed <= *capacity)
+        return items;
+    size_t cap = *capacity ? *capacity * 2 : 32;
+    while (cap < needed)
+        cap *= 2;
+    void *grown = realloc(items, cap * item_size);
+    if (!grown)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    *capacity = cap;
+    return grown;
+}
+
+static int ccb_loop_slot_var(const CcbLoopCtx *c, const CcbInsn *insn)
+{
+    bool is_param = insn->op == CCB_OP_LOAD_PARAM || insn->op == CCB_OP_STORE_PARAM || insn->op == CCB_OP_ADDR_PARAM;
+    return is_param ? insn->index : c->param_count + insn->index;
+}
+
+static CcbLoopValue ccb_loop_leaf(size_t i, bool invariant)
+{
+    CcbLoopValue v;
+    memset(&v, 0, sizeof(v));
+    v.start = i;
+    v.end = i;
+    v.pure = true;
+    v.invariant = invariant;
+    v.iv = -1;
+    return v;
+}
+
+static CcbLoopValue ccb_loop_opaque(size_t i)
+{
+    CcbLoopValue v = ccb_loop_leaf(i, false);
+    v.pure = false;
+    return v;
+}
+
+static void ccb_loop_push(CcbLoopCtx *c, CcbLoopValue v)
+{
+    c->stack = (CcbLoopValue *)ccb_loop_grow(c->stack, &c->stack_capacity, c->stack_count + 1, sizeof(CcbLoopValue));
+    c->stack[c->stack_count++] = v;
+}
+
+static CcbLoopValue ccb_loop_pop(CcbLoopCtx *c)
+{
+    if (c->stack_count == 0)
+        return ccb_loop_opaque(SIZE_MAX);
+    return c->stack[--c->stack_count];
+}
+
+/* `v` feeds an instruction that does not extend it, so it is as large as
+   it will get. */
+static void ccb_loop_consume(CcbLoopCtx *c, const CcbLoopValue *v)
+{
+    if (!v->pure)
+        return;
+    bool hoist = v->invariant && (v->heavy || v->end - v->start >= 2);
+    bool reduce = !v->invariant && v->iv >= 0 && v->widened && v->has_base && v->scale != 0;
+    if (!hoist && !reduce)
+        return;
+    c->cands = (CcbLoopCand *)ccb_loop_grow(c->cands, &c->cand_capacity, c->cand_count + 1, sizeof(CcbLoopCand));
+    CcbLoopCand *cand = &c->cands[c->cand_count++];
+    cand->start = v->start;
+    cand->end = v->end;
+    cand->reduce = reduce;
+    cand->iv = v->iv;
+    cand->scale = v->scale;
+}
+
+static bool ccb_loop_contiguous(const CcbLoopValue *ops, int n, size_t i)
+{
+    size_t next = i;
+    for (int k = n - 1; k >= 0; --k)
+    {
+        if (!ops[k].pure || ops[k].end + 1 != next)
+            return false;
+        next = ops[k].start;
+    }
+    return true;
+}
+
+static void ccb_loop_unary(CcbLoopCtx *c, size_t i, const CcbLoopValue *op, bool invariant, bool heavy)
+{
+    if (invariant && ccb_loop_contiguous(op, 1, i))
+    {
+        CcbLoopValue v = *op;
+        v.end = i;
+        v.heavy = v.heavy || heavy;
+        ccb_loop_push(c, v);
+        return;
+    }
+    ccb_loop_consume(c, op);
+    ccb_loop_push(c, ccb_loop_opaque(i));
+}
+
+static const CcbInsn *ccb_loop_int_const(const CcbLoopCtx *c, const CcbLoopValue *v)
+{
+    if (!v->pure || v->start != v->end || v->start == SIZE_MAX)
+        return NULL;
+    const CcbInsn *insn = &c->insns[v->start];
+    return insn->op == CCB_OP_CONST && insn->has_imm ? insn : NULL;
+}
+
+static bool ccb_loop_may_trap(const CcbLoopCtx *c, const CcbInsn *insn, const CcbLoopValue *divisor)
+{
+    if (insn->op != CCB_OP_BINOP || (insn->sub != CCB_BINOP_DIV && insn->sub != CCB_BINOP_MOD) ||
+        !ccb_ir_type_is_integer(insn->type))
+        return false;
+    const CcbInsn *k = ccb_loop_int_const(c, divisor);
+    if (!k || k->imm == 0)
+        return true;
+    return ccb_ir_type_is_signed(insn->type) && !insn->is_unsigned && ccb_insn_imm_signed(k) == -1;
+}
+
+/* Extends an induction-variable value by an invariant operand: base + x,
+   x << k or x * k. */
+static bool ccb_loop_affine(const CcbLoopCtx *c, const CcbInsn *insn, const CcbLoopValue *ops, CcbLoopValue *out)
+{
+    int a = ops[0].iv >= 0 ? 0 : (ops[1].iv >= 0 ? 1 : -1);
+    if (a < 0 || !ops[a].widened || ops[a].has_base || !ops[1 - a].invariant)
+        return false;
+    const CcbLoopValue *other = &ops[1 - a];
+    const CcbInsn *k = ccb_loop_int_const(c, other);
+    *out = ops[a];
+    switch (insn->sub)
+    {
+    case CCB_BINOP_ADD:
+        out->has_base = true;
+        out->base_start = other->start;
+        out->base_end = other->end;
+        break;
+    case CCB_BINOP_SHL:
+        if (a != 0 || !k || k->imm >= 32)
+            return false;
+        out->scale *= (int64_t)1 << k->imm;
+        break;
+    case CCB_BINOP_MUL:
+    {
+        if (!k)
+            return false;
+        int64_t m = ccb_insn_imm_signed(k);
+        if (m > CCB_LOOP_MAX_SCALE || m < -CCB_LOOP_MAX_SCALE)
+            return false;
+        out->scale *= m;
+        break;
+    }
+    default:
+        return false;
+    }
+    return out->scale <= CCB_LOOP_MAX_SCALE && out->scale >= -CCB_LOOP_MAX_SCALE;
+}
+
+/* The header's exit test `i < bound` (or `i > bound`) keeps a counter
+   stepping by 1 (or -1) from wrapping in the iterations that step it. */
+static void ccb_loop_note_guard(CcbLoopCtx *c, const CcbInsn *insn, const CcbLoopValue *ops)
+{
+    int a = ops[0].iv >= 0 ? 0 : (ops[1].iv >= 0 ? 1 : -1);
+    if (a < 0 || ops[a].widened || ops[a].has_base || ops[a].start != ops[a].end || !ops[1 - a].invariant)
+        return;
+    CcbLoopIv *iv = &c->ivs[ops[a].iv];
+    if (!ccb_ir_type_is_integer(insn->type))
+        return;
+    bool up = (a == 0 && insn->sub == CCB_CMP_LT) || (a == 1 && insn->sub == CCB_CMP_GT);
+    bool down = (a == 0 && insn->sub == CCB_CMP_GT) || (a == 1 && insn->sub == CCB_CMP_LT);
+    if (!up && !down)
+        return;
+    bool is_unsigned = insn->is_unsigned || !ccb_ir_type_is_signed(insn->type);
+    if (ccb_ir_type_bits(insn->type) == 32 && ((up && iv->step == 1) || (down && iv->step == -1)))
+    {
+        iv->bounded = true;
+        iv->bounded_unsigned = is_unsigned;
+    }
+    if (!ops[1 - a].pure)
+        return;
+    c->guard_iv = ops[a].iv;
+    c->guard_up = up;
+    c->guard_unsigned = is_unsigned;
+    c->counter_at = ops[a].start;
+    c->bound_start = ops[1 - a].start;
+    c->bound_end = ops[1 - a].end;
+}
+
+static void ccb_loop_binary(CcbLoopCtx *c, size_t i, const CcbInsn *insn, CcbLoopValue *ops, bool in_header)
+{
+    if (i == c->guard_at)
+        ccb_loop_note_guard(c, insn, ops);
+    bool contiguous = ccb_loop_contiguous(ops, 2, i);
+    if (contiguous && ops[0].invariant && ops[1].invariant &&
+        (!ccb_loop_may_trap(c, insn, &ops[1]) || (in_header && !c->writes_memory)))
+    {
+        CcbLoopValue v = ops[0];
+        v.end = i;
+        v.heavy = ops[0].heavy || ops[1].heavy;
+        ccb_loop_push(c, v);
+        return;
+    }
+    CcbLoopValue v;
+    if (contiguous && insn->op == CCB_OP_BINOP && ccb_ir_type_is_integer(insn->type) &&
+        ccb_ir_type_bits(insn->type) == 64 && ccb_loop_affine(c, insn, ops, &v))
+    {
+        v.start = ops[0].start;
+        v.end = i;
+        ccb_loop_push(c, v);
+        return;
+    }
+    ccb_loop_consume(c, &ops[0]);
+    ccb_loop_consume(c, &ops[1]);
+    ccb_loop_push(c, ccb_loop_opaque(i));
+}
+
+static void ccb_loop_convert(CcbLoopCtx *c, size_t i, const CcbInsn *insn, const CcbLoopValue *op)
+{
+    if (op->iv >= 0 && !op->widened && ccb_loop_contiguous(op, 1, i) && ccb_ir_type_bits(insn->type) == 32 &&
+        ccb_ir_type_bits(insn->to_type) == 64 && ccb_ir_type_is_integer(insn->to_type) &&
+        (insn->sub == CC_CONVERT_SEXT || insn->sub == CC_CONVERT_ZEXT))
+    {
+        const CcbLoopIv *iv = &c->ivs[op->iv];
+        if (iv->bounded && iv->bounded_unsigned == (insn->sub == CC_CONVERT_ZEXT))
+        {
+            CcbLoopValue v = *op;
+            v.end = i;
+            v.widened = true;
+            ccb_loop_push(c, v);
+            return;
+        }
+    }
+    ccb_loop_unary(c, i, op, op->invariant, false);
+}
+
+static void ccb_loop_scan_block(CcbLoopCtx *c, int block)
+{
+    const CcbBlock *blk = &c->cfg.blocks[block];
+    bool in_header = block == c->header;
+    bool reads_ok = in_header && !c->writes_memory;
+    c->stack_count = 0;
+    for (size_t i = blk->start; i < blk->end; ++i)
+    {
+        const CcbInsn *insn = &c->insns[i];
+        CcbLoopValue ops[2];
+        switch (insn->op)
+        {
+        case CCB_OP_CONST:
+        case CCB_OP_CONST_STR:
+        case CCB_OP_ADDR_LOCAL:
+        case CCB_OP_ADDR_PARAM:
+        case CCB_OP_ADDR_GLOBAL:
+            ccb_loop_push(c, ccb_loop_leaf(i, true));
+            break;
+        case CCB_OP_LOAD_LOCAL:
+        case CCB_OP_LOAD_PARAM:
+        {
+            int var = ccb_loop_slot_var(c, insn);
+            CcbLoopValue v = ccb_loop_leaf(i, false);
+            if (c->addr_taken[var])
+            {
+                v.invariant = reads_ok;
+                v.heavy = true;
+            }
+            else if (c->stores[var] == 0)
+                v.invariant = true;
+            else if (c->iv_of[var] >= 0)
+            {
+                v.iv = c->iv_of[var];
+                v.widened = c->ivs[v.iv].wide;
+                v.scale = 1;
+            }
+            ccb_loop_push(c, v);
+            break;
+        }
+        case CCB_OP_LOAD_GLOBAL:
+        {
+            CcbLoopValue v = ccb_loop_leaf(i, reads_ok);
+            v.heavy = true;
+            ccb_loop_push(c, v);
+            break;
+        }
+        case CCB_OP_LOAD_INDIRECT:
+            ops[0] = ccb_loop_pop(c);
+            ccb_loop_unary(c, i, &ops[0], ops[0].invariant && reads_ok, true);
+            break;
+        case CCB_OP_UNOP:
+        case CCB_OP_TEST_NULL:
+            ops[0] = ccb_loop_pop(c);
+            ccb_loop_unary(c, i, &ops[0], ops[0].invariant, false);
+            break;
+        case CCB_OP_CONVERT:
+            ops[0] = ccb_loop_pop(c);
+            ccb_loop_convert(c, i, insn, &ops[0]);
+            break;
+        case CCB_OP_BINOP:
+        case CCB_OP_COMPARE:
+            ops[1] = ccb_loop_pop(c);
+            ops[0] = ccb_loop_pop(c);
+            ccb_loop_binary(c, i, insn, ops, in_header);
+            break;
+        case CCB_OP_CALL:
+        case CCB_OP_CALL_INDIRECT:
+            for (int k = 0; k < insn->arg_count; ++k)
+            {
+                ops[0] = ccb_loop_pop(c);
+                ccb_loop_consume(c, &ops[0]);
+            }
+            if (insn->op == CCB_OP_CALL_INDIRECT)
+            {
+                ops[0] = ccb_loop_pop(c);
+                ccb_loop_consume(c, &ops[0]);
+            }
+            if (insn->type != CC_TYPE_VOID && insn->type != CC_TYPE_INVALID)
+                ccb_loop_push(c, ccb_loop_opaque(i));
+            break;
+        case CCB_OP_DUP:
+            ops[0] = ccb_loop_pop(c);
+            ccb_loop_consume(c, &ops[0]);
+            ccb_loop_push(c, ccb_loop_opaque(i));
+            ccb_loop_push(c, ccb_loop_opaque(i));
+            break;
+        case CCB_OP_STACK_ALLOC:
+            ccb_loop_push(c, ccb_loop_opaque(i));
+            break;
+        case CCB_OP_STORE_INDIRECT:
+            ops[0] = ccb_loop_pop(c);
+            ccb_loop_consume(c, &ops[0]);
+            ops[0] = ccb_loop_pop(c);
+            ccb_loop_consume(c, &ops[0]);
+            break;
+        case CCB_OP_RET:
+            if (insn->type == CC_TYPE_VOID)
+                break;
+            /* fall through */
+        case CCB_OP_STORE_LOCAL:
+        case CCB_OP_STORE_PARAM:
+        case CCB_OP_STORE_GLOBAL:
+        case CCB_OP_DROP:
+        case CCB_OP_BRANCH:
+            ops[0] = ccb_loop_pop(c);
+            ccb_loop_consume(c, &ops[0]);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static int ccb_loop_block_of(const CcbLoopCtx *c, const CcbLoop *loop, size_t at)
+{
+    for (int b = 0; b < loop->block_count; ++b)
+    {
+        const CcbBlock *blk = &c->cfg.blocks[loop->blocks[b]];
+        if (at >= blk->start && at < blk->end)
+            return loop->blocks[b];
+    }
+    return -1;
+}
+
+/* Matches `load var; const c; add` (or `const c; load var; add`, or
+   `load var; const c; sub`) right before `at`, within one block. */
+static bool ccb_loop_step_before(const CcbLoopCtx *c, int block, int var, size_t at, int64_t *step, unsigned *bits)
+{
+    if (at < c->cfg.blocks[block].start + 3)
+        return false;
+    const CcbInsn *op = &c->insns[at - 1];
+    const CcbInsn *load = &c->insns[at - 3];
+    const CcbInsn *k = &c->insns[at - 2];
+    if (op->op != CCB_OP_BINOP || (op->sub != CCB_BINOP_ADD && op->sub != CCB_BINOP_SUB) ||
+        !ccb_ir_type_is_integer(op->type))
+        return false;
+    *bits = ccb_ir_type_bits(op->type);
+    if (*bits != 32 && *bits != 64)
+        return false;
+    if (op->sub == CCB_BINOP_ADD && load->op == CCB_OP_CONST)
+    {
+        const CcbInsn *swap = load;
+        load = k;
+        k = swap;
+    }
+    if ((load->op != CCB_OP_LOAD_LOCAL && load->op != CCB_OP_LOAD_PARAM) || ccb_loop_slot_var(c, load) != var ||
+        k->op != CCB_OP_CONST || !k->has_imm || ccb_ir_type_bits(k->type) != *bits)
+        return false;
+    *step = ccb_insn_imm_signed(k);
+    if (op->sub == CCB_BINOP_SUB)
+        *step = -*step;
+    return *step != 0 && *step <= CCB_LOOP_MAX_SCALE && *step >= -CCB_LOOP_MAX_SCALE;
+}
+
+/* Records the loop's basic induction variables: slots whose only store in
+   the loop, outside any inner loop, is `slot = slot + c`. The sum may also
+   come through a slot that holds it, as value numbering leaves it. */
+static void ccb_loop_find_ivs(CcbLoopCtx *c, const CcbLoop *loop, const CcbLoop *loops, int loop_count)
+{
+    for (int var = 0; var < c->var_count; ++var)
+    {
+        if (c->stores[var] != 1 || c->addr_taken[var])
+            continue;
+        size_t s = c->store_at[var];
+        int block = ccb_loop_block_of(c, loop, s);
+        if (block < 0)
+            continue;
+        bool inner = false;
+        for (int l = 0; l < loop_count && !inner; ++l)
+        {
+            const CcbLoop *other = &loops[l];
+            if (other == loop || other->block_count >= loop->block_count || !c->in_loop[other->header])
+                continue;
+            for (int b = 0; b < other->block_count; ++b)
+                inner = inner || other->blocks[b] == block;
+        }
+        if (inner)
+            continue;
+
+        int64_t step = 0;
+        unsigned bits = 0;
+        int step_block = block;
+        if (!ccb_loop_step_before(c, block, var, s, &step, &bits))
+        {
+            const CcbInsn *copy = &c->insns[s - 1];
+            if (s == c->cfg.blocks[block].start || copy->op != CCB_OP_LOAD_LOCAL)
+                continue;
+            int held = ccb_loop_slot_var(c, copy);
+            size_t at = c->store_at[held];
+            if (c->stores[held] != 1 || c->addr_taken[held])
+                continue;
+            step_block = ccb_loop_block_of(c, loop, at);
+            if (step_block < 0 || (step_block == block ? at > s : !ccb_cfg_dominates(&c->cfg, step_block, block)) ||
+                !ccb_loop_step_before(c, step_block, var, at, &step, &bits))
+                continue;
+        }
+        /* A 32-bit counter stepped in the header is stepped before its test. */
+        if (bits == 32 && (block == c->header || step_block == c->header))
+            continue;
+        c->ivs = (CcbLoopIv *)realloc(c->ivs, (size_t)(c->iv_count + 1) * sizeof(CcbLoopIv));
+        if (!c->ivs)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        CcbLoopIv *iv = &c->ivs[c->iv_count];
+        memset(iv, 0, sizeof(*iv));
+        iv->var = var;
+        iv->store = s;
+        iv->step = step;
+        iv->wide = bits == 64;
+        c->iv_of[var] = c->iv_count++;
+    }
+}
+
+static bool ccb_loop_same_code(const CcbInsn *insns, size_t a, size_t b, size_t len)
+{
+    for (size_t k = 0; k < len; ++k)
+    {
+        const CcbInsn *x = &insns[a + k];
+        const CcbInsn *y = &insns[b + k];
+        if (x->op != y->op || x->sub != y->sub || x->is_unsigned != y->is_unsigned || x->has_imm != y->has_imm ||
+            x->is_varargs != y->is_varargs || x->type != y->type || x->to_type != y->to_type ||
+            x->index != y->index || x->align != y->align || x->arg_count != y->arg_count || x->imm != y->imm ||
+            memcmp(&x->fimm, &y->fimm, sizeof(x->fimm)) != 0 || x->symbol != y->symbol ||
+            x->symbol2 != y->symbol2 || x->args != y->args)
+            return false;
+    }
+    return true;
+}
+
+static CCValueType ccb_loop_result_type(const CcbInsn *insn)
+{
+    switch (insn->op)
+    {
+    case CCB_OP_CONVERT:
+        return insn->to_type;
+    case CCB_OP_COMPARE:
+    case CCB_OP_TEST_NULL:
+        return CC_TYPE_I1;
+    case CCB_OP_ADDR_LOCAL:
+    case CCB_OP_ADDR_PARAM:
+    case CCB_OP_ADDR_GLOBAL:
+        return CC_TYPE_PTR;
+    default:
+        return insn->type;
+    }
+}
+
+static int ccb_loop_cand_cmp(const void *a, const void *b)
+{
+    size_t sa = ((const CcbLoopCand *)a)->start;
+    size_t sb = ((const CcbLoopCand *)b)->start;
+    return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+static int ccb_loop_step_cmp(const void *a, const void *b)
+{
+    const CcbLoopStep *x = (const CcbLoopStep *)a;
+    const CcbLoopStep *y = (const CcbLoopStep *)b;
+    if (x->after != y->after)
+        return x->after < y->after ? -1 : 1;
+    return x->temp < y->temp ? -1 : (x->temp > y->temp ? 1 : 0);
+}
+
+static void ccb_loop_build_plan(CcbLoopCtx *c, CcbLoopPlan *plan)
+{
+    if (c->cand_count == 0)
+        return;
+    qsort(c->cands, c->cand_count, sizeof(CcbLoopCand), ccb_loop_cand_cmp);
+    int rep[CCB_LOOP_MAX_TEMPS];
+    plan->inits = (CcbLoopSpan *)xmalloc(CCB_LOOP_MAX_TEMPS * sizeof(CcbLoopSpan));
+    plan->temp_types = (CCValueType *)xmalloc(CCB_LOOP_MAX_TEMPS * sizeof(CCValueType));
+    plan->replaces = (CcbLoopSpan *)xmalloc(c->cand_count * sizeof(CcbLoopSpan));
+    for (size_t k = 0; k < c->cand_count; ++k)
+    {
+        const CcbLoopCand *cand = &c->cands[k];
+        size_t len = cand->end - cand->start + 1;
+        int temp = -1;
+        for (int t = 0; t < plan->temp_count && temp < 0; ++t)
+        {
+            const CcbLoopCand *other = &c->cands[rep[t]];
+            if (other->reduce == cand->reduce && other->end - other->start + 1 == len &&
+                ccb_loop_same_code(c->insns, other->start, cand->start, len))
+                temp = t;
+        }
+        if (temp < 0)
+        {
+            CCValueType type = ccb_loop_result_type(&c->insns[cand->end]);
+            if (plan->temp_count == CCB_LOOP_MAX_TEMPS || type == CC_TYPE_INVALID || type == CC_TYPE_VOID)
+                continue;
+            temp = plan->temp_count++;
+            rep[temp] = (int)k;
+            plan->temp_types[temp] = type;
+            plan->inits[temp].start = cand->start;
+            plan->inits[temp].end = cand->end;
+            plan->inits[temp].temp = temp;
+            if (cand->reduce)
+                plan->reduced++;
+            else
+                plan->hoisted++;
+        }
+        CcbLoopSpan *span = &plan->replaces[plan->replace_count++];
+        span->start = cand->start;
+        span->end = cand->end;
+        span->temp = temp;
+    }
+
+    plan->steps = (CcbLoopStep *)xmalloc((size_t)(plan->reduced ? plan->reduced : 1) * sizeof(CcbLoopStep));
+    for (int t = 0; t < plan->temp_count; ++t)
+    {
+        const CcbLoopCand *cand = &c->cands[rep[t]];
+        if (!cand->reduce)
+            continue;
+        CcbLoopStep *step = &plan->steps[plan->step_count++];
+        step->after = c->ivs[cand->iv].store;
+        step->temp = t;
+        step->step = c->ivs[cand->iv].step * cand->scale;
+    }
+    qsort(plan->steps, plan->step_count, sizeof(CcbLoopStep), ccb_loop_step_cmp);
+}
+
+/* The preheader goes right before the header's label: fall-through entries
+   already arrive there and jumps from outside are retargeted. A latch that
+   falls into the header would run it too, so such loops are skipped. */
+static bool ccb_loop_find_entries(CcbLoopCtx *c, size_t **retargets, size_t *retarget_count)
+{
+    const CcbBlock *hdr = &c->cfg.blocks[c->header];
+    *retargets = (size_t *)xmalloc((size_t)(hdr->pred_count ? hdr->pred_count : 1) * sizeof(size_t));
+    for (int p = 0; p < hdr->pred_count; ++p)
+    {
+        int pred = hdr->preds[p];
+        const CcbInsn *last = &c->insns[c->cfg.blocks[pred].end - 1];
+        bool explicit_edge = last->op == CCB_OP_JUMP || last->op == CCB_OP_BRANCH;
+        if (c->in_loop[pred])
+        {
+            if (!explicit_edge)
+                return false;
+            continue;
+        }
+        if (explicit_edge)
+            (*retargets)[(*retarget_count)++] = c->cfg.blocks[pred].end - 1;
+    }
+    return true;
+}
+
+/* Decodes what both planners need about the loop headed by `header`.
+   Returns NULL when the body cannot be modelled or there is no such loop;
+   ccb_loop_ctx_free releases the context either way. */
+static const CcbLoop *ccb_loop_ctx_init(CcbLoopCtx *c, const CcbInsn *insns, size_t count, const char *header,
+                                        CcbGvnPureCallFn is_pure_call, void *ctx)
+{
+    memset(c, 0, sizeof(*c));
+    c->guard_at = SIZE_MAX;
+    c->guard_iv = -1;
+    int max_param = -1;
+    int max_local = -1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        switch (insns[i].op)
+        {
+        case CCB_OP_OTHER:
+        case CCB_OP_PHI:
+        case CCB_OP_SELECT:
+        case CCB_OP_JUMP_INDIRECT:
+            return NULL;
+        case CCB_OP_LOAD_PARAM:
+        case CCB_OP_STORE_PARAM:
+        case CCB_OP_ADDR_PARAM:
+            if (insns[i].index > max_param)
+                max_param = insns[i].index;
+            break;
+        case CCB_OP_LOAD_LOCAL:
+        case CCB_OP_STORE_LOCAL:
+        case CCB_OP_ADDR_LOCAL:
+            if (insns[i].index > max_local)
+                max_local = insns[i].index;
+            break;
+        default:
+            break;
+        }
+    }
+    if (!ccb_cfg_build(&c->cfg, insns, count))
+        return NULL;
+    c->insns = insns;
+    c->loop_count = ccb_cfg_find_loops(&c->cfg, &c->loops);
+    const CcbLoop *loop = NULL;
+    for (int l = 0; l < c->loop_count && !loop; ++l)
+    {
+        const CcbInsn *first = &insns[c->cfg.blocks[c->loops[l].header].start];
+        if (first->op == CCB_OP_LABEL && first->symbol == header)
+            loop = &c->loops[l];
+    }
+    if (!loop)
+        return NULL;
+
+    c->header = loop->header;
+    c->in_loop = (bool *)xcalloc((size_t)c->cfg.block_count, sizeof(bool));
+    for (int b = 0; b < loop->block_count; ++b)
+        c->in_loop[loop->blocks[b]] = true;
+    c->param_count = max_param + 1;
+    c->var_count = max_param + 1 + max_local + 1;
+    size_t vars = (size_t)(c->var_count ? c->var_count : 1);
+    c->addr_taken = (bool *)xcalloc(vars, sizeof(bool));
+    c->stores = (int *)xcalloc(vars, sizeof(int));
+    c->store_at = (size_t *)xcalloc(vars, sizeof(size_t));
+    c->iv_of = (int *)xmalloc(vars * sizeof(int));
+    for (int v = 0; v < c->var_count; ++v)
+        c->iv_of[v] = -1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (insns[i].op == CCB_OP_ADDR_LOCAL || insns[i].op == CCB_OP_ADDR_PARAM)
+            c->addr_taken[ccb_loop_slot_var(c, &insns[i])] = true;
+    }
+    for (int b = 0; b < loop->block_count; ++b)
+    {
+        const CcbBlock *blk = &c->cfg.blocks[loop->blocks[b]];
+        for (size_t i = blk->start; i < blk->end; ++i)
+        {
+            const CcbInsn *insn = &insns[i];
+            switch (insn->op)
+            {
+            case CCB_OP_STORE_LOCAL:
+            case CCB_OP_STORE_PARAM:
+            {
+                int var = ccb_loop_slot_var(c, insn);
+                c->stores[var]++;
+                c->store_at[var] = i;
+                if (c->addr_taken[var])
+                    c->writes_memory = true;
+                break;
+            }
+            case CCB_OP_STORE_GLOBAL:
+            case CCB_OP_STORE_INDIRECT:
+            case CCB_OP_CALL_INDIRECT:
+            case CCB_OP_STACK_ALLOC:
+                c->writes_memory = true;
+                break;
+            case CCB_OP_CALL:
+                if (insn->is_varargs || !is_pure_call || !is_pure_call(insn->symbol, ctx))
+                    c->writes_memory = true;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    ccb_loop_find_ivs(c, loop, c->loops, c->loop_count);
+
+    /* Below -O3 the test may still carry its `!= false` normalization. */
+    const CcbBlock *hdr = &c->cfg.blocks[c->header];
+    size_t test = hdr->end - 2;
+    if (hdr->end - hdr->start >= 5 && insns[test].op == CCB_OP_COMPARE && insns[test].sub == CCB_CMP_NE &&
+        insns[test].type == CC_TYPE_I1 && insns[test - 1].op == CCB_OP_CONST && insns[test - 1].has_imm &&
+        insns[test - 1].imm == 0)
+        test -= 2;
+    if (hdr->end - hdr->start >= 3 && insns[hdr->end - 1].op == CCB_OP_BRANCH && insns[test].op == CCB_OP_COMPARE &&
+        hdr->succ_count == 2 && c->in_loop[hdr->succ[0]] && !c->in_loop[hdr->succ[1]])
+        c->guard_at = test;
+    /* Learns which counter the header's exit test bounds; candidates found
+       on the way are dropped. */
+    ccb_loop_scan_block(c, c->header);
+    c->cand_count = 0;
+    return loop;
+}
+
+static void ccb_loop_ctx_free(CcbLoopCtx *c)
+{
+    free(c->cands);
+    free(c->stack);
+    free(c->ivs);
+    free(c->iv_of);
+    free(c->store_at);
+    free(c->stores);
+    free(c->addr_taken);
+    free(c->in_loop);
+    ccb_cfg_free_loops(c->loops, c->loop_count);
+    ccb_cfg_free(&c->cfg);
+}
+
+bool ccb_loop_plan(const CcbInsn *insns, size_t count, const char *header, CcbGvnPureCallFn is_pure_call,
+                   void *ctx, CcbLoopPlan *plan)
+{
+    memset(plan, 0, sizeof(*plan));
+    CcbLoopCtx c;
+    const CcbLoop *loop = ccb_loop_ctx_init(&c, insns, count, header, is_pure_call, ctx);
+    if (loop && ccb_loop_find_entries(&c, &plan->retargets, &plan->retarget_count))
+    {
+        plan->header = c.cfg.blocks[c.header].start;
+        ccb_loop_scan_block(&c, c.header);
+        for (int b = 0; b < loop->block_count; ++b)
+        {
+            if (loop->blocks[b] != c.header)
+                ccb_loop_scan_block(&c, loop->blocks[b]);
+        }
+        ccb_loop_build_plan(&c, plan);
+    }
+    ccb_loop_ctx_free(&c);
+    if (plan->replace_count == 0)
+    {
+        ccb_loop_plan_free(plan);
+        return false;
+    }
+    return true;
+}
+
+/* The counter's value on entry when the header's only outside predecessor
+   (or a chain of single-predecessor blocks above it) last stores a const. */
+static bool ccb_loop_entry_const(const CcbLoopCtx *c, int var, int64_t *value)
+{
+    const CcbBlock *hdr = &c->cfg.blocks[c->header];
+    int block = -1;
+    for (int p = 0; p < hdr->pred_count; ++p)
+    {
+        if (c->in_loop[hdr->preds[p]])
+            continue;
+        if (block >= 0)
+            return false;
+        block = hdr->preds[p];
+    }
+    for (int hops = 0; block >= 0 && hops < 8; ++hops)
+    {
+        const CcbBlock *blk = &c->cfg.blocks[block];
+        for (size_t i = blk->end; i-- > blk->start;)
+        {
+            const CcbInsn *insn = &c->insns[i];
+            if ((insn->op != CCB_OP_STORE_LOCAL && insn->op != CCB_OP_STORE_PARAM) || ccb_loop_slot_var(c, insn) != var)
+                continue;
+            const CcbInsn *k = i > blk->start ? &c->insns[i - 1] : NULL;
+            if (!k || k->op != CCB_OP_CONST || !k->has_imm)
+                return false;
+            *value = ccb_insn_imm_signed(k);
+            return true;
+        }
+        if (blk->pred_count != 1 || c->in_loop[blk->preds[0]])
+            return false;
+        block = blk->preds[0];
+    }
+    return false;
+}
+
+/* Counts the iterations of `while (v < bound) v += step` (or `>`) in the
+   counter's own width and wrapping arithmetic; -1 past `limit`. */
+static int ccb_loop_trip_count(int64_t start, int64_t bound, int64_t step, unsigned bits, bool is_unsigned, bool up,
+                               int limit)
+{
+    uint64_t mask = bits == 64 ? UINT64_MAX : ((UINT64_C(1) << bits) - 1);
+    uint64_t sign = UINT64_C(1) << (bits - 1);
+    uint64_t v = (uint64_t)start & mask;
+    uint64_t b = (uint64_t)bound & mask;
+    for (int trips = 0; trips <= limit; ++trips)
+    {
+        bool less;
+        bool greater;
+        if (is_unsigned)
+        {
+            less = v < b;
+            greater = v > b;
+        }
+        else
+        {
+            less = (v ^ sign) < (b ^ sign);
+            greater = (v ^ sign) > (b ^ sign);
+        }
+        if (!(up ? less : greater))
+            return trips;
+        v = (v + (uint64_t)step) & mask;
+    }
+    return -1;
+}
+
+/* The loop must be laid out as its header, then its body ending in the
+   one `jump` back, with nothing else reachable in between. */
+static size_t ccb_loop_find_latch(const CcbLoopCtx *c, const CcbLoop *loop)
+{
+    const CcbBlock *hdr = &c->cfg.blocks[c->header];
+    size_t end = hdr->end;
+    for (int b = 0; b < loop->block_count; ++b)
+    {
+        const CcbBlock *blk = &c->cfg.blocks[loop->blocks[b]];
+        if (blk->start < hdr->start)
+            return SIZE_MAX;
+        if (blk->end > end)
+            end = blk->end;
+        if (loop->blocks[b] == c->header)
+            continue;
+        for (int p = 0; p < blk->pred_count; ++p)
+        {
+            if (!c->in_loop[blk->preds[p]])
+                return SIZE_MAX;
+        }
+    }
+    const CcbInsn *last = &c->insns[end - 1];
+    if (end == hdr->end || last->op != CCB_OP_JUMP || last->symbol != c->insns[hdr->start].symbol)
+        return SIZE_MAX;
+    for (int b = 0; b < c->cfg.block_count; ++b)
+    {
+        const CcbBlock *blk = &c->cfg.blocks[b];
+        if (blk->start >= hdr->end && blk->end <= end && !c->in_loop[b] && blk->pred_count > 0)
+            return SIZE_MAX;
+    }
+    return end - 1;
+}
+
+static void ccb_loop_plan_unroll(CcbLoopCtx *c, const CcbLoop *loop, int factor, CcbUnrollPlan *plan)
+{
+    const CcbInsn *insns = c->insns;
+    if (c->guard_iv < 0)
+        return;
+    const CcbBlock *hdr = &c->cfg.blocks[c->header];
+    const CcbLoopIv *iv = &c->ivs[c->guard_iv];
+    const CcbInsn *test = &insns[c->guard_at];
+    unsigned bits = ccb_ir_type_bits(test->type);
+    if ((bits != 32 && bits != 64) || (bits == 64) != iv->wide || (c->guard_up ? iv->step < 0 : iv->step > 0))
+        return;
+    /* The header only tests the counter against its bound. */
+    if (!(c->counter_at == hdr->start + 1 && c->bound_start == hdr->start + 2 && c->bound_end + 1 == c->guard_at) &&
+        !(c->bound_start == hdr->start + 1 && c->bound_end + 2 == c->guard_at && c->counter_at + 1 == c->guard_at))
+        return;
+    if (insns[hdr->end].op != CCB_OP_LABEL || insns[hdr->end].symbol != insns[hdr->end - 1].symbol)
+        return;
+    size_t latch = ccb_loop_find_latch(c, loop);
+    if (latch == SIZE_MAX)
+        return;
+
+    /* Every way back to the header steps the counter exactly once. */
+    int store_block = ccb_loop_block_of(c, loop, iv->store);
+    for (int p = 0; p < hdr->pred_count; ++p)
+    {
+        int pred = hdr->preds[p];
+        const CcbInsn *last = &insns[c->cfg.blocks[pred].end - 1];
+        if (c->in_loop[pred] && ((last->op != CCB_OP_JUMP && last->op != CCB_OP_BRANCH) ||
+                                 !ccb_cfg_dominates(&c->cfg, store_block, pred)))
+            return;
+    }
+
+    size_t body = latch - hdr->end;
+    bool calls = false;
+    for (size_t i = hdr->end; i < latch; ++i)
+        calls = calls || insns[i].op == CCB_OP_CALL || insns[i].op == CCB_OP_CALL_INDIRECT;
+    bool nested = false;
+    for (int l = 0; l < c->loop_count; ++l)
+        nested = nested || (&c->loops[l] != loop && c->in_loop[c->loops[l].header]);
+
+    int trips = -1;
+    int64_t start = 0;
+    if (c->bound_start == c->bound_end && insns[c->bound_start].op == CCB_OP_CONST && insns[c->bound_start].has_imm &&
+        ccb_loop_entry_const(c, iv->var, &start))
+        trips = ccb_loop_trip_count(start, ccb_insn_imm_signed(&insns[c->bound_start]), iv->step, bits,
+                                    c->guard_unsigned, c->guard_up, 64);
+    if (trips > 0 && (size_t)trips * body <= CCB_LOOP_UNROLL_MAX_INSNS &&
+        (factor >= trips || (factor == 0 && trips <= 16 && (size_t)trips * body <= 128)))
+    {
+        plan->full = true;
+        plan->copies = trips;
+    }
+    else if (bits == 32)
+    {
+        int copies = factor;
+        if (factor == 0 && !calls && !nested)
+            copies = body <= 16 ? 4 : (body <= 40 ? 2 : 0);
+        if (copies < 2 || (trips >= 0 && trips < copies) || (size_t)copies * body > CCB_LOOP_UNROLL_MAX_INSNS ||
+            !ccb_loop_find_entries(c, &plan->retargets, &plan->retarget_count))
+            return;
+        plan->copies = copies;
+        plan->reach = iv->step * (copies - 1);
+    }
+    else
+    {
+        return;
+    }
+    plan->header = hdr->start;
+    plan->counter = c->counter_at;
+    plan->bound_start = c->bound_start;
+    plan->bound_end = c->bound_end;
+    plan->branch = hdr->end - 1;
+    plan->latch = latch;
+    plan->counter_type = test->type;
+    plan->up = c->guard_up;
+    plan->is_unsigned = c->guard_unsigned;
+}
+
+bool ccb_loop_unroll_plan(const CcbInsn *insns, size_t count, const char *header, int factor, bool auto_unroll,
+                          CcbGvnPureCallFn is_pure_call, void *ctx, CcbUnrollPlan *plan)
+{
+    memset(plan, 0, sizeof(*plan));
+    if (factor == 1 || (factor == 0 && !auto_unroll))
+        return false;
+    CcbLoopCtx c;
+    const CcbLoop *loop = ccb_loop_ctx_init(&c, insns, count, header, is_pure_call, ctx);
+    if (loop)
+        ccb_loop_plan_unroll(&c, loop, factor, plan);
+    ccb_loop_ctx_free(&c);
+    if (plan->copies == 0)
+    {
+        ccb_loop_unroll_plan_free(plan);
+        return false;
+    }
+    return true;
+}
+
+void ccb_loop_unroll_plan_free(CcbUnrollPlan *plan)
+{
+    if (!plan)
+        return;
+    free(plan->retargets);
+    memset(plan, 0, sizeof(*plan));
+}
+
+size_t ccb_loop_headers(const CcbInsn *insns, size_t count, const char ***headers)
+{
+    *headers = NULL;
+    CcbCfg cfg;
+    if (!ccb_cfg_build(&cfg, insns, count))
+        return 0;
+    CcbLoop *loops = NULL;
+    int loop_count = ccb_cfg_find_loops(&cfg, &loops);
+    size_t found = 0;
+    if (loop_count > 0)
+        *headers = (const char **)xmalloc((size_t)loop_count * sizeof(const char *));
+    for (int l = 0; l < loop_count; ++l)
+    {
+        const CcbInsn *first = &insns[cfg.blocks[loops[l].header].start];
+        if (first->op == CCB_OP_LABEL)
+            (*headers)[found++] = first->symbol;
+    }
+    ccb_cfg_free_loops(loops, loop_count);
+    ccb_cfg_free(&cfg);
+    if (found == 0)
+    {
+        free(*headers);
+        *headers = NULL;
+    }
+    return found;
+}
+
+void ccb_loop_plan_free(CcbLoopPlan *plan)
+{
+    if (!plan)
+        return;
+    free(plan->retargets);
+    free(plan->inits);
+    free(plan->replaces);
+    free(plan->steps);
+    free(plan->temp_types);
+    memset(plan, 0, sizeof(*plan));
+}
@@ -0,0 +1,102 @@
+#ifndef CHANCE_CCB_LOOP_H
+#define CHANCE_CCB_LOOP_H
+
+#include "ccb_gvn.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Loop-invariant code motion and induction-variable strength reduction
+   over a decoded ccb function body, one natural loop at a time.
+
+   A pure expression whose operands do not change inside the loop is
+   evaluated once in a new preheader and reloaded from a temp. Memory reads
+   and divisions that may trap only qualify when the loop writes no memory
+   and they sit in the header, which runs whenever the loop is entered.
+
+   An address `base + ext(i) * size` with an invariant base, where `i` is
+   stored once in the loop as `i + c`, becomes a temp that the preheader
+   initialises and that is advanced by `c * size` right after that store.
+   When `i` is 32 bits wide the header must continue on `i < bound` (step
+   1) or `i > bound` (step -1), compared with the extension's signedness,
+   so stepping can never wrap. The body itself is not changed. */
+
+typedef struct
+{
+    size_t start;  /* expression inside the loop */
+    size_t end;    /* its last instruction */
+    int temp;
+} CcbLoopSpan;
+
+typedef struct
+{
+    size_t after;  /* the counter's store */
+    int temp;
+    int64_t step;  /* added to the temp after it */
+} CcbLoopStep;
+
+typedef struct
+{
+    size_t header;          /* the header's label; the preheader goes right before it */
+    size_t *retargets;      /* jumps and branches from outside the loop that name the header */
+    size_t retarget_count;
+    CcbLoopSpan *inits;     /* per temp, the expression that initialises it in the preheader */
+    CcbLoopSpan *replaces;  /* in instruction order; each becomes a load of its temp */
+    size_t replace_count;
+    CcbLoopStep *steps;     /* in instruction order */
+    size_t step_count;
+    CCValueType *temp_types;
+    int temp_count;
+    int hoisted;            /* temps holding invariant values */
+    int reduced;            /* temps following an induction variable */
+} CcbLoopPlan;
+
+/* Returns the count of natural loops whose header starts with a label and
+   stores those labels, inner loops first. *headers is NULL when zero. */
+size_t ccb_loop_headers(const CcbInsn *insns, size_t count, const char ***headers);
+
+/* Plans the loop headed by the label `header`. Returns false and leaves the
+   plan empty when there is no such loop, it cannot get a preheader, or
+   nothing in it qualifies. */
+bool ccb_loop_plan(const CcbInsn *insns, size_t count, const char *header, CcbGvnPureCallFn is_pure_call,
+                   void *ctx, CcbLoopPlan *plan);
+void ccb_loop_plan_free(CcbLoopPlan *plan);
+
+/* Unrolling a counted loop whose header is just `counter < bound` (or
+   `counter > bound`) for an induction counter and an invariant bound, and
+   whose body is laid out right after it up to the one `jump` back.
+
+   With a const entry value and bound the trip count is known, and a small
+   loop is replaced by that many copies of its body. Otherwise a 32-bit
+   counter gets an unrolled loop in front of the original: its header tests
+   in 64 bits that `copies` more iterations would all pass the original
+   test, and its body is `copies` copies without the tests in between. The
+   original loop runs the remaining iterations. */
+typedef struct
+{
+    size_t header;          /* the header's label */
+    size_t counter;         /* its load of the counter */
+    size_t bound_start;     /* the bound the counter is tested against */
+    size_t bound_end;
+    size_t branch;          /* the header's branch; the body starts right after it */
+    size_t latch;           /* the `jump` back that ends the body */
+    size_t *retargets;      /* jumps and branches from outside the loop that name the header */
+    size_t retarget_count;
+    int copies;
+    bool full;              /* the copies replace the loop */
+    CCValueType counter_type;
+    bool up;                /* the loop runs while counter < bound, else while counter > bound */
+    bool is_unsigned;
+    int64_t reach;          /* how far the counter moves over all but the last copy */
+} CcbUnrollPlan;
+
+/* Plans unrolling the loop headed by `header`. `factor` is the requested
+   copy count, 0 when none was requested and 1 to leave the loop alone;
+   without a request the loop is only unrolled when `auto_unroll` is set and
+   it is small. Returns false and leaves the plan empty otherwise. */
+bool ccb_loop_unroll_plan(const CcbInsn *insns, size_t count, const char *header, int factor, bool auto_unroll,
+                          CcbGvnPureCallFn is_pure_call, void *ctx, CcbUnrollPlan *plan);
+void ccb_loop_unroll_plan_free(CcbUnrollPlan *plan);
+
+#endif
@@ -0,0 +1,743 @@
+#include "ccb_sroa.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CCB_SROA_MAX_CHAIN 16
+#define CCB_SROA_MAX_FIELDS 16
+#define CCB_SROA_MAX_SCANS 8
+
+typedef struct
+{
+    int agg;          /* >= 0: an address into that aggregate */
+    bool is_const;    /* an i64 constant that may become part of an offset */
+    bool wide;        /* the address bitcast to i64 */
+    bool zero;        /* a lone `const 0` or `const ptr null` */
+    int64_t off;      /* offset into the aggregate, or the constant */
+    int chain_count;  /* instructions computing it, deleted with the aggregate */
+    size_t chain[CCB_SROA_MAX_CHAIN];
+} CcbSroaValue;
+
+typedef struct
+{
+    size_t alloc;     /* its stack_alloc */
+    int size;
+    bool escapes;
+    int field_base;   /* first field in the plan */
+} CcbSroaAgg;
+
+typedef struct
+{
+    int stores;
+    bool addr_taken;
+    int agg;          /* >= 0: stored once with an address into it */
+    bool wide;
+    int64_t off;
+} CcbSroaSlot;
+
+typedef struct
+{
+    int agg;
+    int64_t off;
+    CCValueType type;
+    size_t at;
+    bool store;
+    bool zero;        /* a store of the constant zero, which may span fields */
+    size_t value_at;  /* that constant */
+    int field;        /* zero: the first field it covers, -1 for none */
+    int field_end;
+} CcbSroaAccess;
+
+typedef struct
+{
+    const CcbInsn *insns;
+    size_t count;
+    CcbSroaAgg *aggs;
+    int agg_count;
+    int *agg_at;      /* per instruction: the aggregate a stack_alloc starts, or -1 */
+    CcbSroaSlot *slots;
+    int slot_count;
+    bool learned;     /* a slot got its address this scan */
+
+    CcbSroaValue *stack;
+    size_t stack_count;
+    size_t stack_capacity;
+    int *owner;       /* per instruction: the aggregate whose address it computes, or -1 */
+    CcbSroaAccess *accesses;
+    size_t access_count;
+    size_t access_capacity;
+} CcbSroaCtx;
+
+static void *ccb_sroa_grow(void *items, size_t *capacity, size_t needed, size_t item_size)
+{
+    if (needed <= *capacity)
+        return items;
+    size_t cap = *capacity ? *capacity * 2 : 32;
+    while (cap < needed)
+        cap *= 2;
+    void *grown = realloc(items, cap * item_size);
+    if (!grown)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    *capacity = cap;
+    return grown;
+}
+
+static CcbSroaValue ccb_sroa_opaque(void)
+{
+    CcbSroaValue v;
+    v.agg = -1;
+    v.is_const = false;
+    v.wide = false;
+    v.zero = false;
+    v.off = 0;
+    v.chain_count = 0;
+    return v;
+}
+
+static void ccb_sroa_push(CcbSroaCtx *c, const CcbSroaValue *v)
+{
+    c->stack = (CcbSroaValue *)ccb_sroa_grow(c->stack, &c->stack_capacity, c->stack_count + 1, sizeof(CcbSroaValue));
+    c->stack[c->stack_count++] = *v;
+}
+
+static CcbSroaValue ccb_sroa_pop(CcbSroaCtx *c)
+{
+    if (c->stack_count == 0)
+        return ccb_sroa_opaque();
+    return c->stack[--c->stack_count];
+}
+
+static void ccb_sroa_escape(CcbSroaCtx *c, const CcbSroaValue *v)
+{
+    if (v->agg >= 0)
+        c->aggs[v->agg].escapes = true;
+}
+
+/* Adds instruction `i` to the chain; false (and the aggregate escapes)
+   when the chain is too long to track. */
+static bool ccb_sroa_extend(CcbSroaCtx *c, CcbSroaValue *v, size_t i)
+{
+    if (v->chain_count >= CCB_SROA_MAX_CHAIN)
+    {
+        ccb_sroa_escape(c, v);
+        *v = ccb_sroa_opaque();
+        return false;
+    }
+    v->chain[v->chain_count++] = i;
+    return true;
+}
+
+static bool ccb_sroa_merge(CcbSroaCtx *c, CcbSroaValue *into, const CcbSroaValue *from)
+{
+    for (int k = 0; k < from->chain_count; ++k)
+    {
+        if (!ccb_sroa_extend(c, into, from->chain[k]))
+            return false;
+    }
+    return true;
+}
+
+/* The value and the instruction consuming it are deleted with the
+   aggregate. */
+static void ccb_sroa_claim(CcbSroaCtx *c, const CcbSroaValue *v, size_t i)
+{
+    for (int k = 0; k < v->chain_count; ++k)
+        c->owner[v->chain[k]] = v->agg;
+    if (i != SIZE_MAX)
+        c->owner[i] = v->agg;
+}
+
+/* `zero_at` is the `const 0` a store writes, or SIZE_MAX. */
+static void ccb_sroa_access(CcbSroaCtx *c, const CcbSroaValue *addr, CCValueType type, size_t i, bool store,
+                            size_t zero_at)
+{
+    if (addr->wide || type == CC_TYPE_VOID || type == CC_TYPE_INVALID)
+    {
+        ccb_sroa_escape(c, addr);
+        return;
+    }
+    ccb_sroa_claim(c, addr, SIZE_MAX);
+    if (zero_at != SIZE_MAX)
+        c->owner[zero_at] = addr->agg;
+    c->accesses = (CcbSroaAccess *)ccb_sroa_grow(c->accesses, &c->access_capacity, c->access_count + 1,
+                                                 sizeof(CcbSroaAccess));
+    CcbSroaAccess *a = &c->accesses[c->access_count++];
+    a->agg = addr->agg;
+    a->off = addr->off;
+    a->type = type;
+    a->at = i;
+    a->store = store;
+    a->zero = zero_at != SIZE_MAX;
+    a->value_at = zero_at;
+    a->field = -1;
+    a->field_end = -1;
+}
+
+static void ccb_sroa_flush(CcbSroaCtx *c)
+{
+    while (c->stack_count > 0)
+    {
+        CcbSroaValue v = ccb_sroa_pop(c);
+        ccb_sroa_escape(c, &v);
+    }
+}
+
+static bool ccb_sroa_const_binop(CcbBinop op, int64_t a, int64_t b, int64_t *out)
+{
+    uint64_t ua = (uint64_t)a;
+    uint64_t ub = (uint64_t)b;
+    switch (op)
+    {
+    case CCB_BINOP_ADD:
+        *out = (int64_t)(ua + ub);
+        return true;
+    case CCB_BINOP_SUB:
+        *out = (int64_t)(ua - ub);
+        return true;
+    case CCB_BINOP_MUL:
+        *out = (int64_t)(ua * ub);
+        return true;
+    case CCB_BINOP_SHL:
+        if (ub >= 64)
+            return false;
+        *out = (int64_t)(ua << ub);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void ccb_sroa_binop(CcbSroaCtx *c, size_t i, const CcbInsn *insn)
+{
+    CcbSroaValue r = ccb_sroa_pop(c);
+    CcbSroaValue l = ccb_sroa_pop(c);
+    CcbSroaValue out = ccb_sroa_opaque();
+    bool is_i64 = insn->type == CC_TYPE_I64 || insn->type == CC_TYPE_U64;
+    if (is_i64 && l.is_const && r.is_const)
+    {
+        int64_t value = 0;
+        if (ccb_sroa_const_binop((CcbBinop)insn->sub, l.off, r.off, &value))
+        {
+            out.is_const = true;
+            out.off = value;
+            if (ccb_sroa_merge(c, &out, &l) && ccb_sroa_merge(c, &out, &r) && ccb_sroa_extend(c, &out, i))
+            {
+                ccb_sroa_push(c, &out);
+                return;
+            }
+            out = ccb_sroa_opaque();
+        }
+    }
+    else if (is_i64 && (insn->sub == CCB_BINOP_ADD || insn->sub == CCB_BINOP_SUB) &&
+             ((l.agg >= 0 && l.wide && r.is_const) ||
+              (insn->sub == CCB_BINOP_ADD && r.agg >= 0 && r.wide && l.is_const)))
+    {
+        const CcbSroaValue *base = l.agg >= 0 ? &l : &r;
+        const CcbSroaValue *delta = l.agg >= 0 ? &r : &l;
+        out = *base;
+        out.off = insn->sub == CCB_BINOP_ADD ? (int64_t)((uint64_t)base->off + (uint64_t)delta->off)
+                                             : (int64_t)((uint64_t)base->off - (uint64_t)delta->off);
+        if (ccb_sroa_merge(c, &out, delta) && ccb_sroa_extend(c, &out, i))
+            ccb_sroa_push(c, &out);
+        else
+        {
+            out = ccb_sroa_opaque();
+            ccb_sroa_push(c, &out);
+        }
+        return;
+    }
+    ccb_sroa_escape(c, &l);
+    ccb_sroa_escape(c, &r);
+    ccb_sroa_push(c, &out);
+}
+
+static void ccb_sroa_convert(CcbSroaCtx *c, size_t i, const CcbInsn *insn)
+{
+    CcbSroaValue v = ccb_sroa_pop(c);
+    bool widen = insn->type == CC_TYPE_PTR && (insn->to_type == CC_TYPE_I64 || insn->to_type == CC_TYPE_U64);
+    bool narrow = (insn->type == CC_TYPE_I64 || insn->type == CC_TYPE_U64) && insn->to_type == CC_TYPE_PTR;
+    if (insn->sub == CC_CONVERT_BITCAST && v.agg >= 0 && ((widen && !v.wide) || (narrow && v.wide)))
+    {
+        v.wide = widen;
+        if (!ccb_sroa_extend(c, &v, i))
+            v = ccb_sroa_opaque();
+        ccb_sroa_push(c, &v);
+        return;
+    }
+    bool extend = insn->sub == CC_CONVERT_SEXT || insn->sub == CC_CONVERT_ZEXT;
+    if (v.is_const && extend && (insn->to_type == CC_TYPE_I64 || insn->to_type == CC_TYPE_U64))
+    {
+        unsigned bits = ccb_ir_type_bits(insn->type);
+        if (bits > 0 && bits < 64)
+        {
+            uint64_t mask = (UINT64_C(1) << bits) - 1;
+            uint64_t raw = (uint64_t)v.off & mask;
+            if (insn->sub == CC_CONVERT_SEXT && (raw >> (bits - 1)))
+                raw |= ~mask;
+            v.off = (int64_t)raw;
+        }
+        v.zero = false;
+        if (!ccb_sroa_extend(c, &v, i))
+            v = ccb_sroa_opaque();
+        ccb_sroa_push(c, &v);
+        return;
+    }
+    ccb_sroa_escape(c, &v);
+    CcbSroaValue out = ccb_sroa_opaque();
+    ccb_sroa_push(c, &out);
+}
+
+static void ccb_sroa_store_slot(CcbSroaCtx *c, size_t i, const CcbInsn *insn)
+{
+    CcbSroaValue v = ccb_sroa_pop(c);
+    if (v.agg < 0)
+        return;
+    CcbSroaSlot *slot = insn->op == CCB_OP_STORE_LOCAL && insn->index >= 0 && insn->index < c->slot_count
+                            ? &c->slots[insn->index]
+                            : NULL;
+    if (!slot || slot->stores != 1 || slot->addr_taken)
+    {
+        ccb_sroa_escape(c, &v);
+        return;
+    }
+    if (slot->agg < 0)
+    {
+        slot->agg = v.agg;
+        slot->wide = v.wide;
+        slot->off = v.off;
+        c->learned = true;
+    }
+    else if (slot->agg != v.agg || slot->wide != v.wide || slot->off != v.off)
+    {
+        ccb_sroa_escape(c, &v);
+        c->aggs[slot->agg].escapes = true;
+        return;
+    }
+    ccb_sroa_claim(c, &v, i);
+}
+
+/* Returns false for an instruction whose stack effect is not modelled. */
+static bool ccb_sroa_step(CcbSroaCtx *c, size_t i)
+{
+    const CcbInsn *insn = &c->insns[i];
+    CcbSroaValue v;
+    CcbSroaValue w;
+    switch (insn->op)
+    {
+    case CCB_OP_NONE:
+    case CCB_OP_DIRECTIVE:
+    case CCB_OP_NOP:
+        return true;
+    case CCB_OP_LABEL:
+        ccb_sroa_flush(c);
+        return true;
+    case CCB_OP_JUMP:
+        ccb_sroa_flush(c);
+        return true;
+    case CCB_OP_BRANCH:
+        v = ccb_sroa_pop(c);
+        ccb_sroa_escape(c, &v);
+        ccb_sroa_flush(c);
+        return true;
+    case CCB_OP_RET:
+        if (insn->type != CC_TYPE_VOID)
+        {
+            v = ccb_sroa_pop(c);
+            ccb_sroa_escape(c, &v);
+        }
+        ccb_sroa_flush(c);
+        return true;
+    case CCB_OP_CONST:
+        v = ccb_sroa_opaque();
+        if (insn->has_imm && (ccb_ir_type_is_integer(insn->type) || insn->type == CC_TYPE_PTR))
+        {
+            v.is_const = insn->type != CC_TYPE_PTR;
+            v.zero = insn->imm == 0;
+            v.off = ccb_insn_imm_signed(insn);
+            v.chain[v.chain_count++] = i;
+        }
+        ccb_sroa_push(c, &v);
+        return true;
+    case CCB_OP_STACK_ALLOC:
+        v = ccb_sroa_opaque();
+        if (c->agg_at[i] >= 0)
+        {
+            v.agg = c->agg_at[i];
+            v.chain[v.chain_count++] = i;
+        }
+        ccb_sroa_push(c, &v);
+        return true;
+    case CCB_OP_LOAD_LOCAL:
+        v = ccb_sroa_opaque();
+        if (insn->index >= 0 && insn->index < c->slot_count && c->slots[insn->index].agg >= 0)
+        {
+            const CcbSroaSlot *slot = &c->slots[insn->index];
+            v.agg = slot->agg;
+            v.wide = slot->wide;
+            v.off = slot->off;
+            v.chain[v.chain_count++] = i;
+        }
+        ccb_sroa_push(c, &v);
+        return true;
+    case CCB_OP_CONST_STR:
+    case CCB_OP_LOAD_PARAM:
+    case CCB_OP_LOAD_GLOBAL:
+    case CCB_OP_ADDR_LOCAL:
+    case CCB_OP_ADDR_PARAM:
+    case CCB_OP_ADDR_GLOBAL:
+        v = ccb_sroa_opaque();
+        ccb_sroa_push(c, &v);
+        return true;
+    case CCB_OP_STORE_LOCAL:
+    case CCB_OP_STORE_PARAM:
+        ccb_sroa_store_slot(c, i, insn);
+        return true;
+    case CCB_OP_STORE_GLOBAL:
+    case CCB_OP_DROP:
+        v = ccb_sroa_pop(c);
+        if (insn->op == CCB_OP_DROP && v.agg >= 0)
+            ccb_sroa_claim(c, &v, i);
+        else
+            ccb_sroa_escape(c, &v);
+        return true;
+    case CCB_OP_LOAD_INDIRECT:
+        v = ccb_sroa_pop(c);
+        if (v.agg >= 0)
+            ccb_sroa_access(c, &v, insn->type, i, false, SIZE_MAX);
+        w = ccb_sroa_opaque();
+        ccb_sroa_push(c, &w);
+        return true;
+    case CCB_OP_STORE_INDIRECT:
+        w = ccb_sroa_pop(c);
+        v = ccb_sroa_pop(c);
+        ccb_sroa_escape(c, &w);
+        if (v.agg >= 0)
+            ccb_sroa_access(c, &v, insn->type, i, true, w.zero ? w.chain[0] : SIZE_MAX);
+        return true;
+    case CCB_OP_BINOP:
+        ccb_sroa_binop(c, i, insn);
+        return true;
+    case CCB_OP_COMPARE:
+        v = ccb_sroa_pop(c);
+        w = ccb_sroa_pop(c);
+        ccb_sroa_escape(c, &v);
+        ccb_sroa_escape(c, &w);
+        v = ccb_sroa_opaque();
+        ccb_sroa_push(c, &v);
+        return true;
+    case CCB_OP_CONVERT:
+        ccb_sroa_convert(c, i, insn);
+        return true;
+    case CCB_OP_UNOP:
+    case CCB_OP_TEST_NULL:
+        v = ccb_sroa_pop(c);
+        ccb_sroa_escape(c, &v);
+        v = ccb_sroa_opaque();
+        ccb_sroa_push(c, &v);
+        return true;
+    case CCB_OP_DUP:
+        v = ccb_sroa_pop(c);
+        if (v.agg >= 0 && ccb_sroa_extend(c, &v, i))
+        {
+            ccb_sroa_push(c, &v);
+            ccb_sroa_push(c, &v);
+            return true;
+        }
+        v = ccb_sroa_opaque();
+        ccb_sroa_push(c, &v);
+        ccb_sroa_push(c, &v);
+        return true;
+    case CCB_OP_CALL:
+    case CCB_OP_CALL_INDIRECT:
+        for (int k = 0; k < insn->arg_count; ++k)
+        {
+            v = ccb_sroa_pop(c);
+            ccb_sroa_escape(c, &v);
+        }
+        if (insn->op == CCB_OP_CALL_INDIRECT)
+        {
+            v = ccb_sroa_pop(c);
+            ccb_sroa_escape(c, &v);
+        }
+        if (insn->type != CC_TYPE_VOID && insn->type != CC_TYPE_INVALID)
+        {
+            v = ccb_sroa_opaque();
+            ccb_sroa_push(c, &v);
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int ccb_sroa_access_cmp(const void *a, const void *b)
+{
+    const CcbSroaAccess *x = *(const CcbSroaAccess *const *)a;
+    const CcbSroaAccess *y = *(const CcbSroaAccess *const *)b;
+    if (x->agg != y->agg)
+        return x->agg < y->agg ? -1 : 1;
+    if (x->off != y->off)
+        return x->off < y->off ? -1 : 1;
+    return x->at < y->at ? -1 : (x->at > y->at ? 1 : 0);
+}
+
+static int64_t ccb_sroa_type_size(CCValueType type)
+{
+    unsigned bits = ccb_ir_type_bits(type);
+    return bits == 1 ? 1 : (int64_t)(bits / 8);
+}
+
+/* Numbers the fields of every aggregate that still qualifies: one per
+   offset its loads and stores use. An aggregate whose accesses overlap,
+   disagree on a type or leave the allocation escapes, as does one with a
+   zero fill that covers part of a field. */
+static void ccb_sroa_assign_fields(CcbSroaCtx *c, CcbSroaPlan *plan)
+{
+    CcbSroaAccess **sorted = (CcbSroaAccess **)malloc((c->access_count ? c->access_count : 1) * sizeof(*sorted));
+    int64_t *field_off = NULL;
+    if (!sorted)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < c->access_count; ++k)
+        sorted[k] = &c->accesses[k];
+    qsort(sorted, c->access_count, sizeof(*sorted), ccb_sroa_access_cmp);
+
+    for (size_t k = 0; k < c->access_count;)
+    {
+        int agg = sorted[k]->agg;
+        CcbSroaAgg *a = &c->aggs[agg];
+        size_t end = k;
+        while (end < c->access_count && sorted[end]->agg == agg)
+            end++;
+        int fields = 0;
+        int64_t limit = 0;
+        const CcbSroaAccess *prev = NULL;
+        for (size_t j = k; j < end && !a->escapes; ++j)
+        {
+            const CcbSroaAccess *acc = sorted[j];
+            if (acc->zero)
+                continue;
+            int64_t size = ccb_sroa_type_size(acc->type);
+            if (prev && acc->off == prev->off)
+            {
+                if (acc->type != prev->type)
+                    a->escapes = true;
+                continue;
+            }
+            if (size <= 0 || acc->off < limit || acc->off + size > a->size)
+                a->escapes = true;
+            limit = acc->off + size;
+            prev = acc;
+            fields++;
+        }
+        if (fields > CCB_SROA_MAX_FIELDS)
+            a->escapes = true;
+        if (a->escapes)
+        {
+            k = end;
+            continue;
+        }
+
+        a->field_base = plan->field_count;
+        plan->field_types = (CCValueType *)realloc(plan->field_types,
+                                                   (size_t)(plan->field_count + fields) * sizeof(CCValueType));
+        field_off = (int64_t *)realloc(field_off, (size_t)(plan->field_count + fields) * sizeof(int64_t));
+        if (!plan->field_types || !field_off)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        int field = plan->field_count - 1;
+        prev = NULL;
+        for (size_t j = k; j < end; ++j)
+        {
+            if (sorted[j]->zero)
+                continue;
+            if (!prev || sorted[j]->off != prev->off)
+            {
+                plan->field_types[++field] = sorted[j]->type;
+                field_off[field] = sorted[j]->off;
+            }
+            sorted[j]->field = field;
+            prev = sorted[j];
+        }
+        plan->field_count += fields;
+
+        for (size_t j = k; j < end; ++j)
+        {
+            CcbSroaAccess *acc = sorted[j];
+            if (!acc->zero)
+                continue;
+            int64_t lo = acc->off;
+            int64_t hi = acc->off + ccb_sroa_type_size(acc->type);
+            acc->field = -1;
+            acc->field_end = -1;
+            for (int f = a->field_base; f < plan->field_count; ++f)
+            {
+                int64_t flo = field_off[f];
+                int64_t fhi = flo + ccb_sroa_type_size(plan->field_types[f]);
+                if (fhi <= lo || flo >= hi)
+                    continue;
+                if (flo < lo || fhi > hi)
+                    a->escapes = true;
+                if (acc->field < 0)
+                    acc->field = f;
+                acc->field_end = f + 1;
+            }
+        }
+        if (a->escapes)
+            plan->field_count = a->field_base;
+        k = end;
+    }
+    free(field_off);
+    free(sorted);
+}
+
+bool ccb_sroa_plan(const CcbInsn *insns, size_t count, CcbSroaPlan *plan)
+{
+    memset(plan, 0, sizeof(*plan));
+    CcbSroaCtx c;
+    memset(&c, 0, sizeof(c));
+    c.insns = insns;
+    c.count = count;
+
+    int slot_count = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const CcbInsn *insn = &insns[i];
+        if (insn->op == CCB_OP_OTHER || insn->op == CCB_OP_PHI || insn->op == CCB_OP_SELECT ||
+            insn->op == CCB_OP_JUMP_INDIRECT)
+            return false;
+        if ((insn->op == CCB_OP_LOAD_LOCAL || insn->op == CCB_OP_STORE_LOCAL || insn->op == CCB_OP_ADDR_LOCAL) &&
+            insn->index >= slot_count)
+            slot_count = insn->index + 1;
+        if (insn->op == CCB_OP_STACK_ALLOC)
+            c.agg_count++;
+    }
+    if (c.agg_count == 0)
+        return false;
+
+    c.aggs = (CcbSroaAgg *)calloc((size_t)c.agg_count, sizeof(CcbSroaAgg));
+    c.agg_at = (int *)malloc(count * sizeof(int));
+    c.owner = (int *)malloc(count * sizeof(int));
+    c.slot_count = slot_count;
+    c.slots = (CcbSroaSlot *)calloc((size_t)(slot_count ? slot_count : 1), sizeof(CcbSroaSlot));
+    if (!c.aggs || !c.agg_at || !c.owner || !c.slots)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    int agg = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const CcbInsn *insn = &insns[i];
+        c.agg_at[i] = -1;
+        if (insn->op == CCB_OP_STACK_ALLOC)
+        {
+            c.aggs[agg].alloc = i;
+            c.aggs[agg].size = insn->index;
+            c.agg_at[i] = agg++;
+        }
+        else if (insn->op == CCB_OP_STORE_LOCAL)
+            c.slots[insn->index].stores++;
+        else if (insn->op == CCB_OP_ADDR_LOCAL)
+            c.slots[insn->index].addr_taken = true;
+    }
+    for (int s = 0; s < slot_count; ++s)
+        c.slots[s].agg = -1;
+
+    /* A slot's address is only known once its store is seen, so scan
+       until no slot learns one; the last scan has them all from the
+       start. */
+    bool ok = true;
+    for (int scan = 0; ok; ++scan)
+    {
+        if (scan == CCB_SROA_MAX_SCANS)
+        {
+            ok = false;
+            break;
+        }
+        c.learned = false;
+        c.stack_count = 0;
+        c.access_count = 0;
+        for (int a = 0; a < c.agg_count; ++a)
+            c.aggs[a].escapes = false;
+        for (size_t i = 0; i < count; ++i)
+            c.owner[i] = -1;
+        for (size_t i = 0; ok && i < count; ++i)
+            ok = ccb_sroa_step(&c, i);
+        ccb_sroa_flush(&c);
+        if (!c.learned)
+            break;
+    }
+
+    if (ok)
+        ccb_sroa_assign_fields(&c, plan);
+    for (int a = 0; ok && a < c.agg_count; ++a)
+    {
+        if (!c.aggs[a].escapes)
+            plan->split++;
+    }
+    if (ok && plan->split > 0)
+    {
+        size_t a = 0;
+        size_t capacity = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            int owner = c.owner[i];
+            bool access = a < c.access_count && c.accesses[a].at == i;
+            if (access && !c.aggs[c.accesses[a].agg].escapes)
+            {
+                plan->edits = (CcbSroaEdit *)ccb_sroa_grow(plan->edits, &capacity, plan->edit_count + 1,
+                                                           sizeof(CcbSroaEdit));
+                CcbSroaEdit *edit = &plan->edits[plan->edit_count++];
+                edit->at = i;
+                edit->kind = c.accesses[a].zero ? CCB_SROA_ZERO
+                                                : (c.accesses[a].store ? CCB_SROA_STORE : CCB_SROA_LOAD);
+                edit->field = c.accesses[a].field;
+                edit->field_end = c.accesses[a].field_end;
+            }
+            else if (owner >= 0 && !c.aggs[owner].escapes)
+            {
+                plan->edits = (CcbSroaEdit *)ccb_sroa_grow(plan->edits, &capacity, plan->edit_count + 1,
+                                                           sizeof(CcbSroaEdit));
+                CcbSroaEdit *edit = &plan->edits[plan->edit_count++];
+                edit->at = i;
+                edit->kind = CCB_SROA_DELETE;
+                edit->field = -1;
+                edit->field_end = -1;
+            }
+            if (access)
+                a++;
+        }
+    }
+
+    free(c.aggs);
+    free(c.agg_at);
+    free(c.owner);
+    free(c.slots);
+    free(c.stack);
+    free(c.accesses);
+    if (!ok || plan->split == 0)
+    {
+        ccb_sroa_plan_free(plan);
+        return false;
+    }
+    return true;
+}
+
+void ccb_sroa_plan_free(CcbSroaPlan *plan)
+{
+    if (!plan)
+        return;
+    free(plan->edits);
+    free(plan->field_types);
+    memset(plan, 0, sizeof(*plan));
+}
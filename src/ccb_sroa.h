@@ -0,0 +1,52 @@
+#ifndef CHANCE_CCB_SROA_H
+#define CHANCE_CCB_SROA_H
+
+#include "ccb_ir.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Scalar replacement of aggregates over a decoded ccb function body.
+
+   A stack_alloc whose address only ever reaches `load_indirect` and
+   `store_indirect` at constant offsets, directly or through locals that
+   are stored once, is replaced by one local per accessed field. The
+   address arithmetic and the alloc go away and each access becomes a
+   load or store of its field's local; a store of zero spanning several
+   fields, as zero-initialisation emits, zeroes each of them. Any other
+   use of the address (a call argument, a compare, a store to memory, a
+   value live across a block boundary) keeps the aggregate in memory, as
+   do accesses that overlap or disagree on a field's type. The body itself
+   is not changed. */
+
+typedef enum
+{
+    CCB_SROA_DELETE,
+    CCB_SROA_LOAD,   /* load_local of the field */
+    CCB_SROA_STORE,  /* store_local of the field */
+    CCB_SROA_ZERO    /* zero every field in [field, field_end) */
+} CcbSroaEditKind;
+
+typedef struct
+{
+    size_t at;
+    CcbSroaEditKind kind;
+    int field;        /* index into field_types */
+    int field_end;
+} CcbSroaEdit;
+
+typedef struct
+{
+    CcbSroaEdit *edits;       /* in instruction order */
+    size_t edit_count;
+    CCValueType *field_types; /* one new local per field */
+    int field_count;
+    int split;                /* aggregates replaced */
+} CcbSroaPlan;
+
+/* Returns false and leaves the plan empty when the body has instructions
+   the planner does not model or no aggregate qualifies. */
+bool ccb_sroa_plan(const CcbInsn *insns, size_t count, CcbSroaPlan *plan);
+void ccb_sroa_plan_free(CcbSroaPlan *plan);
+
+#endif
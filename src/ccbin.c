@@ -0,0 +1,1155 @@
+#include "ccbin.h"
+#include "ast.h"
+#include "ccb_ir.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Layout written by chancecodec's --emit-ccbin, format version 4 (all
+   integers little-endian, strings are a u32 length and the bytes):
+
+     "CCBIN" u16 format-version u32 bytecode-version
+     u32 globals   { name u32 type u8 const u8 0 u8 1 u32 align u32 0
+                     u8 has-init [u64 init] }
+     u32 externs   { name u32 ret u8 varargs u8 no-return
+                     u32 params { u32 type } }
+     u32 functions { name u32 ret u8 varargs u8 no-return u8[4] 0
+                     u32 params { u32 type } u32 locals { u32 type }
+                     u32 insns { u8 op u32 text-line operands } }
+
+   Instructions carry the 1-based line of their text form. Visibility is
+   not part of the format. */
+
+#define CCBIN_MAGIC "CCBIN"
+#define CCBIN_FORMAT_VERSION 4u
+#define CCBIN_TYPE_COUNT 13
+
+enum
+{
+    CCBIN_OP_CONST = 0x00,
+    CCBIN_OP_CONST_STR = 0x01,
+    CCBIN_OP_LOAD_PARAM = 0x02,
+    CCBIN_OP_ADDR_PARAM = 0x03,
+    CCBIN_OP_LOAD_LOCAL = 0x04,
+    CCBIN_OP_STORE_LOCAL = 0x05,
+    CCBIN_OP_ADDR_LOCAL = 0x06,
+    CCBIN_OP_LOAD_GLOBAL = 0x07,
+    CCBIN_OP_STORE_GLOBAL = 0x08,
+    CCBIN_OP_ADDR_GLOBAL = 0x09,
+    CCBIN_OP_LOAD_INDIRECT = 0x0a,
+    CCBIN_OP_STORE_INDIRECT = 0x0b,
+    CCBIN_OP_BINOP = 0x0c,
+    CCBIN_OP_COMPARE = 0x0e,
+    CCBIN_OP_CONVERT = 0x0f,
+    CCBIN_OP_STACK_ALLOC = 0x10,
+    CCBIN_OP_DROP = 0x11,
+    CCBIN_OP_LABEL = 0x12,
+    CCBIN_OP_JUMP = 0x13,
+    CCBIN_OP_BRANCH = 0x14,
+    CCBIN_OP_CALL = 0x15,
+    CCBIN_OP_RET = 0x16,
+};
+
+typedef struct
+{
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} CcbinBuf;
+
+typedef struct
+{
+    CCValueType *items;
+    size_t count;
+    size_t cap;
+} CcbinTypes;
+
+typedef struct
+{
+    char *name;
+    CCValueType type;
+    bool is_const;
+    bool has_init;
+    uint64_t init;
+    uint32_t align;
+} CcbinGlobal;
+
+typedef struct
+{
+    char *name;
+    CCValueType ret;
+    bool is_varargs;
+    CcbinTypes params;
+    CcbinTypes locals;
+    uint32_t declared_params;
+    uint32_t declared_locals;
+    bool sealed;
+    int scratch[CCBIN_TYPE_COUNT];
+    uint32_t insn_count;
+    size_t code_start;
+    size_t code_end;
+} CcbinFunction;
+
+typedef struct
+{
+    size_t offset;
+    char *symbol;
+} CcbinFixup;
+
+struct CcbinWriter
+{
+    bool declined;
+    char reason[192];
+    uint32_t line_no;
+    bool saw_header;
+    uint32_t bytecode_version;
+    char *pending;
+    size_t pending_len;
+    size_t pending_cap;
+    CcbinGlobal *globals;
+    size_t global_count;
+    size_t global_cap;
+    CcbinFunction *externs;
+    size_t extern_count;
+    size_t extern_cap;
+    CcbinFunction *funcs;
+    size_t func_count;
+    size_t func_cap;
+    char **no_return;
+    size_t no_return_count;
+    size_t no_return_cap;
+    CcbinFixup *fixups;
+    size_t fixup_count;
+    size_t fixup_cap;
+    bool in_func;
+    uint32_t str_count;
+    CcbinBuf code;
+};
+
+static void ccbin_decline(CcbinWriter *w, const char *fmt, ...)
+{
+    if (w->declined)
+        return;
+    w->declined = true;
+    int n = snprintf(w->reason, sizeof(w->reason), "line %u: ", w->line_no);
+    if (n < 0 || (size_t)n >= sizeof(w->reason))
+        n = 0;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(w->reason + n, sizeof(w->reason) - (size_t)n, fmt, ap);
+    va_end(ap);
+}
+
+static bool ccbin_grow(CcbinWriter *w, void **items, size_t *cap, size_t need, size_t elem)
+{
+    if (need <= *cap)
+        return true;
+    size_t new_cap = *cap ? *cap * 2 : 16;
+    while (new_cap < need)
+        new_cap *= 2;
+    void *grown = realloc(*items, new_cap * elem);
+    if (!grown)
+    {
+        ccbin_decline(w, "out of memory");
+        return false;
+    }
+    *items = grown;
+    *cap = new_cap;
+    return true;
+}
+
+static bool put_bytes(CcbinWriter *w, CcbinBuf *b, const void *data, size_t len)
+{
+    if (!ccbin_grow(w, (void **)&b->data, &b->cap, b->len + len, 1))
+        return false;
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return true;
+}
+
+static bool put_u8(CcbinWriter *w, CcbinBuf *b, uint8_t value)
+{
+    return put_bytes(w, b, &value, 1);
+}
+
+static bool put_u32(CcbinWriter *w, CcbinBuf *b, uint32_t value)
+{
+    uint8_t buf[4];
+    for (int i = 0; i < 4; ++i)
+        buf[i] = (uint8_t)(value >> (8 * i));
+    return put_bytes(w, b, buf, sizeof(buf));
+}
+
+static bool put_u64(CcbinWriter *w, CcbinBuf *b, uint64_t value)
+{
+    uint8_t buf[8];
+    for (int i = 0; i < 8; ++i)
+        buf[i] = (uint8_t)(value >> (8 * i));
+    return put_bytes(w, b, buf, sizeof(buf));
+}
+
+static bool put_string(CcbinWriter *w, CcbinBuf *b, const char *str, size_t len)
+{
+    if (len > UINT32_MAX)
+    {
+        ccbin_decline(w, "string too long");
+        return false;
+    }
+    return put_u32(w, b, (uint32_t)len) && put_bytes(w, b, str, len);
+}
+
+static bool ccbin_type_code(CCValueType ty, uint32_t *out)
+{
+    switch (ty)
+    {
+    case CC_TYPE_I1:
+        *out = 0;
+        return true;
+    case CC_TYPE_I8:
+        *out = 1;
+        return true;
+    case CC_TYPE_U8:
+        *out = 2;
+        return true;
+    case CC_TYPE_I16:
+        *out = 3;
+        return true;
+    case CC_TYPE_U16:
+        *out = 4;
+        return true;
+    case CC_TYPE_I32:
+        *out = 5;
+        return true;
+    case CC_TYPE_U32:
+        *out = 6;
+        return true;
+    case CC_TYPE_I64:
+        *out = 7;
+        return true;
+    case CC_TYPE_U64:
+        *out = 8;
+        return true;
+    case CC_TYPE_F32:
+        *out = 9;
+        return true;
+    case CC_TYPE_F64:
+        *out = 10;
+        return true;
+    case CC_TYPE_PTR:
+        *out = 11;
+        return true;
+    case CC_TYPE_VOID:
+        *out = 12;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool put_type(CcbinWriter *w, CcbinBuf *b, CCValueType ty)
+{
+    uint32_t code;
+    if (!ccbin_type_code(ty, &code))
+    {
+        ccbin_decline(w, "unknown value type");
+        return false;
+    }
+    return put_u32(w, b, code);
+}
+
+static bool ccbin_types_push(CcbinWriter *w, CcbinTypes *types, CCValueType ty)
+{
+    if (!ccbin_grow(w, (void **)&types->items, &types->cap, types->count + 1, sizeof(*types->items)))
+        return false;
+    types->items[types->count++] = ty;
+    return true;
+}
+
+static bool ccbin_put_types(CcbinWriter *w, CcbinBuf *b, const CcbinTypes *types)
+{
+    if (!put_u32(w, b, (uint32_t)types->count))
+        return false;
+    for (size_t i = 0; i < types->count; ++i)
+    {
+        if (!put_type(w, b, types->items[i]))
+            return false;
+    }
+    return true;
+}
+
+/* Parses "(i32,ptr)"; "()" is an empty list. */
+static bool ccbin_parse_type_list(CcbinWriter *w, const char *text, size_t len, CcbinTypes *out)
+{
+    if (len < 2 || text[0] != '(' || text[len - 1] != ')')
+        return false;
+    size_t pos = 1;
+    while (pos < len - 1)
+    {
+        size_t end = pos;
+        while (end < len - 1 && text[end] != ',')
+            ++end;
+        CCValueType ty = ccb_ir_type_from_name(text + pos, end - pos);
+        if (ty == CC_TYPE_INVALID || ty == CC_TYPE_VOID || !ccbin_types_push(w, out, ty))
+            return false;
+        pos = end + 1;
+    }
+    return true;
+}
+
+static const char *ccbin_token(const char *s, const char **start, size_t *len)
+{
+    while (*s == ' ' || *s == '\t')
+        ++s;
+    *start = s;
+    while (*s && *s != ' ' && *s != '\t')
+        ++s;
+    *len = (size_t)(s - *start);
+    return s;
+}
+
+static bool ccbin_token_is(const char *start, size_t len, const char *text)
+{
+    return strlen(text) == len && memcmp(start, text, len) == 0;
+}
+
+static bool ccbin_attr(const char *start, size_t len, const char *key, const char **value, size_t *value_len)
+{
+    size_t key_len = strlen(key);
+    if (len <= key_len || memcmp(start, key, key_len) != 0 || start[key_len] != '=')
+        return false;
+    *value = start + key_len + 1;
+    *value_len = len - key_len - 1;
+    return true;
+}
+
+static char *ccbin_strndup(const char *s, size_t len)
+{
+    char *copy = (char *)xmalloc(len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static bool ccbin_parse_u32(const char *s, size_t len, uint32_t *out)
+{
+    if (len == 0 || len > 10)
+        return false;
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (s[i] < '0' || s[i] > '9')
+            return false;
+        value = value * 10 + (uint64_t)(s[i] - '0');
+    }
+    if (value > UINT32_MAX)
+        return false;
+    *out = (uint32_t)value;
+    return true;
+}
+
+static unsigned ccbin_type_size(CCValueType ty)
+{
+    unsigned bits = ccb_ir_type_bits(ty);
+    return bits <= 8 ? 1 : bits / 8;
+}
+
+/* Integer payload of a const or global initialiser: signed types are
+   sign-extended to 64 bits, everything else (and i1) zero-extended. */
+static uint64_t ccbin_imm_bits(const CcbInsn *insn)
+{
+    return insn->type == CC_TYPE_I1 ? insn->imm : (uint64_t)ccb_insn_imm_signed(insn);
+}
+
+static bool ccbin_int_value(CCValueType ty, const char *text, uint64_t *out)
+{
+    if (ty == CC_TYPE_PTR && strcmp(text, "null") == 0)
+    {
+        *out = 0;
+        return true;
+    }
+    char line[160];
+    if (snprintf(line, sizeof(line), "const %s %s", ccb_ir_type_name(ty), text) >= (int)sizeof(line))
+        return false;
+    CcbInsn insn;
+    ccb_insn_decode(line, &insn);
+    if (insn.op != CCB_OP_CONST || !insn.has_imm)
+        return false;
+    *out = ccbin_imm_bits(&insn);
+    return true;
+}
+
+static bool ccbin_name_listed(char **names, size_t count, const char *name)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (strcmp(names[i], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void ccbin_parse_global(CcbinWriter *w, const char *rest)
+{
+    const char *tok;
+    size_t len;
+    rest = ccbin_token(rest, &tok, &len);
+    if (len == 0)
+    {
+        ccbin_decline(w, "malformed .global");
+        return;
+    }
+    CcbinGlobal g;
+    memset(&g, 0, sizeof(g));
+    g.type = CC_TYPE_INVALID;
+    char *name = ccbin_strndup(tok, len);
+    char init_text[128] = {0};
+    uint32_t size = 0;
+    for (;;)
+    {
+        rest = ccbin_token(rest, &tok, &len);
+        if (len == 0)
+            break;
+        const char *value;
+        size_t value_len;
+        if (ccbin_attr(tok, len, "type", &value, &value_len))
+            g.type = ccb_ir_type_from_name(value, value_len);
+        else if (ccbin_attr(tok, len, "init", &value, &value_len) && value_len < sizeof(init_text))
+        {
+            memcpy(init_text, value, value_len);
+            init_text[value_len] = '\0';
+            g.has_init = true;
+        }
+        else if ((ccbin_attr(tok, len, "size", &value, &value_len) && ccbin_parse_u32(value, value_len, &size)) ||
+                 (ccbin_attr(tok, len, "align", &value, &value_len) && ccbin_parse_u32(value, value_len, &g.align)))
+            continue;
+        else if (ccbin_token_is(tok, len, "const"))
+            g.is_const = true;
+        else if (!ccbin_token_is(tok, len, "hidden"))
+        {
+            ccbin_decline(w, "global '%s' uses '%.*s'", name, (int)len, tok);
+            free(name);
+            return;
+        }
+    }
+    if (!ccb_ir_type_is_integer(g.type) && g.type != CC_TYPE_PTR)
+    {
+        ccbin_decline(w, "global '%s' is not an integer or pointer", name);
+        free(name);
+        return;
+    }
+    /* A zero-filled object: the format keeps only its alignment. */
+    if (size != 0 && (g.align == 0 || g.has_init))
+    {
+        ccbin_decline(w, "global '%s' has an unsupported layout", name);
+        free(name);
+        return;
+    }
+    if (g.align == 0)
+        g.align = ccbin_type_size(g.type);
+    if (g.has_init && !ccbin_int_value(g.type, init_text, &g.init))
+    {
+        ccbin_decline(w, "global '%s' has initialiser '%s'", name, init_text);
+        free(name);
+        return;
+    }
+    if (!ccbin_grow(w, (void **)&w->globals, &w->global_cap, w->global_count + 1, sizeof(*w->globals)))
+    {
+        free(name);
+        return;
+    }
+    g.name = name;
+    w->globals[w->global_count++] = g;
+}
+
+static void ccbin_parse_extern(CcbinWriter *w, const char *rest)
+{
+    const char *tok;
+    size_t len;
+    rest = ccbin_token(rest, &tok, &len);
+    if (len == 0 || !ccbin_grow(w, (void **)&w->externs, &w->extern_cap, w->extern_count + 1, sizeof(*w->externs)))
+    {
+        ccbin_decline(w, "malformed .extern");
+        return;
+    }
+    CcbinFunction *ext = &w->externs[w->extern_count++];
+    memset(ext, 0, sizeof(*ext));
+    ext->name = ccbin_strndup(tok, len);
+    ext->ret = CC_TYPE_INVALID;
+    bool have_params = false;
+    for (;;)
+    {
+        rest = ccbin_token(rest, &tok, &len);
+        if (len == 0)
+            break;
+        const char *value;
+        size_t value_len;
+        if (ccbin_attr(tok, len, "returns", &value, &value_len))
+            ext->ret = ccb_ir_type_from_name(value, value_len);
+        else if (ccbin_attr(tok, len, "params", &value, &value_len))
+            have_params = ccbin_parse_type_list(w, value, value_len, &ext->params);
+        else if (ccbin_token_is(tok, len, "varargs"))
+            ext->is_varargs = true;
+        else
+        {
+            ccbin_decline(w, "extern '%s' uses '%.*s'", ext->name, (int)len, tok);
+            return;
+        }
+    }
+    if (!have_params || ext->ret == CC_TYPE_INVALID)
+        ccbin_decline(w, "malformed .extern '%s'", ext->name);
+}
+
+static void ccbin_parse_func(CcbinWriter *w, const char *rest)
+{
+    const char *tok;
+    size_t len;
+    rest = ccbin_token(rest, &tok, &len);
+    if (len == 0 || !ccbin_grow(w, (void **)&w->funcs, &w->func_cap, w->func_count + 1, sizeof(*w->funcs)))
+    {
+        ccbin_decline(w, "malformed .func");
+        return;
+    }
+    CcbinFunction *fn = &w->funcs[w->func_count++];
+    memset(fn, 0, sizeof(*fn));
+    fn->name = ccbin_strndup(tok, len);
+    fn->ret = CC_TYPE_INVALID;
+    for (int i = 0; i < CCBIN_TYPE_COUNT; ++i)
+        fn->scratch[i] = -1;
+    fn->code_start = fn->code_end = w->code.len;
+    w->in_func = true;
+    for (;;)
+    {
+        rest = ccbin_token(rest, &tok, &len);
+        if (len == 0)
+            break;
+        const char *value;
+        size_t value_len;
+        uint32_t count;
+        if (ccbin_attr(tok, len, "ret", &value, &value_len))
+            fn->ret = ccb_ir_type_from_name(value, value_len);
+        else if (ccbin_attr(tok, len, "params", &value, &value_len) && ccbin_parse_u32(value, value_len, &count))
+            fn->declared_params = count;
+        else if (ccbin_attr(tok, len, "locals", &value, &value_len) && ccbin_parse_u32(value, value_len, &count))
+            fn->declared_locals = count;
+        else if (ccbin_token_is(tok, len, "varargs"))
+            fn->is_varargs = true;
+        else if (!ccbin_token_is(tok, len, "hidden"))
+        {
+            ccbin_decline(w, "function '%s' uses '%.*s'", fn->name, (int)len, tok);
+            return;
+        }
+    }
+    if (fn->ret == CC_TYPE_INVALID)
+        ccbin_decline(w, "malformed .func '%s'", fn->name);
+}
+
+static void ccbin_parse_types_line(CcbinWriter *w, const char *rest, CcbinTypes *out)
+{
+    const char *tok;
+    size_t len;
+    for (;;)
+    {
+        rest = ccbin_token(rest, &tok, &len);
+        if (len == 0)
+            return;
+        CCValueType ty = ccb_ir_type_from_name(tok, len);
+        if (ty == CC_TYPE_INVALID || ty == CC_TYPE_VOID)
+        {
+            ccbin_decline(w, "unknown type '%.*s'", (int)len, tok);
+            return;
+        }
+        if (!ccbin_types_push(w, out, ty))
+            return;
+    }
+}
+
+/* The .params/.locals lines end at the first instruction; they must
+   match the counts on the .func line. */
+static bool ccbin_seal_function(CcbinWriter *w, CcbinFunction *fn)
+{
+    if (fn->sealed)
+        return true;
+    fn->sealed = true;
+    if (fn->params.count != fn->declared_params || fn->locals.count != fn->declared_locals)
+    {
+        ccbin_decline(w, "function '%s' declares %u params and %u locals", fn->name, fn->declared_params,
+                      fn->declared_locals);
+        return false;
+    }
+    return true;
+}
+
+static void ccbin_parse_directive(CcbinWriter *w, const char *line)
+{
+    const char *tok;
+    size_t len;
+    const char *rest = ccbin_token(line, &tok, &len);
+    CcbinFunction *fn = w->in_func ? &w->funcs[w->func_count - 1] : NULL;
+    if (fn && !fn->sealed && ccbin_token_is(tok, len, ".params") && fn->params.count == 0)
+        ccbin_parse_types_line(w, rest, &fn->params);
+    else if (fn && !fn->sealed && ccbin_token_is(tok, len, ".locals") && fn->locals.count == 0)
+        ccbin_parse_types_line(w, rest, &fn->locals);
+    else if (fn && ccbin_token_is(tok, len, ".endfunc"))
+    {
+        if (ccbin_seal_function(w, fn))
+            w->in_func = false;
+    }
+    else if (!fn && ccbin_token_is(tok, len, ".func"))
+        ccbin_parse_func(w, rest);
+    else if (!fn && ccbin_token_is(tok, len, ".extern"))
+        ccbin_parse_extern(w, rest);
+    else if (!fn && ccbin_token_is(tok, len, ".global"))
+        ccbin_parse_global(w, rest);
+    else if (!fn && ccbin_token_is(tok, len, ".no-return"))
+    {
+        ccbin_token(rest, &tok, &len);
+        if (len == 0 ||
+            !ccbin_grow(w, (void **)&w->no_return, &w->no_return_cap, w->no_return_count + 1, sizeof(*w->no_return)))
+        {
+            ccbin_decline(w, "malformed .no-return");
+            return;
+        }
+        w->no_return[w->no_return_count++] = ccbin_strndup(tok, len);
+    }
+    else
+        ccbin_decline(w, "directive '%.*s' is not supported", (int)len, tok);
+}
+
+/* Decodes the body of a const_str literal: \\, \", \0 and \xHH, the
+   escapes codegen writes. */
+static char *ccbin_unquote(const char *s, size_t *out_len)
+{
+    while (*s == ' ' || *s == '\t')
+        ++s;
+    if (*s != '"')
+        return NULL;
+    ++s;
+    size_t cap = strlen(s) + 1;
+    char *out = (char *)xmalloc(cap);
+    size_t n = 0;
+    for (; *s && *s != '"'; ++s)
+    {
+        if (*s != '\\')
+        {
+            out[n++] = *s;
+            continue;
+        }
+        ++s;
+        if (*s == '\\' || *s == '"')
+            out[n++] = *s;
+        else if (*s == '0')
+            out[n++] = '\0';
+        else if ((*s == 'x' || *s == 'X') && s[1] && s[2])
+        {
+            char hex[3] = {s[1], s[2], '\0'};
+            char *end = NULL;
+            unsigned long value = strtoul(hex, &end, 16);
+            if (*end != '\0')
+                break;
+            out[n++] = (char)value;
+            s += 2;
+        }
+        else
+            break;
+    }
+    if (*s != '"' || s[1] != '\0')
+    {
+        free(out);
+        return NULL;
+    }
+    *out_len = n;
+    return out;
+}
+
+static bool ccbin_put_op(CcbinWriter *w, CcbinFunction *fn, uint8_t op)
+{
+    fn->insn_count++;
+    return put_u8(w, &w->code, op) && put_u32(w, &w->code, w->line_no);
+}
+
+static bool ccbin_put_slot(CcbinWriter *w, CcbinFunction *fn, uint8_t op, CCValueType ty, uint32_t index)
+{
+    return ccbin_put_op(w, fn, op) && put_type(w, &w->code, ty) && put_u32(w, &w->code, index);
+}
+
+/* Global types are resolved once the whole module has been seen, since
+   codegen may declare a global after the functions that use it. */
+static bool ccbin_put_global_ref(CcbinWriter *w, CcbinFunction *fn, uint8_t op, const char *symbol)
+{
+    if (!ccbin_put_op(w, fn, op))
+        return false;
+    if (op == CCBIN_OP_ADDR_GLOBAL)
+    {
+        if (!put_type(w, &w->code, CC_TYPE_PTR))
+            return false;
+    }
+    else
+    {
+        if (!ccbin_grow(w, (void **)&w->fixups, &w->fixup_cap, w->fixup_count + 1, sizeof(*w->fixups)))
+            return false;
+        w->fixups[w->fixup_count].offset = w->code.len;
+        w->fixups[w->fixup_count].symbol = xstrdup(symbol);
+        w->fixup_count++;
+        if (!put_u32(w, &w->code, 0))
+            return false;
+    }
+    return put_string(w, &w->code, symbol, strlen(symbol));
+}
+
+static bool ccbin_put_const(CcbinWriter *w, CcbinFunction *fn, CCValueType ty, uint64_t bits, bool is_null)
+{
+    uint8_t unsigned_flag = (ccb_ir_type_is_integer(ty) && !ccb_ir_type_is_signed(ty)) || ty == CC_TYPE_F64;
+    return ccbin_put_op(w, fn, CCBIN_OP_CONST) && put_type(w, &w->code, ty) && put_u8(w, &w->code, unsigned_flag) &&
+           put_u8(w, &w->code, is_null) && put_u64(w, &w->code, bits);
+}
+
+static bool ccbin_put_arith(CcbinWriter *w, CcbinFunction *fn, uint8_t op, uint8_t kind, CCValueType ty,
+                            bool is_unsigned)
+{
+    return ccbin_put_op(w, fn, op) && put_u8(w, &w->code, kind) && put_type(w, &w->code, ty) &&
+           put_u8(w, &w->code, is_unsigned);
+}
+
+/* A per-type local the lowerings below park values in. */
+static bool ccbin_scratch_local(CcbinWriter *w, CcbinFunction *fn, CCValueType ty, uint32_t *out)
+{
+    uint32_t code;
+    if (!ccbin_type_code(ty, &code) || ty == CC_TYPE_VOID)
+    {
+        ccbin_decline(w, "no scratch local for this type");
+        return false;
+    }
+    if (fn->scratch[code] < 0)
+    {
+        fn->scratch[code] = (int)fn->locals.count;
+        if (!ccbin_types_push(w, &fn->locals, ty))
+            return false;
+    }
+    *out = (uint32_t)fn->scratch[code];
+    return true;
+}
+
+static bool ccbin_slot_type(CcbinWriter *w, const CcbinTypes *slots, int index, CCValueType *out)
+{
+    if (index < 0 || (size_t)index >= slots->count)
+    {
+        ccbin_decline(w, "slot %d out of range", index);
+        return false;
+    }
+    *out = slots->items[index];
+    return true;
+}
+
+static bool ccbin_indirect_flag(CCValueType ty)
+{
+    return !ccb_ir_type_is_signed(ty);
+}
+
+static void ccbin_parse_insn(CcbinWriter *w, const char *line)
+{
+    CcbinFunction *fn = &w->funcs[w->func_count - 1];
+    if (!ccbin_seal_function(w, fn))
+        return;
+    CcbInsn insn;
+    ccb_insn_decode(line, &insn);
+    CcbinBuf *b = &w->code;
+    CCValueType ty = CC_TYPE_INVALID;
+    uint32_t scratch = 0;
+    bool ok = true;
+    switch (insn.op)
+    {
+    case CCB_OP_NONE:
+    case CCB_OP_NOP:
+        break;
+    case CCB_OP_LABEL:
+        ok = ccbin_put_op(w, fn, CCBIN_OP_LABEL) && put_string(w, b, insn.symbol, strlen(insn.symbol));
+        break;
+    case CCB_OP_JUMP:
+        ok = ccbin_put_op(w, fn, CCBIN_OP_JUMP) && put_string(w, b, insn.symbol, strlen(insn.symbol));
+        break;
+    case CCB_OP_BRANCH:
+        ok = ccbin_put_op(w, fn, CCBIN_OP_BRANCH) && put_string(w, b, insn.symbol, strlen(insn.symbol)) &&
+             put_string(w, b, insn.symbol2, strlen(insn.symbol2));
+        break;
+    case CCB_OP_CONST:
+    {
+        const char *tok;
+        size_t len;
+        const char *rest = ccbin_token(line, &tok, &len);
+        rest = ccbin_token(rest, &tok, &len);
+        ccbin_token(rest, &tok, &len);
+        if (insn.type == CC_TYPE_F64)
+        {
+            char text[64];
+            char *end = NULL;
+            if (len == 0 || len >= sizeof(text))
+            {
+                ok = false;
+                break;
+            }
+            memcpy(text, tok, len);
+            text[len] = '\0';
+            double value = strtod(text, &end);
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            ok = *end == '\0' && ccbin_put_const(w, fn, CC_TYPE_F64, bits, false);
+        }
+        else if (insn.has_imm)
+            ok = ccbin_put_const(w, fn, insn.type, ccbin_imm_bits(&insn),
+                                 insn.type == CC_TYPE_PTR && insn.imm == 0);
+        else
+            ok = false;
+        break;
+    }
+    case CCB_OP_CONST_STR:
+    {
+        size_t len = 0;
+        char *value = ccbin_unquote(line + strspn(line, " \t") + strlen("const_str"), &len);
+        char symbol[32];
+        int symbol_len = snprintf(symbol, sizeof(symbol), "__str%u", w->str_count++);
+        ok = value && ccbin_put_op(w, fn, CCBIN_OP_CONST_STR) && put_string(w, b, value, len) &&
+             put_string(w, b, symbol, (size_t)symbol_len);
+        free(value);
+        break;
+    }
+    case CCB_OP_LOAD_PARAM:
+    case CCB_OP_LOAD_LOCAL:
+    case CCB_OP_STORE_LOCAL:
+    {
+        const CcbinTypes *slots = insn.op == CCB_OP_LOAD_PARAM ? &fn->params : &fn->locals;
+        uint8_t op = insn.op == CCB_OP_LOAD_PARAM   ? CCBIN_OP_LOAD_PARAM
+                     : insn.op == CCB_OP_LOAD_LOCAL ? CCBIN_OP_LOAD_LOCAL
+                                                    : CCBIN_OP_STORE_LOCAL;
+        ok = ccbin_slot_type(w, slots, insn.index, &ty) && ccbin_put_slot(w, fn, op, ty, (uint32_t)insn.index);
+        break;
+    }
+    case CCB_OP_ADDR_PARAM:
+    case CCB_OP_ADDR_LOCAL:
+    {
+        const CcbinTypes *slots = insn.op == CCB_OP_ADDR_PARAM ? &fn->params : &fn->locals;
+        uint8_t op = insn.op == CCB_OP_ADDR_PARAM ? CCBIN_OP_ADDR_PARAM : CCBIN_OP_ADDR_LOCAL;
+        /* addr_param one past the last parameter is the varargs area */
+        bool va_area = insn.op == CCB_OP_ADDR_PARAM && fn->is_varargs && (size_t)insn.index == fn->params.count;
+        ok = (va_area || ccbin_slot_type(w, slots, insn.index, &ty)) &&
+             ccbin_put_slot(w, fn, op, CC_TYPE_PTR, (uint32_t)insn.index);
+        break;
+    }
+    case CCB_OP_STORE_PARAM:
+        /* value -> scratch; addr_param; scratch; store_indirect */
+        ok = ccbin_slot_type(w, &fn->params, insn.index, &ty) && ccbin_scratch_local(w, fn, ty, &scratch) &&
+             ccbin_put_slot(w, fn, CCBIN_OP_STORE_LOCAL, ty, scratch) &&
+             ccbin_put_slot(w, fn, CCBIN_OP_ADDR_PARAM, CC_TYPE_PTR, (uint32_t)insn.index) &&
+             ccbin_put_slot(w, fn, CCBIN_OP_LOAD_LOCAL, ty, scratch) &&
+             ccbin_put_op(w, fn, CCBIN_OP_STORE_INDIRECT) && put_type(w, b, ty) &&
+             put_u8(w, b, ccbin_indirect_flag(ty));
+        break;
+    case CCB_OP_LOAD_GLOBAL:
+        ok = ccbin_put_global_ref(w, fn, CCBIN_OP_LOAD_GLOBAL, insn.symbol);
+        break;
+    case CCB_OP_STORE_GLOBAL:
+        ok = ccbin_put_global_ref(w, fn, CCBIN_OP_STORE_GLOBAL, insn.symbol);
+        break;
+    case CCB_OP_ADDR_GLOBAL:
+        ok = ccbin_put_global_ref(w, fn, CCBIN_OP_ADDR_GLOBAL, insn.symbol);
+        break;
+    case CCB_OP_LOAD_INDIRECT:
+    case CCB_OP_STORE_INDIRECT:
+        ok = insn.type != CC_TYPE_I1 &&
+             ccbin_put_op(w, fn, insn.op == CCB_OP_LOAD_INDIRECT ? CCBIN_OP_LOAD_INDIRECT : CCBIN_OP_STORE_INDIRECT) &&
+             put_type(w, b, insn.type) && put_u8(w, b, ccbin_indirect_flag(insn.type));
+        break;
+    case CCB_OP_BINOP:
+        ok = ccbin_put_arith(w, fn, CCBIN_OP_BINOP, insn.sub, insn.type, insn.is_unsigned);
+        break;
+    case CCB_OP_COMPARE:
+        ok = ccbin_put_arith(w, fn, CCBIN_OP_COMPARE, insn.sub, insn.type, insn.is_unsigned);
+        break;
+    case CCB_OP_UNOP:
+        /* neg x -> x * -1, bitnot x -> x ^ ~0, not b -> b ^ 1 (i1 only) */
+        if (insn.sub == CCB_UNOP_NEG && insn.type == CC_TYPE_F64)
+        {
+            double minus_one = -1.0;
+            uint64_t bits;
+            memcpy(&bits, &minus_one, sizeof(bits));
+            ok = ccbin_put_const(w, fn, CC_TYPE_F64, bits, false) &&
+                 ccbin_put_arith(w, fn, CCBIN_OP_BINOP, CCB_BINOP_MUL, CC_TYPE_F64, false);
+        }
+        else if ((insn.sub == CCB_UNOP_NEG || insn.sub == CCB_UNOP_BITNOT) && ccb_ir_type_is_integer(insn.type) &&
+                 insn.type != CC_TYPE_I1)
+        {
+            unsigned bits = ccb_ir_type_bits(insn.type);
+            uint64_t ones = ccb_ir_type_is_signed(insn.type) || bits >= 64 ? UINT64_MAX : (UINT64_C(1) << bits) - 1;
+            ok = ccbin_put_const(w, fn, insn.type, ones, false) &&
+                 ccbin_put_arith(w, fn, CCBIN_OP_BINOP, insn.sub == CCB_UNOP_NEG ? CCB_BINOP_MUL : CCB_BINOP_XOR,
+                                 insn.type, !ccb_ir_type_is_signed(insn.type));
+        }
+        else if (insn.sub == CCB_UNOP_NOT && insn.type == CC_TYPE_I1)
+            ok = ccbin_put_const(w, fn, CC_TYPE_I1, 1, false) &&
+                 ccbin_put_arith(w, fn, CCBIN_OP_BINOP, CCB_BINOP_XOR, CC_TYPE_I1, false);
+        else
+            ok = false;
+        break;
+    case CCB_OP_CONVERT:
+        ok = ccbin_put_op(w, fn, CCBIN_OP_CONVERT) && put_u8(w, b, insn.sub) && put_type(w, b, insn.type) &&
+             put_type(w, b, insn.to_type);
+        break;
+    case CCB_OP_TEST_NULL:
+        ok = ccbin_put_const(w, fn, CC_TYPE_PTR, 0, true) &&
+             ccbin_put_arith(w, fn, CCBIN_OP_COMPARE, CCB_CMP_EQ, CC_TYPE_PTR, false);
+        break;
+    case CCB_OP_CALL:
+    {
+        CcbinTypes args;
+        memset(&args, 0, sizeof(args));
+        ok = insn.symbol && insn.args && ccbin_parse_type_list(w, insn.args, strlen(insn.args), &args) &&
+             ccbin_put_op(w, fn, CCBIN_OP_CALL) && put_string(w, b, insn.symbol, strlen(insn.symbol)) &&
+             put_type(w, b, insn.type) && ccbin_put_types(w, b, &args) && put_u8(w, b, insn.is_varargs);
+        free(args.items);
+        break;
+    }
+    case CCB_OP_RET:
+        ok = ccbin_put_op(w, fn, CCBIN_OP_RET) &&
+             put_u8(w, b, fn->ret != CC_TYPE_VOID && insn.type != CC_TYPE_VOID);
+        break;
+    case CCB_OP_DROP:
+        ok = ccbin_put_op(w, fn, CCBIN_OP_DROP) && put_type(w, b, insn.type);
+        break;
+    case CCB_OP_DUP:
+        ok = ccbin_scratch_local(w, fn, insn.type, &scratch) &&
+             ccbin_put_slot(w, fn, CCBIN_OP_STORE_LOCAL, insn.type, scratch) &&
+             ccbin_put_slot(w, fn, CCBIN_OP_LOAD_LOCAL, insn.type, scratch) &&
+             ccbin_put_slot(w, fn, CCBIN_OP_LOAD_LOCAL, insn.type, scratch);
+        break;
+    case CCB_OP_STACK_ALLOC:
+        ok = insn.index >= 0 && insn.align >= 0 && ccbin_put_op(w, fn, CCBIN_OP_STACK_ALLOC) &&
+             put_u32(w, b, (uint32_t)insn.index) && put_u32(w, b, (uint32_t)insn.align);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+    if (!ok)
+    {
+        const char *tok;
+        size_t len;
+        ccbin_token(line, &tok, &len);
+        ccbin_decline(w, "cannot encode '%.*s'", (int)len, tok);
+        return;
+    }
+    fn->code_end = w->code.len;
+}
+
+static void ccbin_parse_line(CcbinWriter *w, const char *line)
+{
+    ++w->line_no;
+    const char *start = line + strspn(line, " \t");
+    if (!w->saw_header)
+    {
+        if (*start == '\0')
+            return;
+        if (strncmp(start, "ccbytecode ", 11) != 0 || !ccbin_parse_u32(start + 11, strlen(start + 11), &w->bytecode_version) ||
+            w->bytecode_version != 3)
+        {
+            ccbin_decline(w, "unsupported module header");
+            return;
+        }
+        w->saw_header = true;
+        return;
+    }
+    if (*start == '.')
+        ccbin_parse_directive(w, start);
+    else if (w->in_func)
+        ccbin_parse_insn(w, start);
+    else if (*start != '\0')
+        ccbin_decline(w, "instruction outside a function");
+}
+
+CcbinWriter *ccbin_writer_create(void)
+{
+    return (CcbinWriter *)xcalloc(1, sizeof(CcbinWriter));
+}
+
+static void ccbin_function_free(CcbinFunction *fn)
+{
+    free(fn->name);
+    free(fn->params.items);
+    free(fn->locals.items);
+}
+
+void ccbin_writer_free(CcbinWriter *w)
+{
+    if (!w)
+        return;
+    free(w->pending);
+    for (size_t i = 0; i < w->global_count; ++i)
+        free(w->globals[i].name);
+    free(w->globals);
+    for (size_t i = 0; i < w->extern_count; ++i)
+        ccbin_function_free(&w->externs[i]);
+    free(w->externs);
+    for (size_t i = 0; i < w->func_count; ++i)
+        ccbin_function_free(&w->funcs[i]);
+    free(w->funcs);
+    for (size_t i = 0; i < w->no_return_count; ++i)
+        free(w->no_return[i]);
+    free(w->no_return);
+    for (size_t i = 0; i < w->fixup_count; ++i)
+        free(w->fixups[i].symbol);
+    free(w->fixups);
+    free(w->code.data);
+    free(w);
+}
+
+void ccbin_writer_feed(CcbinWriter *w, const char *data, size_t len)
+{
+    while (len > 0 && !w->declined)
+    {
+        const char *nl = memchr(data, '\n', len);
+        size_t chunk = nl ? (size_t)(nl - data) : len;
+        if (!ccbin_grow(w, (void **)&w->pending, &w->pending_cap, w->pending_len + chunk + 1, 1))
+            return;
+        memcpy(w->pending + w->pending_len, data, chunk);
+        w->pending_len += chunk;
+        if (!nl)
+            return;
+        w->pending[w->pending_len] = '\0';
+        if (w->pending_len > 0 && w->pending[w->pending_len - 1] == '\r')
+            w->pending[w->pending_len - 1] = '\0';
+        ccbin_parse_line(w, w->pending);
+        w->pending_len = 0;
+        data += chunk + 1;
+        len -= chunk + 1;
+    }
+}
+
+bool ccbin_writer_encodable(const CcbinWriter *w)
+{
+    return w && !w->declined;
+}
+
+const char *ccbin_writer_reason(const CcbinWriter *w)
+{
+    return w && w->declined ? w->reason : "";
+}
+
+static const CcbinGlobal *ccbin_find_global(const CcbinWriter *w, const char *name)
+{
+    for (size_t i = 0; i < w->global_count; ++i)
+    {
+        if (strcmp(w->globals[i].name, name) == 0)
+            return &w->globals[i];
+    }
+    return NULL;
+}
+
+static bool ccbin_put_signature(CcbinWriter *w, CcbinBuf *b, const CcbinFunction *fn, bool no_return)
+{
+    return put_string(w, b, fn->name, strlen(fn->name)) && put_type(w, b, fn->ret) &&
+           put_u8(w, b, fn->is_varargs) && put_u8(w, b, no_return);
+}
+
+static bool ccbin_assemble(CcbinWriter *w, CcbinBuf *out)
+{
+    for (size_t i = 0; i < w->fixup_count; ++i)
+    {
+        const CcbinGlobal *g = ccbin_find_global(w, w->fixups[i].symbol);
+        uint32_t code;
+        if (!g || !ccbin_type_code(g->type, &code))
+        {
+            ccbin_decline(w, "global '%s' is not defined in the module", w->fixups[i].symbol);
+            return false;
+        }
+        for (int k = 0; k < 4; ++k)
+            w->code.data[w->fixups[i].offset + (size_t)k] = (uint8_t)(code >> (8 * k));
+    }
+
+    uint8_t version[2] = {(uint8_t)(CCBIN_FORMAT_VERSION & 0xFFu), (uint8_t)(CCBIN_FORMAT_VERSION >> 8)};
+    if (!put_bytes(w, out, CCBIN_MAGIC, 5) || !put_bytes(w, out, version, 2) ||
+        !put_u32(w, out, w->bytecode_version))
+        return false;
+
+    if (!put_u32(w, out, (uint32_t)w->global_count))
+        return false;
+    for (size_t i = 0; i < w->global_count; ++i)
+    {
+        const CcbinGlobal *g = &w->globals[i];
+        if (!put_string(w, out, g->name, strlen(g->name)) || !put_type(w, out, g->type) ||
+            !put_u8(w, out, g->is_const) || !put_u8(w, out, 0) || !put_u8(w, out, 1) ||
+            !put_u32(w, out, g->align) || !put_u32(w, out, 0) || !put_u8(w, out, g->has_init))
+            return false;
+        if (g->has_init && !put_u64(w, out, g->init))
+            return false;
+    }
+
+    if (!put_u32(w, out, (uint32_t)w->extern_count))
+        return false;
+    for (size_t i = 0; i < w->extern_count; ++i)
+    {
+        const CcbinFunction *ext = &w->externs[i];
+        bool no_return = ccbin_name_listed(w->no_return, w->no_return_count, ext->name);
+        if (!ccbin_put_signature(w, out, ext, no_return) || !ccbin_put_types(w, out, &ext->params))
+            return false;
+    }
+
+    if (!put_u32(w, out, (uint32_t)w->func_count))
+        return false;
+    static const uint8_t reserved[4] = {0, 0, 0, 0};
+    for (size_t i = 0; i < w->func_count; ++i)
+    {
+        const CcbinFunction *fn = &w->funcs[i];
+        bool no_return = ccbin_name_listed(w->no_return, w->no_return_count, fn->name);
+        if (!ccbin_put_signature(w, out, fn, no_return) || !put_bytes(w, out, reserved, sizeof(reserved)) ||
+            !ccbin_put_types(w, out, &fn->params) || !ccbin_put_types(w, out, &fn->locals) ||
+            !put_u32(w, out, fn->insn_count) ||
+            !put_bytes(w, out, w->code.data + fn->code_start, fn->code_end - fn->code_start))
+            return false;
+    }
+    return true;
+}
+
+int ccbin_writer_finish(CcbinWriter *w, const char *path)
+{
+    if (!w || !path)
+        return 1;
+    if (!w->declined && w->pending_len > 0)
+    {
+        w->pending[w->pending_len] = '\0';
+        ccbin_parse_line(w, w->pending);
+        w->pending_len = 0;
+    }
+    if (!w->declined && w->in_func)
+        ccbin_decline(w, "unterminated function");
+    if (!w->declined && !w->saw_header)
+        ccbin_decline(w, "missing module header");
+
+    CcbinBuf out;
+    memset(&out, 0, sizeof(out));
+    if (w->declined || !ccbin_assemble(w, &out))
+    {
+        free(out.data);
+        return 1;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        fprintf(stderr, "codegen: failed to open '%s': %s\n", path, strerror(errno));
+        free(out.data);
+        return 1;
+    }
+    bool ok = fwrite(out.data, 1, out.len, f) == out.len;
+    if (fclose(f) != 0)
+        ok = false;
+    free(out.data);
+    if (!ok)
+    {
+        fprintf(stderr, "codegen: failed writing '%s'\n", path);
+        remove(path);
+        return 1;
+    }
+    return 0;
+}
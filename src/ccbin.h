@@ -0,0 +1,33 @@
+#ifndef CHANCE_CCBIN_H
+#define CHANCE_CCBIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Direct ccbin serialisation.
+
+   The writer is fed the module text as codegen writes it out and builds
+   the binary module (the format `chancecodec --emit-ccbin` produces) on
+   the side, so library builds and the backend step can skip the text
+   round trip through chancecodec's parser. It only encodes what it knows
+   the loader's layout for; anything else (debug info, data and section
+   globals, literals, indirect calls, ...) makes it decline, and the
+   caller keeps using the text. */
+
+typedef struct CcbinWriter CcbinWriter;
+
+CcbinWriter *ccbin_writer_create(void);
+void ccbin_writer_free(CcbinWriter *w);
+
+/* Accepts module text in arbitrary chunks. */
+void ccbin_writer_feed(CcbinWriter *w, const char *data, size_t len);
+
+/* False once the writer met something it cannot encode. */
+bool ccbin_writer_encodable(const CcbinWriter *w);
+const char *ccbin_writer_reason(const CcbinWriter *w);
+
+/* Writes the module to `path`; returns nonzero when it was not
+   encodable or the file could not be written. */
+int ccbin_writer_finish(CcbinWriter *w, const char *path);
+
+#endif
@@ -1541,11 +1541,10 @@ int ccsim_vm_collapse_hidden_function(char **function_lines, size_t function_lin
 
         if (ccsim_parse_branch_targets(line, tmp_label, sizeof(tmp_label), symbol_name, sizeof(symbol_name)))
         {
+            /* The condition stays on the stack: the region computed it, so
+               the region must not be collapsed into bare stores. */
             if (stack.count > 0)
-            {
-                (void)ccsim_stack_pop(&stack);
                 ccsim_tracef("vm prepare branch at line=%zu", pc);
-            }
             ccsim_tracef("vm barrier control/call at line=%zu", pc);
             CCSIM_VM_FLUSH_REGION(pc);
             continue;
@@ -1626,11 +1625,11 @@ int ccsim_vm_collapse_hidden_function(char **function_lines, size_t function_lin
                         continue;
                 }
 
+                /* Arguments stay on the stack for the same reason as a
+                   branch condition: the call consumes what the region pushed. */
                 int to_pop = arg_count + (is_indirect ? 1 : 0);
                 if (to_pop > (int)stack.count)
                     to_pop = (int)stack.count;
-                for (int i = 0; i < to_pop; ++i)
-                    (void)ccsim_stack_pop(&stack);
                 ccsim_tracef("vm prepare call at line=%zu pop=%d", pc, to_pop);
             }
             ccsim_tracef("vm barrier control/call at line=%zu", pc);
@@ -2108,6 +2107,38 @@ static bool ccsim_find_function_range(char **module_lines, size_t module_line_co
     return false;
 }
 
+/* Only hidden callees are evaluated, and evaluation gives up at the first
+   of these lines that comes before a `ret`; the constant-callee scan needs
+   a `ret` as well. */
+int ccsim_function_body_needed(char **lines, size_t count)
+{
+    char symbol[256] = {0};
+    char ret_type[16] = {0};
+    size_t params_count = 0;
+    bool is_hidden = false;
+    if (!lines || count == 0 ||
+        !ccsim_parse_func_header(lines[0], symbol, sizeof(symbol), ret_type, sizeof(ret_type), &params_count, &is_hidden))
+        return 1;
+    if (!is_hidden)
+        return 0;
+    static const char *const stops[] = {"label ", "jump ", "branch ", "call ", "call_indirect", "addr_global ",
+                                        "load_global ", "store_global ", "load_indirect ", "store_indirect "};
+    for (size_t i = 1; i < count; ++i)
+    {
+        const char *line = ccsim_trim(lines[i]);
+        if (!line || *line == '\0' || *line == '.')
+            continue;
+        if (strncmp(line, "ret", 3) == 0)
+            return 1;
+        for (size_t s = 0; s < sizeof(stops) / sizeof(stops[0]); ++s)
+        {
+            if (strncmp(line, stops[s], strlen(stops[s])) == 0)
+                return 0;
+        }
+    }
+    return 0;
+}
+
 static bool ccsim_eval_hidden_pure_call(char **module_lines, size_t module_line_count,
                                         const char *callee_symbol,
                                         const CcsimValue *args, size_t arg_count,
@@ -39,6 +39,12 @@ extern "C"
                                           const CcsimOptions *options,
                                           CcsimStats *stats);
 
+    /* Whether the function in lines[0..count), from its `.func` header to
+       `.endfunc`, can matter as a callee in the module_lines handed to the
+       calls above. When it cannot, its header and `.endfunc` alone stand in
+       for it. */
+    int ccsim_function_body_needed(char **lines, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
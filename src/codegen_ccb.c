@@ -1,5 +1,11 @@
 #include "ast.h"
+#include "ccb_gvn.h"
+#include "ccb_loop.h"
+#include "ccb_sroa.h"
+#include "ccb_ir.h"
+#include "ccbin.h"
 #include "ccsim.h"
+#include "profile.h"
 #include "cc/bytecode.h"
 
 #include <errno.h>
@@ -11,6 +17,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static bool g_ccb_pointer_32bit = false;
 
@@ -32,15 +39,88 @@ static size_t ccb_pointer_size_bytes(void)
     return g_ccb_pointer_32bit ? 4u : 8u;
 }
 
+/* Bump allocator for line text that is dropped all at once. Chunks are
+   kept across resets, so a list that is filled and emptied repeatedly
+   stops allocating once it has seen its largest batch. */
+#define CCB_ARENA_CHUNK_BYTES 65536u
+
+typedef struct CcbArenaChunk
+{
+    struct CcbArenaChunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+} CcbArenaChunk;
+
+typedef struct
+{
+    CcbArenaChunk *chunks; /* the one being filled comes first */
+    CcbArenaChunk *spare;
+} CcbArena;
+
+static void *ccb_arena_alloc(CcbArena *arena, size_t size)
+{
+    size = (size + 7u) & ~(size_t)7u;
+    CcbArenaChunk *chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size)
+    {
+        CcbArenaChunk **link = &arena->spare;
+        while (*link && (*link)->size < size)
+            link = &(*link)->next;
+        chunk = *link;
+        if (chunk)
+            *link = chunk->next;
+        else
+        {
+            size_t bytes = size > CCB_ARENA_CHUNK_BYTES ? size : CCB_ARENA_CHUNK_BYTES;
+            chunk = (CcbArenaChunk *)malloc(sizeof(CcbArenaChunk) + bytes);
+            if (!chunk)
+                return NULL;
+            chunk->size = bytes;
+        }
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+    void *out = chunk->data + chunk->used;
+    chunk->used += size;
+    return out;
+}
+
+static void ccb_arena_reset(CcbArena *arena)
+{
+    while (arena->chunks)
+    {
+        CcbArenaChunk *chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        chunk->next = arena->spare;
+        arena->spare = chunk;
+    }
+}
+
+static void ccb_arena_free(CcbArena *arena)
+{
+    ccb_arena_reset(arena);
+    while (arena->spare)
+    {
+        CcbArenaChunk *chunk = arena->spare;
+        arena->spare = chunk->next;
+        free(chunk);
+    }
+}
+
 typedef struct
 {
     char **items;
     size_t count;
     size_t capacity;
+    CcbArena *arena; /* owns the items when set; they are never freed one by one */
     uint32_t *debug_files;
     uint32_t *debug_lines;
     uint32_t *debug_columns;
+    CcbInsn *insns; /* decoded items, kept in step when track_insns */
     bool track_debug;
+    bool track_insns;
     bool has_active_debug;
     uint32_t active_debug_file;
     uint32_t active_debug_line;
@@ -54,10 +134,13 @@ static void string_list_init(StringList *list)
     list->items = NULL;
     list->count = 0;
     list->capacity = 0;
+    list->arena = NULL;
     list->debug_files = NULL;
     list->debug_lines = NULL;
     list->debug_columns = NULL;
+    list->insns = NULL;
     list->track_debug = false;
+    list->track_insns = false;
     list->has_active_debug = false;
     list->active_debug_file = 0;
     list->active_debug_line = 0;
@@ -68,19 +151,22 @@ static void string_list_free(StringList *list)
 {
     if (!list)
         return;
-    for (size_t i = 0; i < list->count; ++i)
+    for (size_t i = 0; i < list->count && !list->arena; ++i)
         free(list->items[i]);
     free(list->items);
     free(list->debug_files);
     free(list->debug_lines);
     free(list->debug_columns);
+    free(list->insns);
     list->items = NULL;
     list->count = 0;
     list->capacity = 0;
     list->debug_files = NULL;
     list->debug_lines = NULL;
     list->debug_columns = NULL;
+    list->insns = NULL;
     list->track_debug = false;
+    list->track_insns = false;
     list->has_active_debug = false;
     list->active_debug_file = 0;
     list->active_debug_line = 0;
@@ -162,6 +248,24 @@ static bool string_list_enable_debug_tracking(StringList *list)
     return string_list_resize_debug_storage(list, 0, list->capacity);
 }
 
+static bool string_list_enable_insn_tracking(StringList *list)
+{
+    if (!list)
+        return false;
+    if (list->track_insns)
+        return true;
+    if (list->capacity > 0)
+    {
+        list->insns = (CcbInsn *)malloc(list->capacity * sizeof(CcbInsn));
+        if (!list->insns)
+            return false;
+        for (size_t i = 0; i < list->count; ++i)
+            ccb_insn_decode(list->items[i], &list->insns[i]);
+    }
+    list->track_insns = true;
+    return true;
+}
+
 static void string_list_set_debug_location(StringList *list, uint32_t file, uint32_t line, uint32_t column)
 {
     if (!list)
@@ -250,6 +354,13 @@ static bool string_list_reserve(StringList *list, size_t desired)
         return false;
 
     list->items = new_items;
+    if (list->track_insns)
+    {
+        CcbInsn *new_insns = (CcbInsn *)realloc(list->insns, new_cap * sizeof(CcbInsn));
+        if (!new_insns)
+            return false;
+        list->insns = new_insns;
+    }
     if (list->track_debug)
     {
         if (!string_list_resize_debug_storage(list, old_cap, new_cap))
@@ -266,7 +377,7 @@ static bool string_list_append_copy(StringList *list, const char *src, size_t le
     if (!string_list_reserve(list, list->count + 1))
         return false;
 
-    char *copy = (char *)malloc(len + 1);
+    char *copy = list->arena ? (char *)ccb_arena_alloc(list->arena, len + 1) : (char *)malloc(len + 1);
     if (!copy)
         return false;
     if (src && len)
@@ -275,6 +386,8 @@ static bool string_list_append_copy(StringList *list, const char *src, size_t le
 
     size_t index = list->count;
     list->items[index] = copy;
+    if (list->track_insns)
+        ccb_insn_decode(copy, &list->insns[index]);
     if (list->track_debug && list->debug_files && list->debug_lines && list->debug_columns)
     {
         if (list->has_active_debug)
@@ -354,13 +467,18 @@ static void string_list_remove_range(StringList *list, size_t index, size_t coun
 
     for (size_t i = 0; i < count; ++i)
     {
-        free(list->items[index + i]);
+        if (!list->arena)
+            free(list->items[index + i]);
         list->items[index + i] = NULL;
     }
 
     size_t tail = list->count - (index + count);
     if (tail > 0)
+    {
         memmove(&list->items[index], &list->items[index + count], tail * sizeof(char *));
+        if (list->track_insns)
+            memmove(&list->insns[index], &list->insns[index + count], tail * sizeof(CcbInsn));
+    }
     if (list->track_debug && list->debug_files && list->debug_lines && list->debug_columns)
     {
         if (tail > 0)
@@ -377,15 +495,147 @@ static void string_list_remove_range(StringList *list, size_t index, size_t coun
     list->count -= count;
 }
 
+static bool string_list_insert(StringList *list, size_t index, const char *str)
+{
+    if (!list || index > list->count)
+        return false;
+    if (!string_list_append(list, str))
+        return false;
+    size_t last = list->count - 1;
+    char *item = list->items[last];
+    memmove(&list->items[index + 1], &list->items[index], (last - index) * sizeof(char *));
+    list->items[index] = item;
+    if (list->track_insns)
+    {
+        CcbInsn insn = list->insns[last];
+        memmove(&list->insns[index + 1], &list->insns[index], (last - index) * sizeof(CcbInsn));
+        list->insns[index] = insn;
+    }
+    if (list->track_debug && list->debug_files && list->debug_lines && list->debug_columns)
+    {
+        uint32_t file = list->debug_files[last];
+        uint32_t line = list->debug_lines[last];
+        uint32_t column = list->debug_columns[last];
+        memmove(&list->debug_files[index + 1], &list->debug_files[index], (last - index) * sizeof(uint32_t));
+        memmove(&list->debug_lines[index + 1], &list->debug_lines[index], (last - index) * sizeof(uint32_t));
+        memmove(&list->debug_columns[index + 1], &list->debug_columns[index], (last - index) * sizeof(uint32_t));
+        list->debug_files[index] = file;
+        list->debug_lines[index] = line;
+        list->debug_columns[index] = column;
+    }
+    return true;
+}
+
+/* Takes ownership of `item`; the debug location of the slot is kept. */
+static void string_list_replace(StringList *list, size_t index, char *item)
+{
+    if (!list || index >= list->count)
+    {
+        free(item);
+        return;
+    }
+    if (list->arena)
+    {
+        size_t len = strlen(item);
+        char *copy = (char *)ccb_arena_alloc(list->arena, len + 1);
+        if (copy)
+            memcpy(copy, item, len + 1);
+        free(item);
+        if (!copy)
+            return;
+        item = copy;
+    }
+    else
+        free(list->items[index]);
+    list->items[index] = item;
+    if (list->track_insns)
+        ccb_insn_decode(item, &list->insns[index]);
+}
+
+static const CcbInsn *string_list_insn(const StringList *list, size_t index)
+{
+    static const CcbInsn none = {CCB_OP_NONE};
+    if (!list || !list->track_insns || index >= list->count)
+        return &none;
+    return &list->insns[index];
+}
+
+/* Constant bytes the module keeps in hidden globals, such as the file and
+   variable names handed to null-check diagnostics. Identical sequences share
+   one global, and a sequence that ends another (a NUL-terminated string
+   that is the tail of a longer one) points into it. */
+typedef struct
+{
+    char *symbol;
+    uint8_t *data;
+    size_t len;
+    int unit;          /* unit that defines the global */
+    int declared_unit; /* last unit that declared it extern */
+} CcbPoolEntry;
+
+typedef struct
+{
+    uint64_t hash;
+    size_t entry;      /* index + 1; 0 marks a free slot */
+    size_t offset;
+} CcbPoolSlot;
+
+typedef struct
+{
+    CcbPoolEntry *entries;
+    size_t count;
+    size_t capacity;
+    CcbPoolSlot *slots;  /* every suffix of every entry, by content */
+    size_t slot_count;
+    size_t slot_capacity;
+    int next_id;
+    int unit;            /* units emitted so far */
+    char *prefix;        /* exported symbol prefix when shared, else NULL */
+} CcbConstPool;
+
+typedef struct
+{
+    const char *symbol;
+    size_t offset;
+} CcbPoolRef;
+
+/* A `.extern` or `.no-return` line already in the spool, which the module
+   pass may still drop once every reference is known. */
 typedef struct
 {
-    StringList lines;
+    uint64_t offset;
+    size_t len;
+    char *symbol;
+    bool no_return;
+} CcbSpoolDecl;
+
+typedef struct
+{
+    StringList lines;        /* not yet flushed; items live in line_arena */
+    CcbArena line_arena;
     StringList debug_files;
     StringList defined_funcs;
-    StringList interned_string_keys;
-    StringList interned_string_symbols;
-    int next_interned_string_id;
+    CcbConstPool own_pool;
+    CcbConstPool *pool;      /* own_pool, or the one shared by every unit of a --share-constants library */
     bool emit_debug;
+    StringList profile_keys; /* --profile-generate: one key per counter slot */
+    StringList pure_funcs;   /* emitted functions that touch no memory, for GVN */
+    StringList nothrow_funcs; /* emitted functions that cannot leave an exception pending */
+    bool exc_pending_declared;
+    char *profile_tag;
+    /* Finished lines are flushed to an anonymous temporary file, which is
+       copied behind the header once the .file table is known. */
+    FILE *spool;
+    uint64_t spool_bytes;
+    bool prune_decls;          /* -O2 and up: drop unreferenced externs and no-return tags */
+    StringList used_symbols;   /* referenced from flushed lines, when prune_decls */
+    CcbSpoolDecl *decls;
+    size_t decl_count;
+    size_t decl_capacity;
+    StringList flushed_externs;
+    StringList sim_lines;      /* what ccsim may read of flushed functions; items live in sim_arena */
+    CcbArena sim_arena;
+    CcbArena func_arena;       /* prologue and body of the function being built */
 } CcbModule;
 
 typedef struct
@@ -407,6 +657,12 @@ typedef struct
     bool is_loop;
 } LoopContext;
 
+typedef struct
+{
+    char label[32];  /* the loop's condition label */
+    int factor;      /* [Unroll(N)] */
+} CcbUnrollHint;
+
 typedef struct
 {
     CcbModule *module;
@@ -427,6 +683,9 @@ typedef struct
     size_t loop_depth;
     size_t loop_capacity;
     const char *active_try_error_label;
+    StringList profile_cold_labels;
+    CcbUnrollHint *unroll_hints;
+    size_t unroll_hint_count;
 } CcbFunctionBuilder;
 
 typedef enum
@@ -451,7 +710,9 @@ static bool ccb_store_array_bytes(const Type *array_type, const Node *expr, uint
 static bool ccb_flatten_array_initializer(const Type *array_type, const Node *init, uint8_t **out_bytes, size_t *out_size);
 static bool ccb_flatten_struct_initializer(const Type *struct_type, const Node *init, uint8_t **out_bytes, size_t *out_size);
 static char *ccb_encode_bytes_literal(const uint8_t *data, size_t len);
-static const char *ccb_module_intern_hidden_byte_string(CcbModule *mod, const char *base, const uint8_t *data, size_t len);
+static bool ccb_module_pool_bytes(CcbModule *mod, const char *base, const uint8_t *data, size_t len, bool whole, CcbPoolRef *out);
+static int ccb_emit_pooled_cstring(CcbFunctionBuilder *fb, const char *base, const char *text);
+static void ccb_const_pool_free(CcbConstPool *pool);
 static bool ccb_is_string_ptr_type(const Type *ty);
 static char *ccb_make_string_symbol(const char *base, int index);
 static bool ccb_emit_string_ptr_array_global(CcbModule *mod, const char *name, const Type *array_type, const Node *init,
@@ -526,8 +787,9 @@ static Node *ccb_prepare_hosted_entrypoint(CcbModule *mod, const Node *unit, con
                                            const char **out_hidden_name);
 static int ccb_emit_hosted_entrypoint_shim(CcbModule *mod, const Node *fn, CcbEntrypointShimKind kind,
                                            const char *public_name, const char *hidden_name);
-static void ccb_module_optimize(CcbModule *mod, const CodegenOptions *opts);
+static bool ccb_module_flush(CcbModule *mod);
 static void ccb_function_optimize(CcbFunctionBuilder *fb, const CodegenOptions *opts);
+static void ccb_function_layout_cold_blocks(CcbFunctionBuilder *fb);
 static bool ccb_instruction_is_pure(const char *line);
 static void ccb_opt_prune_dropped_values(CcbFunctionBuilder *fb);
 static void ccb_opt_fold_const_binops(CcbFunctionBuilder *fb);
@@ -565,12 +827,30 @@ static void ccb_module_init(CcbModule *mod)
     if (!mod)
         return;
     string_list_init(&mod->lines);
+    memset(&mod->line_arena, 0, sizeof(mod->line_arena));
+    mod->lines.arena = &mod->line_arena;
     string_list_init(&mod->debug_files);
     string_list_init(&mod->defined_funcs);
-    string_list_init(&mod->interned_string_keys);
-    string_list_init(&mod->interned_string_symbols);
-    mod->next_interned_string_id = 0;
+    memset(&mod->own_pool, 0, sizeof(mod->own_pool));
+    mod->pool = &mod->own_pool;
     mod->emit_debug = false;
+    string_list_init(&mod->profile_keys);
+    string_list_init(&mod->pure_funcs);
+    string_list_init(&mod->nothrow_funcs);
+    mod->exc_pending_declared = false;
+    mod->profile_tag = NULL;
+    mod->spool = NULL;
+    mod->spool_bytes = 0;
+    mod->prune_decls = false;
+    string_list_init(&mod->used_symbols);
+    mod->decls = NULL;
+    mod->decl_count = 0;
+    mod->decl_capacity = 0;
+    string_list_init(&mod->flushed_externs);
+    string_list_init(&mod->sim_lines);
+    memset(&mod->sim_arena, 0, sizeof(mod->sim_arena));
+    mod->sim_lines.arena = &mod->sim_arena;
+    memset(&mod->func_arena, 0, sizeof(mod->func_arena));
 }
 
 
@@ -583,10 +863,30 @@ static void ccb_module_free(CcbModule *mod)
     string_list_free(&mod->lines);
     string_list_free(&mod->debug_files);
     string_list_free(&mod->defined_funcs);
-    string_list_free(&mod->interned_string_keys);
-    string_list_free(&mod->interned_string_symbols);
-    mod->next_interned_string_id = 0;
+    ccb_const_pool_free(&mod->own_pool);
+    mod->pool = NULL;
     mod->emit_debug = false;
+    string_list_free(&mod->profile_keys);
+    string_list_free(&mod->pure_funcs);
+    string_list_free(&mod->nothrow_funcs);
+    free(mod->profile_tag);
+    mod->profile_tag = NULL;
+    if (mod->spool)
+    {
+        fclose(mod->spool);
+        mod->spool = NULL;
+    }
+    string_list_free(&mod->used_symbols);
+    for (size_t i = 0; i < mod->decl_count; ++i)
+        free(mod->decls[i].symbol);
+    free(mod->decls);
+    mod->decls = NULL;
+    mod->decl_count = 0;
+    string_list_free(&mod->flushed_externs);
+    string_list_free(&mod->sim_lines);
+    ccb_arena_free(&mod->sim_arena);
+    ccb_arena_free(&mod->line_arena);
+    ccb_arena_free(&mod->func_arena);
 }
 
 static const char *ccb_label_with_varargs_suffix(const char *base, bool is_varargs,
@@ -685,7 +985,7 @@ static void ccb_module_collect_defined_functions(CcbModule *mod, const Node *uni
     for (int i = 0; i < unit->stmt_count; ++i)
     {
         const Node *decl = unit->stmts[i];
-        if (!decl || decl->kind != ND_FUNC)
+        if (!decl || decl->kind != ND_FUNC || decl->is_unreachable)
             continue;
         const char *name = ccb_effective_function_name(decl);
         if (!name || !*name)
@@ -1251,65 +1551,129 @@ static bool ccb_parse_no_return_symbol(const char *line, char *out, size_t outsz
     return ccb_parse_symbol_after_prefix(line, ".no-return ", out, outsz);
 }
 
-static void ccb_module_optimize(CcbModule *mod, const CodegenOptions *opts)
+static bool ccb_spool_write_line(CcbModule *mod, const char *line)
 {
-    if (!mod || !opts || opts->opt_level < 2 || mod->lines.count == 0)
-        return;
+    if (!line)
+        line = "";
+    size_t len = strlen(line);
+    bool newline = len == 0 || line[len - 1] != '\n';
+    if (fwrite(line, 1, len, mod->spool) != len || (newline && fputc('\n', mod->spool) == EOF))
+        return false;
+    mod->spool_bytes += len + (newline ? 1u : 0u);
+    return true;
+}
+
+static bool ccb_module_note_decl(CcbModule *mod, const char *symbol, bool no_return, uint64_t offset)
+{
+    if (mod->decl_count == mod->decl_capacity)
+    {
+        size_t capacity = mod->decl_capacity ? mod->decl_capacity * 2 : 32;
+        CcbSpoolDecl *decls = (CcbSpoolDecl *)realloc(mod->decls, capacity * sizeof(*decls));
+        if (!decls)
+            return false;
+        mod->decls = decls;
+        mod->decl_capacity = capacity;
+    }
+    CcbSpoolDecl *decl = &mod->decls[mod->decl_count++];
+    decl->offset = offset;
+    decl->len = (size_t)(mod->spool_bytes - offset);
+    decl->symbol = xstrdup(symbol);
+    decl->no_return = no_return;
+    return true;
+}
 
-    StringList used_symbols;
-    string_list_init(&used_symbols);
+/* Keeps a flushed function for ccsim, which reads earlier functions as
+   callees: whole when it may use the body, else just its header and
+   `.endfunc`. */
+static bool ccb_module_keep_for_ccsim(CcbModule *mod, char **lines, size_t count)
+{
+    bool whole = ccsim_function_body_needed(lines, count) != 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if ((whole || i == 0 || i + 1 == count) && !string_list_append(&mod->sim_lines, lines[i]))
+            return false;
+    }
+    return true;
+}
 
+/* Moves the finished lines to the spool, stopping short of a function
+   that has no `.endfunc` yet. Only what later lines can still ask about
+   stays behind: extern names, references and pruning candidates for the
+   module pass, and ccsim's view of each function. */
+static bool ccb_module_flush(CcbModule *mod)
+{
+    size_t cut = mod->lines.count;
     for (size_t i = 0; i < mod->lines.count; ++i)
     {
-        const char *line = mod->lines.items[i];
-        char symbol[256] = {0};
-        if (!ccb_parse_symbol_reference(line, symbol, sizeof(symbol)))
-            continue;
-        if (!string_list_contains(&used_symbols, symbol))
-            string_list_append(&used_symbols, symbol);
+        const char *line = ccb_trim_leading_ws(mod->lines.items[i]);
+        if (line && strncmp(line, ".func ", 6) == 0)
+            cut = i;
+        else if (line && strcmp(line, ".endfunc") == 0)
+            cut = mod->lines.count;
+    }
+    if (cut == 0)
+        return true;
+    if (!mod->spool)
+    {
+        mod->spool = tmpfile();
+        if (!mod->spool)
+        {
+            fprintf(stderr, "codegen: failed to create a temporary file: %s\n", strerror(errno));
+            return false;
+        }
     }
 
-    size_t removed_externs = 0;
-    size_t removed_no_return = 0;
-    for (size_t i = 0; i < mod->lines.count;)
+    size_t func_start = cut;
+    for (size_t i = 0; i < cut; ++i)
     {
         const char *line = mod->lines.items[i];
+        const char *trimmed = ccb_trim_leading_ws(line);
         char symbol[256] = {0};
-
-        if (ccb_parse_extern_symbol(line, symbol, sizeof(symbol)))
+        uint64_t offset = mod->spool_bytes;
+        if (!ccb_spool_write_line(mod, line))
         {
-            if (!string_list_contains(&used_symbols, symbol))
-            {
-                string_list_remove_range(&mod->lines, i, 1);
-                ++removed_externs;
-                continue;
-            }
-            ++i;
-            continue;
+            fprintf(stderr, "codegen: failed writing the temporary file\n");
+            return false;
         }
+        if (!trimmed)
+            continue;
 
-        if (ccb_parse_no_return_symbol(line, symbol, sizeof(symbol)))
+        if (strncmp(trimmed, ".func ", 6) == 0)
+            func_start = i;
+        else if (strcmp(trimmed, ".endfunc") == 0 && func_start < i)
         {
-            bool symbol_is_defined = string_list_contains(&mod->defined_funcs, symbol);
-            bool symbol_is_used = string_list_contains(&used_symbols, symbol);
-            if (!symbol_is_defined && !symbol_is_used)
-            {
-                string_list_remove_range(&mod->lines, i, 1);
-                ++removed_no_return;
-                continue;
-            }
+            if (!ccb_module_keep_for_ccsim(mod, &mod->lines.items[func_start], i - func_start + 1))
+                return false;
+            func_start = cut;
         }
 
-        ++i;
-    }
+        if (ccb_parse_extern_symbol(line, symbol, sizeof(symbol)))
+        {
+            if (!string_list_contains(&mod->flushed_externs, symbol) && !string_list_append(&mod->flushed_externs, symbol))
+                return false;
+            if (mod->prune_decls && !ccb_module_note_decl(mod, symbol, false, offset))
+                return false;
+        }
+        else if (mod->prune_decls && ccb_parse_no_return_symbol(line, symbol, sizeof(symbol)))
+        {
+            if (!ccb_module_note_decl(mod, symbol, true, offset))
+                return false;
+        }
+        else if (strncmp(trimmed, ".global __cert__exc_pending ", 28) == 0)
+            mod->exc_pending_declared = true;
 
-    if (compiler_verbose_enabled() && (removed_externs || removed_no_return))
-    {
-        compiler_verbose_logf("optimizer", "module pass: pruned %zu externs, %zu no-return tags",
-                              removed_externs, removed_no_return);
+        if (mod->prune_decls && ccb_parse_symbol_reference(line, symbol, sizeof(symbol)) &&
+            !string_list_contains(&mod->used_symbols, symbol) && !string_list_append(&mod->used_symbols, symbol))
+            return false;
     }
 
-    string_list_free(&used_symbols);
+    size_t rest = mod->lines.count - cut;
+    if (rest > 0)
+        memmove(mod->lines.items, mod->lines.items + cut, rest * sizeof(char *));
+    mod->lines.count = rest;
+    if (rest == 0)
+        ccb_arena_reset(&mod->line_arena);
+    return true;
 }
 
 static bool ccb_node_uses_tracked_alloc(const Node *node)
@@ -1317,7 +1681,7 @@ static bool ccb_node_uses_tracked_alloc(const Node *node)
     if (!node)
         return false;
 
-    if (node->kind == ND_NEW)
+    if (node->kind == ND_NEW && !node->new_on_stack)
         return true;
 
     if (ccb_node_uses_tracked_alloc(node->lhs) ||
@@ -1372,17 +1736,23 @@ static bool ccb_node_uses_tracked_alloc(const Node *node)
     return false;
 }
 
-static void ccb_function_builder_init(CcbFunctionBuilder *fb, CcbModule *mod, const Node *fn,
+static bool ccb_function_builder_init(CcbFunctionBuilder *fb, CcbModule *mod, const Node *fn,
                                       const CodegenOptions *opts, bool enable_debug)
 {
     if (!fb)
-        return;
+        return false;
     fb->module = mod;
     fb->opts = opts;
     fb->fn = fn;
     fb->ret_type = map_type_to_cc(fn && fn->ret_type ? fn->ret_type : NULL);
     string_list_init(&fb->prologue);
     string_list_init(&fb->body);
+    if (mod)
+    {
+        fb->prologue.arena = &mod->func_arena;
+        fb->body.arena = &mod->func_arena;
+    }
+    bool ok = string_list_enable_insn_tracking(&fb->prologue) && string_list_enable_insn_tracking(&fb->body);
     if (enable_debug)
         string_list_enable_debug_tracking(&fb->body);
     fb->locals = NULL;
@@ -1400,6 +1770,10 @@ static void ccb_function_builder_init(CcbFunctionBuilder *fb, CcbModule *mod, co
     fb->loop_depth = 0;
     fb->loop_capacity = 0;
     fb->active_try_error_label = NULL;
+    string_list_init(&fb->profile_cold_labels);
+    fb->unroll_hints = NULL;
+    fb->unroll_hint_count = 0;
+    return ok;
 }
 
 static void ccb_function_builder_free(CcbFunctionBuilder *fb)
@@ -1408,6 +1782,10 @@ static void ccb_function_builder_free(CcbFunctionBuilder *fb)
         return;
     string_list_free(&fb->prologue);
     string_list_free(&fb->body);
+    /* Functions are built one at a time, and their lines have been copied
+       into the module by now. */
+    if (fb->module)
+        ccb_arena_reset(&fb->module->func_arena);
     free(fb->locals);
     fb->locals = NULL;
     fb->locals_count = 0;
@@ -1424,6 +1802,10 @@ static void ccb_function_builder_free(CcbFunctionBuilder *fb)
     fb->loop_depth = 0;
     fb->loop_capacity = 0;
     fb->active_try_error_label = NULL;
+    string_list_free(&fb->profile_cold_labels);
+    free(fb->unroll_hints);
+    fb->unroll_hints = NULL;
+    fb->unroll_hint_count = 0;
 }
 
 static char *ccb_dup_absolute_path(const char *path)
@@ -1499,12 +1881,70 @@ static int ccb_emit_expr_basic(CcbFunctionBuilder *fb, const Node *expr)
     return rc;
 }
 
+/* Pushes the runtime's pending-exception flag, which it exports so a poll
+   is a load rather than a call. */
+static int ccb_emit_exception_pending(CcbFunctionBuilder *fb)
+{
+    CcbModule *mod = fb ? fb->module : NULL;
+    if (!mod)
+        return 1;
+    if (!mod->exc_pending_declared)
+    {
+        bool defined = false;
+        for (size_t i = 0; i < mod->lines.count && !defined; ++i)
+        {
+            const char *line = ccb_trim_leading_ws(mod->lines.items[i]);
+            defined = line && strncmp(line, ".global __cert__exc_pending ", 28) == 0;
+        }
+        if (!defined && !ccb_module_appendf(mod, ".global __cert__exc_pending type=%s extern", cc_type_name(CC_TYPE_I32)))
+            return 1;
+        mod->exc_pending_declared = true;
+    }
+    return ccb_emit_load_global(&fb->body, "__cert__exc_pending") ? 0 : 1;
+}
+
+static bool ccb_callee_is_nothrow(const CcbModule *mod, const char *callee)
+{
+    return mod && callee && string_list_contains(&mod->nothrow_funcs, callee);
+}
+
+/* Whether code emitted from `start` on may leave an exception pending:
+   only calls reach the runtime's error paths, so a stretch whose calls all
+   go to functions known not to throw cannot. */
+static bool ccb_body_may_throw(const CcbFunctionBuilder *fb, const StringList *list, size_t start)
+{
+    if (!list->track_insns)
+        return true;
+    for (size_t i = start; i < list->count; ++i)
+    {
+        const CcbInsn *insn = string_list_insn(list, i);
+        switch (insn->op)
+        {
+        case CCB_OP_CALL:
+            if (!ccb_callee_is_nothrow(fb->module, insn->symbol))
+                return true;
+            break;
+        case CCB_OP_STORE_GLOBAL:
+            if (insn->symbol && strcmp(insn->symbol, "__cert__exc_pending") == 0)
+                return true;
+            break;
+        case CCB_OP_CALL_INDIRECT:
+        case CCB_OP_JUMP_INDIRECT:
+        case CCB_OP_OTHER:
+            return true;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
 static int ccb_emit_active_try_pending_branch(CcbFunctionBuilder *fb)
 {
     if (!fb || !fb->active_try_error_label || !fb->active_try_error_label[0])
         return 0;
 
-    if (!string_list_appendf(&fb->body, "  call __cert__exception_has_pending i32 ()"))
+    if (ccb_emit_exception_pending(fb))
         return 1;
     if (!ccb_emit_const_zero(&fb->body, CC_TYPE_I32))
         return 1;
@@ -1575,6 +2015,19 @@ static int ccb_append_function_body(CcbModule *mod, const CcbFunctionBuilder *fb
     return 0;
 }
 
+static int ccb_unroll_hint_add(CcbFunctionBuilder *fb, const char *label, int factor)
+{
+    CcbUnrollHint *grown = (CcbUnrollHint *)realloc(fb->unroll_hints, (fb->unroll_hint_count + 1) * sizeof(CcbUnrollHint));
+    if (!grown)
+        return 0;
+    fb->unroll_hints = grown;
+    CcbUnrollHint *hint = &grown[fb->unroll_hint_count++];
+    strncpy(hint->label, label, sizeof(hint->label) - 1);
+    hint->label[sizeof(hint->label) - 1] = '\0';
+    hint->factor = factor;
+    return 1;
+}
+
 static int ccb_loop_push(CcbFunctionBuilder *fb, const char *break_label, const char *continue_label, bool is_loop)
 {
     if (!fb || !break_label)
@@ -1886,24 +2339,11 @@ static bool ccb_instruction_is_drop(const char *line)
     return strncmp(line, "drop ", 5) == 0;
 }
 
-static bool ccb_parse_local_index(const char *line, const char *prefix, int *out_index)
+static bool ccb_parse_local_index(const CcbInsn *insn, CcbOpcode op, int *out_index)
 {
-    if (!line || !prefix || !out_index)
-        return false;
-    line = ccb_trim_leading_ws(line);
-    size_t len = strlen(prefix);
-    if (strncmp(line, prefix, len) != 0)
+    if (!insn || !out_index || insn->op != op)
         return false;
-    const char *cursor = line + len;
-    while (*cursor == ' ' || *cursor == '\t')
-        ++cursor;
-    if (*cursor == '\0')
-        return false;
-    char *endptr = NULL;
-    long value = strtol(cursor, &endptr, 10);
-    if (endptr == cursor || (*endptr && !isspace((unsigned char)*endptr)))
-        return false;
-    *out_index = (int)value;
+    *out_index = insn->index;
     return true;
 }
 
@@ -1957,179 +2397,74 @@ typedef struct
     long long s;
 } CcbConstInfo;
 
-static bool ccb_parse_const_info(const char *line, CcbConstInfo *out)
+static bool ccb_parse_const_info(const CcbInsn *insn, CcbConstInfo *out)
 {
-    if (!line || !out)
-        return false;
-
-    while (*line == ' ' || *line == '\t')
-        ++line;
-    if (strncmp(line, "const_str", 9) == 0)
-        return false;
-    if (strncmp(line, "const ", 6) != 0)
-        return false;
-    line += 6;
-
-    char type_name[16];
-    char value_text[128];
-    if (sscanf(line, "%15s %127s", type_name, value_text) != 2)
-        return false;
-
-    unsigned width = ccb_type_bit_width_from_name(type_name);
-    if (width == 0)
-        return false;
-    bool is_ptr = ccb_type_is_ptr_name(type_name);
-    if (!ccb_type_is_integer_name(type_name) && !is_ptr)
+    if (!insn || !out || insn->op != CCB_OP_CONST || !insn->has_imm)
         return false;
 
-    bool is_signed = ccb_type_is_signed_name(type_name);
-    char *endptr = NULL;
-    errno = 0;
-    unsigned long long uval = 0;
-    long long sval = 0;
-    if (is_ptr && strcmp(value_text, "null") == 0)
-    {
-        uval = 0;
-        sval = 0;
-    }
-    else if (is_signed)
-    {
-        sval = strtoll(value_text, &endptr, 0);
-        if (endptr == value_text || *endptr != '\0' || errno == ERANGE)
-            return false;
-        uval = (unsigned long long)sval;
-    }
-    else
-    {
-        uval = strtoull(value_text, &endptr, 0);
-        if (endptr == value_text || *endptr != '\0' || errno == ERANGE)
-            return false;
-        sval = (long long)uval;
-    }
-
-    unsigned long long mask = ccb_mask_for_width(width);
-    uval &= mask;
-    sval = is_signed ? ccb_sign_extend(uval, width) : (long long)uval;
-
+    const char *type_name = ccb_ir_type_name(insn->type);
     strncpy(out->type, type_name, sizeof(out->type) - 1);
     out->type[sizeof(out->type) - 1] = '\0';
-    out->width = width;
-    out->is_signed = is_signed;
-    out->u = uval;
-    out->s = sval;
+    out->width = ccb_ir_type_bits(insn->type);
+    out->is_signed = ccb_ir_type_is_signed(insn->type);
+    out->u = insn->imm;
+    out->s = out->is_signed ? ccb_insn_imm_signed(insn) : (long long)insn->imm;
     return true;
 }
 
-static bool ccb_parse_unop_info(const char *line, char *op_buf, size_t op_sz,
+static bool ccb_parse_unop_info(const CcbInsn *insn, char *op_buf, size_t op_sz,
                                 char *type_buf, size_t type_sz)
 {
-    if (!line || !op_buf || !type_buf)
-        return false;
-
-    while (*line == ' ' || *line == '\t')
-        ++line;
-    if (strncmp(line, "unop ", 5) != 0)
+    if (!insn || !op_buf || !type_buf || insn->op != CCB_OP_UNOP)
         return false;
-    line += 5;
 
-    char op[16];
-    char type_name[16];
-    if (sscanf(line, "%15s %15s", op, type_name) != 2)
-        return false;
-
-    strncpy(op_buf, op, op_sz - 1);
+    strncpy(op_buf, ccb_ir_unop_name((CcbUnop)insn->sub), op_sz - 1);
     op_buf[op_sz - 1] = '\0';
-    strncpy(type_buf, type_name, type_sz - 1);
+    strncpy(type_buf, ccb_ir_type_name(insn->type), type_sz - 1);
     type_buf[type_sz - 1] = '\0';
     return true;
 }
 
-static bool ccb_parse_compare_info(const char *line, char *op_buf, size_t op_sz,
+static bool ccb_parse_compare_info(const CcbInsn *insn, char *op_buf, size_t op_sz,
                                    char *type_buf, size_t type_sz, bool *is_unsigned)
 {
-    if (!line || !op_buf || !type_buf || !is_unsigned)
-        return false;
-
-    while (*line == ' ' || *line == '\t')
-        ++line;
-    if (strncmp(line, "compare ", 8) != 0)
-        return false;
-    line += 8;
-
-    char op[16];
-    char type_name[16];
-    char extra[16];
-    int parsed = sscanf(line, "%15s %15s %15s", op, type_name, extra);
-    if (parsed < 2)
+    if (!insn || !op_buf || !type_buf || !is_unsigned || insn->op != CCB_OP_COMPARE)
         return false;
 
-    bool unsigned_hint = false;
-    if (parsed >= 3 && strcmp(extra, "unsigned") == 0)
-        unsigned_hint = true;
-
-    strncpy(op_buf, op, op_sz - 1);
+    strncpy(op_buf, ccb_ir_compare_name((CcbCompare)insn->sub), op_sz - 1);
     op_buf[op_sz - 1] = '\0';
-    strncpy(type_buf, type_name, type_sz - 1);
+    strncpy(type_buf, ccb_ir_type_name(insn->type), type_sz - 1);
     type_buf[type_sz - 1] = '\0';
-    *is_unsigned = unsigned_hint;
+    *is_unsigned = insn->is_unsigned != 0;
     return true;
 }
 
-static bool ccb_parse_convert_info(const char *line, char *kind_buf, size_t kind_sz,
+static bool ccb_parse_convert_info(const CcbInsn *insn, char *kind_buf, size_t kind_sz,
                                    char *from_buf, size_t from_sz, char *to_buf, size_t to_sz)
 {
-    if (!line || !kind_buf || !from_buf || !to_buf)
-        return false;
-
-    while (*line == ' ' || *line == '\t')
-        ++line;
-    if (strncmp(line, "convert ", 8) != 0)
-        return false;
-    line += 8;
-
-    char kind[16];
-    char from_name[16];
-    char to_name[16];
-    if (sscanf(line, "%15s %15s %15s", kind, from_name, to_name) != 3)
+    if (!insn || !kind_buf || !from_buf || !to_buf || insn->op != CCB_OP_CONVERT)
         return false;
 
-    strncpy(kind_buf, kind, kind_sz - 1);
+    strncpy(kind_buf, ccb_ir_convert_name((CCConvertKind)insn->sub), kind_sz - 1);
     kind_buf[kind_sz - 1] = '\0';
-    strncpy(from_buf, from_name, from_sz - 1);
+    strncpy(from_buf, ccb_ir_type_name(insn->type), from_sz - 1);
     from_buf[from_sz - 1] = '\0';
-    strncpy(to_buf, to_name, to_sz - 1);
+    strncpy(to_buf, ccb_ir_type_name(insn->to_type), to_sz - 1);
     to_buf[to_sz - 1] = '\0';
     return true;
 }
 
-static bool ccb_parse_binop_info(const char *line, char *op_buf, size_t op_sz,
+static bool ccb_parse_binop_info(const CcbInsn *insn, char *op_buf, size_t op_sz,
                                  char *type_buf, size_t type_sz, bool *is_unsigned)
 {
-    if (!line || !op_buf || !type_buf || !is_unsigned)
+    if (!insn || !op_buf || !type_buf || !is_unsigned || insn->op != CCB_OP_BINOP)
         return false;
 
-    while (*line == ' ' || *line == '\t')
-        ++line;
-    if (strncmp(line, "binop ", 6) != 0)
-        return false;
-    line += 6;
-
-    char op[16];
-    char type_name[16];
-    char extra[16];
-    int parsed = sscanf(line, "%15s %15s %15s", op, type_name, extra);
-    if (parsed < 2)
-        return false;
-
-    bool unsigned_hint = false;
-    if (parsed >= 3 && strcmp(extra, "unsigned") == 0)
-        unsigned_hint = true;
-
-    strncpy(op_buf, op, op_sz - 1);
+    strncpy(op_buf, ccb_ir_binop_name((CcbBinop)insn->sub), op_sz - 1);
     op_buf[op_sz - 1] = '\0';
-    strncpy(type_buf, type_name, type_sz - 1);
+    strncpy(type_buf, ccb_ir_type_name(insn->type), type_sz - 1);
     type_buf[type_sz - 1] = '\0';
-    *is_unsigned = unsigned_hint;
+    *is_unsigned = insn->is_unsigned != 0;
     return true;
 }
 
@@ -2184,6 +2519,8 @@ static int ccb_module_has_extern(const CcbModule *mod, const char *name)
 {
     if (!mod || !name)
         return 0;
+    if (string_list_contains(&mod->flushed_externs, name))
+        return 1;
     for (size_t i = 0; i < mod->lines.count; ++i)
     {
         const char *line = mod->lines.items[i];
@@ -2212,9 +2549,10 @@ static int ccb_module_has_function(const CcbModule *mod, const char *name)
         return 0;
     if (string_list_contains(&mod->defined_funcs, name))
         return 1;
-    for (size_t i = 0; i < mod->lines.count; ++i)
+    size_t total = mod->sim_lines.count + mod->lines.count;
+    for (size_t i = 0; i < total; ++i)
     {
-        const char *line = mod->lines.items[i];
+        const char *line = i < mod->sim_lines.count ? mod->sim_lines.items[i] : mod->lines.items[i - mod->sim_lines.count];
         line = ccb_trim_leading_ws(line);
         if (!line || strncmp(line, ".func ", 6) != 0)
             continue;
@@ -2346,62 +2684,33 @@ static int ccb_ensure_runtime_extern(CcbFunctionBuilder *fb, const char *name, c
     return 0;
 }
 
-static bool ccb_parse_load_ref(const char *line, const char **op, int *index)
+static bool ccb_parse_load_ref(const CcbInsn *insn, const char **op, int *index)
 {
-    if (!line || !op || !index)
+    if (!insn || !op || !index)
         return false;
-    line = ccb_trim_leading_ws(line);
-    if (strncmp(line, "load_local ", 11) == 0)
-    {
-        line += 11;
+    if (insn->op == CCB_OP_LOAD_LOCAL)
         *op = "load_local";
-    }
-    else if (strncmp(line, "load_param ", 11) == 0)
-    {
-        line += 11;
+    else if (insn->op == CCB_OP_LOAD_PARAM)
         *op = "load_param";
-    }
     else
-    {
-        return false;
-    }
-    char *endptr = NULL;
-    long val = strtol(line, &endptr, 10);
-    if (endptr == line || (*endptr && !isspace((unsigned char)*endptr)))
         return false;
-    *index = (int)val;
+    *index = insn->index;
     return true;
 }
 
-static bool ccb_parse_const_i32(const char *line, int *value)
+static bool ccb_parse_const_i32(const CcbInsn *insn, int *value)
 {
-    if (!line || !value)
-        return false;
-    line = ccb_trim_leading_ws(line);
-    if (strncmp(line, "const i32 ", 10) != 0)
-        return false;
-    line += 10;
-    char *endptr = NULL;
-    long val = strtol(line, &endptr, 10);
-    if (endptr == line || (*endptr && !isspace((unsigned char)*endptr)))
+    if (!insn || !value || insn->op != CCB_OP_CONST || insn->type != CC_TYPE_I32 || !insn->has_imm)
         return false;
-    *value = (int)val;
+    *value = (int)ccb_insn_imm_signed(insn);
     return true;
 }
 
-static bool ccb_parse_const_i64(const char *line, long long *value)
+static bool ccb_parse_const_i64(const CcbInsn *insn, long long *value)
 {
-    if (!line || !value)
-        return false;
-    line = ccb_trim_leading_ws(line);
-    if (strncmp(line, "const i64 ", 10) != 0)
+    if (!insn || !value || insn->op != CCB_OP_CONST || insn->type != CC_TYPE_I64 || !insn->has_imm)
         return false;
-    line += 10;
-    char *endptr = NULL;
-    long long val = strtoll(line, &endptr, 10);
-    if (endptr == line || (*endptr && !isspace((unsigned char)*endptr)))
-        return false;
-    *value = val;
+    *value = ccb_insn_imm_signed(insn);
     return true;
 }
 
@@ -2420,67 +2729,41 @@ static bool ccb_is_prefix_line(const char *line, const char *prefix)
     return strncmp(line, prefix, len) == 0;
 }
 
-static bool ccb_parse_label_name(const char *line, char *out, size_t outsz)
+static bool ccb_copy_insn_symbol(const char *symbol, char *out, size_t outsz)
 {
-    if (!line || !out || outsz == 0)
-        return false;
-    line = ccb_trim_leading_ws(line);
-    if (strncmp(line, "label ", 6) != 0)
+    if (!symbol || !out || outsz == 0)
         return false;
-    const char *cursor = line + 6;
-    while (*cursor == ' ' || *cursor == '\t')
-        ++cursor;
-    if (*cursor == '\0')
+    size_t len = strlen(symbol);
+    if (len >= outsz)
+        len = outsz - 1;
+    memcpy(out, symbol, len);
+    out[len] = '\0';
+    return len > 0;
+}
+
+static bool ccb_parse_label_name(const CcbInsn *insn, char *out, size_t outsz)
+{
+    if (!insn || insn->op != CCB_OP_LABEL)
         return false;
-    size_t pos = 0;
-    while (*cursor && !isspace((unsigned char)*cursor) && pos + 1 < outsz)
-        out[pos++] = *cursor++;
-    out[pos] = '\0';
-    return pos > 0;
+    return ccb_copy_insn_symbol(insn->symbol, out, outsz);
 }
 
-static bool ccb_parse_branch_targets(const char *line, char *true_label,
+static bool ccb_parse_branch_targets(const CcbInsn *insn, char *true_label,
                                      size_t true_sz, char *false_label,
                                      size_t false_sz)
 {
-    if (!line || !true_label || !false_label || true_sz == 0 || false_sz == 0)
+    if (!insn || insn->op != CCB_OP_BRANCH)
         return false;
-    line = ccb_trim_leading_ws(line);
-    if (strncmp(line, "branch ", 7) != 0)
-        return false;
-    const char *cursor = line + 7;
-    while (*cursor == ' ' || *cursor == '\t')
-        ++cursor;
-    size_t pos = 0;
-    while (*cursor && !isspace((unsigned char)*cursor) && pos + 1 < true_sz)
-        true_label[pos++] = *cursor++;
-    true_label[pos] = '\0';
-    while (*cursor == ' ' || *cursor == '\t')
-        ++cursor;
-    pos = 0;
-    while (*cursor && !isspace((unsigned char)*cursor) && pos + 1 < false_sz)
-        false_label[pos++] = *cursor++;
-    false_label[pos] = '\0';
-    return true_label[0] != '\0' && false_label[0] != '\0';
+    bool ok_true = ccb_copy_insn_symbol(insn->symbol, true_label, true_sz);
+    bool ok_false = ccb_copy_insn_symbol(insn->symbol2, false_label, false_sz);
+    return ok_true && ok_false;
 }
 
-static bool ccb_parse_jump_target(const char *line, char *out, size_t outsz)
+static bool ccb_parse_jump_target(const CcbInsn *insn, char *out, size_t outsz)
 {
-    if (!line || !out || outsz == 0)
-        return false;
-    line = ccb_trim_leading_ws(line);
-    if (strncmp(line, "jump ", 5) != 0)
-        return false;
-    const char *cursor = line + 5;
-    while (*cursor == ' ' || *cursor == '\t')
-        ++cursor;
-    if (*cursor == '\0')
+    if (!insn || insn->op != CCB_OP_JUMP)
         return false;
-    size_t pos = 0;
-    while (*cursor && !isspace((unsigned char)*cursor) && pos + 1 < outsz)
-        out[pos++] = *cursor++;
-    out[pos] = '\0';
-    return pos > 0;
+    return ccb_copy_insn_symbol(insn->symbol, out, outsz);
 }
 
 static bool ccb_parse_zero_store_at_offset(const StringList *body, size_t index,
@@ -2492,21 +2775,19 @@ static bool ccb_parse_zero_store_at_offset(const StringList *body, size_t index,
     if (index + 6 >= body->count)
         return false;
 
-    const char *line0 = body->items[index + 0];
     const char *line1 = body->items[index + 1];
-    const char *line2 = body->items[index + 2];
     const char *line3 = body->items[index + 3];
     const char *line4 = body->items[index + 4];
     const char *line5 = body->items[index + 5];
     const char *line6 = body->items[index + 6];
     const char *line7 = (index + 7 < body->count) ? body->items[index + 7] : NULL;
 
-    if (!ccb_parse_load_ref(line0, load_op, load_index))
+    if (!ccb_parse_load_ref(string_list_insn(body, index), load_op, load_index))
         return false;
     if (!ccb_is_exact_line(line1, "convert bitcast ptr i64"))
         return false;
 
-    if (ccb_parse_const_i32(line2, offset))
+    if (ccb_parse_const_i32(string_list_insn(body, index + 2), offset))
     {
         if (!ccb_is_exact_line(line3, "convert sext i32 i64") &&
             !ccb_is_exact_line(line3, "convert zext i32 i64"))
@@ -2524,7 +2805,7 @@ static bool ccb_parse_zero_store_at_offset(const StringList *body, size_t index,
     }
 
     long long offset64 = 0;
-    if (!ccb_parse_const_i64(line2, &offset64))
+    if (!ccb_parse_const_i64(string_list_insn(body, index + 2), &offset64))
         return false;
     if (offset64 < INT_MIN || offset64 > INT_MAX)
         return false;
@@ -2606,24 +2887,11 @@ static bool ccb_is_byte_store_line(const char *line)
     return strcmp(line, "store_indirect i8") == 0 || strcmp(line, "store_indirect u8") == 0;
 }
 
-static bool ccb_parse_store_indirect_width(const char *line, int *out_width_bytes)
+static bool ccb_parse_store_indirect_width(const CcbInsn *insn, int *out_width_bytes)
 {
-    if (!line || !out_width_bytes)
-        return false;
-    line = ccb_trim_leading_ws(line);
-    if (strncmp(line, "store_indirect ", 15) != 0)
-        return false;
-    line += 15;
-    while (*line == ' ' || *line == '\t')
-        ++line;
-    if (*line == '\0')
+    if (!insn || !out_width_bytes || insn->op != CCB_OP_STORE_INDIRECT)
         return false;
-    char type_name[16] = {0};
-    size_t pos = 0;
-    while (*line && !isspace((unsigned char)*line) && pos + 1 < sizeof(type_name))
-        type_name[pos++] = *line++;
-    type_name[pos] = '\0';
-    unsigned bits = ccb_type_bit_width_from_name(type_name);
+    unsigned bits = ccb_ir_type_bits(insn->type);
     if (bits == 0 || bits % 8 != 0)
         return false;
     *out_width_bytes = (int)(bits / 8);
@@ -2642,7 +2910,7 @@ static bool ccb_parse_indirect_store_pattern(const StringList *body, size_t star
     size_t p = ccb_skip_loc_directives(body, start);
     if (p >= body->count)
         return false;
-    if (!ccb_parse_load_ref(body->items[p], &out->load_op, &out->load_index))
+    if (!ccb_parse_load_ref(string_list_insn(body, p), &out->load_op, &out->load_index))
         return false;
 
     int offset = 0;
@@ -2654,7 +2922,7 @@ static bool ccb_parse_indirect_store_pattern(const StringList *body, size_t star
     {
         p_next = ccb_skip_loc_directives(body, p_next + 1);
         long long offset_i64 = 0;
-        if (!ccb_parse_const_i64(body->items[p_next], &offset_i64))
+        if (!ccb_parse_const_i64(string_list_insn(body, p_next), &offset_i64))
             return false;
         if (offset_i64 < INT_MIN || offset_i64 > INT_MAX)
             return false;
@@ -2678,14 +2946,14 @@ static bool ccb_parse_indirect_store_pattern(const StringList *body, size_t star
     if (p_next >= body->count)
         return false;
     CcbConstInfo cinfo;
-    if (!ccb_parse_const_info(body->items[p_next], &cinfo))
+    if (!ccb_parse_const_info(string_list_insn(body, p_next), &cinfo))
         return false;
 
     p_next = ccb_skip_loc_directives(body, p_next + 1);
     if (p_next >= body->count)
         return false;
     int width_bytes = 0;
-    if (!ccb_parse_store_indirect_width(body->items[p_next], &width_bytes))
+    if (!ccb_parse_store_indirect_width(string_list_insn(body, p_next), &width_bytes))
         return false;
 
     out->offset = offset;
@@ -2705,7 +2973,7 @@ static bool ccb_parse_byte_store_pattern(const StringList *body, size_t start, C
     size_t p = ccb_skip_loc_directives(body, start);
     if (p >= body->count)
         return false;
-    if (!ccb_parse_load_ref(body->items[p], &out->load_op, &out->load_index))
+    if (!ccb_parse_load_ref(string_list_insn(body, p), &out->load_op, &out->load_index))
         return false;
 
     p = ccb_skip_loc_directives(body, p + 1);
@@ -2718,7 +2986,7 @@ static bool ccb_parse_byte_store_pattern(const StringList *body, size_t start, C
 
     int offset_i32 = 0;
     long long offset_i64 = 0;
-    if (ccb_parse_const_i32(body->items[p], &offset_i32))
+    if (ccb_parse_const_i32(string_list_insn(body, p), &offset_i32))
     {
         out->offset = offset_i32;
 
@@ -2739,7 +3007,7 @@ static bool ccb_parse_byte_store_pattern(const StringList *body, size_t start, C
     }
     else
     {
-        if (!ccb_parse_const_i64(body->items[p], &offset_i64))
+        if (!ccb_parse_const_i64(string_list_insn(body, p), &offset_i64))
             return false;
         if (offset_i64 < INT_MIN || offset_i64 > INT_MAX)
             return false;
@@ -2759,7 +3027,7 @@ static bool ccb_parse_byte_store_pattern(const StringList *body, size_t start, C
         return false;
 
     CcbConstInfo cinfo;
-    if (!ccb_parse_const_info(body->items[p], &cinfo))
+    if (!ccb_parse_const_info(string_list_insn(body, p), &cinfo))
         return false;
     if (!(strcmp(cinfo.type, "i8") == 0 || strcmp(cinfo.type, "u8") == 0))
         return false;
@@ -2824,7 +3092,7 @@ static bool ccb_parse_const_store_block(const StringList *body, size_t start,
     while (p < body->count)
     {
         CcbConstInfo cinfo;
-        if (ccb_parse_const_info(body->items[p], &cinfo))
+        if (ccb_parse_const_info(string_list_insn(body, p), &cinfo))
         {
             size_t store_line = ccb_skip_loc_directives(body, p + 1);
             if (store_line >= body->count)
@@ -2912,7 +3180,7 @@ static bool ccb_parse_or_store_block(const StringList *body, size_t start,
         q = ccb_skip_loc_directives(body, q + 1);
 
         CcbConstInfo direct_const;
-        if (q < body->count && ccb_parse_const_info(body->items[q], &direct_const) &&
+        if (q < body->count && ccb_parse_const_info(string_list_insn(body, q), &direct_const) &&
             strcmp(direct_const.type, type_name) == 0)
         {
             q = ccb_skip_loc_directives(body, q + 1);
@@ -2921,7 +3189,7 @@ static bool ccb_parse_or_store_block(const StringList *body, size_t start,
             char op_type[16] = {0};
             bool unsigned_hint = false;
             if (q < body->count &&
-                ccb_parse_binop_info(body->items[q], op_name, sizeof(op_name), op_type, sizeof(op_type), &unsigned_hint) &&
+                ccb_parse_binop_info(string_list_insn(body, q), op_name, sizeof(op_name), op_type, sizeof(op_type), &unsigned_hint) &&
                 strcmp(op_name, "or") == 0 && strcmp(op_type, type_name) == 0)
             {
                 (void)unsigned_hint;
@@ -2940,12 +3208,12 @@ static bool ccb_parse_or_store_block(const StringList *body, size_t start,
 
     int ptr_idx = -1;
     int val_idx = -1;
-    if (p >= body->count || !ccb_parse_local_index(body->items[p], "store_local", &ptr_idx))
+    if (p >= body->count || !ccb_parse_local_index(string_list_insn(body, p), CCB_OP_STORE_LOCAL, &ptr_idx))
         return false;
     p = ccb_skip_loc_directives(body, p + 1);
 
     int idx = -1;
-    if (p >= body->count || !ccb_parse_local_index(body->items[p], "load_local", &idx) || idx != ptr_idx)
+    if (p >= body->count || !ccb_parse_local_index(string_list_insn(body, p), CCB_OP_LOAD_LOCAL, &idx) || idx != ptr_idx)
         return false;
     p = ccb_skip_loc_directives(body, p + 1);
 
@@ -2954,16 +3222,16 @@ static bool ccb_parse_or_store_block(const StringList *body, size_t start,
         return false;
     p = ccb_skip_loc_directives(body, p + 1);
 
-    if (p >= body->count || !ccb_parse_local_index(body->items[p], "store_local", &val_idx))
+    if (p >= body->count || !ccb_parse_local_index(string_list_insn(body, p), CCB_OP_STORE_LOCAL, &val_idx))
         return false;
     p = ccb_skip_loc_directives(body, p + 1);
 
-    if (p >= body->count || !ccb_parse_local_index(body->items[p], "load_local", &idx) || idx != val_idx)
+    if (p >= body->count || !ccb_parse_local_index(string_list_insn(body, p), CCB_OP_LOAD_LOCAL, &idx) || idx != val_idx)
         return false;
     p = ccb_skip_loc_directives(body, p + 1);
 
     CcbConstInfo cinfo;
-    if (p >= body->count || !ccb_parse_const_info(body->items[p], &cinfo) || strcmp(cinfo.type, type_name) != 0)
+    if (p >= body->count || !ccb_parse_const_info(string_list_insn(body, p), &cinfo) || strcmp(cinfo.type, type_name) != 0)
         return false;
     out->or_value = cinfo.u;
     p = ccb_skip_loc_directives(body, p + 1);
@@ -2972,21 +3240,21 @@ static bool ccb_parse_or_store_block(const StringList *body, size_t start,
     char op_type[16] = {0};
     bool unsigned_hint = false;
     if (p >= body->count ||
-        !ccb_parse_binop_info(body->items[p], op_name, sizeof(op_name), op_type, sizeof(op_type), &unsigned_hint) ||
+        !ccb_parse_binop_info(string_list_insn(body, p), op_name, sizeof(op_name), op_type, sizeof(op_type), &unsigned_hint) ||
         strcmp(op_name, "or") != 0 || strcmp(op_type, type_name) != 0)
         return false;
     (void)unsigned_hint;
     p = ccb_skip_loc_directives(body, p + 1);
 
-    if (p >= body->count || !ccb_parse_local_index(body->items[p], "store_local", &idx) || idx != val_idx)
+    if (p >= body->count || !ccb_parse_local_index(string_list_insn(body, p), CCB_OP_STORE_LOCAL, &idx) || idx != val_idx)
         return false;
     p = ccb_skip_loc_directives(body, p + 1);
 
-    if (p >= body->count || !ccb_parse_local_index(body->items[p], "load_local", &idx) || idx != ptr_idx)
+    if (p >= body->count || !ccb_parse_local_index(string_list_insn(body, p), CCB_OP_LOAD_LOCAL, &idx) || idx != ptr_idx)
         return false;
     p = ccb_skip_loc_directives(body, p + 1);
 
-    if (p >= body->count || !ccb_parse_local_index(body->items[p], "load_local", &idx) || idx != val_idx)
+    if (p >= body->count || !ccb_parse_local_index(string_list_insn(body, p), CCB_OP_LOAD_LOCAL, &idx) || idx != val_idx)
         return false;
     p = ccb_skip_loc_directives(body, p + 1);
 
@@ -3020,8 +3288,7 @@ static bool ccb_replace_linef(StringList *body, size_t index, const char *fmt, .
         free(buffer);
         return false;
     }
-    free(body->items[index]);
-    body->items[index] = buffer;
+    string_list_replace(body, index, buffer);
     return true;
 }
 
@@ -3032,8 +3299,7 @@ static bool ccb_replace_line_copy(StringList *body, size_t index, const char *re
     char *copy = xstrdup(replacement);
     if (!copy)
         return false;
-    free(body->items[index]);
-    body->items[index] = copy;
+    string_list_replace(body, index, copy);
     return true;
 }
 
@@ -3102,13 +3368,9 @@ static void ccb_opt_fold_const_binops(CcbFunctionBuilder *fb)
     size_t i = 0;
     while (i + 2 < body->count)
     {
-        const char *line0 = body->items[i];
-        const char *line1 = body->items[i + 1];
-        const char *line2 = body->items[i + 2];
-
         CcbConstInfo lhs;
         CcbConstInfo rhs;
-        if (!ccb_parse_const_info(line0, &lhs) || !ccb_parse_const_info(line1, &rhs))
+        if (!ccb_parse_const_info(string_list_insn(body, i), &lhs) || !ccb_parse_const_info(string_list_insn(body, i + 1), &rhs))
         {
             ++i;
             continue;
@@ -3122,7 +3384,7 @@ static void ccb_opt_fold_const_binops(CcbFunctionBuilder *fb)
         char op[16];
         char type_name[16];
         bool unsigned_hint = false;
-        if (!ccb_parse_binop_info(line2, op, sizeof(op), type_name, sizeof(type_name), &unsigned_hint))
+        if (!ccb_parse_binop_info(string_list_insn(body, i + 2), op, sizeof(op), type_name, sizeof(type_name), &unsigned_hint))
         {
             ++i;
             continue;
@@ -3274,8 +3536,7 @@ static void ccb_opt_fold_const_binops(CcbFunctionBuilder *fb)
         }
         memcpy(replacement, new_line, new_len + 1);
 
-        free(body->items[i]);
-        body->items[i] = replacement;
+        string_list_replace(body, i, replacement);
         string_list_remove_range(body, i + 1, 2);
         if (i > 0)
             --i;
@@ -3291,11 +3552,8 @@ static void ccb_opt_fold_const_unops(CcbFunctionBuilder *fb)
     size_t i = 0;
     while (i + 1 < body->count)
     {
-        const char *line0 = body->items[i];
-        const char *line1 = body->items[i + 1];
-
         CcbConstInfo operand;
-        if (!ccb_parse_const_info(line0, &operand))
+        if (!ccb_parse_const_info(string_list_insn(body, i), &operand))
         {
             ++i;
             continue;
@@ -3303,7 +3561,7 @@ static void ccb_opt_fold_const_unops(CcbFunctionBuilder *fb)
 
         char op[16];
         char type_name[16];
-        if (!ccb_parse_unop_info(line1, op, sizeof(op), type_name,
+        if (!ccb_parse_unop_info(string_list_insn(body, i + 1), op, sizeof(op), type_name,
                                  sizeof(type_name)))
         {
             ++i;
@@ -3381,8 +3639,7 @@ static void ccb_opt_fold_const_unops(CcbFunctionBuilder *fb)
         }
         memcpy(replacement, new_line, new_len + 1);
 
-        free(body->items[i]);
-        body->items[i] = replacement;
+        string_list_replace(body, i, replacement);
         string_list_remove_range(body, i + 1, 1);
         if (i > 0)
             --i;
@@ -3398,13 +3655,9 @@ static void ccb_opt_fold_const_compares(CcbFunctionBuilder *fb)
     size_t i = 0;
     while (i + 2 < body->count)
     {
-        const char *line0 = body->items[i];
-        const char *line1 = body->items[i + 1];
-        const char *line2 = body->items[i + 2];
-
         CcbConstInfo lhs;
         CcbConstInfo rhs;
-        if (!ccb_parse_const_info(line0, &lhs) || !ccb_parse_const_info(line1, &rhs))
+        if (!ccb_parse_const_info(string_list_insn(body, i), &lhs) || !ccb_parse_const_info(string_list_insn(body, i + 1), &rhs))
         {
             ++i;
             continue;
@@ -3418,7 +3671,7 @@ static void ccb_opt_fold_const_compares(CcbFunctionBuilder *fb)
         char op[16];
         char type_name[16];
         bool unsigned_hint = false;
-        if (!ccb_parse_compare_info(line2, op, sizeof(op), type_name,
+        if (!ccb_parse_compare_info(string_list_insn(body, i + 2), op, sizeof(op), type_name,
                                     sizeof(type_name), &unsigned_hint))
         {
             ++i;
@@ -3481,8 +3734,7 @@ static void ccb_opt_fold_const_compares(CcbFunctionBuilder *fb)
         }
         memcpy(replacement, new_line, new_len + 1);
 
-        free(body->items[i]);
-        body->items[i] = replacement;
+        string_list_replace(body, i, replacement);
         string_list_remove_range(body, i + 1, 2);
         if (i > 0)
             --i;
@@ -3499,7 +3751,7 @@ static void ccb_opt_fold_const_test_null(CcbFunctionBuilder *fb)
     while (i + 1 < body->count)
     {
         CcbConstInfo value;
-        if (!ccb_parse_const_info(body->items[i], &value))
+        if (!ccb_parse_const_info(string_list_insn(body, i), &value))
         {
             ++i;
             continue;
@@ -3528,8 +3780,7 @@ static void ccb_opt_fold_const_test_null(CcbFunctionBuilder *fb)
         }
         memcpy(replacement, new_line, new_len + 1);
 
-        free(body->items[i]);
-        body->items[i] = replacement;
+        string_list_replace(body, i, replacement);
         string_list_remove_range(body, i + 1, 1);
         if (i > 0)
             --i;
@@ -3545,11 +3796,8 @@ static void ccb_opt_fold_const_converts(CcbFunctionBuilder *fb)
     size_t i = 0;
     while (i + 1 < body->count)
     {
-        const char *line0 = body->items[i];
-        const char *line1 = body->items[i + 1];
-
         CcbConstInfo source;
-        if (!ccb_parse_const_info(line0, &source))
+        if (!ccb_parse_const_info(string_list_insn(body, i), &source))
         {
             ++i;
             continue;
@@ -3558,7 +3806,7 @@ static void ccb_opt_fold_const_converts(CcbFunctionBuilder *fb)
         char kind[16];
         char from_name[16];
         char to_name[16];
-        if (!ccb_parse_convert_info(line1, kind, sizeof(kind), from_name,
+        if (!ccb_parse_convert_info(string_list_insn(body, i + 1), kind, sizeof(kind), from_name,
                                     sizeof(from_name), to_name, sizeof(to_name)))
         {
             ++i;
@@ -3638,8 +3886,7 @@ static void ccb_opt_fold_const_converts(CcbFunctionBuilder *fb)
         }
         memcpy(replacement, new_line, new_len + 1);
 
-        free(body->items[i]);
-        body->items[i] = replacement;
+        string_list_replace(body, i, replacement);
         string_list_remove_range(body, i + 1, 1);
         if (i > 0)
             --i;
@@ -3658,8 +3905,8 @@ static void ccb_opt_strength_reduce_binops(CcbFunctionBuilder *fb)
         char op[16];
         char type_name[16];
         bool unsigned_hint = false;
-        if (!ccb_parse_const_info(body->items[i + 1], &rhs) ||
-            !ccb_parse_binop_info(body->items[i + 2], op, sizeof(op), type_name, sizeof(type_name), &unsigned_hint) ||
+        if (!ccb_parse_const_info(string_list_insn(body, i + 1), &rhs) ||
+            !ccb_parse_binop_info(string_list_insn(body, i + 2), op, sizeof(op), type_name, sizeof(type_name), &unsigned_hint) ||
             strcmp(rhs.type, type_name) != 0 ||
             !ccb_type_is_integer_name(type_name))
         {
@@ -3704,8 +3951,8 @@ static void ccb_opt_simplify_noop_arith_and_bitcasts(CcbFunctionBuilder *fb)
         char op_name[16];
         char type_name[16];
         bool unsigned_hint = false;
-        if (ccb_parse_const_info(body->items[i + 1], &rhs_const) &&
-            ccb_parse_binop_info(body->items[i + 2], op_name, sizeof(op_name),
+        if (ccb_parse_const_info(string_list_insn(body, i + 1), &rhs_const) &&
+            ccb_parse_binop_info(string_list_insn(body, i + 2), op_name, sizeof(op_name),
                                  type_name, sizeof(type_name), &unsigned_hint) &&
             strcmp(rhs_const.type, type_name) == 0 &&
             (ccb_type_is_integer_name(type_name) || ccb_type_is_ptr_name(type_name)) &&
@@ -3725,8 +3972,8 @@ static void ccb_opt_simplify_noop_arith_and_bitcasts(CcbFunctionBuilder *fb)
         }
 
         CcbConstInfo lhs_const;
-        if (ccb_parse_const_info(body->items[i], &lhs_const) &&
-            ccb_parse_binop_info(body->items[i + 2], op_name, sizeof(op_name),
+        if (ccb_parse_const_info(string_list_insn(body, i), &lhs_const) &&
+            ccb_parse_binop_info(string_list_insn(body, i + 2), op_name, sizeof(op_name),
                                  type_name, sizeof(type_name), &unsigned_hint) &&
             strcmp(lhs_const.type, type_name) == 0 &&
             (ccb_type_is_integer_name(type_name) || ccb_type_is_ptr_name(type_name)) &&
@@ -3751,10 +3998,10 @@ static void ccb_opt_simplify_noop_arith_and_bitcasts(CcbFunctionBuilder *fb)
     {
         char kind1[16], from1[16], to1[16];
         char kind2[16], from2[16], to2[16];
-        if (!ccb_parse_convert_info(body->items[i], kind1, sizeof(kind1), from1, sizeof(from1), to1, sizeof(to1)) ||
-            !ccb_parse_convert_info(body->items[i + 1], kind2, sizeof(kind2), from2, sizeof(from2), to2, sizeof(to2)))
+        if (!ccb_parse_convert_info(string_list_insn(body, i), kind1, sizeof(kind1), from1, sizeof(from1), to1, sizeof(to1)) ||
+            !ccb_parse_convert_info(string_list_insn(body, i + 1), kind2, sizeof(kind2), from2, sizeof(from2), to2, sizeof(to2)))
         {
-            if (ccb_parse_convert_info(body->items[i], kind1, sizeof(kind1), from1, sizeof(from1), to1, sizeof(to1)) &&
+            if (ccb_parse_convert_info(string_list_insn(body, i), kind1, sizeof(kind1), from1, sizeof(from1), to1, sizeof(to1)) &&
                 strcmp(from1, to1) == 0)
             {
                 string_list_remove_range(body, i, 1);
@@ -3808,7 +4055,7 @@ static void ccb_opt_promote_local_values(CcbFunctionBuilder *fb)
     for (size_t i = 0; i < body->count; ++i)
     {
         int local_idx = -1;
-        if (ccb_parse_local_index(body->items[i], "addr_local", &local_idx) &&
+        if (ccb_parse_local_index(string_list_insn(body, i), CCB_OP_ADDR_LOCAL, &local_idx) &&
             local_idx >= 0 && (size_t)local_idx < fb->local_count)
             promotable[local_idx] = false;
     }
@@ -3817,8 +4064,8 @@ static void ccb_opt_promote_local_values(CcbFunctionBuilder *fb)
     {
         int store_idx = -1;
         int load_idx = -1;
-        if (!ccb_parse_local_index(body->items[i], "store_local", &store_idx) ||
-            !ccb_parse_local_index(body->items[i + 1], "load_local", &load_idx) ||
+        if (!ccb_parse_local_index(string_list_insn(body, i), CCB_OP_STORE_LOCAL, &store_idx) ||
+            !ccb_parse_local_index(string_list_insn(body, i + 1), CCB_OP_LOAD_LOCAL, &load_idx) ||
             store_idx != load_idx || store_idx < 0 || (size_t)store_idx >= fb->local_count ||
             !promotable[store_idx])
         {
@@ -3836,14 +4083,14 @@ static void ccb_opt_promote_local_values(CcbFunctionBuilder *fb)
     for (size_t i = 0; i < body->count; ++i)
     {
         int local_idx = -1;
-        if (ccb_parse_local_index(body->items[i], "load_local", &local_idx) &&
+        if (ccb_parse_local_index(string_list_insn(body, i), CCB_OP_LOAD_LOCAL, &local_idx) &&
             local_idx >= 0 && (size_t)local_idx < fb->local_count && promotable[local_idx] && known_lines[local_idx])
         {
             ccb_replace_line_copy(body, i, known_lines[local_idx]);
             continue;
         }
 
-        if (ccb_parse_local_index(body->items[i], "store_local", &local_idx) &&
+        if (ccb_parse_local_index(string_list_insn(body, i), CCB_OP_STORE_LOCAL, &local_idx) &&
             local_idx >= 0 && (size_t)local_idx < fb->local_count)
         {
             free(known_lines[local_idx]);
@@ -4001,7 +4248,7 @@ static bool ccb_parse_const_store_after_addr(const StringList *body, size_t star
         return false;
 
     size_t p = ccb_skip_loc_directives(body, start);
-    if (p >= body->count || !ccb_parse_const_info(body->items[p], out_const))
+    if (p >= body->count || !ccb_parse_const_info(string_list_insn(body, p), out_const))
         return false;
 
     p = ccb_skip_loc_directives(body, p + 1);
@@ -4037,7 +4284,7 @@ static bool ccb_parse_dup_or_store_after_addr(const StringList *body, size_t sta
 
     p = ccb_skip_loc_directives(body, p + 1);
     CcbConstInfo cinfo;
-    if (p >= body->count || !ccb_parse_const_info(body->items[p], &cinfo) || strcmp(cinfo.type, type_name) != 0)
+    if (p >= body->count || !ccb_parse_const_info(string_list_insn(body, p), &cinfo) || strcmp(cinfo.type, type_name) != 0)
         return false;
 
     p = ccb_skip_loc_directives(body, p + 1);
@@ -4045,7 +4292,7 @@ static bool ccb_parse_dup_or_store_after_addr(const StringList *body, size_t sta
     char op_type[16] = {0};
     bool unsigned_hint = false;
     if (p >= body->count ||
-        !ccb_parse_binop_info(body->items[p], op_name, sizeof(op_name), op_type, sizeof(op_type), &unsigned_hint) ||
+        !ccb_parse_binop_info(string_list_insn(body, p), op_name, sizeof(op_name), op_type, sizeof(op_type), &unsigned_hint) ||
         strcmp(op_name, "or") != 0 || strcmp(op_type, type_name) != 0)
         return false;
     (void)unsigned_hint;
@@ -4216,6 +4463,7 @@ static void ccb_opt_remove_overwritten_indirect_stores(CcbFunctionBuilder *fb)
                 break;
 
             const char *line = ccb_trim_leading_ws(body->items[probe]);
+            const CcbInsn *insn = string_list_insn(body, probe);
             if (!line)
                 break;
 
@@ -4233,9 +4481,9 @@ static void ccb_opt_remove_overwritten_indirect_stores(CcbFunctionBuilder *fb)
             if (strcmp(src.load_op, "load_local") == 0)
             {
                 int idx = -1;
-                if (ccb_parse_local_index(line, "store_local", &idx) && idx == src.load_index)
+                if (ccb_parse_local_index(insn, CCB_OP_STORE_LOCAL, &idx) && idx == src.load_index)
                     break;
-                if (ccb_parse_local_index(line, "addr_local", &idx) && idx == src.load_index)
+                if (ccb_parse_local_index(insn, CCB_OP_ADDR_LOCAL, &idx) && idx == src.load_index)
                     break;
             }
 
@@ -4405,7 +4653,7 @@ static void ccb_opt_fold_string_copy_loop(CcbFunctionBuilder *fb)
     char cond_label[64] = {0};
     char body_label[64] = {0};
     char end_label[64] = {0};
-    if (!ccb_parse_label_name(body->items[cursor++], cond_label, sizeof(cond_label)))
+    if (!ccb_parse_label_name(string_list_insn(body, cursor++), cond_label, sizeof(cond_label)))
         return;
 
     if (!ccb_is_exact_line(body->items[cursor++], "load_param 0") ||
@@ -4424,12 +4672,12 @@ static void ccb_opt_fold_string_copy_loop(CcbFunctionBuilder *fb)
 
     char branch_true[64] = {0};
     char branch_false[64] = {0};
-    if (!ccb_parse_branch_targets(body->items[cursor++], branch_true,
+    if (!ccb_parse_branch_targets(string_list_insn(body, cursor++), branch_true,
                                   sizeof(branch_true), branch_false,
                                   sizeof(branch_false)))
         return;
 
-    if (!ccb_parse_label_name(body->items[cursor++], body_label, sizeof(body_label)))
+    if (!ccb_parse_label_name(string_list_insn(body, cursor++), body_label, sizeof(body_label)))
         return;
     if (!ccb_is_exact_line(body->items[cursor++], "load_param 1") ||
         !ccb_is_exact_line(body->items[cursor++], "convert bitcast ptr i64") ||
@@ -4470,7 +4718,7 @@ static void ccb_opt_fold_string_copy_loop(CcbFunctionBuilder *fb)
     if (!ccb_is_prefix_line(body->items[cursor++], "jump "))
         return;
 
-    if (!ccb_parse_label_name(body->items[cursor++], end_label, sizeof(end_label)))
+    if (!ccb_parse_label_name(string_list_insn(body, cursor++), end_label, sizeof(end_label)))
         return;
     if (!ccb_is_exact_line(body->items[cursor++], "load_param 1") ||
         !ccb_is_exact_line(body->items[cursor++], "convert bitcast ptr i64") ||
@@ -4594,8 +4842,8 @@ static void ccb_opt_simplify_store_load_store(CcbFunctionBuilder *fb)
     {
         int store_idx = -1;
         int load_idx = -1;
-        if (!ccb_parse_local_index(body->items[i], "store_local", &store_idx) ||
-            !ccb_parse_local_index(body->items[i + 1], "load_local", &load_idx) ||
+        if (!ccb_parse_local_index(string_list_insn(body, i), CCB_OP_STORE_LOCAL, &store_idx) ||
+            !ccb_parse_local_index(string_list_insn(body, i + 1), CCB_OP_LOAD_LOCAL, &load_idx) ||
             store_idx != load_idx)
         {
             ++i;
@@ -4613,7 +4861,7 @@ static void ccb_opt_simplify_store_load_store(CcbFunctionBuilder *fb)
         for (size_t j = i + 2; j < body->count; ++j)
         {
             int idx = -1;
-            if (ccb_parse_local_index(body->items[j], "load_local", &idx) && idx == store_idx)
+            if (ccb_parse_local_index(string_list_insn(body, j), CCB_OP_LOAD_LOCAL, &idx) && idx == store_idx)
             {
                 used_later = 1;
                 break;
@@ -4647,7 +4895,7 @@ static void ccb_opt_inline_const_str_locals(CcbFunctionBuilder *fb)
         }
 
         int store_idx = -1;
-        if (!ccb_parse_local_index(body->items[i + 1], "store_local", &store_idx))
+        if (!ccb_parse_local_index(string_list_insn(body, i + 1), CCB_OP_STORE_LOCAL, &store_idx))
         {
             ++i;
             continue;
@@ -4658,12 +4906,12 @@ static void ccb_opt_inline_const_str_locals(CcbFunctionBuilder *fb)
         for (size_t j = i + 2; j < body->count; ++j)
         {
             int idx = -1;
-            if (ccb_parse_local_index(body->items[j], "store_local", &idx) && idx == store_idx)
+            if (ccb_parse_local_index(string_list_insn(body, j), CCB_OP_STORE_LOCAL, &idx) && idx == store_idx)
             {
                 blocked = 1;
                 break;
             }
-            if (ccb_parse_local_index(body->items[j], "load_local", &idx) && idx == store_idx)
+            if (ccb_parse_local_index(string_list_insn(body, j), CCB_OP_LOAD_LOCAL, &idx) && idx == store_idx)
             {
                 use_index = j;
                 break;
@@ -4680,7 +4928,7 @@ static void ccb_opt_inline_const_str_locals(CcbFunctionBuilder *fb)
         for (size_t j = use_index + 1; j < body->count; ++j)
         {
             int idx = -1;
-            if (ccb_parse_local_index(body->items[j], "load_local", &idx) && idx == store_idx)
+            if (ccb_parse_local_index(string_list_insn(body, j), CCB_OP_LOAD_LOCAL, &idx) && idx == store_idx)
             {
                 extra_use = 1;
                 break;
@@ -4692,8 +4940,7 @@ static void ccb_opt_inline_const_str_locals(CcbFunctionBuilder *fb)
             continue;
         }
 
-        free(body->items[use_index]);
-        body->items[use_index] = xstrdup(body->items[i]);
+        string_list_replace(body, use_index, xstrdup(body->items[i]));
 
         string_list_remove_range(body, i, 2);
         if (use_index > i)
@@ -4739,31 +4986,32 @@ static void ccb_opt_propagate_local_values(CcbFunctionBuilder *fb)
     {
         CcbConstInfo cinfo;
         int const_store_idx = -1;
-        if (ccb_parse_const_info(body->items[i], &cinfo) &&
-            ccb_parse_local_index(body->items[i + 1], "store_local", &const_store_idx))
+        if (ccb_parse_const_info(string_list_insn(body, i), &cinfo) &&
+            ccb_parse_local_index(string_list_insn(body, i + 1), CCB_OP_STORE_LOCAL, &const_store_idx))
         {
             char const_line[128];
             ccb_format_const_line(const_line, sizeof(const_line), cinfo.type, cinfo.u, cinfo.s);
             for (size_t j = i + 2; j < body->count; ++j)
             {
                 const char *line = body->items[j];
+                const CcbInsn *insn = string_list_insn(body, j);
                 if (ccb_instruction_is_control_barrier(line))
                     break;
 
                 int idx = -1;
-                if (ccb_parse_local_index(line, "store_local", &idx) && idx == const_store_idx)
+                if (ccb_parse_local_index(insn, CCB_OP_STORE_LOCAL, &idx) && idx == const_store_idx)
                     break;
-                if (ccb_parse_local_index(line, "addr_local", &idx) && idx == const_store_idx)
+                if (ccb_parse_local_index(insn, CCB_OP_ADDR_LOCAL, &idx) && idx == const_store_idx)
                     break;
-                if (ccb_parse_local_index(line, "load_local", &idx) && idx == const_store_idx)
+                if (ccb_parse_local_index(insn, CCB_OP_LOAD_LOCAL, &idx) && idx == const_store_idx)
                     ccb_replace_linef(body, j, "%s", const_line);
             }
         }
 
         int src_idx = -1;
         int dst_idx = -1;
-        if (!ccb_parse_local_index(body->items[i], "load_local", &src_idx) ||
-            !ccb_parse_local_index(body->items[i + 1], "store_local", &dst_idx) ||
+        if (!ccb_parse_local_index(string_list_insn(body, i), CCB_OP_LOAD_LOCAL, &src_idx) ||
+            !ccb_parse_local_index(string_list_insn(body, i + 1), CCB_OP_STORE_LOCAL, &dst_idx) ||
             src_idx == dst_idx)
         {
             continue;
@@ -4772,15 +5020,16 @@ static void ccb_opt_propagate_local_values(CcbFunctionBuilder *fb)
         for (size_t j = i + 2; j < body->count; ++j)
         {
             const char *line = body->items[j];
+            const CcbInsn *insn = string_list_insn(body, j);
             if (ccb_instruction_is_control_barrier(line))
                 break;
 
             int idx = -1;
-            if (ccb_parse_local_index(line, "store_local", &idx) && (idx == src_idx || idx == dst_idx))
+            if (ccb_parse_local_index(insn, CCB_OP_STORE_LOCAL, &idx) && (idx == src_idx || idx == dst_idx))
                 break;
-            if (ccb_parse_local_index(line, "addr_local", &idx) && (idx == src_idx || idx == dst_idx))
+            if (ccb_parse_local_index(insn, CCB_OP_ADDR_LOCAL, &idx) && (idx == src_idx || idx == dst_idx))
                 break;
-            if (ccb_parse_local_index(line, "load_local", &idx) && idx == dst_idx)
+            if (ccb_parse_local_index(insn, CCB_OP_LOAD_LOCAL, &idx) && idx == dst_idx)
                 ccb_replace_linef(body, j, "  load_local %d", src_idx);
         }
     }
@@ -4796,7 +5045,7 @@ static void ccb_opt_remove_dead_local_stores(CcbFunctionBuilder *fb)
     while (i < body->count)
     {
         int store_idx = -1;
-        if (!ccb_parse_local_index(body->items[i], "store_local", &store_idx))
+        if (!ccb_parse_local_index(string_list_insn(body, i), CCB_OP_STORE_LOCAL, &store_idx))
         {
             ++i;
             continue;
@@ -4809,6 +5058,7 @@ static void ccb_opt_remove_dead_local_stores(CcbFunctionBuilder *fb)
         for (size_t j = i + 1; j < body->count; ++j)
         {
             const char *line = body->items[j];
+            const CcbInsn *insn = string_list_insn(body, j);
             const char *trimmed = ccb_trim_leading_ws(line);
             if (trimmed && (strncmp(trimmed, "label ", 6) == 0 ||
                             strncmp(trimmed, "jump ", 5) == 0 ||
@@ -4821,15 +5071,15 @@ static void ccb_opt_remove_dead_local_stores(CcbFunctionBuilder *fb)
                 break;
 
             int idx = -1;
-            if ((ccb_parse_local_index(line, "load_local", &idx) ||
-                 ccb_parse_local_index(line, "addr_local", &idx)) &&
+            if ((ccb_parse_local_index(insn, CCB_OP_LOAD_LOCAL, &idx) ||
+                 ccb_parse_local_index(insn, CCB_OP_ADDR_LOCAL, &idx)) &&
                 idx == store_idx)
             {
                 used = true;
                 break;
             }
 
-            if (ccb_parse_local_index(line, "store_local", &idx) && idx == store_idx)
+            if (ccb_parse_local_index(insn, CCB_OP_STORE_LOCAL, &idx) && idx == store_idx)
             {
                 overwritten = true;
                 break;
@@ -4848,16 +5098,17 @@ static void ccb_opt_remove_dead_local_stores(CcbFunctionBuilder *fb)
             continue;
         }
 
-        size_t remove_index = i;
-        size_t remove_count = 1;
-        if (i > 0 && ccb_instruction_is_pure(body->items[i - 1]))
+        if (i == 0 || !ccb_instruction_is_pure(body->items[i - 1]))
         {
-            remove_index = i - 1;
-            remove_count = 2;
+            /* The producer has to stay, so its value is dropped instead. */
+            const char *type_name = ccb_local_type_name_by_index(fb, store_idx);
+            if (type_name)
+                ccb_replace_linef(body, i, "  drop %s", type_name);
+            ++i;
+            continue;
         }
-        string_list_remove_range(body, remove_index, remove_count);
-        if (remove_index > 0)
-            --i;
+        string_list_remove_range(body, i - 1, 2);
+        --i;
     }
 }
 
@@ -4869,19 +5120,19 @@ static void ccb_remap_local_indices(StringList *list, const size_t *map, size_t
     for (size_t i = 0; i < list->count; ++i)
     {
         int idx = -1;
-        if (ccb_parse_local_index(list->items[i], "load_local", &idx))
+        if (ccb_parse_local_index(string_list_insn(list, i), CCB_OP_LOAD_LOCAL, &idx))
         {
             if (idx >= 0 && (size_t)idx < old_count && map[idx] != SIZE_MAX)
                 ccb_replace_linef(list, i, "  load_local %zu", map[idx]);
             continue;
         }
-        if (ccb_parse_local_index(list->items[i], "store_local", &idx))
+        if (ccb_parse_local_index(string_list_insn(list, i), CCB_OP_STORE_LOCAL, &idx))
         {
             if (idx >= 0 && (size_t)idx < old_count && map[idx] != SIZE_MAX)
                 ccb_replace_linef(list, i, "  store_local %zu", map[idx]);
             continue;
         }
-        if (ccb_parse_local_index(list->items[i], "addr_local", &idx))
+        if (ccb_parse_local_index(string_list_insn(list, i), CCB_OP_ADDR_LOCAL, &idx))
         {
             if (idx >= 0 && (size_t)idx < old_count && map[idx] != SIZE_MAX)
                 ccb_replace_linef(list, i, "  addr_local %zu", map[idx]);
@@ -4906,9 +5157,9 @@ static void ccb_opt_remove_unused_local_slots(CcbFunctionBuilder *fb)
         for (size_t i = 0; i < list->count; ++i)
         {
             int idx = -1;
-            if ((ccb_parse_local_index(list->items[i], "load_local", &idx) ||
-                 ccb_parse_local_index(list->items[i], "store_local", &idx) ||
-                 ccb_parse_local_index(list->items[i], "addr_local", &idx)) &&
+            if ((ccb_parse_local_index(string_list_insn(list, i), CCB_OP_LOAD_LOCAL, &idx) ||
+                 ccb_parse_local_index(string_list_insn(list, i), CCB_OP_STORE_LOCAL, &idx) ||
+                 ccb_parse_local_index(string_list_insn(list, i), CCB_OP_ADDR_LOCAL, &idx)) &&
                 idx >= 0 && (size_t)idx < old_count)
             {
                 used[idx] = true;
@@ -4978,7 +5229,7 @@ static void ccb_opt_simplify_const_branches(CcbFunctionBuilder *fb)
     while (i + 1 < body->count)
     {
         CcbConstInfo cond;
-        if (!ccb_parse_const_info(body->items[i], &cond) || strcmp(cond.type, "i1") != 0)
+        if (!ccb_parse_const_info(string_list_insn(body, i), &cond) || strcmp(cond.type, "i1") != 0)
         {
             ++i;
             continue;
@@ -4986,7 +5237,7 @@ static void ccb_opt_simplify_const_branches(CcbFunctionBuilder *fb)
 
         char true_label[64] = {0};
         char false_label[64] = {0};
-        if (!ccb_parse_branch_targets(body->items[i + 1], true_label, sizeof(true_label),
+        if (!ccb_parse_branch_targets(string_list_insn(body, i + 1), true_label, sizeof(true_label),
                                       false_label, sizeof(false_label)))
         {
             ++i;
@@ -5022,7 +5273,7 @@ static void ccb_opt_simplify_bool_normalization(CcbFunctionBuilder *fb)
         }
 
         CcbConstInfo cinfo;
-        if (!ccb_parse_const_info(body->items[i], &cinfo) || strcmp(cinfo.type, "i1") != 0 || cinfo.u != 0)
+        if (!ccb_parse_const_info(string_list_insn(body, i), &cinfo) || strcmp(cinfo.type, "i1") != 0 || cinfo.u != 0)
         {
             ++i;
             continue;
@@ -5031,7 +5282,7 @@ static void ccb_opt_simplify_bool_normalization(CcbFunctionBuilder *fb)
         char op[16] = {0};
         char type_name[16] = {0};
         bool is_unsigned = false;
-        if (!ccb_parse_compare_info(body->items[i + 1], op, sizeof(op), type_name,
+        if (!ccb_parse_compare_info(string_list_insn(body, i + 1), op, sizeof(op), type_name,
                                     sizeof(type_name), &is_unsigned) ||
             is_unsigned || strcmp(op, "ne") != 0 || strcmp(type_name, "i1") != 0)
         {
@@ -5060,7 +5311,7 @@ static void ccb_opt_remove_unreachable_fallthrough(CcbFunctionBuilder *fb)
     for (size_t i = 0; i < body->count; ++i)
     {
         char jump_label[64] = {0};
-        if (ccb_parse_jump_target(body->items[i], jump_label, sizeof(jump_label)))
+        if (ccb_parse_jump_target(string_list_insn(body, i), jump_label, sizeof(jump_label)))
         {
             if (!string_list_contains(&referenced, jump_label))
                 string_list_append(&referenced, jump_label);
@@ -5069,7 +5320,7 @@ static void ccb_opt_remove_unreachable_fallthrough(CcbFunctionBuilder *fb)
 
         char true_label[64] = {0};
         char false_label[64] = {0};
-        if (!ccb_parse_branch_targets(body->items[i], true_label, sizeof(true_label),
+        if (!ccb_parse_branch_targets(string_list_insn(body, i), true_label, sizeof(true_label),
                                       false_label, sizeof(false_label)))
             continue;
 
@@ -5083,7 +5334,7 @@ static void ccb_opt_remove_unreachable_fallthrough(CcbFunctionBuilder *fb)
     for (size_t i = 0; i < body->count;)
     {
         char label[64] = {0};
-        if (ccb_parse_label_name(body->items[i], label, sizeof(label)))
+        if (ccb_parse_label_name(string_list_insn(body, i), label, sizeof(label)))
         {
             bool has_inbound = string_list_contains(&referenced, label) != 0;
             if (!reachable && !has_inbound)
@@ -5119,7 +5370,7 @@ static bool ccb_rewrite_label_target(StringList *body, const char *from_label, c
     for (size_t i = 0; i < body->count; ++i)
     {
         char jump_label[64] = {0};
-        if (ccb_parse_jump_target(body->items[i], jump_label, sizeof(jump_label)))
+        if (ccb_parse_jump_target(string_list_insn(body, i), jump_label, sizeof(jump_label)))
         {
             if (strcmp(jump_label, from_label) == 0)
             {
@@ -5131,7 +5382,7 @@ static bool ccb_rewrite_label_target(StringList *body, const char *from_label, c
 
         char true_label[64] = {0};
         char false_label[64] = {0};
-        if (!ccb_parse_branch_targets(body->items[i], true_label, sizeof(true_label),
+        if (!ccb_parse_branch_targets(string_list_insn(body, i), true_label, sizeof(true_label),
                                       false_label, sizeof(false_label)))
             continue;
 
@@ -5163,8 +5414,8 @@ static void ccb_opt_merge_consecutive_labels(CcbFunctionBuilder *fb)
     {
         char keep_label[64] = {0};
         char merge_label[64] = {0};
-        if (!ccb_parse_label_name(body->items[i], keep_label, sizeof(keep_label)) ||
-            !ccb_parse_label_name(body->items[i + 1], merge_label, sizeof(merge_label)))
+        if (!ccb_parse_label_name(string_list_insn(body, i), keep_label, sizeof(keep_label)) ||
+            !ccb_parse_label_name(string_list_insn(body, i + 1), merge_label, sizeof(merge_label)))
         {
             ++i;
             continue;
@@ -5186,8 +5437,8 @@ static void ccb_opt_remove_dead_local_copies(CcbFunctionBuilder *fb)
     {
         int src_idx = -1;
         int dst_idx = -1;
-        if (!ccb_parse_local_index(body->items[i], "load_local", &src_idx) ||
-            !ccb_parse_local_index(body->items[i + 1], "store_local", &dst_idx) ||
+        if (!ccb_parse_local_index(string_list_insn(body, i), CCB_OP_LOAD_LOCAL, &src_idx) ||
+            !ccb_parse_local_index(string_list_insn(body, i + 1), CCB_OP_STORE_LOCAL, &dst_idx) ||
             src_idx == dst_idx)
         {
             ++i;
@@ -5201,6 +5452,7 @@ static void ccb_opt_remove_dead_local_copies(CcbFunctionBuilder *fb)
         for (size_t j = i + 2; j < body->count; ++j)
         {
             const char *line = body->items[j];
+            const CcbInsn *insn = string_list_insn(body, j);
             if (ccb_instruction_is_control_barrier(line))
             {
                 const char *trimmed = ccb_trim_leading_ws(line);
@@ -5210,13 +5462,13 @@ static void ccb_opt_remove_dead_local_copies(CcbFunctionBuilder *fb)
             }
 
             int idx = -1;
-            if (ccb_parse_local_index(line, "load_local", &idx) && idx == dst_idx)
+            if (ccb_parse_local_index(insn, CCB_OP_LOAD_LOCAL, &idx) && idx == dst_idx)
             {
                 used = true;
                 break;
             }
-            if ((ccb_parse_local_index(line, "store_local", &idx) ||
-                 ccb_parse_local_index(line, "addr_local", &idx)) &&
+            if ((ccb_parse_local_index(insn, CCB_OP_STORE_LOCAL, &idx) ||
+                 ccb_parse_local_index(insn, CCB_OP_ADDR_LOCAL, &idx)) &&
                 idx == dst_idx)
             {
                 killed = true;
@@ -5249,9 +5501,9 @@ static void ccb_opt_simplify_addr_local_temp(CcbFunctionBuilder *fb)
         int base_idx = -1;
         int temp_idx = -1;
         int load_idx = -1;
-        if (!ccb_parse_local_index(body->items[i], "addr_local", &base_idx) ||
-            !ccb_parse_local_index(body->items[i + 1], "store_local", &temp_idx) ||
-            !ccb_parse_local_index(body->items[i + 2], "load_local", &load_idx) ||
+        if (!ccb_parse_local_index(string_list_insn(body, i), CCB_OP_ADDR_LOCAL, &base_idx) ||
+            !ccb_parse_local_index(string_list_insn(body, i + 1), CCB_OP_STORE_LOCAL, &temp_idx) ||
+            !ccb_parse_local_index(string_list_insn(body, i + 2), CCB_OP_LOAD_LOCAL, &load_idx) ||
             temp_idx != load_idx)
         {
             ++i;
@@ -5262,17 +5514,18 @@ static void ccb_opt_simplify_addr_local_temp(CcbFunctionBuilder *fb)
         for (size_t j = i + 3; j < body->count; ++j)
         {
             const char *line = body->items[j];
+            const CcbInsn *insn = string_list_insn(body, j);
             if (ccb_instruction_is_control_barrier(line))
                 break;
 
             int idx = -1;
-            if (ccb_parse_local_index(line, "load_local", &idx) && idx == temp_idx)
+            if (ccb_parse_local_index(insn, CCB_OP_LOAD_LOCAL, &idx) && idx == temp_idx)
             {
                 used_later = true;
                 break;
             }
-            if ((ccb_parse_local_index(line, "store_local", &idx) ||
-                 ccb_parse_local_index(line, "addr_local", &idx)) &&
+            if ((ccb_parse_local_index(insn, CCB_OP_STORE_LOCAL, &idx) ||
+                 ccb_parse_local_index(insn, CCB_OP_ADDR_LOCAL, &idx)) &&
                 idx == temp_idx)
                 break;
         }
@@ -5301,8 +5554,8 @@ static void ccb_opt_remove_redundant_jumps(CcbFunctionBuilder *fb)
     {
         char jump_label[64] = {0};
         char next_label[64] = {0};
-        if (!ccb_parse_jump_target(body->items[i], jump_label, sizeof(jump_label)) ||
-            !ccb_parse_label_name(body->items[i + 1], next_label, sizeof(next_label)) ||
+        if (!ccb_parse_jump_target(string_list_insn(body, i), jump_label, sizeof(jump_label)) ||
+            !ccb_parse_label_name(string_list_insn(body, i + 1), next_label, sizeof(next_label)) ||
             strcmp(jump_label, next_label) != 0)
         {
             ++i;
@@ -5330,7 +5583,7 @@ static void ccb_opt_remove_unused_labels(CcbFunctionBuilder *fb)
     for (size_t i = 0; i < body->count; ++i)
     {
         char jump_label[64] = {0};
-        if (ccb_parse_jump_target(body->items[i], jump_label, sizeof(jump_label)))
+        if (ccb_parse_jump_target(string_list_insn(body, i), jump_label, sizeof(jump_label)))
         {
             if (!string_list_contains(&referenced, jump_label))
                 string_list_append(&referenced, jump_label);
@@ -5339,7 +5592,7 @@ static void ccb_opt_remove_unused_labels(CcbFunctionBuilder *fb)
 
         char true_label[64] = {0};
         char false_label[64] = {0};
-        if (!ccb_parse_branch_targets(body->items[i], true_label, sizeof(true_label),
+        if (!ccb_parse_branch_targets(string_list_insn(body, i), true_label, sizeof(true_label),
                                       false_label, sizeof(false_label)))
             continue;
 
@@ -5352,7 +5605,7 @@ static void ccb_opt_remove_unused_labels(CcbFunctionBuilder *fb)
     for (size_t i = 0; i < body->count;)
     {
         char label[64] = {0};
-        if (!ccb_parse_label_name(body->items[i], label, sizeof(label)) ||
+        if (!ccb_parse_label_name(string_list_insn(body, i), label, sizeof(label)) ||
             string_list_contains(&referenced, label))
         {
             ++i;
@@ -5370,7 +5623,7 @@ static void ccb_opt_remove_unused_labels(CcbFunctionBuilder *fb)
         while (end < body->count)
         {
             char next_label[64] = {0};
-            if (ccb_parse_label_name(body->items[end], next_label, sizeof(next_label)))
+            if (ccb_parse_label_name(string_list_insn(body, end), next_label, sizeof(next_label)))
                 break;
             ++end;
         }
@@ -5397,398 +5650,1148 @@ static void ccb_opt_remove_nops(CcbFunctionBuilder *fb)
     }
 }
 
-static void ccb_function_optimize(CcbFunctionBuilder *fb, const CodegenOptions *opts)
+static bool ccb_gvn_callee_is_pure(const char *callee, void *ctx)
 {
-    if (!fb || !opts || opts->opt_level <= 0)
-        return;
-
-    
-
-
-
-
-    return;
+    const CcbModule *mod = (const CcbModule *)ctx;
+    return mod && callee && string_list_contains(&mod->pure_funcs, callee);
+}
 
-    const char *fn_name = (fb->fn && fb->fn->name) ? fb->fn->name : "<anon>";
-    if (compiler_verbose_enabled())
-        compiler_verbose_logf("optimizer", "optimizing '%s' (O%d)", fn_name, opts->opt_level);
-    if (opts->opt_level >= 3)
-    {
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold string copy loop");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold string copy loop");
-        ccb_opt_fold_string_copy_loop(fb);
-    }
-    if (compiler_verbose_deep_enabled())
-        compiler_verbose_treef("optimizer", "+-", "pass prune dropped values");
-    if (compiler_verbose_enabled())
-        compiler_verbose_logf("optimizer", "pass prune dropped values");
-    ccb_opt_prune_dropped_values(fb);
+/* Replaces expressions whose value is already available (see ccb_gvn.h)
+   with a load of the slot or temp holding it. */
+static void ccb_opt_gvn(CcbFunctionBuilder *fb)
+{
+    StringList *body = &fb->body;
+    if (!body->track_insns || body->count == 0)
+        return;
+    CcbGvnPlan plan;
+    if (!ccb_gvn_plan(body->insns, body->count, ccb_gvn_callee_is_pure, fb->module, &plan))
+        return;
 
-    if (opts->opt_level >= 2)
+    int *temp_slots = (int *)xmalloc((size_t)(plan.temp_count ? plan.temp_count : 1) * sizeof(int));
+    for (int t = 0; t < plan.temp_count; ++t)
     {
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold constant binops");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold constant binops");
-        ccb_opt_fold_const_binops(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold constant unops");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold constant unops");
-        ccb_opt_fold_const_unops(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold constant compares");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold constant compares");
-        ccb_opt_fold_const_compares(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold test_null constants");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold test_null constants");
-        ccb_opt_fold_const_test_null(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold constant converts");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold constant converts");
-        ccb_opt_fold_const_converts(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass strength reduce binops");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass strength reduce binops");
-        ccb_opt_strength_reduce_binops(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass simplify no-op arith/bitcasts");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass simplify no-op arith/bitcasts");
-        ccb_opt_simplify_noop_arith_and_bitcasts(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold const OR store chains");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold const OR store chains");
-        ccb_opt_fold_const_or_store_chains(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass pack byte store runs");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass pack byte store runs");
-        ccb_opt_pack_byte_store_runs(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove overwritten indirect stores");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove overwritten indirect stores");
-        ccb_opt_remove_overwritten_indirect_stores(fb);
+        CcbLocal *temp = ccb_local_add(fb, NULL, NULL, false, false);
+        if (!temp)
+        {
+            free(temp_slots);
+            ccb_gvn_plan_free(&plan);
+            return;
+        }
+        temp->value_type = plan.temp_types[t];
+        temp_slots[t] = temp->index;
     }
 
-    if (opts->opt_level >= 3)
+    /* Edit back to front so pending positions stay valid. A save after the
+       last instruction of a leader never falls inside a reused span. */
+    size_t r = plan.reuse_count;
+    size_t s = plan.save_count;
+    char line[64];
+    while (r > 0 || s > 0)
     {
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass simplify store/load/store");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass simplify store/load/store");
-        ccb_opt_simplify_store_load_store(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass promote local values");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass promote local values");
-        ccb_opt_promote_local_values(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass propagate local values");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass propagate local values");
-        ccb_opt_propagate_local_values(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove dead local stores");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove dead local stores");
-        ccb_opt_remove_dead_local_stores(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove unused local slots");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove unused local slots");
-        ccb_opt_remove_unused_local_slots(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold constant compares");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold constant compares");
-        ccb_opt_fold_const_compares(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold test_null constants");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold test_null constants");
-        ccb_opt_fold_const_test_null(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass simplify bool normalization");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass simplify bool normalization");
-        ccb_opt_simplify_bool_normalization(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass simplify const branches");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass simplify const branches");
-        ccb_opt_simplify_const_branches(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove unreachable fallthrough");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove unreachable fallthrough");
-        ccb_opt_remove_unreachable_fallthrough(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass merge consecutive labels");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass merge consecutive labels");
-        ccb_opt_merge_consecutive_labels(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove redundant jumps");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove redundant jumps");
-        ccb_opt_remove_redundant_jumps(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove unused labels");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove unused labels");
-        ccb_opt_remove_unused_labels(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove redundant jumps");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove redundant jumps");
-        ccb_opt_remove_redundant_jumps(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove unused labels");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove unused labels");
-        ccb_opt_remove_unused_labels(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass propagate local values");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass propagate local values");
-        ccb_opt_propagate_local_values(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove dead local stores");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove dead local stores");
-        ccb_opt_remove_dead_local_stores(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove unused local slots");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove unused local slots");
-        ccb_opt_remove_unused_local_slots(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass remove dead local copies");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass remove dead local copies");
-        ccb_opt_remove_dead_local_copies(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass simplify addr_local temps");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass simplify addr_local temps");
-        ccb_opt_simplify_addr_local_temp(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold const OR store chains");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold const OR store chains");
-        ccb_opt_fold_const_or_store_chains(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold dup RMW OR chains");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold dup RMW OR chains");
-        ccb_opt_fold_dup_rmw_or_chains(fb);
-
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass prune dropped values");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass prune dropped values");
-        ccb_opt_prune_dropped_values(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass inline const_str locals");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass inline const_str locals");
-        ccb_opt_inline_const_str_locals(fb);
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass fold zero-init memset");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass fold zero-init memset");
-        ccb_opt_fold_zero_init_memset(fb);
-
-        if (compiler_verbose_deep_enabled())
-            fprintf(stderr, "\x1b[31m& CCSim hardcore simulation\x1b[0m\n");
-        if (compiler_verbose_deep_enabled())
-            compiler_verbose_treef("optimizer", "+-", "pass ccsim (final)");
-        if (compiler_verbose_enabled())
-            compiler_verbose_logf("optimizer", "pass ccsim (final)");
-        CcsimOptions ccsim_options;
-        ccsim_options.opt_level = opts->opt_level;
-        ccsim_options.aggressive = (fb->fn && !fb->fn->is_exposed && !fb->fn->export_name) ? 1 : 0;
-        CcsimStats ccsim_stats;
-        memset(&ccsim_stats, 0, sizeof(ccsim_stats));
-        if (fb->module)
-        {
-            const char *vm_fn_name = (fb->fn && fb->fn->metadata.backend_name) ? fb->fn->metadata.backend_name :
-                                     ((fb->fn && fb->fn->name) ? fb->fn->name : NULL);
-            if (fb->fn && fb->fn->export_name && fb->fn->name)
-                vm_fn_name = fb->fn->name;
-            if (vm_fn_name)
-            {
-                int vm_collapsed = ccsim_vm_collapse_hidden_function(fb->body.items, fb->body.count,
-                                                                      vm_fn_name,
-                                                                      fb->module->lines.items, fb->module->lines.count,
-                                                                      &ccsim_options, &ccsim_stats);
-                if (vm_collapsed && compiler_verbose_deep_enabled())
-                    compiler_verbose_treef("ccsim-vm", "|-", "collapsed '%s'", vm_fn_name);
-                else if (vm_collapsed && compiler_verbose_enabled())
-                    compiler_verbose_logf("ccsim-vm", "collapsed '%s'", vm_fn_name);
-            }
-            ccsim_collapse_hidden_calls(fb->body.items, fb->body.count,
-                                        fb->module->lines.items, fb->module->lines.count,
-                                        &ccsim_options, &ccsim_stats);
-        }
-        ccsim_optimize_lines(fb->body.items, fb->body.count, &ccsim_options, &ccsim_stats);
-        ccb_opt_remove_nops(fb);
-        ccb_opt_remove_unreachable_fallthrough(fb);
-        ccb_opt_remove_unused_labels(fb);
-        ccb_opt_remove_redundant_jumps(fb);
-        if (compiler_verbose_enabled() && (ccsim_stats.vm_collapsed_functions || ccsim_stats.rewritten_load_locals || ccsim_stats.const_folds || ccsim_stats.collapsed_hidden_calls))
-            compiler_verbose_logf("optimizer", "ccsim: passes=%zu vm-collapses=%zu call-collapses=%zu rewrites=%zu folds=%zu barriers=%zu",
-                                  ccsim_stats.passes,
-                                  ccsim_stats.vm_collapsed_functions,
-                                  ccsim_stats.collapsed_hidden_calls,
-                                  ccsim_stats.rewritten_load_locals,
-                                  ccsim_stats.const_folds,
-                                  ccsim_stats.simulation_barriers);
+        bool take_save = s > 0 && (r == 0 || plan.saves[s - 1].after >= plan.reuses[r - 1].start);
+        if (take_save)
+        {
+            const CcbGvnSave *save = &plan.saves[--s];
+            int slot = temp_slots[save->temp];
+            snprintf(line, sizeof(line), "  load_local %d", slot);
+            string_list_insert(body, save->after + 1, line);
+            snprintf(line, sizeof(line), "  store_local %d", slot);
+            string_list_insert(body, save->after + 1, line);
+            continue;
+        }
+        const CcbGvnReuse *reuse = &plan.reuses[--r];
+        if (reuse->temp >= 0)
+            snprintf(line, sizeof(line), "  load_local %d", temp_slots[reuse->temp]);
+        else
+            snprintf(line, sizeof(line), "  %s %d", reuse->load == CCB_OP_LOAD_PARAM ? "load_param" : "load_local",
+                     reuse->slot);
+        string_list_replace(body, reuse->start, xstrdup(line));
+        string_list_remove_range(body, reuse->start + 1, reuse->end - reuse->start);
     }
-
     if (compiler_verbose_enabled())
-        compiler_verbose_logf("optimizer", "completed '%s'", fn_name);
+        compiler_verbose_logf("optimizer", "gvn: %zu reuses, %d temps", plan.reuse_count, plan.temp_count);
+    free(temp_slots);
+    ccb_gvn_plan_free(&plan);
 }
 
-static void ccb_function_builder_register_params(CcbFunctionBuilder *fb)
+/* Splits stack_alloc'd aggregates that never escape into one local per
+   field (see ccb_sroa.h). */
+static void ccb_opt_sroa(CcbFunctionBuilder *fb)
 {
-    if (!fb || !fb->fn || fb->fn->param_count <= 0)
+    StringList *body = &fb->body;
+    if (!body->track_insns || body->count == 0)
+        return;
+    CcbSroaPlan plan;
+    if (!ccb_sroa_plan(body->insns, body->count, &plan))
         return;
 
-    for (int i = 0; i < fb->fn->param_count; ++i)
+    int *field_slots = (int *)xmalloc((size_t)(plan.field_count ? plan.field_count : 1) * sizeof(int));
+    for (int f = 0; f < plan.field_count; ++f)
     {
-        const char *param_name = NULL;
-        if (fb->fn->param_names && fb->fn->param_names[i] && fb->fn->param_names[i][0] != '\0')
-            param_name = fb->fn->param_names[i];
-        Type *param_type = fb->fn->param_types ? fb->fn->param_types[i] : NULL;
-        bool address_only = param_type && param_type->kind == TY_STRUCT;
-        if (!ccb_local_add(fb, param_name, param_type, address_only, true))
+        CcbLocal *field = ccb_local_add(fb, NULL, NULL, false, false);
+        if (!field)
         {
-            diag_error_at(fb->fn->src, fb->fn->line, fb->fn->col,
-                          "failed to allocate local slot for parameter %d", i);
+            free(field_slots);
+            ccb_sroa_plan_free(&plan);
             return;
         }
+        field->value_type = plan.field_types[f];
+        field_slots[f] = field->index;
+    }
 
-        if (ccb_function_param_has_managed_length(fb->fn, i))
+    char line[64];
+    for (size_t e = plan.edit_count; e-- > 0;)
+    {
+        const CcbSroaEdit *edit = &plan.edits[e];
+        if (edit->kind == CCB_SROA_DELETE)
         {
-            char *length_name = ccb_make_managed_length_name(param_name);
-            if (!ccb_local_add_u64(fb, length_name, true))
+            string_list_remove_range(body, edit->at, 1);
+            continue;
+        }
+        if (edit->kind == CCB_SROA_ZERO)
+        {
+            string_list_remove_range(body, edit->at, 1);
+            for (int f = edit->field_end; f-- > edit->field && f >= 0;)
             {
-                diag_error_at(fb->fn->src, fb->fn->line, fb->fn->col,
-                              "failed to allocate managed array length slot for parameter %d", i);
-                return;
+                CcbInsn zero;
+                memset(&zero, 0, sizeof(zero));
+                zero.op = CCB_OP_CONST;
+                zero.type = plan.field_types[f];
+                zero.has_imm = !ccb_value_type_is_float(zero.type);
+                snprintf(line, sizeof(line), "  store_local %d", field_slots[f]);
+                string_list_insert(body, edit->at, line);
+                if (ccb_insn_format(&zero, line, sizeof(line)))
+                    string_list_insert(body, edit->at, line);
             }
+            continue;
         }
+        snprintf(line, sizeof(line), "  %s %d", edit->kind == CCB_SROA_LOAD ? "load_local" : "store_local",
+                 field_slots[edit->field]);
+        string_list_replace(body, edit->at, xstrdup(line));
     }
+    if (compiler_verbose_enabled())
+        compiler_verbose_logf("optimizer", "sroa: %d aggregates split into %d locals", plan.split, plan.field_count);
+    free(field_slots);
+    ccb_sroa_plan_free(&plan);
 }
 
-static CcbLocal *ccb_local_lookup(CcbFunctionBuilder *fb, const char *name)
+/* Applies one loop's plan (see ccb_loop.h): a new preheader before the
+   header initialises the temps, planned spans reload them, and induction
+   temps are advanced after their counter's store. */
+static bool ccb_apply_loop_plan(CcbFunctionBuilder *fb, const CcbLoopPlan *plan)
 {
-    if (!fb || !name)
-        return NULL;
-    for (size_t i = fb->locals_count; i-- > 0;)
+    StringList *body = &fb->body;
+    const char *header = body->insns[plan->header].symbol;
+    char pre[64];
+    char line[512];
+    ccb_make_label(fb, pre, sizeof(pre), "loop_pre");
+
+    char **retargets = (char **)xcalloc(plan->retarget_count ? plan->retarget_count : 1, sizeof(char *));
+    for (size_t r = 0; r < plan->retarget_count; ++r)
+    {
+        CcbInsn insn = body->insns[plan->retargets[r]];
+        if (insn.symbol == header)
+            insn.symbol = pre;
+        if (insn.symbol2 == header)
+            insn.symbol2 = pre;
+        if (!ccb_insn_format(&insn, line, sizeof(line)))
+        {
+            for (size_t k = 0; k < r; ++k)
+                free(retargets[k]);
+            free(retargets);
+            return false;
+        }
+        retargets[r] = xstrdup(line);
+    }
+
+    int *temp_slots = (int *)xmalloc((size_t)plan->temp_count * sizeof(int));
+    for (int t = 0; t < plan->temp_count; ++t)
     {
-        CcbLocal *local = &fb->locals[i];
-        if (!local->name || !local->is_active)
+        CcbLocal *temp = ccb_local_add(fb, NULL, NULL, false, false);
+        if (!temp)
+        {
+            for (size_t r = 0; r < plan->retarget_count; ++r)
+                free(retargets[r]);
+            free(retargets);
+            free(temp_slots);
+            return false;
+        }
+        temp->value_type = plan->temp_types[t];
+        temp_slots[t] = temp->index;
+    }
+
+    /* The preheader copies its spans before any of them is replaced. */
+    size_t pre_count = 1;
+    for (int t = 0; t < plan->temp_count; ++t)
+        pre_count += plan->inits[t].end - plan->inits[t].start + 2;
+    char **pre_lines = (char **)xmalloc(pre_count * sizeof(char *));
+    size_t n = 0;
+    snprintf(line, sizeof(line), "label %s", pre);
+    pre_lines[n++] = xstrdup(line);
+    for (int t = 0; t < plan->temp_count; ++t)
+    {
+        for (size_t k = plan->inits[t].start; k <= plan->inits[t].end; ++k)
+            pre_lines[n++] = xstrdup(body->items[k]);
+        snprintf(line, sizeof(line), "  store_local %d", temp_slots[t]);
+        pre_lines[n++] = xstrdup(line);
+    }
+
+    for (size_t r = 0; r < plan->retarget_count; ++r)
+        string_list_replace(body, plan->retargets[r], retargets[r]);
+    free(retargets);
+
+    /* Back to front; a step inserted where a replaced span starts goes
+       before it, and the preheader precedes everything in the loop. */
+    size_t r = plan->replace_count;
+    size_t s = plan->step_count;
+    bool pre_pending = true;
+    while (r > 0 || s > 0 || pre_pending)
+    {
+        size_t replace_at = r > 0 ? plan->replaces[r - 1].start : 0;
+        size_t step_at = s > 0 ? plan->steps[s - 1].after + 1 : 0;
+        if (r > 0 && (s == 0 || replace_at >= step_at) && (!pre_pending || replace_at >= plan->header))
+        {
+            const CcbLoopSpan *span = &plan->replaces[--r];
+            snprintf(line, sizeof(line), "  load_local %d", temp_slots[span->temp]);
+            string_list_replace(body, span->start, xstrdup(line));
+            string_list_remove_range(body, span->start + 1, span->end - span->start);
             continue;
-        if (local->scope_depth > fb->scope_depth)
+        }
+        if (s > 0 && (!pre_pending || step_at > plan->header))
+        {
+            const CcbLoopStep *step = &plan->steps[--s];
+            int slot = temp_slots[step->temp];
+            snprintf(line, sizeof(line), "  store_local %d", slot);
+            string_list_insert(body, step_at, line);
+            string_list_insert(body, step_at, "  binop add i64");
+            snprintf(line, sizeof(line), "  const i64 %lld", (long long)step->step);
+            string_list_insert(body, step_at, line);
+            snprintf(line, sizeof(line), "  load_local %d", slot);
+            string_list_insert(body, step_at, line);
             continue;
-        if (strcmp(local->name, name) == 0)
-            return local;
+        }
+        for (size_t k = 0; k < n; ++k)
+        {
+            string_list_insert(body, plan->header + k, pre_lines[k]);
+            free(pre_lines[k]);
+        }
+        pre_pending = false;
     }
-    return NULL;
+    free(pre_lines);
+    free(temp_slots);
+    return true;
 }
 
-static CcbLocal *ccb_local_add(CcbFunctionBuilder *fb, const char *name, Type *type, bool address_only, bool is_param)
+/* Hoists loop-invariant code and strength-reduces induction addresses,
+   inner loops first so their preheaders are visible to enclosing loops. */
+static void ccb_opt_licm(CcbFunctionBuilder *fb)
 {
-    if (!fb)
-        return NULL;
-    if (fb->locals_count == fb->locals_capacity)
+    StringList *body = &fb->body;
+    if (!body->track_insns || body->count == 0)
+        return;
+    const char **headers = NULL;
+    size_t header_count = ccb_loop_headers(body->insns, body->count, &headers);
+    int hoisted = 0;
+    int reduced = 0;
+    for (size_t h = 0; h < header_count; ++h)
     {
-        size_t new_cap = fb->locals_capacity ? fb->locals_capacity * 2 : 8;
-        CcbLocal *new_locals = (CcbLocal *)realloc(fb->locals, new_cap * sizeof(CcbLocal));
-        if (!new_locals)
-            return NULL;
-        fb->locals = new_locals;
-        fb->locals_capacity = new_cap;
+        CcbLoopPlan plan;
+        if (!ccb_loop_plan(body->insns, body->count, headers[h], ccb_gvn_callee_is_pure, fb->module, &plan))
+            continue;
+        if (ccb_apply_loop_plan(fb, &plan))
+        {
+            hoisted += plan.hoisted;
+            reduced += plan.reduced;
+        }
+        ccb_loop_plan_free(&plan);
     }
-
-    CcbLocal *slot = &fb->locals[fb->locals_count++];
-    slot->name = name;
-    slot->type = type;
-    slot->value_type = address_only ? CC_TYPE_PTR : map_type_to_cc(type);
-    slot->is_address_only = address_only;
-    slot->is_param = is_param;
-    slot->index = is_param ? (int)fb->param_count : (int)fb->local_count;
-    slot->scope_depth = fb->scope_depth;
-    slot->is_active = true;
-    if (is_param)
-        fb->param_count++;
-    else
-        fb->local_count++;
-    return slot;
+    free(headers);
+    if (compiler_verbose_enabled() && (hoisted || reduced))
+        compiler_verbose_logf("optimizer", "licm: %d hoisted, %d induction temps", hoisted, reduced);
 }
 
-static CcbLocal *ccb_local_add_u64(CcbFunctionBuilder *fb, const char *name, bool is_param)
+/* Renders a jump or branch with its targets looked up in `from`/`to`
+   (one copy's labels) and the header `header` sent to `back`. */
+static bool ccb_unroll_format_edge(const CcbInsn *insn, const char *header, const char *back, const char **from,
+                                   char **to, size_t label_count, char *line, size_t linesz)
 {
-    CcbLocal *slot = ccb_local_add(fb, name, NULL, false, is_param);
-    if (slot)
-        slot->value_type = CC_TYPE_U64;
-    return slot;
+    CcbInsn edge = *insn;
+    const char **targets[2] = {&edge.symbol, &edge.symbol2};
+    for (int t = 0; t < 2; ++t)
+    {
+        if (!*targets[t])
+            continue;
+        if (*targets[t] == header)
+        {
+            *targets[t] = back;
+            continue;
+        }
+        for (size_t k = 0; k < label_count; ++k)
+        {
+            if (*targets[t] == from[k])
+            {
+                *targets[t] = to[k];
+                break;
+            }
+        }
+    }
+    return ccb_insn_format(&edge, line, linesz);
 }
 
-static int ccb_promote_param_to_local(CcbFunctionBuilder *fb, const Node *site, CcbLocal **inout_local)
+static bool ccb_unroll_append(StringList *out, const StringList *body, size_t at, const char *line)
 {
-    if (!fb || !inout_local || !*inout_local)
-        return 1;
-
-    CcbLocal *param = *inout_local;
-    if (!param->is_param)
-        return 0;
+    if (body->track_debug)
+        string_list_set_debug_location(out, string_list_get_debug_file(body, at), string_list_get_debug_line(body, at),
+                                       string_list_get_debug_column(body, at));
+    return string_list_append(out, line);
+}
 
-    const char *param_name = (param->name && *param->name) ? param->name : "<anonymous>";
+/* Rebuilds the body with one loop unrolled as planned (see ccb_loop.h).
+   Each copy of the loop body gets fresh labels; its jumps back to the
+   header go to the next copy (full) or to the unrolled loop's test. */
+static bool ccb_apply_unroll_plan(CcbFunctionBuilder *fb, const CcbUnrollPlan *plan)
+{
+    StringList *body = &fb->body;
+    const CcbInsn *branch = &body->insns[plan->branch];
+    const char *header = body->insns[plan->header].symbol;
+    const char *exit_label = branch->symbol2;
+    size_t first = plan->branch + 1;
+    char line[512];
+    char test[64];
+    if (!plan->full)
+        ccb_make_label(fb, test, sizeof(test), "unroll_cond");
 
-    CcbLocal *shadow = ccb_local_add(fb, param->name, param->type, param->is_address_only, false);
-    if (!shadow)
+    size_t label_count = 0;
+    for (size_t i = first; i < plan->latch; ++i)
     {
-        diag_error_at(site ? site->src : NULL, site ? site->line : 0, site ? site->col : 0,
-                      "failed to create local copy for parameter '%s'", param_name);
-        return 1;
+        if (body->insns[i].op == CCB_OP_LABEL)
+            label_count++;
     }
-
-    shadow->value_type = param->value_type;
-    shadow->scope_depth = param->scope_depth;
-
-    if (!ccb_append_load_local(&fb->prologue, param))
+    const char **from = (const char **)xmalloc(label_count * sizeof(const char *));
+    char **names = (char **)xcalloc((size_t)plan->copies * label_count, sizeof(char *));
+    label_count = 0;
+    for (size_t i = first; i < plan->latch; ++i)
     {
-        diag_error_at(site ? site->src : NULL, site ? site->line : 0, site ? site->col : 0,
-                      "failed to read parameter '%s'", param_name);
-        return 1;
+        if (body->insns[i].op == CCB_OP_LABEL)
+            from[label_count++] = body->insns[i].symbol;
     }
-    if (!ccb_append_store_local(&fb->prologue, shadow))
+    /* Labels nothing jumps to are left out of the copies so the blocks
+       they split can merge. */
+    bool *used = (bool *)xcalloc(label_count ? label_count : 1, sizeof(bool));
+    for (size_t i = first; i < plan->latch; ++i)
     {
-        diag_error_at(site ? site->src : NULL, site ? site->line : 0, site ? site->col : 0,
+        const CcbInsn *insn = &body->insns[i];
+        if (insn->op != CCB_OP_JUMP && insn->op != CCB_OP_BRANCH)
+            continue;
+        for (size_t k = 0; k < label_count; ++k)
+            used[k] = used[k] || from[k] == insn->symbol || from[k] == insn->symbol2;
+        if (label_count > 0 && (insn->symbol == header || insn->symbol2 == header))
+            used[0] = true;
+    }
+    if (label_count > 0 && !plan->full)
+        used[0] = true;
+    for (int j = 0; j < plan->copies; ++j)
+    {
+        for (size_t k = 0; k < label_count; ++k)
+        {
+            char prefix[48];
+            snprintf(prefix, sizeof(prefix), "%.40s_u", from[k]);
+            ccb_make_label(fb, line, sizeof(line), prefix);
+            names[(size_t)j * label_count + k] = xstrdup(line);
+        }
+    }
+
+    StringList out;
+    string_list_init(&out);
+    out.arena = body->arena;
+    bool ok = !body->track_insns || string_list_enable_insn_tracking(&out);
+    if (body->track_debug)
+        string_list_enable_debug_tracking(&out);
+    size_t r = 0;
+    for (size_t i = 0; ok && i < plan->header; ++i)
+    {
+        if (r < plan->retarget_count && plan->retargets[r] == i)
+        {
+            r++;
+            ok = ccb_unroll_format_edge(&body->insns[i], header, test, NULL, NULL, 0, line, sizeof(line)) &&
+                 ccb_unroll_append(&out, body, i, line);
+            continue;
+        }
+        ok = ccb_unroll_append(&out, body, i, body->items[i]);
+    }
+
+    if (plan->full)
+    {
+        ok = ok && ccb_unroll_append(&out, body, plan->header, body->items[plan->header]);
+    }
+    else if (ok)
+    {
+        const char *ext = ccb_ir_convert_name(plan->is_unsigned ? CC_CONVERT_ZEXT : CC_CONVERT_SEXT);
+        const char *type = ccb_ir_type_name(plan->counter_type);
+        char convert[64];
+        snprintf(convert, sizeof(convert), "  convert %s %s i64", ext, type);
+        snprintf(line, sizeof(line), "label %s", test);
+        ok = ccb_unroll_append(&out, body, plan->header, line) &&
+             ccb_unroll_append(&out, body, plan->counter, body->items[plan->counter]) &&
+             ccb_unroll_append(&out, body, plan->header, convert);
+        snprintf(line, sizeof(line), "  const i64 %lld", (long long)plan->reach);
+        ok = ok && ccb_unroll_append(&out, body, plan->header, line) &&
+             ccb_unroll_append(&out, body, plan->header, "  binop add i64");
+        for (size_t i = plan->bound_start; ok && i <= plan->bound_end; ++i)
+            ok = ccb_unroll_append(&out, body, i, body->items[i]);
+        ok = ok && ccb_unroll_append(&out, body, plan->header, convert) &&
+             ccb_unroll_append(&out, body, plan->header, plan->up ? "  compare lt i64" : "  compare gt i64");
+        snprintf(line, sizeof(line), "  branch %s %s", names[0], header);
+        ok = ok && ccb_unroll_append(&out, body, plan->branch, line);
+    }
+
+    for (int j = 0; ok && j < plan->copies; ++j)
+    {
+        char **to = &names[(size_t)j * label_count];
+        const char *back = test;
+        if (plan->full)
+            back = j + 1 < plan->copies ? names[(size_t)(j + 1) * label_count] : exit_label;
+        for (size_t i = first; ok && i < plan->latch; ++i)
+        {
+            const CcbInsn *insn = &body->insns[i];
+            if (insn->op == CCB_OP_LABEL)
+            {
+                for (size_t k = 0; k < label_count; ++k)
+                {
+                    if (from[k] == insn->symbol && used[k])
+                    {
+                        snprintf(line, sizeof(line), "label %s", to[k]);
+                        ok = ccb_unroll_append(&out, body, i, line);
+                    }
+                }
+            }
+            else if (insn->op == CCB_OP_JUMP || insn->op == CCB_OP_BRANCH)
+            {
+                ok = ccb_unroll_format_edge(insn, header, back, from, to, label_count, line, sizeof(line)) &&
+                     ccb_unroll_append(&out, body, i, line);
+            }
+            else
+            {
+                ok = ccb_unroll_append(&out, body, i, body->items[i]);
+            }
+        }
+    }
+
+    size_t rest = plan->header;
+    if (plan->full)
+    {
+        rest = plan->latch + 1;
+        const CcbInsn *next = rest < body->count ? &body->insns[rest] : NULL;
+        if (ok && !(next && next->op == CCB_OP_LABEL && next->symbol == exit_label))
+        {
+            snprintf(line, sizeof(line), "  jump %s", exit_label);
+            ok = ccb_unroll_append(&out, body, plan->latch, line);
+        }
+    }
+    else if (ok)
+    {
+        snprintf(line, sizeof(line), "  jump %s", test);
+        ok = ccb_unroll_append(&out, body, plan->latch, line);
+    }
+    for (size_t i = rest; ok && i < body->count; ++i)
+    {
+        if (r < plan->retarget_count && plan->retargets[r] == i)
+        {
+            r++;
+            ok = ccb_unroll_format_edge(&body->insns[i], header, test, NULL, NULL, 0, line, sizeof(line)) &&
+                 ccb_unroll_append(&out, body, i, line);
+            continue;
+        }
+        ok = ccb_unroll_append(&out, body, i, body->items[i]);
+    }
+
+    if (ok)
+    {
+        string_list_free(body);
+        *body = out;
+    }
+    else
+    {
+        string_list_free(&out);
+    }
+    for (size_t k = 0; k < (size_t)plan->copies * label_count; ++k)
+        free(names[k]);
+    free(names);
+    free(used);
+    free(from);
+    return ok;
+}
+
+/* Unrolls [Unroll(N)] loops, and at -O3 small counted loops, inner loops
+   first. Labels are looked up again after each rewrite. */
+static void ccb_opt_unroll(CcbFunctionBuilder *fb)
+{
+    StringList *body = &fb->body;
+    if (!body->track_insns || body->count == 0)
+        return;
+    bool auto_unroll = fb->opts && fb->opts->opt_level >= 3;
+    if (!auto_unroll && fb->unroll_hint_count == 0)
+        return;
+    const char **headers = NULL;
+    size_t header_count = ccb_loop_headers(body->insns, body->count, &headers);
+    int full = 0;
+    int partial = 0;
+    for (size_t h = 0; h < header_count; ++h)
+    {
+        int factor = 0;
+        for (size_t k = 0; k < fb->unroll_hint_count; ++k)
+        {
+            if (strcmp(fb->unroll_hints[k].label, headers[h]) == 0)
+                factor = fb->unroll_hints[k].factor;
+        }
+        CcbUnrollPlan plan;
+        if (!ccb_loop_unroll_plan(body->insns, body->count, headers[h], factor, auto_unroll, ccb_gvn_callee_is_pure,
+                                  fb->module, &plan))
+            continue;
+        if (ccb_apply_unroll_plan(fb, &plan))
+        {
+            if (plan.full)
+                full++;
+            else
+                partial++;
+        }
+        ccb_loop_unroll_plan_free(&plan);
+    }
+    free(headers);
+    if (compiler_verbose_enabled() && (full || partial))
+        compiler_verbose_logf("optimizer", "unroll: %d fully, %d by copies", full, partial);
+}
+
+/* Turns self-recursive tail calls (`call self` then `ret`, or the end of a
+   void function) into stores to the parameters and a jump back to the top
+   of the body. Parameters the prologue copied into locals get the new
+   values there instead. Bodies that take addresses of their frame or grow
+   it with stack_alloc are left alone, as the old frame would be reused
+   while something may still point into it. */
+static void ccb_opt_tail_recursion(CcbFunctionBuilder *fb)
+{
+    StringList *body = &fb->body;
+    if (!body->track_insns || body->count == 0 || !fb->fn || fb->fn->is_varargs || fb->param_count == 0)
+        return;
+    const char *self = ccb_effective_function_name(fb->fn);
+    if (!self)
+        return;
+    char self_name[1024];
+    snprintf(self_name, sizeof(self_name), "%s", self);
+
+    int *slots = (int *)xmalloc(fb->param_count * sizeof(int));
+    for (size_t p = 0; p < fb->param_count; ++p)
+        slots[p] = -1;
+    const StringList *prologue = &fb->prologue;
+    for (size_t i = 0; i < prologue->count; ++i)
+    {
+        const CcbInsn *insn = string_list_insn(prologue, i);
+        if (insn->op == CCB_OP_NONE || insn->op == CCB_OP_DIRECTIVE)
+            continue;
+        const CcbInsn *next = i + 1 < prologue->count ? string_list_insn(prologue, i + 1) : NULL;
+        if (insn->op != CCB_OP_LOAD_PARAM || !next || next->op != CCB_OP_STORE_LOCAL || insn->index < 0 ||
+            (size_t)insn->index >= fb->param_count)
+        {
+            free(slots);
+            return;
+        }
+        slots[insn->index] = next->index;
+        i++;
+    }
+
+    size_t sites = 0;
+    for (size_t i = 0; i < body->count; ++i)
+    {
+        const CcbInsn *insn = &body->insns[i];
+        if (insn->op == CCB_OP_STACK_ALLOC || insn->op == CCB_OP_ADDR_LOCAL || insn->op == CCB_OP_ADDR_PARAM)
+        {
+            free(slots);
+            return;
+        }
+        if (insn->op == CCB_OP_CALL && insn->symbol && strcmp(insn->symbol, self_name) == 0)
+            sites++;
+    }
+    if (sites == 0)
+    {
+        free(slots);
+        return;
+    }
+
+    char entry[32];
+    char line[64];
+    ccb_make_label(fb, entry, sizeof(entry), "tail_entry");
+    StringList out;
+    string_list_init(&out);
+    out.arena = body->arena;
+    bool ok = string_list_enable_insn_tracking(&out);
+    if (body->track_debug)
+        string_list_enable_debug_tracking(&out);
+    snprintf(line, sizeof(line), "label %s", entry);
+    ok = ok && ccb_unroll_append(&out, body, 0, line);
+    int rewritten = 0;
+    for (size_t i = 0; ok && i < body->count; ++i)
+    {
+        const CcbInsn *insn = &body->insns[i];
+        const CcbInsn *next = i + 1 < body->count ? &body->insns[i + 1] : NULL;
+        bool tail = insn->op == CCB_OP_CALL && !insn->is_varargs && insn->symbol &&
+                    strcmp(insn->symbol, self_name) == 0 && insn->arg_count == (int)fb->param_count &&
+                    (next ? next->op == CCB_OP_RET : fb->ret_type == CC_TYPE_VOID);
+        if (!tail)
+        {
+            ok = ccb_unroll_append(&out, body, i, body->items[i]);
+            continue;
+        }
+        for (size_t p = fb->param_count; ok && p-- > 0;)
+        {
+            if (slots[p] >= 0)
+                snprintf(line, sizeof(line), "  store_local %d", slots[p]);
+            else
+                snprintf(line, sizeof(line), "  store_param %zu", p);
+            ok = ccb_unroll_append(&out, body, i, line);
+        }
+        snprintf(line, sizeof(line), "  jump %s", entry);
+        ok = ok && ccb_unroll_append(&out, body, i, line);
+        rewritten++;
+        if (next)
+            i++;
+    }
+    free(slots);
+    if (!ok || rewritten == 0)
+    {
+        string_list_free(&out);
+        return;
+    }
+    string_list_free(body);
+    *body = out;
+    if (compiler_verbose_enabled())
+        compiler_verbose_logf("optimizer", "tail-recursion: %d calls turned into jumps", rewritten);
+}
+
+/* True when the emitted body can neither observe nor change memory, so
+   ccb_opt_gvn may merge calls to it with equal arguments. */
+static bool ccb_function_body_is_pure(const CcbFunctionBuilder *fb)
+{
+    const StringList *lists[2] = {&fb->prologue, &fb->body};
+    for (int l = 0; l < 2; ++l)
+    {
+        const StringList *list = lists[l];
+        if (!list->track_insns)
+            return false;
+        for (size_t i = 0; i < list->count; ++i)
+        {
+            const CcbInsn *insn = string_list_insn(list, i);
+            switch (insn->op)
+            {
+            case CCB_OP_NONE:
+            case CCB_OP_LABEL:
+            case CCB_OP_JUMP:
+            case CCB_OP_BRANCH:
+            case CCB_OP_CONST:
+            case CCB_OP_LOAD_LOCAL:
+            case CCB_OP_STORE_LOCAL:
+            case CCB_OP_LOAD_PARAM:
+            case CCB_OP_STORE_PARAM:
+            case CCB_OP_BINOP:
+            case CCB_OP_UNOP:
+            case CCB_OP_COMPARE:
+            case CCB_OP_CONVERT:
+            case CCB_OP_TEST_NULL:
+            case CCB_OP_DROP:
+            case CCB_OP_DUP:
+            case CCB_OP_NOP:
+            case CCB_OP_RET:
+                break;
+            case CCB_OP_CALL:
+                if (insn->is_varargs || !ccb_gvn_callee_is_pure(insn->symbol, fb->module))
+                    return false;
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void ccb_opt_ccsim_final(CcbFunctionBuilder *fb)
+{
+    if (compiler_verbose_deep_enabled())
+        fprintf(stderr, "\x1b[31m& CCSim hardcore simulation\x1b[0m\n");
+    CcsimOptions ccsim_options;
+    ccsim_options.opt_level = fb->opts ? fb->opts->opt_level : 0;
+    ccsim_options.aggressive = (fb->fn && !fb->fn->is_exposed && !fb->fn->export_name) ? 1 : 0;
+    CcsimStats ccsim_stats;
+    memset(&ccsim_stats, 0, sizeof(ccsim_stats));
+    /* ccsim frees and replaces the lines it rewrites, so it works on heap
+       copies of the arena-owned body. */
+    size_t line_count = fb->body.count;
+    char **lines = (char **)xmalloc((line_count ? line_count : 1) * sizeof(char *));
+    for (size_t i = 0; i < line_count; ++i)
+        lines[i] = xstrdup(fb->body.items[i]);
+    if (fb->module)
+    {
+        const char *vm_fn_name = (fb->fn && fb->fn->metadata.backend_name) ? fb->fn->metadata.backend_name :
+                                 ((fb->fn && fb->fn->name) ? fb->fn->name : NULL);
+        if (fb->fn && fb->fn->export_name && fb->fn->name)
+            vm_fn_name = fb->fn->name;
+        /* ccsim looks for callees among the functions emitted so far. */
+        if (!ccb_module_flush(fb->module))
+        {
+            for (size_t i = 0; i < line_count; ++i)
+                free(lines[i]);
+            free(lines);
+            return;
+        }
+        StringList *module_lines = &fb->module->sim_lines;
+        if (vm_fn_name)
+        {
+            int vm_collapsed = ccsim_vm_collapse_hidden_function(lines, line_count,
+                                                                  vm_fn_name,
+                                                                  module_lines->items, module_lines->count,
+                                                                  &ccsim_options, &ccsim_stats);
+            if (vm_collapsed && compiler_verbose_deep_enabled())
+                compiler_verbose_treef("ccsim-vm", "|-", "collapsed '%s'", vm_fn_name);
+            else if (vm_collapsed && compiler_verbose_enabled())
+                compiler_verbose_logf("ccsim-vm", "collapsed '%s'", vm_fn_name);
+        }
+        ccsim_collapse_hidden_calls(lines, line_count,
+                                    module_lines->items, module_lines->count,
+                                    &ccsim_options, &ccsim_stats);
+    }
+    ccsim_optimize_lines(lines, line_count, &ccsim_options, &ccsim_stats);
+    for (size_t i = 0; i < line_count; ++i)
+    {
+        if (strcmp(lines[i], fb->body.items[i]) != 0)
+            string_list_replace(&fb->body, i, lines[i]);
+        else
+            free(lines[i]);
+    }
+    free(lines);
+    ccb_opt_remove_nops(fb);
+    ccb_opt_remove_unreachable_fallthrough(fb);
+    ccb_opt_remove_unused_labels(fb);
+    ccb_opt_remove_redundant_jumps(fb);
+    if (compiler_verbose_enabled() && (ccsim_stats.vm_collapsed_functions || ccsim_stats.rewritten_load_locals || ccsim_stats.const_folds || ccsim_stats.collapsed_hidden_calls))
+        compiler_verbose_logf("optimizer", "ccsim: passes=%zu vm-collapses=%zu call-collapses=%zu rewrites=%zu folds=%zu barriers=%zu",
+                              ccsim_stats.passes,
+                              ccsim_stats.vm_collapsed_functions,
+                              ccsim_stats.collapsed_hidden_calls,
+                              ccsim_stats.rewritten_load_locals,
+                              ccsim_stats.const_folds,
+                              ccsim_stats.simulation_barriers);
+}
+
+typedef struct
+{
+    const char *name;
+    void (*run)(CcbFunctionBuilder *fb);
+} CcbOptPass;
+
+static const CcbOptPass ccb_opt_passes[] = {
+    {"fold-string-copy-loop", ccb_opt_fold_string_copy_loop},
+    {"prune-dropped-values", ccb_opt_prune_dropped_values},
+    {"fold-const-binops", ccb_opt_fold_const_binops},
+    {"fold-const-unops", ccb_opt_fold_const_unops},
+    {"fold-const-compares", ccb_opt_fold_const_compares},
+    {"fold-const-test-null", ccb_opt_fold_const_test_null},
+    {"fold-const-converts", ccb_opt_fold_const_converts},
+    {"strength-reduce-binops", ccb_opt_strength_reduce_binops},
+    {"simplify-noop-arith", ccb_opt_simplify_noop_arith_and_bitcasts},
+    {"fold-const-or-store-chains", ccb_opt_fold_const_or_store_chains},
+    {"pack-byte-store-runs", ccb_opt_pack_byte_store_runs},
+    {"remove-overwritten-stores", ccb_opt_remove_overwritten_indirect_stores},
+    {"simplify-store-load-store", ccb_opt_simplify_store_load_store},
+    {"promote-local-values", ccb_opt_promote_local_values},
+    {"propagate-local-values", ccb_opt_propagate_local_values},
+    {"remove-dead-local-stores", ccb_opt_remove_dead_local_stores},
+    {"remove-unused-local-slots", ccb_opt_remove_unused_local_slots},
+    {"simplify-bool-normalization", ccb_opt_simplify_bool_normalization},
+    {"simplify-const-branches", ccb_opt_simplify_const_branches},
+    {"remove-unreachable-fallthrough", ccb_opt_remove_unreachable_fallthrough},
+    {"merge-consecutive-labels", ccb_opt_merge_consecutive_labels},
+    {"remove-redundant-jumps", ccb_opt_remove_redundant_jumps},
+    {"remove-unused-labels", ccb_opt_remove_unused_labels},
+    {"remove-dead-local-copies", ccb_opt_remove_dead_local_copies},
+    {"simplify-addr-local-temps", ccb_opt_simplify_addr_local_temp},
+    {"fold-dup-rmw-or-chains", ccb_opt_fold_dup_rmw_or_chains},
+    {"inline-const-str-locals", ccb_opt_inline_const_str_locals},
+    {"fold-zero-init-memset", ccb_opt_fold_zero_init_memset},
+    {"sroa", ccb_opt_sroa},
+    {"gvn", ccb_opt_gvn},
+    {"licm", ccb_opt_licm},
+    {"unroll", ccb_opt_unroll},
+    {"tail-recursion", ccb_opt_tail_recursion},
+    {"ccsim", ccb_opt_ccsim_final},
+};
+
+/* The default pipeline; a step runs when -O is at least min_level. */
+static const struct
+{
+    const char *pass;
+    int min_level;
+} ccb_opt_pipeline[] = {
+    {"fold-string-copy-loop", 3},
+    {"prune-dropped-values", 1},
+    {"fold-const-binops", 2},
+    {"fold-const-unops", 2},
+    {"fold-const-compares", 2},
+    {"fold-const-test-null", 2},
+    {"fold-const-converts", 2},
+    {"strength-reduce-binops", 2},
+    {"simplify-noop-arith", 2},
+    {"fold-const-or-store-chains", 2},
+    {"pack-byte-store-runs", 2},
+    {"remove-overwritten-stores", 2},
+    {"tail-recursion", 2},
+    {"simplify-store-load-store", 3},
+    {"promote-local-values", 3},
+    {"propagate-local-values", 3},
+    {"remove-dead-local-stores", 3},
+    {"remove-unused-local-slots", 3},
+    {"sroa", 3},
+    {"gvn", 3},
+    {"fold-const-compares", 3},
+    {"fold-const-test-null", 3},
+    {"simplify-bool-normalization", 3},
+    {"simplify-const-branches", 3},
+    {"remove-unreachable-fallthrough", 3},
+    {"merge-consecutive-labels", 3},
+    {"remove-redundant-jumps", 3},
+    {"remove-unused-labels", 3},
+    {"remove-redundant-jumps", 3},
+    {"remove-unused-labels", 3},
+    {"licm", 3},
+    {"unroll", 2},
+    {"propagate-local-values", 3},
+    {"remove-dead-local-stores", 3},
+    {"remove-unused-local-slots", 3},
+    {"remove-dead-local-copies", 3},
+    {"simplify-addr-local-temps", 3},
+    {"fold-const-or-store-chains", 3},
+    {"fold-dup-rmw-or-chains", 3},
+    {"prune-dropped-values", 3},
+    {"inline-const-str-locals", 3},
+    {"fold-zero-init-memset", 3},
+    {"ccsim", 3},
+};
+
+static const CcbOptPass *ccb_opt_find_pass(const char *name, size_t len)
+{
+    for (size_t i = 0; i < sizeof(ccb_opt_passes) / sizeof(ccb_opt_passes[0]); ++i)
+    {
+        if (strlen(ccb_opt_passes[i].name) == len && strncmp(ccb_opt_passes[i].name, name, len) == 0)
+            return &ccb_opt_passes[i];
+    }
+    return NULL;
+}
+
+int codegen_ccb_opt_pass_known(const char *name, size_t len)
+{
+    return name && ccb_opt_find_pass(name, len) != NULL;
+}
+
+/* `list` is a comma-separated pass list as given on the command line. */
+static bool ccb_opt_pass_listed(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    while (list && *list)
+    {
+        const char *comma = strchr(list, ',');
+        size_t item_len = comma ? (size_t)(comma - list) : strlen(list);
+        if (item_len == len && strncmp(list, name, len) == 0)
+            return true;
+        list = comma ? comma + 1 : NULL;
+    }
+    return false;
+}
+
+static size_t ccb_opt_count_insns(const StringList *body)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < body->count; ++i)
+    {
+        CcbOpcode op = string_list_insn(body, i)->op;
+        if (op != CCB_OP_NONE && op != CCB_OP_DIRECTIVE && op != CCB_OP_LABEL)
+            count++;
+    }
+    return count;
+}
+
+static void ccb_opt_run_pass(CcbFunctionBuilder *fb, const CcbOptPass *pass)
+{
+    if (fb->opts && ccb_opt_pass_listed(fb->opts->disabled_passes, pass->name))
+        return;
+    if (compiler_verbose_deep_enabled())
+        compiler_verbose_treef("optimizer", "+-", "pass %s", pass->name);
+    if (!compiler_verbose_enabled())
+    {
+        pass->run(fb);
+        return;
+    }
+    size_t before = ccb_opt_count_insns(&fb->body);
+    clock_t start = clock();
+    pass->run(fb);
+    double ms = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+    compiler_verbose_logf("optimizer", "pass %s: %zu -> %zu insns, %.3f ms",
+                          pass->name, before, ccb_opt_count_insns(&fb->body), ms);
+}
+
+static void ccb_function_optimize(CcbFunctionBuilder *fb, const CodegenOptions *opts)
+{
+    if (!fb || !opts)
+        return;
+    if (opts->opt_level <= 0 && !opts->opt_passes)
+        return;
+
+    const char *fn_name = (fb->fn && fb->fn->name) ? fb->fn->name : "<anon>";
+    if (compiler_verbose_enabled())
+        compiler_verbose_logf("optimizer", "optimizing '%s' (O%d)", fn_name, opts->opt_level);
+
+    if (opts->opt_passes)
+    {
+        const char *list = opts->opt_passes;
+        while (*list)
+        {
+            const char *comma = strchr(list, ',');
+            size_t len = comma ? (size_t)(comma - list) : strlen(list);
+            const CcbOptPass *pass = ccb_opt_find_pass(list, len);
+            if (pass)
+                ccb_opt_run_pass(fb, pass);
+            if (!comma)
+                break;
+            list = comma + 1;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < sizeof(ccb_opt_pipeline) / sizeof(ccb_opt_pipeline[0]); ++i)
+        {
+            if (opts->opt_level < ccb_opt_pipeline[i].min_level)
+                continue;
+            const CcbOptPass *pass = ccb_opt_find_pass(ccb_opt_pipeline[i].pass, strlen(ccb_opt_pipeline[i].pass));
+            if (pass)
+                ccb_opt_run_pass(fb, pass);
+        }
+    }
+
+    if (compiler_verbose_enabled())
+        compiler_verbose_logf("optimizer", "completed '%s'", fn_name);
+}
+
+/* Moves blocks the profile marked cold (see ccb_profile_mark_cold) behind
+   the rest of the function so the hot path falls through. Blocks that used
+   to fall into their successor get an explicit jump when they are split. */
+static void ccb_function_layout_cold_blocks(CcbFunctionBuilder *fb)
+{
+    if (!fb || fb->profile_cold_labels.count == 0 || fb->body.count == 0)
+        return;
+
+    StringList *body = &fb->body;
+    size_t *starts = (size_t *)xmalloc((body->count + 1) * sizeof(size_t));
+    size_t block_count = 0;
+    starts[block_count++] = 0;
+    for (size_t i = 1; i < body->count; ++i)
+    {
+        if (strncmp(ccb_trim_leading_ws(body->items[i]), "label ", 6) == 0)
+            starts[block_count++] = i;
+    }
+    starts[block_count] = body->count;
+
+    bool *cold = (bool *)xcalloc(block_count, sizeof(bool));
+    size_t cold_count = 0;
+    char label[128];
+    for (size_t b = 1; b < block_count; ++b)
+    {
+        if (ccb_parse_label_name(string_list_insn(body, starts[b]), label, sizeof(label)) &&
+            string_list_contains(&fb->profile_cold_labels, label))
+        {
+            cold[b] = true;
+            cold_count++;
+        }
+    }
+
+    /* A hot tail that runs off the end of the function cannot be followed by
+       the sunk blocks. */
+    bool tail_terminates = ccb_instruction_is_terminator(body->items[body->count - 1]);
+    if (cold_count == 0 || cold_count == block_count - 1 || (!cold[block_count - 1] && !tail_terminates))
+    {
+        free(cold);
+        free(starts);
+        return;
+    }
+
+    size_t *order = (size_t *)xmalloc(block_count * sizeof(size_t));
+    size_t pos = 0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (size_t b = 0; b < block_count; ++b)
+        {
+            if (cold[b] == (pass == 1))
+                order[pos++] = b;
+        }
+    }
+
+    StringList laid;
+    string_list_init(&laid);
+    laid.arena = body->arena;
+    bool ok = !body->track_insns || string_list_enable_insn_tracking(&laid);
+    if (body->track_debug)
+        string_list_enable_debug_tracking(&laid);
+    for (size_t k = 0; ok && k < block_count; ++k)
+    {
+        size_t b = order[k];
+        for (size_t i = starts[b]; ok && i < starts[b + 1]; ++i)
+        {
+            if (body->track_debug)
+                string_list_set_debug_location(&laid, string_list_get_debug_file(body, i),
+                                               string_list_get_debug_line(body, i),
+                                               string_list_get_debug_column(body, i));
+            ok = string_list_append(&laid, body->items[i]);
+        }
+        size_t last = starts[b + 1] - 1;
+        bool falls_through = b + 1 < block_count && !ccb_instruction_is_terminator(body->items[last]);
+        bool successor_next = k + 1 < block_count && order[k + 1] == b + 1;
+        if (ok && falls_through && !successor_next)
+        {
+            ok = ccb_parse_label_name(string_list_insn(body, starts[b + 1]), label, sizeof(label)) &&
+                 string_list_appendf(&laid, "  jump %s", label);
+        }
+    }
+
+    if (ok)
+    {
+        string_list_free(body);
+        *body = laid;
+        compiler_verbose_logf("codegen", "profile: moved %zu cold block(s) to the end of '%s'", cold_count,
+                              (fb->fn && fb->fn->name) ? fb->fn->name : "<anon>");
+    }
+    else
+    {
+        string_list_free(&laid);
+    }
+    free(order);
+    free(cold);
+    free(starts);
+}
+
+static void ccb_function_builder_register_params(CcbFunctionBuilder *fb)
+{
+    if (!fb || !fb->fn || fb->fn->param_count <= 0)
+        return;
+
+    for (int i = 0; i < fb->fn->param_count; ++i)
+    {
+        const char *param_name = NULL;
+        if (fb->fn->param_names && fb->fn->param_names[i] && fb->fn->param_names[i][0] != '\0')
+            param_name = fb->fn->param_names[i];
+        Type *param_type = fb->fn->param_types ? fb->fn->param_types[i] : NULL;
+        bool address_only = param_type && param_type->kind == TY_STRUCT;
+        if (!ccb_local_add(fb, param_name, param_type, address_only, true))
+        {
+            diag_error_at(fb->fn->src, fb->fn->line, fb->fn->col,
+                          "failed to allocate local slot for parameter %d", i);
+            return;
+        }
+
+        if (ccb_function_param_has_managed_length(fb->fn, i))
+        {
+            char *length_name = ccb_make_managed_length_name(param_name);
+            if (!ccb_local_add_u64(fb, length_name, true))
+            {
+                diag_error_at(fb->fn->src, fb->fn->line, fb->fn->col,
+                              "failed to allocate managed array length slot for parameter %d", i);
+                return;
+            }
+        }
+    }
+}
+
+static CcbLocal *ccb_local_lookup(CcbFunctionBuilder *fb, const char *name)
+{
+    if (!fb || !name)
+        return NULL;
+    for (size_t i = fb->locals_count; i-- > 0;)
+    {
+        CcbLocal *local = &fb->locals[i];
+        if (!local->name || !local->is_active)
+            continue;
+        if (local->scope_depth > fb->scope_depth)
+            continue;
+        if (strcmp(local->name, name) == 0)
+            return local;
+    }
+    return NULL;
+}
+
+static CcbLocal *ccb_local_add(CcbFunctionBuilder *fb, const char *name, Type *type, bool address_only, bool is_param)
+{
+    if (!fb)
+        return NULL;
+    if (fb->locals_count == fb->locals_capacity)
+    {
+        size_t new_cap = fb->locals_capacity ? fb->locals_capacity * 2 : 8;
+        CcbLocal *new_locals = (CcbLocal *)realloc(fb->locals, new_cap * sizeof(CcbLocal));
+        if (!new_locals)
+            return NULL;
+        fb->locals = new_locals;
+        fb->locals_capacity = new_cap;
+    }
+
+    CcbLocal *slot = &fb->locals[fb->locals_count++];
+    slot->name = name;
+    slot->type = type;
+    slot->value_type = address_only ? CC_TYPE_PTR : map_type_to_cc(type);
+    slot->is_address_only = address_only;
+    slot->is_param = is_param;
+    slot->index = is_param ? (int)fb->param_count : (int)fb->local_count;
+    slot->scope_depth = fb->scope_depth;
+    slot->is_active = true;
+    if (is_param)
+        fb->param_count++;
+    else
+        fb->local_count++;
+    return slot;
+}
+
+static CcbLocal *ccb_local_add_u64(CcbFunctionBuilder *fb, const char *name, bool is_param)
+{
+    CcbLocal *slot = ccb_local_add(fb, name, NULL, false, is_param);
+    if (slot)
+        slot->value_type = CC_TYPE_U64;
+    return slot;
+}
+
+static int ccb_promote_param_to_local(CcbFunctionBuilder *fb, const Node *site, CcbLocal **inout_local)
+{
+    if (!fb || !inout_local || !*inout_local)
+        return 1;
+
+    CcbLocal *param = *inout_local;
+    if (!param->is_param)
+        return 0;
+
+    const char *param_name = (param->name && *param->name) ? param->name : "<anonymous>";
+
+    CcbLocal *shadow = ccb_local_add(fb, param->name, param->type, param->is_address_only, false);
+    if (!shadow)
+    {
+        diag_error_at(site ? site->src : NULL, site ? site->line : 0, site ? site->col : 0,
+                      "failed to create local copy for parameter '%s'", param_name);
+        return 1;
+    }
+
+    shadow->value_type = param->value_type;
+    shadow->scope_depth = param->scope_depth;
+
+    if (!ccb_append_load_local(&fb->prologue, param))
+    {
+        diag_error_at(site ? site->src : NULL, site ? site->line : 0, site ? site->col : 0,
+                      "failed to read parameter '%s'", param_name);
+        return 1;
+    }
+    if (!ccb_append_store_local(&fb->prologue, shadow))
+    {
+        diag_error_at(site ? site->src : NULL, site ? site->line : 0, site ? site->col : 0,
                       "failed to copy parameter '%s' into local storage", param_name);
         return 1;
     }
@@ -6936,6 +7939,13 @@ static int ccb_emit_pointer_difference(CcbFunctionBuilder *fb, const Node *expr)
     return 0;
 }
 
+static bool ccb_require_cert_strcmp(CcbFunctionBuilder *fb)
+{
+    if (ccb_module_has_function(fb->module, "__cert__strcmp") || ccb_module_has_extern(fb->module, "__cert__strcmp"))
+        return true;
+    return ccb_module_appendf(fb->module, ".extern __cert__strcmp params=(ptr,ptr) returns=i32");
+}
+
 static int ccb_emit_string_equality_compare(CcbFunctionBuilder *fb, const Node *expr)
 {
     if (!fb || !expr || !expr->lhs || !expr->rhs)
@@ -6968,11 +7978,8 @@ static int ccb_emit_string_equality_compare(CcbFunctionBuilder *fb, const Node *
     if (!ccb_emit_store_local(fb, rhs_local))
         return 1;
 
-    if (!ccb_module_has_function(fb->module, "__cert__strcmp") && !ccb_module_has_extern(fb->module, "__cert__strcmp"))
-    {
-        if (!ccb_module_appendf(fb->module, ".extern __cert__strcmp params=(ptr,ptr) returns=i32"))
-            return 1;
-    }
+    if (!ccb_require_cert_strcmp(fb))
+        return 1;
 
     if (!string_list_appendf(&fb->body, lhs_local_is_param ? "  load_param %d" : "  load_local %d", lhs_local_index))
         return 1;
@@ -7014,33 +8021,11 @@ static int ccb_emit_string_length_expr(CcbFunctionBuilder *fb, const Node *expr)
     if (expr->lhs->kind == ND_VAR && expr->lhs->var_ref && *expr->lhs->var_ref)
         symbol_name = expr->lhs->var_ref;
 
-    size_t file_len = strlen(file_name);
-    uint8_t *file_bytes = (uint8_t *)malloc(file_len + 1);
-    if (!file_bytes)
-        return 1;
-    memcpy(file_bytes, file_name, file_len);
-    file_bytes[file_len] = 0;
-    const char *file_sym = ccb_module_intern_hidden_byte_string(fb->module, "file", file_bytes, file_len + 1);
-    free(file_bytes);
-    if (!file_sym)
-        return 1;
-
-    size_t symbol_len = strlen(symbol_name);
-    uint8_t *name_bytes = (uint8_t *)malloc(symbol_len + 1);
-    if (!name_bytes)
-        return 1;
-    memcpy(name_bytes, symbol_name, symbol_len);
-    name_bytes[symbol_len] = 0;
-    const char *name_sym = ccb_module_intern_hidden_byte_string(fb->module, "name", name_bytes, symbol_len + 1);
-    free(name_bytes);
-    if (!name_sym)
-        return 1;
-
-    if (!ccb_emit_addr_global(&fb->body, file_sym))
+    if (ccb_emit_pooled_cstring(fb, "file", file_name))
         return 1;
     if (!ccb_emit_const_u64(&fb->body, CC_TYPE_U64, (uint64_t)expr->line))
         return 1;
-    if (!ccb_emit_addr_global(&fb->body, name_sym))
+    if (ccb_emit_pooled_cstring(fb, "name", symbol_name))
         return 1;
 
     if (!string_list_appendf(&fb->body, "  call __cert__strlen u64 (ptr,ptr,u64,ptr)"))
@@ -7153,7 +8138,7 @@ static int ccb_emit_deref_address(CcbFunctionBuilder *fb, const Node *expr, CCVa
     if (out_elem_type)
         *out_elem_type = elem_type;
     
-    if (base_type && base_type->kind == TY_REF && base_type->ref_nullability == 1)
+    if (base_type && base_type->kind == TY_REF && base_type->ref_nullability == 1 && !expr->null_check_elided)
     {
         
         if (!string_list_appendf(&fb->body, "  dup ptr"))
@@ -7190,40 +8175,17 @@ static int ccb_emit_deref_address(CcbFunctionBuilder *fb, const Node *expr, CCVa
 
         
         const char *fname = expr->src && expr->src->filename ? expr->src->filename : "";
-        size_t flen = strlen(fname);
-        uint8_t *fbytes = (uint8_t *)malloc(flen + 1);
-        if (!fbytes)
-            return 1;
-        memcpy(fbytes, fname, flen);
-        fbytes[flen] = 0;
-        const char *file_sym = ccb_module_intern_hidden_byte_string(fb->module, "file", fbytes, flen + 1);
-        free(fbytes);
-        if (!file_sym)
-            return 1;
-
-        
         const char *vname = "";
         if (base->kind == ND_VAR && base->var_ref)
             vname = base->var_ref;
-        size_t nlen = strlen(vname);
-        uint8_t *nbytes = (uint8_t *)malloc(nlen + 1);
-        if (!nbytes)
-            return 1;
-        memcpy(nbytes, vname, nlen);
-        nbytes[nlen] = 0;
-        const char *name_sym = ccb_module_intern_hidden_byte_string(fb->module, "name", nbytes, nlen + 1);
-        free(nbytes);
-        if (!name_sym)
-            return 1;
 
         if (!string_list_appendf(&fb->body, "  drop ptr"))
             return 1;
-
-        if (!ccb_emit_addr_global(&fb->body, file_sym))
+        if (ccb_emit_pooled_cstring(fb, "file", fname))
             return 1;
         if (!ccb_emit_const_u64(&fb->body, CC_TYPE_U64, (uint64_t)expr->line))
             return 1;
-        if (!ccb_emit_addr_global(&fb->body, name_sym))
+        if (ccb_emit_pooled_cstring(fb, "name", vname))
             return 1;
         if (fb->active_try_error_label && fb->active_try_error_label[0])
         {
@@ -7452,7 +8414,8 @@ static int ccb_emit_member_address(CcbFunctionBuilder *fb, const Node *expr, CCV
             return 1;
     }
 
-    if (!expr->is_pointer_deref && base->type && base->type->kind == TY_REF && base->type->ref_nullability == 1)
+    if (!expr->is_pointer_deref && base->type && base->type->kind == TY_REF && base->type->ref_nullability == 1 &&
+        !expr->null_check_elided)
     {
         if (!string_list_appendf(&fb->body, "  dup ptr"))
             return 1;
@@ -7483,39 +8446,18 @@ static int ccb_emit_member_address(CcbFunctionBuilder *fb, const Node *expr, CCV
                 return 1;
         }
 
-        const char *fname = expr->src && expr->src->filename ? expr->src->filename : "";
-        size_t flen = strlen(fname);
-        uint8_t *fbytes = (uint8_t *)malloc(flen + 1);
-        if (!fbytes)
-            return 1;
-        memcpy(fbytes, fname, flen);
-        fbytes[flen] = 0;
-        const char *file_sym = ccb_module_intern_hidden_byte_string(fb->module, "file", fbytes, flen + 1);
-        free(fbytes);
-        if (!file_sym)
-            return 1;
-
+        const char *fname = expr->src && expr->src->filename ? expr->src->filename : "";
         const char *vname = "";
         if (base->kind == ND_VAR && base->var_ref)
             vname = base->var_ref;
-        size_t nlen = strlen(vname);
-        uint8_t *nbytes = (uint8_t *)malloc(nlen + 1);
-        if (!nbytes)
-            return 1;
-        memcpy(nbytes, vname, nlen);
-        nbytes[nlen] = 0;
-        const char *name_sym = ccb_module_intern_hidden_byte_string(fb->module, "name", nbytes, nlen + 1);
-        free(nbytes);
-        if (!name_sym)
-            return 1;
 
         if (!string_list_appendf(&fb->body, "  drop ptr"))
             return 1;
-        if (!ccb_emit_addr_global(&fb->body, file_sym))
+        if (ccb_emit_pooled_cstring(fb, "file", fname))
             return 1;
         if (!ccb_emit_const_u64(&fb->body, CC_TYPE_U64, (uint64_t)expr->line))
             return 1;
-        if (!ccb_emit_addr_global(&fb->body, name_sym))
+        if (ccb_emit_pooled_cstring(fb, "name", vname))
             return 1;
         if (fb->active_try_error_label && fb->active_try_error_label[0])
         {
@@ -8022,99 +8964,311 @@ static int ccb_emit_pointer_offset(CcbFunctionBuilder *fb, int offset, const Nod
     return 0;
 }
 
-static int ccb_emit_struct_copy(CcbFunctionBuilder *fb, const Type *struct_type, CcbLocal *dst_ptr, CcbLocal *src_ptr)
+static bool ccb_profile_symbol(const CcbModule *mod, const char *what, char *buffer, size_t bufsz)
 {
-    if (!fb || !struct_type || struct_type->kind != TY_STRUCT || !dst_ptr || !src_ptr)
-        return 0;
+    int n = snprintf(buffer, bufsz, "__profile_%s_%s", what,
+                     (mod && mod->profile_tag) ? mod->profile_tag : "unit");
+    return n > 0 && (size_t)n < bufsz;
+}
 
-    ptrdiff_t dst_slot = dst_ptr ? (ptrdiff_t)(dst_ptr - fb->locals) : -1;
-    ptrdiff_t src_slot = src_ptr ? (ptrdiff_t)(src_ptr - fb->locals) : -1;
+/* Allocates the next counter slot of the module for the given key and bumps
+   it in place. */
+static int ccb_emit_profile_counter(CcbFunctionBuilder *fb, ProfileCounterKind kind, int site, int arm)
+{
+    char key[1024];
+    char counters[256];
+    if (!profile_format_key(key, sizeof(key), kind, profile_function_key(fb->fn), site, arm) ||
+        !ccb_profile_symbol(fb->module, "counters", counters, sizeof(counters)))
+        return 1;
+    size_t slot = fb->module->profile_keys.count;
+    if (!string_list_append(&fb->module->profile_keys, key))
+        return 1;
 
-    if (!ccb_struct_copy_refresh(fb, dst_slot, src_slot, &dst_ptr, &src_ptr))
+    if (!ccb_emit_addr_global(&fb->body, counters))
+        return 1;
+    if (ccb_emit_pointer_offset(fb, (int)(slot * 8), NULL))
+        return 1;
+    if (!string_list_appendf(&fb->body, "  dup %s", cc_type_name(CC_TYPE_PTR)) ||
+        !ccb_emit_load_indirect(&fb->body, CC_TYPE_U64) ||
+        !ccb_emit_const(&fb->body, CC_TYPE_U64, 1) ||
+        !string_list_appendf(&fb->body, "  binop add %s", cc_type_name(CC_TYPE_U64)) ||
+        !ccb_emit_store_indirect(&fb->body, CC_TYPE_U64))
         return 1;
+    return 0;
+}
 
-    int field_count = struct_type->strct.field_count;
-    for (int i = 0; i < field_count; ++i)
+/* The first call into an instrumented module arms the module's dump
+   function (see ccb_module_emit_profile_data) to run at exit. */
+static int ccb_emit_profile_prologue(CcbFunctionBuilder *fb)
+{
+    CcbModule *mod = fb->module;
+    char armed[256];
+    char dump[256];
+    if (!ccb_profile_symbol(mod, "armed", armed, sizeof(armed)) ||
+        !ccb_profile_symbol(mod, "dump", dump, sizeof(dump)))
+        return 1;
+    if (ccb_ensure_runtime_extern(fb, "atexit", "i32", "(ptr)") ||
+        ccb_ensure_runtime_extern(fb, "getenv", "ptr", "(ptr)") ||
+        ccb_ensure_runtime_extern(fb, "fopen", "ptr", "(ptr,ptr)") ||
+        ccb_ensure_runtime_extern(fb, "fputc", "i32", "(i32,ptr)") ||
+        ccb_ensure_runtime_extern(fb, "fclose", "i32", "(ptr)"))
+        return 1;
+    if (!ccb_module_has_function(mod, "fprintf") && !ccb_module_has_extern(mod, "fprintf") &&
+        !ccb_module_appendf(mod, ".extern fprintf params=(ptr,ptr) returns=i32 varargs"))
+        return 1;
+
+    char register_label[32];
+    char entry_label[32];
+    ccb_make_label(fb, register_label, sizeof(register_label), "profile_register");
+    ccb_make_label(fb, entry_label, sizeof(entry_label), "profile_entry");
+
+    bool ok = ccb_emit_load_global(&fb->body, armed) &&
+              ccb_emit_const(&fb->body, CC_TYPE_I32, 0) &&
+              string_list_appendf(&fb->body, "  compare eq %s", cc_type_name(CC_TYPE_I32)) &&
+              string_list_appendf(&fb->body, "  branch %s %s", register_label, entry_label) &&
+              string_list_appendf(&fb->body, "label %s", register_label) &&
+              ccb_emit_const(&fb->body, CC_TYPE_I32, 1) &&
+              ccb_emit_store_global(&fb->body, armed) &&
+              ccb_emit_addr_global(&fb->body, dump) &&
+              string_list_append(&fb->body, "  call atexit i32 (ptr)") &&
+              string_list_append(&fb->body, "  drop i32") &&
+              string_list_appendf(&fb->body, "label %s", entry_label);
+    if (!ok)
+        return 1;
+    return ccb_emit_profile_counter(fb, PROFILE_FUNCTION, 0, 0);
+}
+
+/* Records every label emitted since `from` as cold so block layout can sink
+   it below the hot path. */
+static void ccb_profile_mark_cold(CcbFunctionBuilder *fb, size_t from)
+{
+    char label[128];
+    for (size_t i = from; i < fb->body.count; ++i)
+    {
+        if (ccb_parse_label_name(string_list_insn(&fb->body, i), label, sizeof(label)))
+            string_list_append(&fb->profile_cold_labels, label);
+    }
+}
+
+/* Blocks up to this many bytes are moved with inline word loads and stores;
+   larger ones go through the runtime's memcpy/memset. */
+#define CCB_BLOCK_INLINE_BYTES 64
+
+static size_t ccb_type_align_bytes(const Type *ty)
+{
+    if (!ty)
+        return 1;
+    switch (ty->kind)
+    {
+    case TY_I16:
+    case TY_U16:
+        return 2;
+    case TY_I32:
+    case TY_U32:
+    case TY_F32:
+        return 4;
+    case TY_I64:
+    case TY_U64:
+    case TY_F64:
+    case TY_VA_LIST:
+        return 8;
+    case TY_PTR:
+        return ccb_pointer_size_bytes();
+    case TY_F128:
+        return 16;
+    case TY_ARRAY:
+        return ty->array.elem ? ccb_type_align_bytes(ty->array.elem) : 8;
+    case TY_STRUCT:
     {
-        if (!ccb_struct_copy_refresh(fb, dst_slot, src_slot, &dst_ptr, &src_ptr))
+        if (ty->strct.is_packed)
             return 1;
-        const Type *field_type = struct_type->strct.field_types ? struct_type->strct.field_types[i] : NULL;
-        if (!field_type)
-            continue;
+        size_t max_align = 1;
+        for (int i = 0; ty->strct.field_types && i < ty->strct.field_count; ++i)
+        {
+            size_t field_align = ccb_type_align_bytes(ty->strct.field_types[i]);
+            if (field_align > max_align)
+                max_align = field_align;
+        }
+        return max_align;
+    }
+    default:
+        return 1;
+    }
+}
 
-        int field_offset = struct_type->strct.field_offsets ? struct_type->strct.field_offsets[i] : 0;
+typedef struct
+{
+    size_t offset;
+    size_t size;
+    CCValueType type;
+} CcbBlockWord;
 
-        if (type_is_address_only(field_type))
+/* Lists the scalars of `ty` in offset order. Fails for unions, unsized
+   arrays and anything wider than a word, which are moved as raw bytes. */
+static bool ccb_block_leaves(const Type *ty, size_t base, CcbBlockWord *leaves, int *count, int cap)
+{
+    if (!ty)
+        return false;
+    if (ty->kind == TY_STRUCT)
+    {
+        if (ty->is_union || (ty->strct.field_count > 0 && (!ty->strct.field_types || !ty->strct.field_offsets)))
+            return false;
+        for (int i = 0; i < ty->strct.field_count; ++i)
+        {
+            if (!ccb_block_leaves(ty->strct.field_types[i], base + (size_t)ty->strct.field_offsets[i], leaves, count, cap))
+                return false;
+        }
+        return true;
+    }
+    if (ty->kind == TY_ARRAY)
+    {
+        if (ty->array.is_unsized || !ty->array.elem)
+            return false;
+        size_t elem_size = ccb_type_size_bytes(ty->array.elem);
+        for (int i = 0; i < ty->array.length; ++i)
         {
-            Type *field_ptr_ty = type_ptr((Type *)field_type);
+            if (!ccb_block_leaves(ty->array.elem, base + (size_t)i * elem_size, leaves, count, cap))
+                return false;
+        }
+        return true;
+    }
+    size_t size = ccb_type_size_bytes(ty);
+    if (size == 0 || size > 8 || *count >= cap)
+        return false;
+    if (*count > 0 && leaves[*count - 1].offset + leaves[*count - 1].size > base)
+        return false;
+    leaves[*count].offset = base;
+    leaves[*count].size = size;
+    leaves[*count].type = map_type_to_cc(ty);
+    ++*count;
+    return true;
+}
 
-            CcbLocal *dst_field = ccb_local_add(fb, NULL, field_ptr_ty, false, false);
-            if (!dst_field)
-                return 1;
-            ptrdiff_t dst_field_slot = dst_field - fb->locals;
-            if (!ccb_struct_copy_refresh(fb, dst_slot, src_slot, &dst_ptr, &src_ptr))
-                return 1;
-            if (!ccb_emit_load_local(fb, dst_ptr))
-                return 1;
-            if (ccb_emit_pointer_offset(fb, field_offset, NULL))
-                return 1;
-            if (!ccb_emit_store_local(fb, dst_field))
-                return 1;
+static CCValueType ccb_block_int_type(size_t width)
+{
+    return width == 8 ? CC_TYPE_I64 : width == 4 ? CC_TYPE_I32 : width == 2 ? CC_TYPE_I16 : CC_TYPE_I8;
+}
 
-            CcbLocal *src_field = ccb_local_add(fb, NULL, field_ptr_ty, false, false);
-            if (!src_field)
-                return 1;
-            ptrdiff_t src_field_slot = src_field - fb->locals;
-            if (!ccb_struct_copy_refresh(fb, dst_slot, src_slot, &dst_ptr, &src_ptr))
-                return 1;
-            if (!ccb_emit_load_local(fb, src_ptr))
-                return 1;
-            if (ccb_emit_pointer_offset(fb, field_offset, NULL))
-                return 1;
-            if (!ccb_emit_store_local(fb, src_field))
-                return 1;
+/* Splits a block of `size` bytes into the word moves that copy or zero it.
+   Padding is skipped, and neighbouring scalars are merged into the widest
+   aligned integer word that covers them whole; a scalar that stays alone
+   keeps its own type. Returns the word count. */
+static int ccb_block_words(const Type *ty, size_t size, CcbBlockWord *words, int cap)
+{
+    size_t align = ccb_type_align_bytes(ty);
+    if (align > 8)
+        align = 8;
 
-            dst_field = ccb_local_from_slot(fb, dst_field_slot);
-            src_field = ccb_local_from_slot(fb, src_field_slot);
-            if (!dst_field || !src_field)
-                return 1;
+    CcbBlockWord leaves[CCB_BLOCK_INLINE_BYTES];
+    int leaf_count = 0;
+    int count = 0;
+    if (!ccb_block_leaves(ty, 0, leaves, &leaf_count, CCB_BLOCK_INLINE_BYTES))
+    {
+        size_t offset = 0;
+        while (offset < size && count < cap)
+        {
+            size_t width = align;
+            while (width > 1 && (offset % width != 0 || offset + width > size))
+                width /= 2;
+            words[count].offset = offset;
+            words[count].size = width;
+            words[count].type = ccb_block_int_type(width);
+            ++count;
+            offset += width;
+        }
+        return count;
+    }
 
-            if (ccb_emit_struct_copy(fb, field_type, dst_field, src_field))
-                return 1;
-            if (!ccb_struct_copy_refresh(fb, dst_slot, src_slot, &dst_ptr, &src_ptr))
-                return 1;
-            continue;
+    int i = 0;
+    while (i < leaf_count && count < cap)
+    {
+        size_t offset = leaves[i].offset;
+        int next = i + 1;
+        words[count] = leaves[i];
+        for (size_t width = align; width > 1; width /= 2)
+        {
+            if (offset % width != 0 || offset + width > size)
+                continue;
+            int end = i;
+            while (end < leaf_count && leaves[end].offset + leaves[end].size <= offset + width)
+                ++end;
+            if (end - i < 2 || (end < leaf_count && leaves[end].offset < offset + width))
+                continue;
+            words[count].size = width;
+            words[count].type = ccb_block_int_type(width);
+            next = end;
+            break;
         }
+        ++count;
+        i = next;
+    }
+    return count;
+}
+
+/* Copies a value of type `ty` from the address in `src_slot` to the one in
+   `dst_slot`, or zeroes it when `src_slot` is negative. Small blocks become
+   inline word moves; large ones call __cert__memcpy or __cert__memset. */
+static int ccb_emit_block_move(CcbFunctionBuilder *fb, const Type *ty, ptrdiff_t dst_slot, ptrdiff_t src_slot)
+{
+    CcbLocal *dst = ccb_local_from_slot(fb, dst_slot);
+    CcbLocal *src = src_slot >= 0 ? ccb_local_from_slot(fb, src_slot) : NULL;
+    if (!dst || (src_slot >= 0 && !src))
+        return 1;
+
+    size_t size = ccb_type_size_bytes(ty);
+    if (size == 0)
+        return 0;
 
-        CCValueType field_cc_ty = map_type_to_cc(field_type);
-        if (!ccb_emit_load_local(fb, src_ptr))
+    if (size > CCB_BLOCK_INLINE_BYTES)
+    {
+        const char *callee = src ? "__cert__memcpy" : "__cert__memset";
+        if (ccb_ensure_runtime_extern(fb, callee, "ptr", src ? "(ptr,ptr,u64)" : "(ptr,i32,u64)"))
             return 1;
-        if (ccb_emit_pointer_offset(fb, field_offset, NULL))
+        if (!ccb_emit_load_local(fb, dst))
             return 1;
-        if (!ccb_emit_load_indirect(&fb->body, field_cc_ty))
+        if (src ? !ccb_emit_load_local(fb, src) : !ccb_emit_const(&fb->body, CC_TYPE_I32, 0))
             return 1;
-
-        CcbLocal *value_tmp = ccb_local_add(fb, NULL, (Type *)field_type, false, false);
-        if (!value_tmp)
+        if (!ccb_emit_const(&fb->body, CC_TYPE_U64, (int64_t)size))
             return 1;
-        if (!ccb_emit_store_local(fb, value_tmp))
+        if (!string_list_appendf(&fb->body, "  call %s ptr (ptr,%s,u64)", callee, src ? "ptr" : "i32"))
             return 1;
-
-        if (!ccb_struct_copy_refresh(fb, dst_slot, src_slot, &dst_ptr, &src_ptr))
+        if (!string_list_append(&fb->body, "  drop ptr"))
             return 1;
+        return 0;
+    }
 
-        if (!ccb_emit_load_local(fb, dst_ptr))
+    CcbBlockWord words[CCB_BLOCK_INLINE_BYTES];
+    int word_count = ccb_block_words(ty, size, words, CCB_BLOCK_INLINE_BYTES);
+    for (int i = 0; i < word_count; ++i)
+    {
+        if (!ccb_emit_load_local(fb, dst))
             return 1;
-        if (ccb_emit_pointer_offset(fb, field_offset, NULL))
+        if (ccb_emit_pointer_offset(fb, (int)words[i].offset, NULL))
             return 1;
-        if (!ccb_emit_load_local(fb, value_tmp))
+        if (src)
+        {
+            if (!ccb_emit_load_local(fb, src))
+                return 1;
+            if (ccb_emit_pointer_offset(fb, (int)words[i].offset, NULL))
+                return 1;
+            if (!ccb_emit_load_indirect(&fb->body, words[i].type))
+                return 1;
+        }
+        else if (!ccb_emit_const_zero(&fb->body, words[i].type))
             return 1;
-        if (!ccb_emit_store_indirect(&fb->body, field_cc_ty))
+        if (!ccb_emit_store_indirect(&fb->body, words[i].type))
             return 1;
     }
     return 0;
 }
 
+static int ccb_emit_struct_copy(CcbFunctionBuilder *fb, const Type *struct_type, CcbLocal *dst_ptr, CcbLocal *src_ptr)
+{
+    if (!fb || !struct_type || struct_type->kind != TY_STRUCT || !dst_ptr || !src_ptr)
+        return 0;
+    return ccb_emit_block_move(fb, struct_type, dst_ptr - fb->locals, src_ptr - fb->locals);
+}
+
 static int ccb_emit_struct_zero(CcbFunctionBuilder *fb, const Node *var_decl, const char *var_name, const Type *struct_type)
 {
     if (!fb || !var_name || !struct_type || struct_type->kind != TY_STRUCT)
@@ -8128,28 +9282,15 @@ static int ccb_emit_struct_zero(CcbFunctionBuilder *fb, const Node *var_decl, co
     var_ref.line = var_decl ? var_decl->line : 0;
     var_ref.col = var_decl ? var_decl->col : 0;
 
-    for (int i = 0; i < struct_type->strct.field_count; ++i)
-    {
-        Node member = {0};
-        member.kind = ND_MEMBER;
-        member.lhs = &var_ref;
-        member.field_index = i;
-        member.field_offset = struct_type->strct.field_offsets ? struct_type->strct.field_offsets[i] : 0;
-        member.type = struct_type->strct.field_types ? struct_type->strct.field_types[i] : NULL;
-        member.is_pointer_deref = 0;
-        member.src = var_decl ? var_decl->src : NULL;
-        member.line = var_decl ? var_decl->line : 0;
-        member.col = var_decl ? var_decl->col : 0;
-
-        CCValueType field_ty = CC_TYPE_I32;
-        if (ccb_emit_member_address(fb, &member, &field_ty, NULL))
-            return 1;
-        if (!ccb_emit_const_zero(&fb->body, field_ty))
-            return 1;
-        if (!ccb_emit_store_indirect(&fb->body, field_ty))
-            return 1;
-    }
-    return 0;
+    CcbLocal *dst_ptr = ccb_local_add(fb, NULL, type_ptr((Type *)struct_type), false, false);
+    if (!dst_ptr)
+        return 1;
+    ptrdiff_t dst_slot = dst_ptr - fb->locals;
+    if (ccb_emit_expr_basic(fb, &var_ref))
+        return 1;
+    if (!ccb_emit_store_local(fb, ccb_local_from_slot(fb, dst_slot)))
+        return 1;
+    return ccb_emit_block_move(fb, struct_type, dst_slot, -1);
 }
 
 static int ccb_emit_struct_initializer(CcbFunctionBuilder *fb, const Node *var_decl, const char *var_name, const Type *struct_type, const Node *init)
@@ -8798,8 +9939,7 @@ static bool ccb_rewrite_param_loads(StringList *list, int param_index, int local
         if (!replacement)
             return false;
         snprintf(replacement, (size_t)needed + 1, "%.*sload_local %d", (int)indent_len, line, local_index);
-        free(list->items[i]);
-        list->items[i] = replacement;
+        string_list_replace(list, i, replacement);
     }
     return true;
 }
@@ -8934,7 +10074,28 @@ static int ccb_emit_call_like(CcbFunctionBuilder *fb, const Node *expr, bool for
         }
     }
 
-    if (!is_indirect && expr->call_target && expr->call_target->inline_candidate)
+    if (!is_indirect && expr->profile_site > 0 && fb->opts && fb->opts->profile_generate)
+    {
+        if (ccb_emit_profile_counter(fb, PROFILE_CALL, expr->profile_site, 0))
+            return 1;
+    }
+
+    bool cold_site = false;
+    if (!is_indirect && expr->profile_site > 0 && profile_loaded() && expr->call_target &&
+        expr->call_target->inline_candidate)
+    {
+        const char *fn_key = profile_function_key(fb->fn);
+        long long site_count = profile_count(PROFILE_CALL, fn_key, expr->profile_site, 0);
+        cold_site = profile_is_cold(site_count, profile_count(PROFILE_FUNCTION, fn_key, 0, 0));
+        if (cold_site)
+        {
+            ((Node *)expr->call_target)->inline_needs_body = 1;
+            compiler_verbose_logf("inline", "keep call to '%s': call site is cold in the profile",
+                                  expr->call_target->name ? expr->call_target->name : "<anon>");
+        }
+    }
+
+    if (!is_indirect && !cold_site && expr->call_target && expr->call_target->inline_candidate)
     {
         int inline_rc = ccb_emit_inline_call(fb, expr, expr->call_target);
         if (inline_rc == 0)
@@ -9160,7 +10321,8 @@ static int ccb_emit_call_like(CcbFunctionBuilder *fb, const Node *expr, bool for
         free(arg_text);
     }
 
-    if (!rc && fb->active_try_error_label && fb->active_try_error_label[0])
+    if (!rc && fb->active_try_error_label && fb->active_try_error_label[0] &&
+        ccb_body_may_throw(fb, &fb->body, fb->body.count - 1))
     {
         CCValueType ret_ty = ccb_type_for_expr(expr);
         CcbLocal *ret_local = NULL;
@@ -9191,6 +10353,321 @@ static int ccb_emit_call_like(CcbFunctionBuilder *fb, const Node *expr, bool for
     return rc;
 }
 
+#define CCB_SWITCH_SEARCH_MIN_ARMS 5
+#define CCB_SWITCH_LEAF_ARMS 3
+
+typedef struct
+{
+    uint64_t key;       /* the value in selector order, sign bit flipped for signed types */
+    int64_t value;      /* the case value wrapped to the selector type */
+    const char *label;
+} CcbSwitchArm;
+
+static int ccb_switch_arm_cmp(const void *a, const void *b)
+{
+    uint64_t ka = ((const CcbSwitchArm *)a)->key;
+    uint64_t kb = ((const CcbSwitchArm *)b)->key;
+    return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+static bool ccb_emit_switch_test(CcbFunctionBuilder *fb, const CcbLocal *selector, CCValueType ty, const char *op,
+                                 int64_t value, const char *if_true, const char *if_false)
+{
+    bool is_signed = ccb_value_type_is_signed(ty);
+    const char *hint = is_signed || strcmp(op, "eq") == 0 ? "" : " unsigned";
+    return ccb_emit_load_local(fb, selector) &&
+           (is_signed ? ccb_emit_const(&fb->body, ty, value) : ccb_emit_const_u64(&fb->body, ty, (uint64_t)value)) &&
+           string_list_appendf(&fb->body, "  compare %s %s%s", op, cc_type_name(ty), hint) &&
+           string_list_appendf(&fb->body, "  branch %s %s", if_true, if_false);
+}
+
+/* The case value wrapped to the selector type, as the comparison sees it. */
+static bool ccb_switch_case_value(CCValueType ty, const Node *expr, int64_t *out)
+{
+    unsigned bits = ccb_ir_type_bits(ty);
+    int64_t value = 0;
+    if (!ccb_value_type_is_integer(ty) || bits < 8 || !ccb_eval_const_int64(expr, &value))
+        return false;
+    if (bits < 64)
+    {
+        uint64_t mask = (UINT64_C(1) << bits) - 1;
+        uint64_t wrapped = (uint64_t)value & mask;
+        if (ccb_value_type_is_signed(ty) && (wrapped >> (bits - 1)))
+            wrapped |= ~mask;
+        value = (int64_t)wrapped;
+    }
+    *out = value;
+    return true;
+}
+
+/* Dispatches to arms[lo..hi] (sorted by key) knowing the selector's key
+   lies in [known_lo, known_hi]: a balanced tree of `<` tests down to a few
+   equality tests. A value the bounds pin down needs no test at all, so a
+   dense run of cases costs one test per tree level. */
+static bool ccb_emit_switch_search(CcbFunctionBuilder *fb, const CcbLocal *selector, CCValueType ty,
+                                   const CcbSwitchArm *arms, int lo, int hi, uint64_t known_lo, uint64_t known_hi,
+                                   const char *default_label)
+{
+    char next[32];
+    if (hi - lo + 1 <= CCB_SWITCH_LEAF_ARMS)
+    {
+        for (int i = lo; i <= hi; ++i)
+        {
+            if (arms[i].key == known_lo && arms[i].key == known_hi)
+                return string_list_appendf(&fb->body, "  jump %s", arms[i].label);
+            ccb_make_label(fb, next, sizeof(next), "switch_next");
+            if (!ccb_emit_switch_test(fb, selector, ty, "eq", arms[i].value, arms[i].label, next) ||
+                !string_list_appendf(&fb->body, "label %s", next))
+                return false;
+            if (arms[i].key == known_lo)
+                known_lo++;
+        }
+        return string_list_appendf(&fb->body, "  jump %s", default_label);
+    }
+
+    int mid = lo + (hi - lo + 1) / 2;
+    char left[32];
+    ccb_make_label(fb, left, sizeof(left), "switch_lt");
+    ccb_make_label(fb, next, sizeof(next), "switch_ge");
+    return ccb_emit_switch_test(fb, selector, ty, "lt", arms[mid].value, left, next) &&
+           string_list_appendf(&fb->body, "label %s", left) &&
+           ccb_emit_switch_search(fb, selector, ty, arms, lo, mid - 1, known_lo, arms[mid].key - 1, default_label) &&
+           string_list_appendf(&fb->body, "label %s", next) &&
+           ccb_emit_switch_search(fb, selector, ty, arms, mid, hi, arms[mid].key, known_hi, default_label);
+}
+
+/* Lowers the dispatch of a switch or match with many integer cases to a
+   binary search; values[i] is NULL for the default arm. Returns 0 when it
+   emitted it, -1 to fall back to the linear chain of tests, and 1 on
+   error. */
+static int ccb_emit_switch_dispatch(CcbFunctionBuilder *fb, const CcbLocal *selector, CCValueType ty,
+                                    const Node *const *values, char **labels, int case_count,
+                                    const char *default_label)
+{
+    unsigned bits = ccb_ir_type_bits(ty);
+    bool is_signed = ccb_value_type_is_signed(ty);
+    uint64_t mask = bits >= 64 ? UINT64_MAX : ((UINT64_C(1) << bits) - 1);
+    uint64_t sign = bits >= 64 ? UINT64_C(1) << 63 : UINT64_C(1) << (bits - 1);
+
+    CcbSwitchArm *arms = (CcbSwitchArm *)xmalloc((size_t)case_count * sizeof(CcbSwitchArm));
+    int arm_count = 0;
+    for (int i = 0; i < case_count; ++i)
+    {
+        int64_t value = 0;
+        if (!values[i])
+            continue;
+        if (!ccb_switch_case_value(ty, values[i], &value))
+        {
+            free(arms);
+            return -1;
+        }
+        CcbSwitchArm *arm = &arms[arm_count++];
+        arm->value = value;
+        arm->key = is_signed ? (uint64_t)value ^ (UINT64_C(1) << 63) : (uint64_t)value;
+        arm->label = labels[i];
+    }
+    qsort(arms, (size_t)arm_count, sizeof(CcbSwitchArm), ccb_switch_arm_cmp);
+    bool distinct = true;
+    for (int i = 1; i < arm_count; ++i)
+        distinct = distinct && arms[i].key != arms[i - 1].key;
+    if (arm_count < CCB_SWITCH_SEARCH_MIN_ARMS || !distinct)
+    {
+        free(arms);
+        return -1;
+    }
+
+    uint64_t known_lo = is_signed ? (~mask | sign) ^ (UINT64_C(1) << 63) : 0;
+    uint64_t known_hi = is_signed ? (sign - 1) ^ (UINT64_C(1) << 63) : mask;
+    bool ok = ccb_emit_switch_search(fb, selector, ty, arms, 0, arm_count - 1, known_lo, known_hi, default_label);
+    free(arms);
+    return ok ? 0 : 1;
+}
+
+#define CCB_STRING_SWITCH_HASH_MIN_ARMS 4
+#define CCB_STRING_SWITCH_SEEDS 32
+
+typedef struct
+{
+    uint32_t hash;
+    const Node *value;
+    const char *label;
+} CcbStringArm;
+
+static int ccb_string_arm_cmp(const void *a, const void *b)
+{
+    uint32_t ha = ((const CcbStringArm *)a)->hash;
+    uint32_t hb = ((const CcbStringArm *)b)->hash;
+    return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+/* FNV-1a over the bytes strcmp looks at, from a seeded offset basis. */
+static uint32_t ccb_string_hash(uint32_t basis, const Node *value)
+{
+    uint32_t h = basis;
+    for (int i = 0; i < value->str_len && value->str_data[i] != '\0'; ++i)
+        h = (h ^ (uint8_t)value->str_data[i]) * UINT32_C(16777619);
+    return h;
+}
+
+static bool ccb_emit_string_confirm(CcbFunctionBuilder *fb, const CcbLocal *selector, const Node *value,
+                                    const char *if_equal, const char *if_not)
+{
+    return ccb_emit_load_local(fb, selector) && ccb_emit_expr_basic(fb, value) == 0 &&
+           string_list_appendf(&fb->body, "  call __cert__strcmp i32 (ptr,ptr)") &&
+           ccb_emit_const_zero(&fb->body, CC_TYPE_I32) &&
+           string_list_appendf(&fb->body, "  compare eq %s", cc_type_name(CC_TYPE_I32)) &&
+           string_list_appendf(&fb->body, "  branch %s %s", if_equal, if_not);
+}
+
+/* Lowers the dispatch of a switch or match on a string; values[i] is a
+   string literal, or NULL for the default arm. A few cases are compared in
+   turn. Otherwise the selector is hashed once, with an offset basis picked
+   at compile time so the cases' hashes are all distinct when possible, the
+   hash is binary searched like an integer switch, and the one candidate
+   found is confirmed with strcmp. Returns 0 on success and 1 on error. */
+static int ccb_emit_string_dispatch(CcbFunctionBuilder *fb, const CcbLocal *selector, const Node *const *values,
+                                    char **labels, int case_count, const char *default_label)
+{
+    char next[32];
+    if (!ccb_require_cert_strcmp(fb))
+        return 1;
+
+    CcbStringArm *arms = (CcbStringArm *)xmalloc((size_t)case_count * sizeof(CcbStringArm));
+    int arm_count = 0;
+    for (int i = 0; i < case_count; ++i)
+    {
+        if (!values[i])
+            continue;
+        if (values[i]->kind != ND_STRING)
+        {
+            diag_error_at(values[i]->src, values[i]->line, values[i]->col,
+                          "string case labels must be string literals");
+            free(arms);
+            return 1;
+        }
+        arms[arm_count].value = values[i];
+        arms[arm_count].label = labels[i];
+        arm_count++;
+    }
+
+    if (arm_count < CCB_STRING_SWITCH_HASH_MIN_ARMS)
+    {
+        for (int i = 0; i < arm_count; ++i)
+        {
+            ccb_make_label(fb, next, sizeof(next), "switch_next");
+            if (!ccb_emit_string_confirm(fb, selector, arms[i].value, arms[i].label, next) ||
+                !string_list_appendf(&fb->body, "label %s", next))
+            {
+                free(arms);
+                return 1;
+            }
+        }
+        free(arms);
+        return string_list_appendf(&fb->body, "  jump %s", default_label) ? 0 : 1;
+    }
+
+    uint32_t basis = UINT32_C(2166136261);
+    for (uint32_t seed = 0; seed < CCB_STRING_SWITCH_SEEDS; ++seed)
+    {
+        uint32_t candidate = UINT32_C(2166136261) ^ (seed * UINT32_C(0x9E3779B9));
+        for (int i = 0; i < arm_count; ++i)
+            arms[i].hash = ccb_string_hash(candidate, arms[i].value);
+        qsort(arms, (size_t)arm_count, sizeof(CcbStringArm), ccb_string_arm_cmp);
+        bool distinct = true;
+        for (int i = 1; i < arm_count; ++i)
+            distinct = distinct && arms[i].hash != arms[i - 1].hash;
+        basis = candidate;
+        if (distinct)
+            break;
+    }
+
+    /* The hash is computed in i32, which wraps like the u32 above. */
+    CcbLocal *hash = ccb_local_add(fb, NULL, type_i32(), false, false);
+    CcbLocal *byte = ccb_local_add(fb, NULL, type_i32(), false, false);
+    CcbLocal *cursor = ccb_local_add(fb, NULL, type_ptr(type_char()), false, false);
+    if (!hash || !byte || !cursor)
+    {
+        free(arms);
+        return 1;
+    }
+    char start[32], loop[32], step[32], done[32];
+    ccb_make_label(fb, start, sizeof(start), "switch_hash");
+    ccb_make_label(fb, loop, sizeof(loop), "switch_hash_loop");
+    ccb_make_label(fb, step, sizeof(step), "switch_hash_step");
+    ccb_make_label(fb, done, sizeof(done), "switch_hash_done");
+    bool ok = ccb_emit_load_local(fb, selector) && string_list_appendf(&fb->body, "  test_null") &&
+              string_list_appendf(&fb->body, "  branch %s %s", default_label, start) &&
+              string_list_appendf(&fb->body, "label %s", start) &&
+              ccb_emit_const(&fb->body, CC_TYPE_I32, (int32_t)basis) && ccb_emit_store_local(fb, hash) &&
+              ccb_emit_load_local(fb, selector) && ccb_emit_store_local(fb, cursor) &&
+              string_list_appendf(&fb->body, "label %s", loop) &&
+              ccb_emit_load_local(fb, cursor) && ccb_emit_load_indirect(&fb->body, CC_TYPE_U8) &&
+              ccb_emit_convert_between(fb, CC_TYPE_U8, CC_TYPE_I32, NULL) == 0 &&
+              ccb_emit_store_local(fb, byte) &&
+              ccb_emit_load_local(fb, byte) && ccb_emit_const_zero(&fb->body, CC_TYPE_I32) &&
+              string_list_appendf(&fb->body, "  compare eq %s", cc_type_name(CC_TYPE_I32)) &&
+              string_list_appendf(&fb->body, "  branch %s %s", done, step) &&
+              string_list_appendf(&fb->body, "label %s", step) &&
+              ccb_emit_load_local(fb, hash) && ccb_emit_load_local(fb, byte) &&
+              string_list_appendf(&fb->body, "  binop xor %s", cc_type_name(CC_TYPE_I32)) &&
+              ccb_emit_const(&fb->body, CC_TYPE_I32, 16777619) &&
+              string_list_appendf(&fb->body, "  binop mul %s", cc_type_name(CC_TYPE_I32)) &&
+              ccb_emit_store_local(fb, hash) &&
+              ccb_emit_load_local(fb, cursor) &&
+              ccb_emit_convert_between(fb, CC_TYPE_PTR, CC_TYPE_I64, NULL) == 0 &&
+              ccb_emit_const(&fb->body, CC_TYPE_I64, 1) &&
+              string_list_appendf(&fb->body, "  binop add %s", cc_type_name(CC_TYPE_I64)) &&
+              ccb_emit_convert_between(fb, CC_TYPE_I64, CC_TYPE_PTR, NULL) == 0 &&
+              ccb_emit_store_local(fb, cursor) &&
+              string_list_appendf(&fb->body, "  jump %s", loop) &&
+              string_list_appendf(&fb->body, "label %s", done);
+
+    /* One search arm per distinct hash, leading to the strcmp of each case
+       that has it. */
+    CcbSwitchArm *buckets = (CcbSwitchArm *)xmalloc((size_t)arm_count * sizeof(CcbSwitchArm));
+    char **bucket_labels = (char **)xcalloc((size_t)arm_count, sizeof(char *));
+    int bucket_count = 0;
+    for (int i = 0; ok && i < arm_count; ++i)
+    {
+        if (i > 0 && arms[i].hash == arms[i - 1].hash)
+            continue;
+        char label[32];
+        ccb_make_label(fb, label, sizeof(label), "switch_hit");
+        bucket_labels[bucket_count] = xstrdup(label);
+        CcbSwitchArm *bucket = &buckets[bucket_count];
+        bucket->value = (int32_t)arms[i].hash;
+        bucket->key = (uint64_t)bucket->value ^ (UINT64_C(1) << 63);
+        bucket->label = bucket_labels[bucket_count];
+        bucket_count++;
+    }
+    qsort(buckets, (size_t)bucket_count, sizeof(CcbSwitchArm), ccb_switch_arm_cmp);
+    uint64_t known_lo = (uint64_t)(int64_t)INT32_MIN ^ (UINT64_C(1) << 63);
+    uint64_t known_hi = (uint64_t)(int64_t)INT32_MAX ^ (UINT64_C(1) << 63);
+    ok = ok && ccb_emit_switch_search(fb, hash, CC_TYPE_I32, buckets, 0, bucket_count - 1, known_lo, known_hi,
+                                      default_label);
+    for (int i = 0, b = 0; ok && i < arm_count; ++i)
+    {
+        if (i == 0 || arms[i].hash != arms[i - 1].hash)
+            ok = string_list_appendf(&fb->body, "label %s", bucket_labels[b++]);
+        bool last = i + 1 == arm_count || arms[i + 1].hash != arms[i].hash;
+        if (last)
+        {
+            ok = ok && ccb_emit_string_confirm(fb, selector, arms[i].value, arms[i].label, default_label);
+            continue;
+        }
+        ccb_make_label(fb, next, sizeof(next), "switch_next");
+        ok = ok && ccb_emit_string_confirm(fb, selector, arms[i].value, arms[i].label, next) &&
+             string_list_appendf(&fb->body, "label %s", next);
+    }
+
+    for (int i = 0; i < bucket_count; ++i)
+        free(bucket_labels[i]);
+    free(bucket_labels);
+    free(buckets);
+    free(arms);
+    return ok ? 0 : 1;
+}
+
 static int ccb_emit_expr_basic_impl(CcbFunctionBuilder *fb, const Node *expr)
 {
     if (!fb || !expr)
@@ -9241,8 +10718,16 @@ static int ccb_emit_expr_basic_impl(CcbFunctionBuilder *fb, const Node *expr)
             return 1;
         }
 
-        
-        if (expr->lhs)
+        if (expr->new_on_stack)
+        {
+            size_t count = expr->lhs ? (size_t)expr->lhs->int_val : 1;
+            if (!string_list_appendf(&fb->body, "  stack_alloc %zu %zu", elem_size * count, (size_t)8))
+                return 1;
+            if (compiler_verbose_enabled())
+                compiler_verbose_logf("optimizer", "'%s': new at line %d lowered to a %zu-byte stack slot",
+                                      (fb->fn && fb->fn->name) ? fb->fn->name : "<anon>", expr->line, elem_size * count);
+        }
+        else if (expr->lhs)
         {
             if (ccb_emit_expr_basic(fb, expr->lhs))
                 return 1;
@@ -9260,15 +10745,18 @@ static int ccb_emit_expr_basic_impl(CcbFunctionBuilder *fb, const Node *expr)
         }
 
         
-        if (!ccb_module_has_function(fb->module, "__cert__new") && !ccb_module_has_extern(fb->module, "__cert__new"))
+        if (!expr->new_on_stack)
         {
-            if (!ccb_module_appendf(fb->module, ".extern __cert__new params=(u64) returns=ptr"))
+            if (!ccb_module_has_function(fb->module, "__cert__new") && !ccb_module_has_extern(fb->module, "__cert__new"))
+            {
+                if (!ccb_module_appendf(fb->module, ".extern __cert__new params=(u64) returns=ptr"))
+                    return 1;
+            }
+
+            if (!string_list_appendf(&fb->body, "  call __cert__new ptr (u64)"))
                 return 1;
         }
 
-        if (!string_list_appendf(&fb->body, "  call __cert__new ptr (u64)"))
-            return 1;
-
         if (elem->kind == TY_STRUCT && ccb_struct_has_field_defaults(elem))
         {
             char temp_name_buf[32];
@@ -10531,7 +12019,18 @@ static int ccb_emit_expr_basic_impl(CcbFunctionBuilder *fb, const Node *expr)
             goto match_fail;
         }
 
+        const Node **patterns = (const Node **)xmalloc((size_t)arm_count * sizeof(const Node *));
         for (int i = 0; i < arm_count; ++i)
+            patterns[i] = arms[i].pattern;
+        int dispatch = ccb_is_string_ptr_type(expr->match_stmt.expr->type)
+                           ? ccb_emit_string_dispatch(fb, scrutinee, patterns, arm_labels, arm_count,
+                                                      arm_labels[wildcard_index])
+                           : ccb_emit_switch_dispatch(fb, scrutinee, scrut_ty, patterns, arm_labels, arm_count,
+                                                      arm_labels[wildcard_index]);
+        free(patterns);
+        if (dispatch > 0)
+            goto match_fail;
+        for (int i = 0; dispatch < 0 && i < arm_count; ++i)
         {
             MatchArm *arm = &arms[i];
             if (!arm->pattern)
@@ -10552,20 +12051,29 @@ static int ccb_emit_expr_basic_impl(CcbFunctionBuilder *fb, const Node *expr)
             if (!miss_target)
                 miss_target = arm_labels[wildcard_index];
 
-            if (!ccb_emit_load_local(fb, scrutinee))
-                goto match_fail;
-            if (ccb_emit_expr_basic(fb, arm->pattern))
-                goto match_fail;
-            CCValueType pat_ty = ccb_type_for_expr(arm->pattern);
-            if (pat_ty != scrut_ty)
+            int64_t pattern_value = 0;
+            if (ccb_switch_case_value(scrut_ty, arm->pattern, &pattern_value))
             {
-                if (ccb_emit_convert_between(fb, pat_ty, scrut_ty, arm->pattern))
+                if (!ccb_emit_switch_test(fb, scrutinee, scrut_ty, "eq", pattern_value, arm_labels[i], miss_target))
+                    goto match_fail;
+            }
+            else
+            {
+                if (!ccb_emit_load_local(fb, scrutinee))
+                    goto match_fail;
+                if (ccb_emit_expr_basic(fb, arm->pattern))
+                    goto match_fail;
+                CCValueType pat_ty = ccb_type_for_expr(arm->pattern);
+                if (pat_ty != scrut_ty)
+                {
+                    if (ccb_emit_convert_between(fb, pat_ty, scrut_ty, arm->pattern))
+                        goto match_fail;
+                }
+                if (!string_list_appendf(&fb->body, "  compare eq %s", cc_type_name(scrut_ty)))
+                    goto match_fail;
+                if (!string_list_appendf(&fb->body, "  branch %s %s", arm_labels[i], miss_target))
                     goto match_fail;
             }
-            if (!string_list_appendf(&fb->body, "  compare eq %s", cc_type_name(scrut_ty)))
-                goto match_fail;
-            if (!string_list_appendf(&fb->body, "  branch %s %s", arm_labels[i], miss_target))
-                goto match_fail;
             if (miss_labels[i])
             {
                 if (!string_list_appendf(&fb->body, "label %s", miss_labels[i]))
@@ -11323,14 +12831,6 @@ static int ccb_emit_expr_basic_impl(CcbFunctionBuilder *fb, const Node *expr)
 
             if (type_is_address_only(field_type))
             {
-                Type *ptr_ty = type_ptr((Type *)field_type);
-                CcbLocal *dst_ptr = ccb_local_add(fb, NULL, ptr_ty, false, false);
-                if (!dst_ptr)
-                    return 1;
-                ptrdiff_t dst_slot = dst_ptr ? (ptrdiff_t)(dst_ptr - fb->locals) : -1;
-                if (!ccb_emit_store_local(fb, dst_ptr))
-                    return 1;
-
                 if (ccb_emit_expr_basic(fb, expr->rhs))
                     return 1;
 
@@ -11341,29 +12841,29 @@ static int ccb_emit_expr_basic_impl(CcbFunctionBuilder *fb, const Node *expr)
                         return 1;
                 }
 
-                CcbLocal *src_ptr = ccb_local_add(fb, NULL, ptr_ty, false, false);
+                CcbLocal *src_ptr = ccb_local_add(fb, NULL, addr_ptr_ty, false, false);
                 if (!src_ptr)
                     return 1;
                 ptrdiff_t src_slot = src_ptr ? (ptrdiff_t)(src_ptr - fb->locals) : -1;
                 if (!ccb_emit_store_local(fb, src_ptr))
                     return 1;
 
-                if (!ccb_struct_copy_refresh(fb, dst_slot, src_slot, &dst_ptr, &src_ptr))
+                if (!ccb_struct_copy_refresh(fb, addr_slot, src_slot, &addr_local, &src_ptr))
                     return 1;
 
-                if (ccb_emit_struct_copy(fb, field_type, dst_ptr, src_ptr))
+                if (ccb_emit_struct_copy(fb, field_type, addr_local, src_ptr))
                     return 1;
 
                 CCValueType result_ty = ccb_type_for_expr(expr);
                 if (result_ty != CC_TYPE_VOID)
                 {
-                    if (dst_slot >= 0)
+                    if (addr_slot >= 0)
                     {
-                        dst_ptr = ccb_local_from_slot(fb, dst_slot);
-                        if (!dst_ptr)
+                        addr_local = ccb_local_from_slot(fb, addr_slot);
+                        if (!addr_local)
                             return 1;
                     }
-                    if (!ccb_emit_load_local(fb, dst_ptr))
+                    if (!ccb_emit_load_local(fb, addr_local))
                         return 1;
                 }
                 return 0;
@@ -11724,6 +13224,22 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
             return 1;
         }
 
+        if (stmt->new_on_stack)
+        {
+            CcbLocal *local = ccb_local_lookup(fb, stmt->lhs->var_ref);
+            if (!local)
+            {
+                diag_error_at(stmt->src, stmt->line, stmt->col,
+                              "delete: unknown local '%s'", stmt->lhs->var_ref);
+                return 1;
+            }
+            if (!ccb_emit_const_zero(&fb->body, CC_TYPE_PTR))
+                return 1;
+            if (!ccb_emit_store_local(fb, local))
+                return 1;
+            return 0;
+        }
+
         
         if (!ccb_module_has_function(fb->module, "__cert__delete") && !ccb_module_has_extern(fb->module, "__cert__delete"))
         {
@@ -11839,8 +13355,6 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
             return 1;
         if (ccb_ensure_runtime_extern(fb, "__cert__exception_leave_try", "void", "()"))
             return 1;
-        if (ccb_ensure_runtime_extern(fb, "__cert__exception_has_pending", "i32", "()"))
-            return 1;
         if (ccb_ensure_runtime_extern(fb, "__cert__exception_clear", "void", "()"))
             return 1;
         if (ccb_ensure_runtime_extern(fb, "__cert__exception_matches_type", "i32", "(ptr)"))
@@ -11881,9 +13395,12 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
             {
                 char step_continue_label[32];
                 ccb_make_label(fb, step_continue_label, sizeof(step_continue_label), "try_cont");
+                size_t step_start = fb->body.count;
                 if (ccb_emit_stmt_basic(fb, stmt->lhs->stmts[i]))
                     return 1;
-                if (!string_list_appendf(&fb->body, "  call __cert__exception_has_pending i32 ()"))
+                if (!ccb_body_may_throw(fb, &fb->body, step_start))
+                    continue;
+                if (ccb_emit_exception_pending(fb))
                     return 1;
                 if (!ccb_emit_const_zero(&fb->body, CC_TYPE_I32))
                     return 1;
@@ -11916,7 +13433,7 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
         if (!string_list_appendf(&fb->body, "  call __cert__exception_leave_try void ()"))
             return 1;
 
-        if (!string_list_appendf(&fb->body, "  call __cert__exception_has_pending i32 ()"))
+        if (ccb_emit_exception_pending(fb))
             return 1;
         if (!ccb_emit_const_zero(&fb->body, CC_TYPE_I32))
             return 1;
@@ -12006,7 +13523,7 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
             if (ccb_emit_stmt_basic(fb, stmt->rhs))
                 return 1;
 
-            if (!string_list_appendf(&fb->body, "  call __cert__exception_has_pending i32 ()"))
+            if (ccb_emit_exception_pending(fb))
                 return 1;
             if (!ccb_emit_const_zero(&fb->body, CC_TYPE_I32))
                 return 1;
@@ -12060,8 +13577,6 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
     {
         if (!stmt->lhs)
         {
-            if (ccb_ensure_runtime_extern(fb, "__cert__exception_has_pending", "i32", "()"))
-                return 1;
             if (ccb_ensure_runtime_extern(fb, "__cert__runtime_error_ex", "void", "(i32,ptr,ptr,ptr,i64,ptr)"))
                 return 1;
 
@@ -12072,7 +13587,7 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
             ccb_make_label(fb, no_exception_label, sizeof(no_exception_label), "throw_noexc");
             ccb_make_label(fb, done_label, sizeof(done_label), "throw_done");
 
-            if (!string_list_appendf(&fb->body, "  call __cert__exception_has_pending i32 ()"))
+            if (ccb_emit_exception_pending(fb))
                 return 1;
             if (!ccb_emit_const_zero(&fb->body, CC_TYPE_I32))
                 return 1;
@@ -12173,22 +13688,45 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
             ccb_make_label(fb, false_label, sizeof(false_label), "if_end");
         }
 
+        bool instrument = fb->opts && fb->opts->profile_generate && stmt->profile_site > 0;
+        bool then_cold = false;
+        bool else_cold = false;
+        if (profile_loaded() && stmt->profile_site > 0)
+        {
+            const char *fn_key = profile_function_key(fb->fn);
+            long long then_count = profile_count(PROFILE_BRANCH, fn_key, stmt->profile_site, 1);
+            long long else_count = has_else ? profile_count(PROFILE_BRANCH, fn_key, stmt->profile_site, 0)
+                                            : profile_count(PROFILE_FUNCTION, fn_key, 0, 0);
+            then_cold = profile_is_cold(then_count, else_count);
+            else_cold = has_else && profile_is_cold(else_count, then_count);
+        }
+
         if (!string_list_appendf(&fb->body, "  branch %s %s", true_label, false_label))
             return 1;
 
+        size_t then_from = fb->body.count;
         if (!string_list_appendf(&fb->body, "label %s", true_label))
             return 1;
+        if (instrument && ccb_emit_profile_counter(fb, PROFILE_BRANCH, stmt->profile_site, 1))
+            return 1;
         if (ccb_emit_stmt_basic(fb, stmt->rhs))
             return 1;
+        if (then_cold)
+            ccb_profile_mark_cold(fb, then_from);
 
         if (has_else)
         {
             if (!string_list_appendf(&fb->body, "  jump %s", end_label))
                 return 1;
+            size_t else_from = fb->body.count;
             if (!string_list_appendf(&fb->body, "label %s", false_label))
                 return 1;
+            if (instrument && ccb_emit_profile_counter(fb, PROFILE_BRANCH, stmt->profile_site, 0))
+                return 1;
             if (ccb_emit_stmt_basic(fb, stmt->body))
                 return 1;
+            if (else_cold)
+                ccb_profile_mark_cold(fb, else_from);
             if (!string_list_appendf(&fb->body, "label %s", end_label))
                 return 1;
         }
@@ -12220,6 +13758,13 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
         if (has_post)
             ccb_make_label(fb, post_label, sizeof(post_label), "while_post");
 
+        if (stmt->loop_unroll > 0 && !ccb_unroll_hint_add(fb, cond_label, stmt->loop_unroll))
+        {
+            diag_error_at(stmt->src, stmt->line, stmt->col,
+                          "failed to allocate loop context");
+            return 1;
+        }
+
         const char *continue_target = has_post ? post_label : cond_label;
         if (!ccb_loop_push(fb, end_label, continue_target, true))
         {
@@ -12348,7 +13893,18 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
         if (!default_label)
             default_label = end_label;
 
+        const Node **case_values = (const Node **)xmalloc((size_t)case_count * sizeof(const Node *));
         for (int i = 0; i < case_count; ++i)
+            case_values[i] = cases[i].is_default ? NULL : cases[i].value;
+        int dispatch = ccb_is_string_ptr_type(stmt->switch_stmt.expr->type)
+                           ? ccb_emit_string_dispatch(fb, selector, case_values, case_labels, case_count,
+                                                      default_label)
+                           : ccb_emit_switch_dispatch(fb, selector, selector_ty, case_values, case_labels,
+                                                      case_count, default_label);
+        free(case_values);
+        if (dispatch > 0)
+            goto switch_fail;
+        for (int i = 0; dispatch < 0 && i < case_count; ++i)
         {
             SwitchCase *entry = &cases[i];
             if (entry->is_default)
@@ -12375,20 +13931,29 @@ static int ccb_emit_stmt_basic_impl(CcbFunctionBuilder *fb, const Node *stmt)
             if (!miss_target)
                 miss_target = end_label;
 
-            if (!ccb_emit_load_local(fb, selector))
-                goto switch_fail;
-            if (ccb_emit_expr_basic(fb, entry->value))
-                goto switch_fail;
-            CCValueType case_ty = ccb_type_for_expr(entry->value);
-            if (case_ty != selector_ty)
+            int64_t case_value = 0;
+            if (ccb_switch_case_value(selector_ty, entry->value, &case_value))
             {
-                if (ccb_emit_convert_between(fb, case_ty, selector_ty, entry->value))
+                if (!ccb_emit_switch_test(fb, selector, selector_ty, "eq", case_value, case_labels[i], miss_target))
+                    goto switch_fail;
+            }
+            else
+            {
+                if (!ccb_emit_load_local(fb, selector))
+                    goto switch_fail;
+                if (ccb_emit_expr_basic(fb, entry->value))
+                    goto switch_fail;
+                CCValueType case_ty = ccb_type_for_expr(entry->value);
+                if (case_ty != selector_ty)
+                {
+                    if (ccb_emit_convert_between(fb, case_ty, selector_ty, entry->value))
+                        goto switch_fail;
+                }
+                if (!string_list_appendf(&fb->body, "  compare eq %s", cc_type_name(selector_ty)))
+                    goto switch_fail;
+                if (!string_list_appendf(&fb->body, "  branch %s %s", case_labels[i], miss_target))
                     goto switch_fail;
             }
-            if (!string_list_appendf(&fb->body, "  compare eq %s", cc_type_name(selector_ty)))
-                goto switch_fail;
-            if (!string_list_appendf(&fb->body, "  branch %s %s", case_labels[i], miss_target))
-                goto switch_fail;
             if (miss_labels[i])
             {
                 if (!string_list_appendf(&fb->body, "label %s", miss_labels[i]))
@@ -13149,7 +14714,11 @@ static int ccb_function_emit_basic(CcbModule *mod, const Node *fn, const Codegen
 
     CcbFunctionBuilder fb;
     bool enable_debug = mod && mod->emit_debug;
-    ccb_function_builder_init(&fb, mod, fn, opts, enable_debug);
+    if (!ccb_function_builder_init(&fb, mod, fn, opts, enable_debug))
+    {
+        ccb_function_builder_free(&fb);
+        return 1;
+    }
     ccb_function_builder_register_params(&fb);
     fb.needs_gc_prep = ccb_node_uses_tracked_alloc(fn->body);
     int rc = 0;
@@ -13174,12 +14743,19 @@ static int ccb_function_emit_basic(CcbModule *mod, const Node *fn, const Codegen
                 rc = 1;
         }
     }
-    if (fn->body && fn->body->kind == ND_BLOCK)
-        rc = ccb_emit_block(&fb, fn->body, false);
-    else
-        rc = ccb_emit_stmt_basic(&fb, fn->body);
+    if (rc == 0 && opts && opts->profile_generate)
+        rc = ccb_emit_profile_prologue(&fb);
+    if (rc == 0)
+    {
+        if (fn->body && fn->body->kind == ND_BLOCK)
+            rc = ccb_emit_block(&fb, fn->body, false);
+        else
+            rc = ccb_emit_stmt_basic(&fb, fn->body);
+    }
     if (!rc)
         ccb_function_optimize(&fb, opts);
+    if (!rc)
+        ccb_function_layout_cold_blocks(&fb);
     if (!rc)
     {
         const char *backend_name_base = fn->metadata.backend_name ? fn->metadata.backend_name : fn->name;
@@ -13242,6 +14818,12 @@ static int ccb_function_emit_basic(CcbModule *mod, const Node *fn, const Codegen
         {
             if (!ccb_module_append_line(mod, ".endfunc"))
                 rc = 1;
+            else if (!fn->metadata.func_line && !fn->is_varargs && ccb_function_body_is_pure(&fb) &&
+                     !string_list_append(&mod->pure_funcs, backend_name))
+                rc = 1;
+            else if (!fn->metadata.func_line && !ccb_body_may_throw(&fb, &fb.prologue, 0) &&
+                     !ccb_body_may_throw(&fb, &fb.body, 0) && !string_list_append(&mod->nothrow_funcs, backend_name))
+                rc = 1;
             else if (fn->is_preserve)
             {
                 if (!ccb_module_appendf(mod, ".preserve %s", backend_name))
@@ -13867,69 +15449,206 @@ static char *ccb_make_string_symbol(const char *base, int index)
     return name;
 }
 
-static const char *ccb_module_intern_hidden_byte_string(CcbModule *mod, const char *base, const uint8_t *data, size_t len)
-{
-    if (!mod)
-        return NULL;
+/* Longer entries are only matched whole. */
+#define CCB_POOL_MAX_SUFFIXED 4096
 
-    const char *safe = (base && *base) ? base : "str";
-    char *literal = ccb_encode_bytes_literal(data, len);
-    if (!literal)
-        return NULL;
+static CcbConstPool g_ccb_shared_pool;
 
-    int key_len = snprintf(NULL, 0, "%s|%s", safe, literal);
-    if (key_len < 0)
+static void ccb_const_pool_free(CcbConstPool *pool)
+{
+    if (!pool)
+        return;
+    for (size_t i = 0; i < pool->count; ++i)
     {
-        free(literal);
+        free(pool->entries[i].symbol);
+        free(pool->entries[i].data);
+    }
+    free(pool->entries);
+    free(pool->slots);
+    free(pool->prefix);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/* FNV-1a over the bytes from last to first, so the hashes of all suffixes
+   of one entry come out of a single pass. */
+static uint64_t ccb_pool_hash_step(uint64_t hash, uint8_t byte)
+{
+    return (hash ^ byte) * 1099511628211ULL;
+}
+
+static uint64_t ccb_pool_hash(const uint8_t *data, size_t len)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = len; i > 0; --i)
+        hash = ccb_pool_hash_step(hash, data[i - 1]);
+    return hash;
+}
+
+static const CcbPoolSlot *ccb_pool_find(const CcbConstPool *pool, const uint8_t *data, size_t len, uint64_t hash)
+{
+    if (pool->slot_capacity == 0)
         return NULL;
+    size_t mask = pool->slot_capacity - 1;
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask)
+    {
+        const CcbPoolSlot *slot = &pool->slots[i];
+        if (slot->entry == 0)
+            return NULL;
+        const CcbPoolEntry *entry = &pool->entries[slot->entry - 1];
+        if (slot->hash == hash && entry->len - slot->offset == len &&
+            memcmp(entry->data + slot->offset, data, len) == 0)
+            return slot;
     }
+}
 
-    char *key = (char *)malloc((size_t)key_len + 1);
-    if (!key)
+static bool ccb_pool_index(CcbConstPool *pool, size_t entry, size_t offset, uint64_t hash)
+{
+    if ((pool->slot_count + 1) * 2 > pool->slot_capacity)
     {
-        free(literal);
-        return NULL;
+        size_t capacity = pool->slot_capacity ? pool->slot_capacity * 2 : 256;
+        CcbPoolSlot *slots = (CcbPoolSlot *)calloc(capacity, sizeof(*slots));
+        if (!slots)
+            return false;
+        for (size_t i = 0; i < pool->slot_capacity; ++i)
+        {
+            if (pool->slots[i].entry == 0)
+                continue;
+            size_t j = (size_t)pool->slots[i].hash & (capacity - 1);
+            while (slots[j].entry != 0)
+                j = (j + 1) & (capacity - 1);
+            slots[j] = pool->slots[i];
+        }
+        free(pool->slots);
+        pool->slots = slots;
+        pool->slot_capacity = capacity;
+    }
+    const CcbPoolEntry *owner = &pool->entries[entry];
+    CcbPoolSlot *existing = (CcbPoolSlot *)ccb_pool_find(pool, owner->data + offset, owner->len - offset, hash);
+    if (existing)
+    {
+        if (offset == 0 && existing->offset != 0)
+        {
+            existing->entry = entry + 1;
+            existing->offset = 0;
+        }
+        return true;
     }
-    snprintf(key, (size_t)key_len + 1, "%s|%s", safe, literal);
+    size_t i = (size_t)hash & (pool->slot_capacity - 1);
+    while (pool->slots[i].entry != 0)
+        i = (i + 1) & (pool->slot_capacity - 1);
+    pool->slots[i].hash = hash;
+    pool->slots[i].entry = entry + 1;
+    pool->slots[i].offset = offset;
+    pool->slot_count++;
+    return true;
+}
 
-    for (size_t i = 0; i < mod->interned_string_keys.count; ++i)
+/* Finds or adds `len` bytes in the module's pool. With `whole` set the
+   bytes must start their global, as a ptrs= initializer needs. The first
+   use of a shared entry in a later unit declares it extern there. */
+static bool ccb_module_pool_bytes(CcbModule *mod, const char *base, const uint8_t *data, size_t len, bool whole, CcbPoolRef *out)
+{
+    if (!mod || !mod->pool || !out || (!data && len > 0))
+        return false;
+    CcbConstPool *pool = mod->pool;
+    uint64_t hash = ccb_pool_hash(data, len);
+    const CcbPoolSlot *found = ccb_pool_find(pool, data, len, hash);
+    if (found && (!whole || found->offset == 0))
     {
-        const char *existing_key = mod->interned_string_keys.items[i];
-        if (existing_key && strcmp(existing_key, key) == 0)
+        CcbPoolEntry *entry = &pool->entries[found->entry - 1];
+        if (entry->unit != pool->unit && entry->declared_unit != pool->unit)
         {
-            const char *existing_sym = (i < mod->interned_string_symbols.count) ? mod->interned_string_symbols.items[i] : NULL;
-            free(key);
-            free(literal);
-            return existing_sym;
+            if (!ccb_module_appendf(mod, ".global %s type=%s extern const", entry->symbol, cc_type_name(CC_TYPE_U8)))
+                return false;
+            entry->declared_unit = pool->unit;
         }
+        out->symbol = entry->symbol;
+        out->offset = found->offset;
+        return true;
     }
 
-    char *sym = ccb_make_string_symbol(safe, mod->next_interned_string_id++);
-    if (!sym)
+    if (pool->count == pool->capacity)
     {
-        free(key);
-        free(literal);
-        return NULL;
+        size_t capacity = pool->capacity ? pool->capacity * 2 : 32;
+        CcbPoolEntry *entries = (CcbPoolEntry *)realloc(pool->entries, capacity * sizeof(*entries));
+        if (!entries)
+            return false;
+        pool->entries = entries;
+        pool->capacity = capacity;
     }
 
-    if (!ccb_module_appendf(mod, ".global %s type=%s size=%zu align=1 data=%s const hidden",
-                            sym, cc_type_name(CC_TYPE_U8), len, literal))
+    char *sym = NULL;
+    if (pool->prefix)
+    {
+        int needed = snprintf(NULL, 0, "__ccb_pool_%s_%d", pool->prefix, pool->next_id);
+        sym = needed < 0 ? NULL : (char *)malloc((size_t)needed + 1);
+        if (sym)
+            snprintf(sym, (size_t)needed + 1, "__ccb_pool_%s_%d", pool->prefix, pool->next_id);
+        pool->next_id++;
+    }
+    else
+    {
+        sym = ccb_make_string_symbol((base && *base) ? base : "str", pool->next_id++);
+    }
+    uint8_t *copy = (uint8_t *)malloc(len ? len : 1);
+    char *literal = ccb_encode_bytes_literal(data, len);
+    if (!sym || !copy || !literal)
     {
         free(sym);
-        free(key);
+        free(copy);
         free(literal);
-        return NULL;
+        return false;
     }
+    if (len)
+        memcpy(copy, data, len);
 
-    bool ok = string_list_append(&mod->interned_string_keys, key) &&
-              string_list_append(&mod->interned_string_symbols, sym);
-    free(key);
+    bool ok = ccb_module_appendf(mod, ".global %s type=%s size=%zu align=1 data=%s const%s",
+                                 sym, cc_type_name(CC_TYPE_U8), len, literal, pool->prefix ? "" : " hidden");
     free(literal);
-    free(sym);
     if (!ok)
-        return NULL;
+    {
+        free(sym);
+        free(copy);
+        return false;
+    }
+
+    size_t index = pool->count++;
+    CcbPoolEntry *entry = &pool->entries[index];
+    entry->symbol = sym;
+    entry->data = copy;
+    entry->len = len;
+    entry->unit = pool->unit;
+    entry->declared_unit = pool->unit;
+
+    if (!ccb_pool_index(pool, index, 0, hash))
+        return false;
+    if (len <= CCB_POOL_MAX_SUFFIXED)
+    {
+        uint64_t suffix_hash = 1469598103934665603ULL;
+        for (size_t offset = len; offset > 1; --offset)
+        {
+            suffix_hash = ccb_pool_hash_step(suffix_hash, copy[offset - 1]);
+            if (!ccb_pool_index(pool, index, offset - 1, suffix_hash))
+                return false;
+        }
+    }
+
+    out->symbol = entry->symbol;
+    out->offset = 0;
+    return true;
+}
 
-    return mod->interned_string_symbols.items[mod->interned_string_symbols.count - 1];
+/* Pushes the address of `text` and its terminating NUL, kept in the pool. */
+static int ccb_emit_pooled_cstring(CcbFunctionBuilder *fb, const char *base, const char *text)
+{
+    if (!fb || !text)
+        return 1;
+    CcbPoolRef ref;
+    if (!ccb_module_pool_bytes(fb->module, base, (const uint8_t *)text, strlen(text) + 1, false, &ref))
+        return 1;
+    if (!ccb_emit_addr_global(&fb->body, ref.symbol))
+        return 1;
+    return ccb_emit_pointer_offset(fb, (int)ref.offset, NULL);
 }
 
 static bool ccb_emit_string_ptr_array_global(CcbModule *mod, const char *name, const Type *array_type, const Node *init,
@@ -13973,19 +15692,11 @@ static bool ccb_emit_string_ptr_array_global(CcbModule *mod, const char *name, c
             break;
         }
 
-        char *sym = ccb_make_string_symbol(name, i);
-        if (!sym)
-        {
-            ok = false;
-            break;
-        }
-
         size_t str_len = (elem->str_len >= 0) ? (size_t)elem->str_len : 0;
         size_t total_len = str_len + 1;
         uint8_t *bytes = (uint8_t *)malloc(total_len);
         if (!bytes)
         {
-            free(sym);
             ok = false;
             break;
         }
@@ -13993,26 +15704,11 @@ static bool ccb_emit_string_ptr_array_global(CcbModule *mod, const char *name, c
             memcpy(bytes, elem->str_data, str_len);
         bytes[str_len] = 0;
 
-        char *literal = ccb_encode_bytes_literal(bytes, total_len);
+        CcbPoolRef ref;
+        ok = ccb_module_pool_bytes(mod, name, bytes, total_len, true, &ref);
         free(bytes);
-        if (!literal)
-        {
-            free(sym);
-            ok = false;
-            break;
-        }
-
-        if (!ccb_module_appendf(mod, ".global %s type=%s size=%zu align=1 data=%s const hidden",
-                                sym, cc_type_name(CC_TYPE_U8), total_len, literal))
-        {
-            free(literal);
-            free(sym);
-            ok = false;
-            break;
-        }
-
-        free(literal);
-        symbols[i] = sym;
+        if (ok)
+            symbols[i] = xstrdup(ref.symbol);
     }
 
     if (!ok)
@@ -14084,8 +15780,49 @@ static void ccb_write_quoted(FILE *out, const char *text)
     fputc('"', out);
 }
 
-static int write_module_to_file(const char *path, const CcbModule *mod)
+static bool ccb_spool_copy(FILE *in, FILE *out, CcbinWriter *bin, uint64_t count)
+{
+    char buf[65536];
+    while (count > 0)
+    {
+        size_t chunk = count < sizeof(buf) ? (size_t)count : sizeof(buf);
+        if (fread(buf, 1, chunk, in) != chunk)
+            return false;
+        if (out && fwrite(buf, 1, chunk, out) != chunk)
+            return false;
+        if (bin)
+            ccbin_writer_feed(bin, buf, chunk);
+        count -= chunk;
+    }
+    return true;
+}
+
+static bool ccb_module_put_line(FILE *out, CcbinWriter *bin, const char *line)
+{
+    size_t len = strlen(line);
+    if (bin)
+    {
+        ccbin_writer_feed(bin, line, len);
+        ccbin_writer_feed(bin, "\n", 1);
+    }
+    return fwrite(line, 1, len, out) == len && fputc('\n', out) != EOF;
+}
+
+static bool ccb_module_keeps_decl(const CcbModule *mod, const CcbSpoolDecl *decl)
 {
+    if (string_list_contains(&mod->used_symbols, decl->symbol))
+        return true;
+    return decl->no_return && string_list_contains(&mod->defined_funcs, decl->symbol);
+}
+
+/* Writes the header, then the spool with `inserts` placed at byte offset
+   insert_at and the externs and no-return tags nothing refers to left
+   out. The same text is fed to `bin` when it is non-NULL. */
+static int write_module_to_file(const char *path, CcbModule *mod, const StringList *inserts, uint64_t insert_at,
+                                CcbinWriter *bin)
+{
+    if (!ccb_module_flush(mod))
+        return 1;
     FILE *out = fopen(path, "wb");
     if (!out)
     {
@@ -14093,7 +15830,8 @@ static int write_module_to_file(const char *path, const CcbModule *mod)
         return 1;
     }
 
-    fprintf(out, "ccbytecode 3\n\n");
+    ccb_module_put_line(out, bin, "ccbytecode 3");
+    ccb_module_put_line(out, bin, "");
     if (mod && mod->emit_debug && mod->debug_files.count > 0)
     {
         for (size_t i = 0; i < mod->debug_files.count; ++i)
@@ -14105,18 +15843,57 @@ static int write_module_to_file(const char *path, const CcbModule *mod)
         }
         fputc('\n', out);
     }
-    for (size_t i = 0; i < mod->lines.count; ++i)
+
+    bool ok = true;
+    if (mod->spool)
     {
-        const char *line = mod->lines.items[i];
-        if (!line)
-            line = "";
-        fputs(line, out);
-        size_t len = strlen(line);
-        if (len == 0 || line[len - 1] != '\n')
-            fputc('\n', out);
+        rewind(mod->spool);
+        size_t removed_externs = 0;
+        size_t removed_no_return = 0;
+        uint64_t pos = 0;
+        bool inserted = inserts->count == 0;
+        for (size_t d = 0; ok && d <= mod->decl_count; ++d)
+        {
+            const CcbSpoolDecl *decl = d < mod->decl_count ? &mod->decls[d] : NULL;
+            uint64_t stop = decl ? decl->offset : mod->spool_bytes;
+            if (!inserted && insert_at <= stop)
+            {
+                ok = ccb_spool_copy(mod->spool, out, bin, insert_at - pos);
+                for (size_t i = 0; ok && i < inserts->count; ++i)
+                    ok = ccb_module_put_line(out, bin, inserts->items[i]);
+                pos = insert_at;
+                inserted = true;
+            }
+            if (!ok)
+                break;
+            if (!decl)
+            {
+                ok = ccb_spool_copy(mod->spool, out, bin, stop - pos);
+                break;
+            }
+            if (ccb_module_keeps_decl(mod, decl))
+                continue;
+            ok = ccb_spool_copy(mod->spool, out, bin, stop - pos) && ccb_spool_copy(mod->spool, NULL, NULL, decl->len);
+            pos = stop + decl->len;
+            if (decl->no_return)
+                ++removed_no_return;
+            else
+                ++removed_externs;
+        }
+        if (compiler_verbose_enabled() && (removed_externs || removed_no_return))
+        {
+            compiler_verbose_logf("optimizer", "module pass: pruned %zu externs, %zu no-return tags",
+                                  removed_externs, removed_no_return);
+        }
     }
+    for (size_t i = 0; ok && !mod->spool && i < inserts->count; ++i)
+        ok = ccb_module_put_line(out, bin, inserts->items[i]);
 
-    fclose(out);
+    if (fclose(out) != 0 || !ok)
+    {
+        fprintf(stderr, "codegen: failed writing '%s'\n", path);
+        return 1;
+    }
     return 0;
 }
 
@@ -14171,6 +15948,167 @@ int codegen_ccb_resolve_module_path(const CodegenOptions *opts, char *buffer, si
     return 0;
 }
 
+static char *ccb_make_profile_tag(const Node *unit)
+{
+    const char *name = (unit && unit->kind == ND_UNIT) ? unit->module_path.full_name : NULL;
+    if (!name || !*name)
+        return xstrdup("unit");
+    char *tag = xstrdup(name);
+    for (char *p = tag; *p; ++p)
+    {
+        if (!isalnum((unsigned char)*p))
+            *p = '_';
+    }
+    return tag;
+}
+
+/* Declares the counter block, the registration flag and the key table for
+   the counters handed out while emitting the module's functions, plus the
+   function that appends '<key> <count>' lines to the profile file at exit.
+   Each module writes its own counters, so instrumented programs need nothing
+   from the runtime library. They go ahead of the first function so every
+   reference follows its definition. */
+static int ccb_module_emit_profile_data(CcbModule *mod, const CodegenOptions *opts, StringList *out)
+{
+    size_t count = mod->profile_keys.count;
+    if (count == 0)
+        return 0;
+
+    char armed[256];
+    char keys[256];
+    char counters[256];
+    char dump[256];
+    if (!ccb_profile_symbol(mod, "armed", armed, sizeof(armed)) ||
+        !ccb_profile_symbol(mod, "keys", keys, sizeof(keys)) ||
+        !ccb_profile_symbol(mod, "counters", counters, sizeof(counters)) ||
+        !ccb_profile_symbol(mod, "dump", dump, sizeof(dump)))
+        return 1;
+
+    size_t len = 1;
+    for (size_t i = 0; i < count; ++i)
+        len += strlen(mod->profile_keys.items[i]) + 1;
+    uint8_t *data = (uint8_t *)xmalloc(len);
+    size_t pos = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t key_len = strlen(mod->profile_keys.items[i]);
+        memcpy(data + pos, mod->profile_keys.items[i], key_len);
+        pos += key_len;
+        data[pos++] = '\n';
+    }
+    data[pos] = '\0';
+    char *literal = ccb_encode_bytes_literal(data, len);
+    free(data);
+    if (!literal)
+        return 1;
+    const char *path = (opts && opts->profile_generate) ? opts->profile_generate : "chance.profile";
+    char *escaped = ccb_escape_string_literal(path, (int)strlen(path));
+    if (!escaped)
+    {
+        free(literal);
+        return 1;
+    }
+
+    const char *ptr = cc_type_name(CC_TYPE_PTR);
+    const char *i8 = cc_type_name(CC_TYPE_I8);
+    const char *i64 = cc_type_name(CC_TYPE_I64);
+    bool ok = string_list_appendf(out, ".global %s type=%s size=%zu align=8 hidden", counters,
+                                  cc_type_name(CC_TYPE_U8), count * 8) &&
+              string_list_appendf(out, ".global %s type=%s init=0 hidden", armed, cc_type_name(CC_TYPE_I32)) &&
+              string_list_appendf(out, ".global %s type=%s size=%zu align=1 data=%s const hidden", keys,
+                                  cc_type_name(CC_TYPE_U8), len, literal);
+    free(literal);
+
+    /* locals: 0 = path, then the open file; 1 = key cursor; 2 = counter cursor.
+       Every key ends in '\n', so the inner loop only has to look for that. */
+    ok = ok &&
+         string_list_appendf(out, ".func %s ret=void params=0 locals=3 hidden", dump) &&
+         string_list_appendf(out, ".locals %s %s %s", ptr, ptr, ptr) &&
+         string_list_append(out, "  const_str \"CHANCE_PROFILE_FILE\"") &&
+         string_list_appendf(out, "  call getenv %s (%s)", ptr, ptr) &&
+         string_list_append(out, "  store_local 0") &&
+         string_list_append(out, "  load_local 0") &&
+         string_list_appendf(out, "  const %s null", ptr) &&
+         string_list_appendf(out, "  compare eq %s", ptr) &&
+         string_list_append(out, "  branch profile_default profile_open") &&
+         string_list_append(out, "label profile_default") &&
+         string_list_appendf(out, "  const_str \"%s\"", escaped) &&
+         string_list_append(out, "  store_local 0") &&
+         string_list_append(out, "label profile_open") &&
+         string_list_append(out, "  load_local 0") &&
+         string_list_append(out, "  const_str \"a\"") &&
+         string_list_appendf(out, "  call fopen %s (%s,%s)", ptr, ptr, ptr) &&
+         string_list_append(out, "  store_local 0") &&
+         string_list_append(out, "  load_local 0") &&
+         string_list_appendf(out, "  const %s null", ptr) &&
+         string_list_appendf(out, "  compare eq %s", ptr) &&
+         string_list_append(out, "  branch profile_done profile_start") &&
+         string_list_append(out, "label profile_start") &&
+         string_list_appendf(out, "  addr_global %s", keys) &&
+         string_list_append(out, "  store_local 1") &&
+         string_list_appendf(out, "  addr_global %s", counters) &&
+         string_list_append(out, "  store_local 2") &&
+         string_list_append(out, "label profile_key") &&
+         string_list_append(out, "  load_local 1") &&
+         string_list_appendf(out, "  load_indirect %s", i8) &&
+         string_list_appendf(out, "  const %s 0", i8) &&
+         string_list_appendf(out, "  compare eq %s", i8) &&
+         string_list_append(out, "  branch profile_close profile_char") &&
+         string_list_append(out, "label profile_char") &&
+         string_list_append(out, "  load_local 1") &&
+         string_list_appendf(out, "  load_indirect %s", i8) &&
+         string_list_appendf(out, "  const %s 10", i8) &&
+         string_list_appendf(out, "  compare eq %s", i8) &&
+         string_list_append(out, "  branch profile_count profile_put") &&
+         string_list_append(out, "label profile_put") &&
+         string_list_append(out, "  load_local 1") &&
+         string_list_appendf(out, "  load_indirect %s", i8) &&
+         string_list_appendf(out, "  convert sext %s %s", i8, cc_type_name(CC_TYPE_I32)) &&
+         string_list_append(out, "  load_local 0") &&
+         string_list_appendf(out, "  call fputc %s (%s,%s)", cc_type_name(CC_TYPE_I32), cc_type_name(CC_TYPE_I32), ptr) &&
+         string_list_appendf(out, "  drop %s", cc_type_name(CC_TYPE_I32)) &&
+         string_list_append(out, "  load_local 1") &&
+         string_list_appendf(out, "  convert bitcast %s %s", ptr, i64) &&
+         string_list_appendf(out, "  const %s 1", i64) &&
+         string_list_appendf(out, "  binop add %s", i64) &&
+         string_list_appendf(out, "  convert bitcast %s %s", i64, ptr) &&
+         string_list_append(out, "  store_local 1") &&
+         string_list_append(out, "  jump profile_char") &&
+         string_list_append(out, "label profile_count") &&
+         string_list_append(out, "  load_local 0") &&
+         string_list_append(out, "  const_str \" %llu\\x0A\"") &&
+         string_list_append(out, "  load_local 2") &&
+         string_list_appendf(out, "  load_indirect %s", cc_type_name(CC_TYPE_U64)) &&
+         string_list_appendf(out, "  call fprintf %s (%s,%s,%s) varargs", cc_type_name(CC_TYPE_I32), ptr, ptr,
+                             cc_type_name(CC_TYPE_U64)) &&
+         string_list_appendf(out, "  drop %s", cc_type_name(CC_TYPE_I32)) &&
+         string_list_append(out, "  load_local 1") &&
+         string_list_appendf(out, "  convert bitcast %s %s", ptr, i64) &&
+         string_list_appendf(out, "  const %s 1", i64) &&
+         string_list_appendf(out, "  binop add %s", i64) &&
+         string_list_appendf(out, "  convert bitcast %s %s", i64, ptr) &&
+         string_list_append(out, "  store_local 1") &&
+         string_list_append(out, "  load_local 2") &&
+         string_list_appendf(out, "  convert bitcast %s %s", ptr, i64) &&
+         string_list_appendf(out, "  const %s 8", i64) &&
+         string_list_appendf(out, "  binop add %s", i64) &&
+         string_list_appendf(out, "  convert bitcast %s %s", i64, ptr) &&
+         string_list_append(out, "  store_local 2") &&
+         string_list_append(out, "  jump profile_key") &&
+         string_list_append(out, "label profile_close") &&
+         string_list_append(out, "  load_local 0") &&
+         string_list_appendf(out, "  call fclose %s (%s)", cc_type_name(CC_TYPE_I32), ptr) &&
+         string_list_appendf(out, "  drop %s", cc_type_name(CC_TYPE_I32)) &&
+         string_list_append(out, "label profile_done") &&
+         string_list_append(out, "  ret void") &&
+         string_list_append(out, ".endfunc");
+    free(escaped);
+    if (!ok)
+        return 1;
+    compiler_verbose_logf("codegen", "profile: instrumented module with %zu counter(s)", count);
+    return 0;
+}
+
 int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts)
 {
     if (!unit)
@@ -14179,11 +16117,26 @@ int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts)
         return 1;
     }
 
+    char out_path[512];
+    if (codegen_ccb_resolve_module_path(opts, out_path, sizeof(out_path)))
+        return 1;
+
     CcbModule mod;
     ccb_module_init(&mod);
+    mod.prune_decls = opts && opts->opt_level >= 2;
     g_ccb_pointer_32bit = (opts && opts->m32);
     if (opts)
         mod.emit_debug = opts->debug_symbols;
+    if (opts && opts->profile_generate)
+        mod.profile_tag = ccb_make_profile_tag(unit);
+    if (opts && opts->share_constants)
+    {
+        if (!g_ccb_shared_pool.prefix)
+            g_ccb_shared_pool.prefix = ccb_make_profile_tag(unit);
+        g_ccb_shared_pool.unit++;
+        mod.pool = &g_ccb_shared_pool;
+    }
+    uint64_t profile_insert_at = 0;
     CcbEntrypointShimKind hosted_entry_kind = CCB_ENTRY_SHIM_NONE;
     const char *hosted_entry_public_name = NULL;
     const char *hosted_entry_hidden_name = NULL;
@@ -14209,7 +16162,7 @@ int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts)
             for (int i = 0; i < unit->stmt_count; ++i)
             {
                 const Node *decl = unit->stmts[i];
-                if (decl && decl->kind == ND_FUNC && decl->inline_candidate)
+                if (decl && decl->kind == ND_FUNC && decl->inline_candidate && !decl->is_unreachable)
                     inline_count++;
             }
 
@@ -14234,7 +16187,7 @@ int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts)
                     for (int i = 0; i < unit->stmt_count; ++i)
                     {
                         const Node *decl = unit->stmts[i];
-                        if (!decl || decl->kind != ND_FUNC || !decl->inline_candidate)
+                        if (!decl || decl->kind != ND_FUNC || !decl->inline_candidate || decl->is_unreachable)
                             continue;
                         inline_funcs[idx++] = decl;
                     }
@@ -14244,7 +16197,7 @@ int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts)
             for (int i = 0; !rc && i < unit->stmt_count; ++i)
             {
                 const Node *decl = unit->stmts[i];
-                if (!decl)
+                if (!decl || decl->is_unreachable)
                     continue;
                 if (decl->kind == ND_VAR_DECL && decl->var_is_global)
                 {
@@ -14252,14 +16205,17 @@ int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts)
                         rc = 1;
                 }
             }
+            if (!rc && !ccb_module_flush(&mod))
+                rc = 1;
+            profile_insert_at = mod.spool_bytes;
             for (int i = 0; !rc && i < unit->stmt_count; ++i)
             {
                 const Node *decl = unit->stmts[i];
-                if (!decl || decl->kind != ND_FUNC)
+                if (!decl || decl->kind != ND_FUNC || decl->is_unreachable)
                     continue;
                 if (decl->inline_candidate)
                     continue;
-                if (ccb_function_emit_basic(&mod, decl, opts))
+                if (ccb_function_emit_basic(&mod, decl, opts) || !ccb_module_flush(&mod))
                     rc = 1;
             }
             if (!rc && hosted_entry_fn && hosted_entry_kind != CCB_ENTRY_SHIM_NONE)
@@ -14281,7 +16237,7 @@ int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts)
                         const Node *decl = inline_funcs[i];
                         if (!decl || !decl->inline_needs_body)
                             continue;
-                        if (ccb_function_emit_basic(&mod, decl, opts))
+                        if (ccb_function_emit_basic(&mod, decl, opts) || !ccb_module_flush(&mod))
                         {
                             rc = 1;
                             break;
@@ -14297,7 +16253,11 @@ int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts)
         }
         else if (unit->kind == ND_FUNC)
         {
-            rc = ccb_function_emit_basic(&mod, unit, opts);
+            if (!ccb_module_flush(&mod))
+                rc = 1;
+            profile_insert_at = mod.spool_bytes;
+            if (!rc)
+                rc = ccb_function_emit_basic(&mod, unit, opts);
         }
         else
         {
@@ -14306,19 +16266,33 @@ int codegen_ccb_write_module(const Node *unit, const CodegenOptions *opts)
         }
     }
 
+    StringList profile_data;
+    string_list_init(&profile_data);
+    if (!rc)
+        rc = ccb_module_emit_profile_data(&mod, opts, &profile_data);
+
     int write_rc = 0;
+    CcbinWriter *bin = NULL;
+    if (!rc && opts->ccbin_output_path && !mod.emit_debug)
+        bin = ccbin_writer_create();
     if (!rc)
+        write_rc = write_module_to_file(out_path, &mod, &profile_data, profile_insert_at, bin);
+    if (!rc && !write_rc && opts->ccbin_output_path)
     {
-        char out_path[512];
-        if (codegen_ccb_resolve_module_path(opts, out_path, sizeof(out_path)))
-            rc = 1;
-        else
+        /* Without a ccbin file the caller hands the text to chancecodec. */
+        if (bin && ccbin_writer_finish(bin, opts->ccbin_output_path) != 0 && ccbin_writer_encodable(bin))
+            write_rc = 1;
+        if (!bin || !ccbin_writer_encodable(bin))
         {
-            ccb_module_optimize(&mod, opts);
-            write_rc = write_module_to_file(out_path, &mod);
+            remove(opts->ccbin_output_path);
+            if (bin && compiler_verbose_enabled())
+                compiler_verbose_logf("codegen", "ccbin: keeping text for '%s' (%s)", out_path,
+                                      ccbin_writer_reason(bin));
         }
     }
+    ccbin_writer_free(bin);
 
+    string_list_free(&profile_data);
     ccb_module_free(&mod);
     return rc || write_rc;
 }
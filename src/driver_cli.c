@@ -70,6 +70,30 @@ void usage(const char *prog)
           "  --implicit-voidp Allow implicit pointer to void* conversions\n");
   fprintf(stderr,
           "  --implicit-sizeof Allow implicit sizeof/alignof/offsetof to integer conversions\n");
+  fprintf(stderr,
+          "  --sema-jobs=<n>  Type-check function bodies on n threads (0 = one per core, default 1)\n");
+  fprintf(stderr,
+          "  --eval-steps=<n> Step budget for evaluating [Eval] calls in global initializers\n");
+  fprintf(stderr,
+          "  --eval-memory=<bytes> Memory budget for evaluating [Eval] calls in global initializers\n");
+  fprintf(stderr,
+          "  --profile-generate[=<file>] Instrument functions, branches and calls; runs append\n"
+          "                   counts to <file> (default chance.profile) at exit\n");
+  fprintf(stderr,
+          "  --profile-use=<file> Guide inlining and block layout with a recorded profile\n");
+  fprintf(stderr,
+          "  --opt-passes=<a,b,...> Run exactly these optimizer passes, in order, instead\n"
+          "                   of the -O pipeline\n");
+  fprintf(stderr,
+          "  --disable-pass=<a,b,...> Skip optimizer passes (repeatable)\n");
+  fprintf(stderr,
+          "  --whole-program  Drop functions, globals and library modules unreachable from\n"
+          "                   the entry point (default for -O1+ executables)\n");
+  fprintf(stderr,
+          "  --no-whole-program Keep every function, global and library module\n");
+  fprintf(stderr,
+          "  --share-constants With --library, emit each constant string once for the\n"
+          "                   whole library instead of once per module\n");
   fprintf(stderr,
           "  -H26             Compile in H26 language mode\n");
   fprintf(stderr,
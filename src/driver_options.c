@@ -27,6 +27,41 @@ static int append_const_input(const char *value, const char ***items,
   return 0;
 }
 
+static int driver_check_pass_list(const char *flag, const char *list)
+{
+  if (!*list)
+  {
+    fprintf(stderr, "error: %s expects a comma-separated list of pass names\n", flag);
+    return 0;
+  }
+  while (1)
+  {
+    const char *comma = strchr(list, ',');
+    size_t len = comma ? (size_t)(comma - list) : strlen(list);
+    if (!codegen_ccb_opt_pass_known(list, len))
+    {
+      fprintf(stderr, "error: unknown optimizer pass '%.*s' in %s\n", (int)len, list, flag);
+      return 0;
+    }
+    if (!comma)
+      return 1;
+    list = comma + 1;
+  }
+}
+
+static int driver_parse_eval_limit(const char *flag, const char *value, long long *out)
+{
+  char *endptr = NULL;
+  long long parsed = strtoll(value, &endptr, 10);
+  if (!*value || !endptr || *endptr != '\0' || parsed <= 0)
+  {
+    fprintf(stderr, "invalid %s value '%s' (expected a positive integer)\n", flag, value);
+    return 0;
+  }
+  *out = parsed;
+  return 1;
+}
+
 int parse_driver_options_argv(int argc, char **argv, DriverOptionsState *state)
 {
   if (!argv || !state || argc <= 0)
@@ -397,6 +432,98 @@ int parse_driver_options_argv(int argc, char **argv, DriverOptionsState *state)
       *state->implicit_sizeof = 1;
       continue;
     }
+    if (strncmp(argv[i], "--sema-jobs=", 12) == 0)
+    {
+      const char *jobs_str = argv[i] + 12;
+      char *endptr = NULL;
+      long parsed = strtol(jobs_str, &endptr, 10);
+      if (!*jobs_str || !endptr || *endptr != '\0' || parsed < 0 || parsed > 256)
+      {
+        fprintf(stderr,
+                "invalid --sema-jobs value '%s' (use 0 for one per core, or 1..256)\n",
+                jobs_str);
+        return 2;
+      }
+      *state->sema_jobs = (int)parsed;
+      continue;
+    }
+    if (strncmp(argv[i], "--eval-steps=", 13) == 0)
+    {
+      if (!driver_parse_eval_limit("--eval-steps", argv[i] + 13, state->eval_steps))
+        return 2;
+      continue;
+    }
+    if (strncmp(argv[i], "--eval-memory=", 14) == 0)
+    {
+      if (!driver_parse_eval_limit("--eval-memory", argv[i] + 14, state->eval_memory))
+        return 2;
+      continue;
+    }
+    if (strcmp(argv[i], "--profile-generate") == 0)
+    {
+      *state->profile_generate = "chance.profile";
+      continue;
+    }
+    if (strncmp(argv[i], "--profile-generate=", 19) == 0)
+    {
+      if (!argv[i][19])
+      {
+        fprintf(stderr, "error: --profile-generate= expects a profile file path\n");
+        return 2;
+      }
+      *state->profile_generate = argv[i] + 19;
+      continue;
+    }
+    if (strncmp(argv[i], "--profile-use=", 14) == 0)
+    {
+      if (!argv[i][14])
+      {
+        fprintf(stderr, "error: --profile-use= expects a profile file path\n");
+        return 2;
+      }
+      *state->profile_use = argv[i] + 14;
+      continue;
+    }
+    if (strncmp(argv[i], "--opt-passes=", 13) == 0)
+    {
+      if (!driver_check_pass_list("--opt-passes=", argv[i] + 13))
+        return 2;
+      *state->opt_passes = argv[i] + 13;
+      continue;
+    }
+    if (strncmp(argv[i], "--disable-pass=", 15) == 0)
+    {
+      const char *list = argv[i] + 15;
+      if (!driver_check_pass_list("--disable-pass=", list))
+        return 2;
+      size_t old_len = *state->disabled_passes ? strlen(*state->disabled_passes) : 0;
+      char *joined = (char *)realloc(*state->disabled_passes, old_len + strlen(list) + 2);
+      if (!joined)
+      {
+        fprintf(stderr, "error: out of memory\n");
+        return 2;
+      }
+      if (old_len)
+        joined[old_len++] = ',';
+      strcpy(joined + old_len, list);
+      *state->disabled_passes = joined;
+      continue;
+    }
+    if (strcmp(argv[i], "--whole-program") == 0)
+    {
+      *state->whole_program = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "--no-whole-program") == 0)
+    {
+      *state->whole_program = 0;
+      continue;
+    }
+    if (strcmp(argv[i], "--share-constants") == 0)
+    {
+      *state->share_constants = 1;
+      continue;
+    }
     if (strcmp(argv[i], "-H26") == 0)
     {
       *state->language_standard = CHANCE_STD_H26;
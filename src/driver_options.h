@@ -29,6 +29,15 @@ typedef struct
   int *implicit_voidp;
   int *implicit_void_function;
   int *implicit_sizeof;
+  int *sema_jobs;
+  long long *eval_steps;
+  long long *eval_memory;
+  const char **profile_generate;
+  const char **profile_use;
+  const char **opt_passes;
+  char **disabled_passes;
+  int *whole_program;
+  int *share_constants;
   int *request_ast;
   int *diagnostics_only;
   int *toolchain_debug_mode;
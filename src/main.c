@@ -16,6 +16,8 @@
 #include "mangle.h"
 #include "module_registry.h"
 #include "preproc.h"
+#include "profile.h"
+#include "reach.h"
 #include <ctype.h>
 #include <errno.h>
 #include <stdarg.h>
@@ -150,6 +152,8 @@ typedef struct
   Node *unit;
   SemaContext *sc;
   Parser *parser;
+  int sema_done;
+  int sema_rc;
 } UnitCompile;
 
 typedef struct
@@ -3334,6 +3338,17 @@ int main(int argc, char **argv)
   int implicit_voidp = 0;
   int implicit_void_function = 0;
   int implicit_sizeof = 0;
+  int sema_jobs = 1;
+  long long eval_steps = 0;
+  long long eval_memory = 0;
+  const char *profile_generate = NULL;
+  const char *profile_use = NULL;
+  const char *opt_passes = NULL;
+  char *disabled_passes = NULL;
+  int whole_program = -1;
+  int share_constants = 0;
+  ReachProgram *reach = NULL;
+  int reach_libraries = 0;
   int language_standard = CHANCEC_DEFAULT_STANDARD;
   int request_ast = 0;
   int diagnostics_only = 0;
@@ -3436,6 +3451,15 @@ int main(int argc, char **argv)
       .implicit_voidp = &implicit_voidp,
       .implicit_void_function = &implicit_void_function,
       .implicit_sizeof = &implicit_sizeof,
+      .sema_jobs = &sema_jobs,
+      .eval_steps = &eval_steps,
+      .eval_memory = &eval_memory,
+      .profile_generate = &profile_generate,
+      .profile_use = &profile_use,
+      .opt_passes = &opt_passes,
+      .disabled_passes = &disabled_passes,
+      .whole_program = &whole_program,
+      .share_constants = &share_constants,
       .request_ast = &request_ast,
       .diagnostics_only = &diagnostics_only,
       .toolchain_debug_mode = &toolchain_debug_mode,
@@ -3662,6 +3686,24 @@ int main(int argc, char **argv)
   sema_set_allow_implicit_voidp(implicit_voidp);
   sema_set_allow_implicit_void_function(implicit_void_function);
   sema_set_allow_implicit_sizeof(implicit_sizeof);
+  sema_set_parallel_jobs(sema_jobs);
+  sema_set_share_template_instances(!emit_library && !no_link && !stop_after_ccb && !stop_after_asm);
+  sema_set_eval_budget(eval_steps, eval_memory);
+  if (profile_generate && profile_use)
+  {
+    fprintf(stderr, "error: --profile-generate and --profile-use cannot be combined\n");
+    goto fail;
+  }
+  /* Instrumented modules dump their counters through atexit/fopen/fprintf. */
+  if (profile_generate && freestanding)
+  {
+    fprintf(stderr, "error: --profile-generate needs the C library and cannot be used in a freestanding build\n");
+    goto fail;
+  }
+  if (profile_generate)
+    profile_enable_sites();
+  if (profile_use && profile_load(profile_use))
+    goto fail;
   parser_set_language_standard((ChanceLanguageStandard)language_standard);
 
   module_registry_reset();
@@ -3918,6 +3960,38 @@ int main(int argc, char **argv)
     strip_map_ready = 1;
   }
 
+  /* Whole-program reachability needs every unit checked before any is
+     emitted, so sema runs up front and codegen reuses the result. Exposed
+     symbols stay roots whenever foreign code may still link against us. */
+  int link_executable = !emit_library && !no_link && !stop_after_ccb && !stop_after_asm;
+  int foreign_inputs = obj_count + asm_count + ccb_count > 0;
+  if (!rc && ce_count > 0 &&
+      (whole_program > 0 ||
+       (whole_program < 0 && opt_level > 0 && link_executable && !foreign_inputs)))
+  {
+    reach = reach_create(!link_executable || foreign_inputs);
+    int sema_failed = 0;
+    for (int fi = 0; fi < ce_count; ++fi)
+    {
+      if (compiler_verbose_enabled())
+        verbose_progress("ce-sema", fi + 1, ce_count);
+      units[fi].sema_rc = sema_check_unit(units[fi].sc, units[fi].unit);
+      units[fi].sema_done = 1;
+      sema_failed |= units[fi].sema_rc != 0;
+      reach_add_unit(reach, units[fi].unit);
+    }
+    for (int li = 0; li < loaded_library_count; ++li)
+    {
+      for (uint32_t mi = 0; mi < loaded_libraries[li].file.module_count; ++mi)
+        reach_add_library_module(reach, &loaded_libraries[li].file.modules[mi]);
+    }
+    if (!sema_failed)
+    {
+      reach_prune_units(reach);
+      reach_libraries = link_executable && obj_count + asm_count == 0;
+    }
+  }
+
   if (compiler_verbose_enabled() && ce_count > 0)
     verbose_section("Codegen CE units");
   for (int fi = 0; fi < ce_count && rc == 0; ++fi)
@@ -3930,7 +4004,7 @@ int main(int argc, char **argv)
     if (compiler_verbose_enabled())
       verbose_progress("ce-codegen", fi + 1, ce_count);
 
-    int serr = sema_check_unit(sc, unit);
+    int serr = uc->sema_done ? uc->sema_rc : sema_check_unit(sc, unit);
     if (!serr)
     {
       char dir[512], base[512];
@@ -4069,11 +4143,30 @@ int main(int argc, char **argv)
                            .imported_extern_count = imported_count,
                            .imported_globals = imported_global_syms,
                            .imported_global_count = imported_global_count,
-                           .opt_level = opt_level};
+                           .opt_level = opt_level,
+                           .profile_generate = profile_generate,
+                           .opt_passes = opt_passes,
+                           .disabled_passes = disabled_passes,
+                           .share_constants = share_constants && emit_library};
       int extern_count = 0;
       const Symbol *extern_syms = parser_get_externs(ps, &extern_count);
       co.externs = extern_syms;
       co.extern_count = extern_count;
+      // Stripping and obfuscation happen in chancecodec, so only plain
+      // library modules are serialised directly.
+      char direct_ccbin_path[1024];
+      if (emit_library && !strip_metadata && !strip_hard && !obfuscate &&
+          !codegen_ccb_resolve_module_path(&co, direct_ccbin_path,
+                                           sizeof(direct_ccbin_path)))
+      {
+        char ccbin_dir[512];
+        char ccbin_base[512];
+        split_path(direct_ccbin_path, ccbin_dir, sizeof(ccbin_dir),
+                   ccbin_base, sizeof(ccbin_base));
+        build_path_with_ext(ccbin_dir, ccbin_base, ".ccbin",
+                            direct_ccbin_path, sizeof(direct_ccbin_path));
+        co.ccbin_output_path = direct_ccbin_path;
+      }
       rc = codegen_ccb_write_module(unit, &co);
       free(imported_syms);
       free(imported_global_syms);
@@ -4083,6 +4176,8 @@ int main(int argc, char **argv)
         if (codegen_ccb_resolve_module_path(&co, ccb_path, sizeof(ccb_path)))
           rc = 1;
       }
+      if (!rc && reach_libraries && reach_note_ccb_file(reach, ccb_path))
+        reach_libraries = 0;
 
       if (!rc && emit_library)
       {
@@ -4121,6 +4216,8 @@ int main(int argc, char **argv)
               free(libmod->ccbin_path);
               libmod->ccbin_path = NULL;
             }
+            if (co.ccbin_output_path)
+              remove(co.ccbin_output_path);
             remove(ccb_path);
           }
           else
@@ -4132,13 +4229,19 @@ int main(int argc, char **argv)
             char ccbin_path[1024];
             build_path_with_ext(ccbin_dir, ccbin_base, ".ccbin", ccbin_path,
                                 sizeof(ccbin_path));
-            if (!chancecodec_cmd_to_use || !*chancecodec_cmd_to_use)
+            uint8_t *ccbin_data = NULL;
+            size_t ccbin_size = 0;
+            int have_ccbin =
+                co.ccbin_output_path &&
+                read_file_bytes(ccbin_path, &ccbin_data, &ccbin_size) == 0;
+            if (!have_ccbin &&
+                (!chancecodec_cmd_to_use || !*chancecodec_cmd_to_use))
             {
               fprintf(stderr, "error: chancecodec executable not resolved "
                               "(required for --library)\n");
               rc = 1;
             }
-            else
+            else if (!have_ccbin)
             {
               int spawn_errno = 0;
               int ccbin_rc = run_chancecodec_emit_ccbin(
@@ -4157,13 +4260,9 @@ int main(int argc, char **argv)
                           "chancecodec --emit-ccbin failed (rc=%d) for '%s'\n",
                           ccbin_rc, ccb_path);
                 rc = 1;
-                remove(ccbin_path);
-                remove(ccb_path);
               }
               else
               {
-                uint8_t *ccbin_data = NULL;
-                size_t ccbin_size = 0;
                 int read_err =
                     read_file_bytes(ccbin_path, &ccbin_data, &ccbin_size);
                 if (read_err != 0)
@@ -4171,22 +4270,22 @@ int main(int argc, char **argv)
                   fprintf(stderr, "error: failed reading ccbin '%s' (%s)\n",
                           ccbin_path, strerror(read_err));
                   rc = 1;
-                  remove(ccbin_path);
-                  remove(ccb_path);
                 }
                 else
-                {
-                  if (libmod->ccbin_data)
-                    free(libmod->ccbin_data);
-                  libmod->ccbin_data = ccbin_data;
-                  libmod->ccbin_size = ccbin_size;
-                  free(libmod->ccbin_path);
-                  libmod->ccbin_path = NULL;
-                }
-                remove(ccbin_path);
-                remove(ccb_path);
+                  have_ccbin = 1;
               }
             }
+            if (have_ccbin)
+            {
+              if (libmod->ccbin_data)
+                free(libmod->ccbin_data);
+              libmod->ccbin_data = ccbin_data;
+              libmod->ccbin_size = ccbin_size;
+              free(libmod->ccbin_path);
+              libmod->ccbin_path = NULL;
+            }
+            remove(ccbin_path);
+            remove(ccb_path);
           }
         }
       }
@@ -4498,6 +4597,13 @@ int main(int argc, char **argv)
   {
     if (compiler_verbose_enabled() && library_codegen_units > 0)
       verbose_section("Processing library modules");
+    for (int ci = 0; reach_libraries && ci < ccb_count; ++ci)
+    {
+      if (reach_note_ccb_file(reach, ccb_inputs[ci]))
+        reach_libraries = 0;
+    }
+    if (reach_libraries)
+      reach_resolve_library_modules(reach);
     int verbose_lib_progress = 0;
     for (int li = 0; li < loaded_library_count && !rc; ++li)
     {
@@ -4507,6 +4613,12 @@ int main(int argc, char **argv)
         const CclibModule *mod = &lib->file.modules[mi];
         if (!mod->ccbin_data || mod->ccbin_size == 0)
           continue;
+        if (reach_libraries && !reach_library_module_needed(reach, mod))
+        {
+          compiler_verbose_logf("reach", "whole-program: skip unreferenced library module '%s'",
+                                mod->module_name ? mod->module_name : "module");
+          continue;
+        }
 
         if (compiler_verbose_enabled())
           verbose_progress("lib-module", ++verbose_lib_progress,
@@ -4720,6 +4832,7 @@ int main(int argc, char **argv)
     rc = run_driver_link_phase(&link_state);
   }
 cleanup:
+  reach_destroy(reach);
   if (!rc && project_after_cmd && project_after_cmd[0])
   {
     int after_rc = system(project_after_cmd);
@@ -4774,6 +4887,7 @@ cleanup:
   for (int i = 0; i < include_dir_count; i++)
     free(include_dirs[i]);
   free(include_dirs);
+  free(disabled_passes);
   free_library_module_array(library_modules, library_module_count);
   if (loaded_library_functions)
   {
@@ -1,4 +1,5 @@
 #include "module_registry.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -7,6 +8,7 @@ typedef struct
     char *module_full;
     char *name;
     Type *type;
+    int next_same_name; /* next entry with this name in any module, -1 at end */
 } StructEntry;
 
 typedef struct
@@ -14,6 +16,7 @@ typedef struct
     char *module_full;
     char *name;
     Type *type;
+    int next_same_name;
 } EnumEntry;
 
 typedef struct
@@ -24,6 +27,38 @@ typedef struct
     int value;
 } EnumValueEntry;
 
+/* String-keyed open-addressing map from a name (or enum/value name pair) to
+   an entry index. Keys point at strings owned by the entries themselves. */
+typedef struct
+{
+    const char *key;
+    const char *key2;
+    uint64_t hash;
+    int index;
+} RegistrySlot;
+
+typedef struct
+{
+    RegistrySlot *slots;
+    int cap;
+    int count;
+} RegistryMap;
+
+/* Second level of the index: everything registered under one module. */
+typedef struct
+{
+    char *module_full;
+    RegistryMap structs;
+    RegistryMap enums;
+    RegistryMap enum_values;
+} ModuleIndex;
+
+typedef struct
+{
+    const Type *type;
+    int index;
+} TypeModuleSlot;
+
 static StructEntry *struct_entries = NULL;
 static int struct_count = 0;
 static int struct_cap = 0;
@@ -36,6 +71,17 @@ static EnumValueEntry *enum_value_entries = NULL;
 static int enum_value_count = 0;
 static int enum_value_cap = 0;
 
+static ModuleIndex *module_indexes = NULL;
+static int module_index_count = 0;
+static int module_index_cap = 0;
+static RegistryMap module_map;
+static RegistryMap struct_name_map;
+static RegistryMap enum_name_map;
+
+static TypeModuleSlot *struct_type_slots = NULL;
+static int struct_type_cap = 0;
+static int struct_type_count = 0;
+
 static char *dup_string(const char *s)
 {
     return s ? xstrdup(s) : NULL;
@@ -81,18 +127,42 @@ static void free_enum_value_entries(void)
     enum_value_cap = 0;
 }
 
+static void registry_map_free(RegistryMap *map)
+{
+    free(map->slots);
+    map->slots = NULL;
+    map->cap = 0;
+    map->count = 0;
+}
+
+static void free_module_indexes(void)
+{
+    for (int i = 0; i < module_index_count; ++i)
+    {
+        free(module_indexes[i].module_full);
+        registry_map_free(&module_indexes[i].structs);
+        registry_map_free(&module_indexes[i].enums);
+        registry_map_free(&module_indexes[i].enum_values);
+    }
+    free(module_indexes);
+    module_indexes = NULL;
+    module_index_count = 0;
+    module_index_cap = 0;
+    registry_map_free(&module_map);
+    registry_map_free(&struct_name_map);
+    registry_map_free(&enum_name_map);
+    free(struct_type_slots);
+    struct_type_slots = NULL;
+    struct_type_cap = 0;
+    struct_type_count = 0;
+}
+
 void module_registry_reset(void)
 {
     free_struct_entries();
     free_enum_entries();
     free_enum_value_entries();
-}
-
-static int match_strings(const char *a, const char *b)
-{
-    if (!a || !b)
-        return 0;
-    return strcmp(a, b) == 0;
+    free_module_indexes();
 }
 
 static int module_name_matches(const char *a, const char *b)
@@ -116,27 +186,193 @@ static int module_name_matches(const char *a, const char *b)
     return 0;
 }
 
-void module_registry_register_struct(const char *module_full, Type *type)
+static uint64_t registry_hash(const char *s)
 {
-    if (!module_full || !type)
-        return;
-    for (int i = 0; i < struct_count; ++i)
+    uint64_t hash = 1469598103934665603ULL;
+    while (*s)
     {
-        if (match_strings(struct_entries[i].module_full, module_full) &&
-            match_strings(struct_entries[i].name, type->struct_name))
+        hash ^= (uint8_t)(*s++);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t registry_hash_pair(const char *a, const char *b)
+{
+    uint64_t h = registry_hash(a);
+    return h ^ (registry_hash(b) + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2));
+}
+
+static int registry_map_find(const RegistryMap *map, const char *key, const char *key2, uint64_t hash)
+{
+    if (map->cap == 0)
+        return -1;
+    int mask = map->cap - 1;
+    for (int at = (int)(hash & (uint64_t)mask);; at = (at + 1) & mask)
+    {
+        const RegistrySlot *slot = &map->slots[at];
+        if (!slot->key)
+            return -1;
+        if (slot->hash == hash && strcmp(slot->key, key) == 0 &&
+            (!key2 || strcmp(slot->key2, key2) == 0))
+            return slot->index;
+    }
+}
+
+static void registry_map_place(RegistryMap *map, const RegistrySlot *src)
+{
+    int mask = map->cap - 1;
+    int at = (int)(src->hash & (uint64_t)mask);
+    while (map->slots[at].key)
+        at = (at + 1) & mask;
+    map->slots[at] = *src;
+    map->count++;
+}
+
+/* Callers only insert keys that registry_map_find did not return. */
+static void registry_map_insert(RegistryMap *map, const char *key, const char *key2, uint64_t hash, int index)
+{
+    if ((map->count + 1) * 2 > map->cap)
+    {
+        RegistryMap grown;
+        grown.cap = map->cap ? map->cap * 2 : 16;
+        grown.count = 0;
+        grown.slots = (RegistrySlot *)xcalloc((size_t)grown.cap, sizeof(RegistrySlot));
+        for (int i = 0; i < map->cap; ++i)
         {
-            struct_entries[i].type = type;
+            if (map->slots[i].key)
+                registry_map_place(&grown, &map->slots[i]);
+        }
+        free(map->slots);
+        *map = grown;
+    }
+    RegistrySlot slot = {key, key2, hash, index};
+    registry_map_place(map, &slot);
+}
+
+static void registry_map_update(RegistryMap *map, const char *key, uint64_t hash, int index)
+{
+    int mask = map->cap - 1;
+    for (int at = (int)(hash & (uint64_t)mask); map->slots[at].key; at = (at + 1) & mask)
+    {
+        if (map->slots[at].hash == hash && strcmp(map->slots[at].key, key) == 0)
+        {
+            map->slots[at].index = index;
             return;
         }
     }
+}
+
+static ModuleIndex *module_index_find(const char *module_full)
+{
+    int idx = registry_map_find(&module_map, module_full, NULL, registry_hash(module_full));
+    return idx >= 0 ? &module_indexes[idx] : NULL;
+}
+
+static ModuleIndex *module_index_ensure(const char *module_full)
+{
+    ModuleIndex *mod = module_index_find(module_full);
+    if (mod)
+        return mod;
+    if (module_index_count == module_index_cap)
+    {
+        module_index_cap = module_index_cap ? module_index_cap * 2 : 8;
+        module_indexes = (ModuleIndex *)realloc(module_indexes, sizeof(ModuleIndex) * (size_t)module_index_cap);
+    }
+    mod = &module_indexes[module_index_count];
+    memset(mod, 0, sizeof(*mod));
+    mod->module_full = dup_string(module_full);
+    registry_map_insert(&module_map, mod->module_full, NULL, registry_hash(module_full), module_index_count);
+    module_index_count++;
+    return mod;
+}
+
+static void struct_type_place(const Type *type, int index)
+{
+    int mask = struct_type_cap - 1;
+    int at = (int)(((uintptr_t)type >> 4) * 0x9E3779B1u) & mask;
+    while (struct_type_slots[at].type && struct_type_slots[at].type != type)
+        at = (at + 1) & mask;
+    if (!struct_type_slots[at].type)
+        struct_type_count++;
+    struct_type_slots[at].type = type;
+    struct_type_slots[at].index = index;
+}
+
+static void struct_type_remember(const Type *type, int index)
+{
+    if ((struct_type_count + 1) * 2 > struct_type_cap)
+    {
+        TypeModuleSlot *old = struct_type_slots;
+        int old_cap = struct_type_cap;
+        struct_type_cap = struct_type_cap ? struct_type_cap * 2 : 64;
+        struct_type_slots = (TypeModuleSlot *)xcalloc((size_t)struct_type_cap, sizeof(TypeModuleSlot));
+        struct_type_count = 0;
+        for (int i = 0; i < old_cap; ++i)
+        {
+            if (old[i].type)
+                struct_type_place(old[i].type, old[i].index);
+        }
+        free(old);
+    }
+    struct_type_place(type, index);
+}
+
+static int struct_type_lookup(const Type *type)
+{
+    if (struct_type_cap == 0)
+        return -1;
+    int mask = struct_type_cap - 1;
+    for (int at = (int)(((uintptr_t)type >> 4) * 0x9E3779B1u) & mask; struct_type_slots[at].type; at = (at + 1) & mask)
+    {
+        if (struct_type_slots[at].type == type)
+            return struct_type_slots[at].index;
+    }
+    return -1;
+}
+
+void module_registry_register_struct(const char *module_full, Type *type)
+{
+    if (!module_full || !type)
+        return;
+    ModuleIndex *mod = module_index_ensure(module_full);
+    const char *name = type->struct_name;
+    uint64_t hash = name ? registry_hash(name) : 0;
+    int existing = name ? registry_map_find(&mod->structs, name, NULL, hash) : -1;
+    if (existing >= 0)
+    {
+        struct_entries[existing].type = type;
+        int known = struct_type_lookup(type);
+        if (known < 0 || known > existing || struct_entries[known].type != type)
+            struct_type_remember(type, existing);
+        return;
+    }
     if (struct_count == struct_cap)
     {
         struct_cap = struct_cap ? struct_cap * 2 : 8;
         struct_entries = (StructEntry *)realloc(struct_entries, sizeof(StructEntry) * (size_t)struct_cap);
     }
-    struct_entries[struct_count].module_full = dup_string(module_full);
-    struct_entries[struct_count].name = dup_string(type->struct_name);
-    struct_entries[struct_count].type = type;
+    StructEntry *entry = &struct_entries[struct_count];
+    entry->module_full = dup_string(module_full);
+    entry->name = dup_string(name);
+    entry->type = type;
+    entry->next_same_name = -1;
+    if (entry->name)
+    {
+        registry_map_insert(&mod->structs, entry->name, NULL, hash, struct_count);
+        int head = registry_map_find(&struct_name_map, entry->name, NULL, hash);
+        if (head >= 0)
+        {
+            entry->next_same_name = head;
+            registry_map_update(&struct_name_map, entry->name, hash, struct_count);
+        }
+        else
+        {
+            registry_map_insert(&struct_name_map, entry->name, NULL, hash, struct_count);
+        }
+    }
+    if (struct_type_lookup(type) < 0)
+        struct_type_remember(type, struct_count);
     struct_count++;
 }
 
@@ -144,23 +380,35 @@ void module_registry_register_enum(const char *module_full, const char *enum_nam
 {
     if (!module_full || !enum_name || !type)
         return;
-    for (int i = 0; i < enum_count; ++i)
+    ModuleIndex *mod = module_index_ensure(module_full);
+    uint64_t hash = registry_hash(enum_name);
+    int existing = registry_map_find(&mod->enums, enum_name, NULL, hash);
+    if (existing >= 0)
     {
-        if (match_strings(enum_entries[i].module_full, module_full) &&
-            match_strings(enum_entries[i].name, enum_name))
-        {
-            enum_entries[i].type = type;
-            return;
-        }
+        enum_entries[existing].type = type;
+        return;
     }
     if (enum_count == enum_cap)
     {
         enum_cap = enum_cap ? enum_cap * 2 : 8;
         enum_entries = (EnumEntry *)realloc(enum_entries, sizeof(EnumEntry) * (size_t)enum_cap);
     }
-    enum_entries[enum_count].module_full = dup_string(module_full);
-    enum_entries[enum_count].name = dup_string(enum_name);
-    enum_entries[enum_count].type = type;
+    EnumEntry *entry = &enum_entries[enum_count];
+    entry->module_full = dup_string(module_full);
+    entry->name = dup_string(enum_name);
+    entry->type = type;
+    entry->next_same_name = -1;
+    registry_map_insert(&mod->enums, entry->name, NULL, hash, enum_count);
+    int head = registry_map_find(&enum_name_map, entry->name, NULL, hash);
+    if (head >= 0)
+    {
+        entry->next_same_name = head;
+        registry_map_update(&enum_name_map, entry->name, hash, enum_count);
+    }
+    else
+    {
+        registry_map_insert(&enum_name_map, entry->name, NULL, hash, enum_count);
+    }
     enum_count++;
 }
 
@@ -168,25 +416,25 @@ void module_registry_register_enum_value(const char *module_full, const char *en
 {
     if (!module_full || !enum_name || !value_name)
         return;
-    for (int i = 0; i < enum_value_count; ++i)
+    ModuleIndex *mod = module_index_ensure(module_full);
+    uint64_t hash = registry_hash_pair(enum_name, value_name);
+    int existing = registry_map_find(&mod->enum_values, enum_name, value_name, hash);
+    if (existing >= 0)
     {
-        if (match_strings(enum_value_entries[i].module_full, module_full) &&
-            match_strings(enum_value_entries[i].enum_name, enum_name) &&
-            match_strings(enum_value_entries[i].value_name, value_name))
-        {
-            enum_value_entries[i].value = value;
-            return;
-        }
+        enum_value_entries[existing].value = value;
+        return;
     }
     if (enum_value_count == enum_value_cap)
     {
         enum_value_cap = enum_value_cap ? enum_value_cap * 2 : 8;
         enum_value_entries = (EnumValueEntry *)realloc(enum_value_entries, sizeof(EnumValueEntry) * (size_t)enum_value_cap);
     }
-    enum_value_entries[enum_value_count].module_full = dup_string(module_full);
-    enum_value_entries[enum_value_count].enum_name = dup_string(enum_name);
-    enum_value_entries[enum_value_count].value_name = dup_string(value_name);
-    enum_value_entries[enum_value_count].value = value;
+    EnumValueEntry *entry = &enum_value_entries[enum_value_count];
+    entry->module_full = dup_string(module_full);
+    entry->enum_name = dup_string(enum_name);
+    entry->value_name = dup_string(value_name);
+    entry->value = value;
+    registry_map_insert(&mod->enum_values, entry->enum_name, entry->value_name, hash, enum_value_count);
     enum_value_count++;
 }
 
@@ -194,48 +442,31 @@ Type *module_registry_lookup_struct(const char *module_full, const char *type_na
 {
     if (!module_full || !type_name)
         return NULL;
-    for (int i = 0; i < struct_count; ++i)
-    {
-        if (match_strings(struct_entries[i].module_full, module_full) &&
-            match_strings(struct_entries[i].name, type_name))
-        {
-            return struct_entries[i].type;
-        }
-    }
-    return NULL;
+    ModuleIndex *mod = module_index_find(module_full);
+    int idx = mod ? registry_map_find(&mod->structs, type_name, NULL, registry_hash(type_name)) : -1;
+    return idx >= 0 ? struct_entries[idx].type : NULL;
 }
 
 Type *module_registry_lookup_enum(const char *module_full, const char *enum_name)
 {
     if (!module_full || !enum_name)
         return NULL;
-    for (int i = 0; i < enum_count; ++i)
-    {
-        if (match_strings(enum_entries[i].module_full, module_full) &&
-            match_strings(enum_entries[i].name, enum_name))
-        {
-            return enum_entries[i].type;
-        }
-    }
-    return NULL;
+    ModuleIndex *mod = module_index_find(module_full);
+    int idx = mod ? registry_map_find(&mod->enums, enum_name, NULL, registry_hash(enum_name)) : -1;
+    return idx >= 0 ? enum_entries[idx].type : NULL;
 }
 
 int module_registry_lookup_enum_value(const char *module_full, const char *enum_name, const char *value_name, int *out_value)
 {
     if (!module_full || !enum_name || !value_name)
         return 0;
-    for (int i = 0; i < enum_value_count; ++i)
-    {
-        if (match_strings(enum_value_entries[i].module_full, module_full) &&
-            match_strings(enum_value_entries[i].enum_name, enum_name) &&
-            match_strings(enum_value_entries[i].value_name, value_name))
-        {
-            if (out_value)
-                *out_value = enum_value_entries[i].value;
-            return 1;
-        }
-    }
-    return 0;
+    ModuleIndex *mod = module_index_find(module_full);
+    int idx = mod ? registry_map_find(&mod->enum_values, enum_name, value_name, registry_hash_pair(enum_name, value_name)) : -1;
+    if (idx < 0)
+        return 0;
+    if (out_value)
+        *out_value = enum_value_entries[idx].value;
+    return 1;
 }
 
 Type *module_registry_canonical_type(Type *ty)
@@ -256,17 +487,14 @@ Type *module_registry_canonical_type(Type *ty)
                 resolved = module_registry_lookup_enum(ty->import_module, ty->import_type_name);
             if (!resolved && ty->import_type_name)
             {
+                uint64_t name_hash = registry_hash(ty->import_type_name);
                 Type *name_match = NULL;
                 int match_count = 0;
-                for (int i = 0; i < struct_count; ++i)
+                for (int i = registry_map_find(&struct_name_map, ty->import_type_name, NULL, name_hash);
+                     i >= 0 && match_count < 2; i = struct_entries[i].next_same_name)
                 {
-                    if (match_strings(struct_entries[i].name, ty->import_type_name))
-                    {
-                        name_match = struct_entries[i].type;
-                        match_count++;
-                        if (match_count > 1)
-                            break;
-                    }
+                    name_match = struct_entries[i].type;
+                    match_count++;
                 }
                 if (match_count == 1)
                     resolved = name_match;
@@ -274,15 +502,13 @@ Type *module_registry_canonical_type(Type *ty)
                 {
                     Type *qualified_match = NULL;
                     int qualified_count = 0;
-                    for (int i = 0; i < struct_count; ++i)
+                    for (int i = registry_map_find(&struct_name_map, ty->import_type_name, NULL, name_hash);
+                         i >= 0 && qualified_count < 2; i = struct_entries[i].next_same_name)
                     {
-                        if (match_strings(struct_entries[i].name, ty->import_type_name) &&
-                            module_name_matches(struct_entries[i].module_full, ty->import_module))
+                        if (module_name_matches(struct_entries[i].module_full, ty->import_module))
                         {
                             qualified_match = struct_entries[i].type;
                             qualified_count++;
-                            if (qualified_count > 1)
-                                break;
                         }
                     }
                     if (qualified_count == 1)
@@ -292,15 +518,11 @@ Type *module_registry_canonical_type(Type *ty)
                 {
                     Type *enum_match = NULL;
                     int enum_matches = 0;
-                    for (int i = 0; i < enum_count; ++i)
+                    for (int i = registry_map_find(&enum_name_map, ty->import_type_name, NULL, name_hash);
+                         i >= 0 && enum_matches < 2; i = enum_entries[i].next_same_name)
                     {
-                        if (match_strings(enum_entries[i].name, ty->import_type_name))
-                        {
-                            enum_match = enum_entries[i].type;
-                            enum_matches++;
-                            if (enum_matches > 1)
-                                break;
-                        }
+                        enum_match = enum_entries[i].type;
+                        enum_matches++;
                     }
                     if (enum_matches == 1)
                         resolved = enum_match;
@@ -308,15 +530,13 @@ Type *module_registry_canonical_type(Type *ty)
                     {
                         Type *enum_qualified = NULL;
                         int enum_qualified_count = 0;
-                        for (int i = 0; i < enum_count; ++i)
+                        for (int i = registry_map_find(&enum_name_map, ty->import_type_name, NULL, name_hash);
+                             i >= 0 && enum_qualified_count < 2; i = enum_entries[i].next_same_name)
                         {
-                            if (match_strings(enum_entries[i].name, ty->import_type_name) &&
-                                module_name_matches(enum_entries[i].module_full, ty->import_module))
+                            if (module_name_matches(enum_entries[i].module_full, ty->import_module))
                             {
                                 enum_qualified = enum_entries[i].type;
                                 enum_qualified_count++;
-                                if (enum_qualified_count > 1)
-                                    break;
                             }
                         }
                         if (enum_qualified_count == 1)
@@ -340,10 +560,20 @@ const char *module_registry_find_struct_module(const Type *type)
 {
     if (!type)
         return NULL;
+    int idx = struct_type_lookup(type);
+    if (idx >= 0 && struct_entries[idx].type == type)
+        return struct_entries[idx].module_full;
+    if (idx < 0)
+        return NULL;
+    /* The remembered entry was re-registered with another type since; fall
+       back to the first entry still holding this one. */
     for (int i = 0; i < struct_count; ++i)
     {
         if (struct_entries[i].type == type)
+        {
+            struct_type_remember(type, i);
             return struct_entries[i].module_full;
+        }
     }
     return NULL;
 }
@@ -982,6 +982,16 @@ static void apply_function_attributes(Parser *ps, Node *fn, struct PendingAttr *
         {
             fn->wants_inline = 1;
         }
+        else if (strcmp(attr->name, "Eval") == 0)
+        {
+            if (attr->value && *attr->value)
+            {
+                diag_error_at(lexer_source(ps->lx), attr->line, attr->col,
+                              "'Eval' attribute does not take arguments");
+                exit(1);
+            }
+            fn->is_eval = 1;
+        }
         else if (strcmp(attr->name, "Hint") == 0)
         {
             
@@ -1401,6 +1411,7 @@ static Node *parse_block(Parser *ps);
 static Node *parse_try_stmt(Parser *ps);
 static Node *parse_while(Parser *ps);
 static Node *parse_for(Parser *ps);
+static Node *parse_unroll_loop(Parser *ps);
 static Node *parse_switch(Parser *ps);
 static Node *parse_match_expr(Parser *ps, Token match_tok);
 static void parse_alias_decl(Parser *ps, int is_exposed);
@@ -5303,6 +5314,12 @@ static Node *parse_stmt(Parser *ps)
     }
     if (t.kind == TK_LBRACE)
         return parse_block(ps);
+    if (t.kind == TK_LBRACKET)
+    {
+        Token name = lexer_peek_n(ps->lx, 1);
+        if (name.kind == TK_IDENT && name.length == 6 && strncmp(name.lexeme, "Unroll", 6) == 0)
+            return parse_unroll_loop(ps);
+    }
     if (t.kind == TK_KW_IF)
     {
         lexer_next(ps->lx);
@@ -5886,6 +5903,35 @@ static Node *parse_while(Parser *ps)
     return w;
 }
 
+/* `[Unroll(N)]` ahead of a while or for loop; N == 1 keeps it rolled. */
+static Node *parse_unroll_loop(Parser *ps)
+{
+    Token open = expect(ps, TK_LBRACKET, "[");
+    expect(ps, TK_IDENT, "Unroll");
+    expect(ps, TK_LPAREN, "(");
+    Token count = expect(ps, TK_INT, "unroll count");
+    if (count.int_val < 1 || count.int_val > 64)
+    {
+        diag_error_at(lexer_source(ps->lx), count.line, count.col,
+                      "unroll count must be between 1 and 64");
+        exit(1);
+    }
+    expect(ps, TK_RPAREN, ")");
+    expect(ps, TK_RBRACKET, "]");
+
+    Token loop_tok = lexer_peek(ps->lx);
+    if (loop_tok.kind != TK_KW_WHILE && loop_tok.kind != TK_KW_FOR)
+    {
+        diag_error_at(lexer_source(ps->lx), open.line, open.col,
+                      "'[Unroll]' must be followed by a while or for loop");
+        exit(1);
+    }
+    Node *loop = loop_tok.kind == TK_KW_WHILE ? parse_while(ps) : parse_for(ps);
+    Node *wh = loop->kind == ND_WHILE ? loop : loop->stmts[loop->stmt_count - 1];
+    wh->loop_unroll = (int)count.int_val;
+    return loop;
+}
+
 static Node *parse_for(Parser *ps)
 {
     
@@ -6823,6 +6869,14 @@ Node *parse_unit(Parser *ps)
             t = lexer_peek(ps->lx);
         }
 
+        int leading_eval = 0;
+        if (t.kind == TK_KW_CONSTANT && lexer_peek_n(ps->lx, 1).kind == TK_KW_FUN)
+        {
+            lexer_next(ps->lx);
+            leading_eval = 1;
+            t = lexer_peek(ps->lx);
+        }
+
         int leading_packed = 0;
         Token packed_tok = {0};
         if (t.kind == TK_KW_PACKED)
@@ -7022,6 +7076,8 @@ Node *parse_unit(Parser *ps)
             int function_is_managed = managed_override_present ? managed_override_value : ps->module_is_managed;
             Node *fn = parse_function(ps, leading_noreturn, visibility, function_is_managed, body_kind, attrs, attr_count);
             apply_function_attributes(ps, fn, attrs, attr_count);
+            if (leading_eval)
+                fn->is_eval = 1;
             clear_pending_attrs(attrs, attr_count);
             attr_count = 0;
             if (decl_count == decl_cap)
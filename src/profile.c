@@ -0,0 +1,203 @@
+#include "profile.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    PROFILE_HOT_FRACTION = 100,
+    PROFILE_COLD_RATIO = 16,
+    PROFILE_KEY_MAX = 1024
+};
+
+typedef struct
+{
+    char *key;
+    uint64_t hash;
+    long long count;
+} ProfileSlot;
+
+static ProfileSlot *profile_slots = NULL;
+static size_t profile_slot_cap = 0;
+static size_t profile_slot_used = 0;
+static long long profile_hot_threshold = 0;
+static int profile_has_data = 0;
+static int profile_sites = 0;
+
+static uint64_t profile_hash(const char *s)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; ++s)
+    {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static ProfileSlot *profile_find_slot(ProfileSlot *slots, size_t cap, const char *key, uint64_t hash)
+{
+    size_t i = (size_t)hash & (cap - 1);
+    while (slots[i].key)
+    {
+        if (slots[i].hash == hash && strcmp(slots[i].key, key) == 0)
+            return &slots[i];
+        i = (i + 1) & (cap - 1);
+    }
+    return &slots[i];
+}
+
+static void profile_grow(void)
+{
+    size_t new_cap = profile_slot_cap ? profile_slot_cap * 2 : 256;
+    ProfileSlot *grown = (ProfileSlot *)xcalloc(new_cap, sizeof(ProfileSlot));
+    for (size_t i = 0; i < profile_slot_cap; ++i)
+    {
+        if (!profile_slots[i].key)
+            continue;
+        *profile_find_slot(grown, new_cap, profile_slots[i].key, profile_slots[i].hash) = profile_slots[i];
+    }
+    free(profile_slots);
+    profile_slots = grown;
+    profile_slot_cap = new_cap;
+}
+
+static void profile_add(const char *key, long long count)
+{
+    if ((profile_slot_used + 1) * 4 >= profile_slot_cap * 3)
+        profile_grow();
+    uint64_t hash = profile_hash(key);
+    ProfileSlot *slot = profile_find_slot(profile_slots, profile_slot_cap, key, hash);
+    if (slot->key)
+    {
+        slot->count = (LLONG_MAX - slot->count < count) ? LLONG_MAX : slot->count + count;
+        return;
+    }
+    slot->key = xstrdup(key);
+    slot->hash = hash;
+    slot->count = count;
+    profile_slot_used++;
+}
+
+void profile_enable_sites(void)
+{
+    profile_sites = 1;
+}
+
+int profile_sites_enabled(void)
+{
+    return profile_sites;
+}
+
+void profile_reset(void)
+{
+    for (size_t i = 0; i < profile_slot_cap; ++i)
+        free(profile_slots[i].key);
+    free(profile_slots);
+    profile_slots = NULL;
+    profile_slot_cap = 0;
+    profile_slot_used = 0;
+    profile_hot_threshold = 0;
+    profile_has_data = 0;
+    profile_sites = 0;
+}
+
+int profile_load(const char *path)
+{
+    FILE *in = fopen(path, "r");
+    if (!in)
+    {
+        diag_error("cannot read profile '%s'", path);
+        return 1;
+    }
+
+    char line[PROFILE_KEY_MAX + 32];
+    int line_no = 0;
+    int rc = 0;
+    long long max_entry = 0;
+    while (fgets(line, sizeof(line), in))
+    {
+        line_no++;
+        size_t len = strlen(line);
+        if (len + 1 == sizeof(line) && line[len - 1] != '\n')
+        {
+            diag_error("profile '%s' line %d is too long", path, line_no);
+            rc = 1;
+            break;
+        }
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0)
+            continue;
+
+        char *count_str = strrchr(line, ' ');
+        char *end = NULL;
+        long long count = count_str ? strtoll(count_str + 1, &end, 10) : -1;
+        if (!count_str || !end || *end != '\0' || end == count_str + 1 || count < 0 ||
+            (line[0] != PROFILE_FUNCTION && line[0] != PROFILE_BRANCH && line[0] != PROFILE_CALL) ||
+            line[1] != ' ')
+        {
+            diag_error("profile '%s' line %d is malformed", path, line_no);
+            rc = 1;
+            break;
+        }
+        *count_str = '\0';
+        profile_add(line, count);
+        if (line[0] == PROFILE_FUNCTION && count > max_entry)
+            max_entry = count;
+    }
+    fclose(in);
+    if (rc)
+        return rc;
+
+    profile_has_data = 1;
+    profile_sites = 1;
+    profile_hot_threshold = max_entry / PROFILE_HOT_FRACTION;
+    if (profile_hot_threshold < 1)
+        profile_hot_threshold = 1;
+    compiler_verbose_logf("profile", "loaded %zu counter(s) from '%s' (hot threshold %lld)",
+                          profile_slot_used, path, profile_hot_threshold);
+    return 0;
+}
+
+int profile_loaded(void)
+{
+    return profile_has_data;
+}
+
+const char *profile_function_key(const Node *fn)
+{
+    if (!fn)
+        return NULL;
+    return fn->metadata.backend_name ? fn->metadata.backend_name : fn->name;
+}
+
+int profile_format_key(char *buf, size_t bufsz, ProfileCounterKind kind, const char *function, int site, int arm)
+{
+    int n = snprintf(buf, bufsz, "%c %s %d %d", (char)kind, function ? function : "?", site, arm);
+    return n > 0 && (size_t)n < bufsz && (size_t)n < PROFILE_KEY_MAX;
+}
+
+long long profile_count(ProfileCounterKind kind, const char *function, int site, int arm)
+{
+    if (!profile_has_data || !function || profile_slot_cap == 0)
+        return -1;
+    char key[PROFILE_KEY_MAX];
+    if (!profile_format_key(key, sizeof(key), kind, function, site, arm))
+        return -1;
+    ProfileSlot *slot = profile_find_slot(profile_slots, profile_slot_cap, key, profile_hash(key));
+    return slot->key ? slot->count : -1;
+}
+
+int profile_is_hot(long long count)
+{
+    return profile_has_data && count >= profile_hot_threshold;
+}
+
+int profile_is_cold(long long count, long long reference)
+{
+    return count >= 0 && reference > 0 && count <= reference / PROFILE_COLD_RATIO;
+}
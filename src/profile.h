@@ -0,0 +1,43 @@
+#ifndef CHANCE_PROFILE_H
+#define CHANCE_PROFILE_H
+
+#include "ast.h"
+
+/* Execution profiles for --profile-generate / --profile-use.
+
+   Instrumented code keeps one u64 counter per key. Keys are
+   "<kind> <function> <site> <arm>" where <function> is the backend name of
+   the enclosing function and <site> is the 1-based number sema gives each
+   if statement and call inside that function (0 for the entry counter).
+   The runtime appends "<key> <count>" lines to the profile file at exit. */
+
+typedef enum
+{
+    PROFILE_FUNCTION = 'f', /* function entry; site 0, arm 0 */
+    PROFILE_BRANCH = 'b',   /* if statement; arm 1 = then, arm 0 = else */
+    PROFILE_CALL = 'c'      /* direct call site; arm 0 */
+} ProfileCounterKind;
+
+/* Makes sema number profile sites. Implied by a successful profile_load. */
+void profile_enable_sites(void);
+int profile_sites_enabled(void);
+
+/* Reads a profile file, summing duplicate keys. Reports diagnostics and
+   returns non-zero on failure. */
+int profile_load(const char *path);
+int profile_loaded(void);
+void profile_reset(void);
+
+const char *profile_function_key(const Node *fn);
+int profile_format_key(char *buf, size_t bufsz, ProfileCounterKind kind, const char *function, int site, int arm);
+
+/* Recorded count for a key, or -1 when the profile has no such counter. */
+long long profile_count(ProfileCounterKind kind, const char *function, int site, int arm);
+
+/* Hot: within 1/100 of the most frequently entered function. Cold: seen at
+   most 1/16 as often as `reference` (a sibling branch or the function
+   entry). Both are false without profile data for the count. */
+int profile_is_hot(long long count);
+int profile_is_cold(long long count, long long reference);
+
+#endif
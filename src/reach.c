@@ -0,0 +1,550 @@
+#include "reach.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    REACH_CCBIN_NAME_MAX = 1024
+};
+
+typedef struct
+{
+    const char *name;
+    size_t len;
+    uint64_t hash;
+    int first; /* head of the ReachRef chain, -1 for a bare token */
+} ReachSlot;
+
+typedef struct
+{
+    ReachSlot *slots;
+    size_t cap;
+    size_t used;
+} ReachTable;
+
+typedef struct
+{
+    Node *decl; /* CE function or global, NULL for a library module */
+    int module;
+    int next;
+} ReachRef;
+
+typedef enum
+{
+    REACH_MODULE_UNSEEN,
+    REACH_MODULE_PENDING,
+    REACH_MODULE_SCANNED
+} ReachModuleState;
+
+struct ReachProgram
+{
+    int keep_exposed;
+    ReachTable names;
+    ReachRef *refs;
+    int ref_count;
+    int ref_cap;
+    Node **decls;
+    int decl_count;
+    int decl_cap;
+    Node **work;
+    int work_count;
+    int work_cap;
+    const CclibModule **modules;
+    unsigned char *module_state;
+    int module_count;
+    int module_cap;
+};
+
+static void *reach_grow(void *items, int *cap, int need, size_t elem)
+{
+    if (need <= *cap)
+        return items;
+    int new_cap = *cap ? *cap * 2 : 16;
+    while (new_cap < need)
+        new_cap *= 2;
+    void *grown = realloc(items, (size_t)new_cap * elem);
+    if (!grown)
+    {
+        diag_error("out of memory");
+        exit(1);
+    }
+    *cap = new_cap;
+    return grown;
+}
+
+static uint64_t reach_hash(const char *s, size_t len)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static ReachSlot *reach_find_slot(ReachSlot *slots, size_t cap, const char *s, size_t len, uint64_t hash)
+{
+    size_t i = (size_t)hash & (cap - 1);
+    while (slots[i].name)
+    {
+        if (slots[i].hash == hash && slots[i].len == len && memcmp(slots[i].name, s, len) == 0)
+            return &slots[i];
+        i = (i + 1) & (cap - 1);
+    }
+    return &slots[i];
+}
+
+static ReachSlot *reach_table_insert(ReachTable *t, const char *s, size_t len)
+{
+    if ((t->used + 1) * 4 >= t->cap * 3)
+    {
+        size_t new_cap = t->cap ? t->cap * 2 : 256;
+        ReachSlot *grown = (ReachSlot *)xcalloc(new_cap, sizeof(ReachSlot));
+        for (size_t i = 0; i < t->cap; ++i)
+        {
+            if (t->slots[i].name)
+                *reach_find_slot(grown, new_cap, t->slots[i].name, t->slots[i].len, t->slots[i].hash) = t->slots[i];
+        }
+        free(t->slots);
+        t->slots = grown;
+        t->cap = new_cap;
+    }
+    uint64_t hash = reach_hash(s, len);
+    ReachSlot *slot = reach_find_slot(t->slots, t->cap, s, len, hash);
+    if (!slot->name)
+    {
+        slot->name = s;
+        slot->len = len;
+        slot->hash = hash;
+        slot->first = -1;
+        t->used++;
+    }
+    return slot;
+}
+
+static const ReachSlot *reach_table_lookup(const ReachTable *t, const char *s, size_t len)
+{
+    if (t->cap == 0)
+        return NULL;
+    ReachSlot *slot = reach_find_slot(t->slots, t->cap, s, len, reach_hash(s, len));
+    return slot->name ? slot : NULL;
+}
+
+static int reach_table_contains(const ReachTable *t, const char *s)
+{
+    return s && reach_table_lookup(t, s, strlen(s)) != NULL;
+}
+
+static int reach_is_name_char(int c)
+{
+    return isalnum(c) || c == '_' || c == '$';
+}
+
+static int reach_strip_varargs(const char *s, size_t *len)
+{
+    static const char suffix[] = "_varargs";
+    const size_t slen = sizeof(suffix) - 1;
+    if (*len <= slen || memcmp(s + *len - slen, suffix, slen) != 0)
+        return 0;
+    *len -= slen;
+    return 1;
+}
+
+static void reach_add_name(ReachProgram *rp, const char *name, Node *decl, int module)
+{
+    if (!name || !*name)
+        return;
+    ReachSlot *slot = reach_table_insert(&rp->names, name, strlen(name));
+    for (int r = slot->first; r >= 0; r = rp->refs[r].next)
+    {
+        if (rp->refs[r].decl == decl && rp->refs[r].module == module)
+            return;
+    }
+    rp->refs = (ReachRef *)reach_grow(rp->refs, &rp->ref_cap, rp->ref_count + 1, sizeof(ReachRef));
+    rp->refs[rp->ref_count].decl = decl;
+    rp->refs[rp->ref_count].module = module;
+    rp->refs[rp->ref_count].next = slot->first;
+    slot->first = rp->ref_count++;
+}
+
+static void reach_mark_decl(ReachProgram *rp, const Node *decl)
+{
+    if (!decl || !decl->is_unreachable)
+        return;
+    ((Node *)decl)->is_unreachable = 0;
+    rp->work = (Node **)reach_grow(rp->work, &rp->work_cap, rp->work_count + 1, sizeof(Node *));
+    rp->work[rp->work_count++] = (Node *)decl;
+}
+
+/* CE code marks CE declarations only; which library modules it needs is
+   read back from the ccb that codegen actually emits. */
+static void reach_mark_name(ReachProgram *rp, const char *s, size_t len, int modules)
+{
+    const ReachSlot *slot = reach_table_lookup(&rp->names, s, len);
+    if (!slot && reach_strip_varargs(s, &len))
+        slot = reach_table_lookup(&rp->names, s, len);
+    if (!slot)
+        return;
+    for (int r = slot->first; r >= 0; r = rp->refs[r].next)
+    {
+        const ReachRef *ref = &rp->refs[r];
+        if (ref->decl)
+            reach_mark_decl(rp, ref->decl);
+        else if (modules && rp->module_state[ref->module] == REACH_MODULE_UNSEEN)
+            rp->module_state[ref->module] = REACH_MODULE_PENDING;
+    }
+}
+
+static void reach_mark_cstr(ReachProgram *rp, const char *name)
+{
+    if (name && *name)
+        reach_mark_name(rp, name, strlen(name), 0);
+}
+
+static void reach_mark_text(ReachProgram *rp, const char *text, size_t len, int modules)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        if (!reach_is_name_char((unsigned char)text[i]))
+        {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < len && reach_is_name_char((unsigned char)text[i]))
+            ++i;
+        if (!isdigit((unsigned char)text[start]))
+            reach_mark_name(rp, text + start, i - start, modules);
+    }
+}
+
+/* ccbin stores symbol names as u32 little-endian length + bytes. Anything
+   that decodes as such is taken as a name; stray matches only keep more. */
+static void reach_scan_ccbin(ReachProgram *rp, const CclibModule *mod, ReachTable *collect, int modules)
+{
+    const uint8_t *data = mod->ccbin_data;
+    size_t size = mod->ccbin_size;
+    for (size_t i = 0; data && i + 4 < size; ++i)
+    {
+        size_t len = (size_t)data[i] | ((size_t)data[i + 1] << 8) | ((size_t)data[i + 2] << 16) |
+                     ((size_t)data[i + 3] << 24);
+        if (len == 0 || len > REACH_CCBIN_NAME_MAX || len > size - i - 4)
+            continue;
+        const char *s = (const char *)data + i + 4;
+        if (isdigit((unsigned char)s[0]))
+            continue;
+        size_t k = 0;
+        while (k < len && reach_is_name_char((unsigned char)s[k]))
+            ++k;
+        if (k != len)
+            continue;
+        if (!collect)
+        {
+            reach_mark_name(rp, s, len, modules);
+            continue;
+        }
+        reach_table_insert(collect, s, len);
+        if (reach_strip_varargs(s, &len))
+            reach_table_insert(collect, s, len);
+    }
+}
+
+static void reach_walk(ReachProgram *rp, const Node *n)
+{
+    if (!n)
+        return;
+    if (n->kind == ND_CALL || n->kind == ND_LAMBDA_CALL)
+    {
+        reach_mark_decl(rp, n->call_target);
+        reach_mark_cstr(rp, n->call_name);
+    }
+    else if (n->kind == ND_VAR)
+    {
+        reach_mark_decl(rp, n->referenced_function);
+        reach_mark_cstr(rp, n->var_ref);
+    }
+    reach_walk(rp, n->lhs);
+    reach_walk(rp, n->rhs);
+    reach_walk(rp, n->body);
+    reach_walk(rp, n->type_expr);
+    reach_walk(rp, n->managed_length_expr);
+    for (int i = 0; i < n->arg_count; ++i)
+        reach_walk(rp, n->args[i]);
+    for (int i = 0; i < n->stmt_count; ++i)
+        reach_walk(rp, n->stmts[i]);
+    for (int i = 0; i < n->init.count; ++i)
+        reach_walk(rp, n->init.elems[i]);
+    if (n->kind == ND_SWITCH)
+    {
+        reach_walk(rp, n->switch_stmt.expr);
+        for (int i = 0; i < n->switch_stmt.case_count; ++i)
+        {
+            reach_walk(rp, n->switch_stmt.cases[i].value);
+            reach_walk(rp, n->switch_stmt.cases[i].body);
+        }
+    }
+    else if (n->kind == ND_MATCH)
+    {
+        reach_walk(rp, n->match_stmt.expr);
+        for (int i = 0; i < n->match_stmt.arm_count; ++i)
+        {
+            reach_walk(rp, n->match_stmt.arms[i].pattern);
+            reach_walk(rp, n->match_stmt.arms[i].guard);
+            reach_walk(rp, n->match_stmt.arms[i].body);
+        }
+    }
+}
+
+static void reach_scan_decl(ReachProgram *rp, const Node *decl)
+{
+    if (decl->kind != ND_FUNC)
+    {
+        reach_walk(rp, decl->rhs);
+        return;
+    }
+    reach_walk(rp, decl->body);
+    for (int i = 0; i < decl->chancecode.count; ++i)
+    {
+        if (decl->chancecode.lines[i])
+            reach_mark_text(rp, decl->chancecode.lines[i], strlen(decl->chancecode.lines[i]), 0);
+    }
+    for (int i = 0; i < decl->literal.count; ++i)
+    {
+        if (decl->literal.lines[i])
+            reach_mark_text(rp, decl->literal.lines[i], strlen(decl->literal.lines[i]), 0);
+    }
+}
+
+static int reach_is_runtime_name(const char *name)
+{
+    return name && strncmp(name, "__cert__", 8) == 0;
+}
+
+static int reach_is_root(const ReachProgram *rp, const Node *decl)
+{
+    if (rp->keep_exposed && decl->is_exposed)
+        return 1;
+    if (decl->kind != ND_FUNC)
+        return 0;
+    if (decl->is_entrypoint || decl->export_name || decl->is_preserve || decl->is_jump_target ||
+        decl->section_name)
+        return 1;
+    if (decl->name && strcmp(decl->name, "main") == 0)
+        return 1;
+    return reach_is_runtime_name(decl->name) || reach_is_runtime_name(decl->metadata.backend_name);
+}
+
+static void reach_add_module_names(ReachProgram *rp, int index)
+{
+    const CclibModule *mod = rp->modules[index];
+    for (uint32_t i = 0; i < mod->function_count; ++i)
+    {
+        reach_add_name(rp, mod->functions[i].name, NULL, index);
+        reach_add_name(rp, mod->functions[i].backend_name, NULL, index);
+    }
+    for (uint32_t i = 0; i < mod->global_count; ++i)
+        reach_add_name(rp, mod->globals[i].name, NULL, index);
+}
+
+ReachProgram *reach_create(int keep_exposed)
+{
+    ReachProgram *rp = (ReachProgram *)xcalloc(1, sizeof(ReachProgram));
+    rp->keep_exposed = keep_exposed;
+    return rp;
+}
+
+void reach_destroy(ReachProgram *rp)
+{
+    if (!rp)
+        return;
+    free(rp->names.slots);
+    free(rp->refs);
+    free(rp->decls);
+    free(rp->work);
+    free(rp->modules);
+    free(rp->module_state);
+    free(rp);
+}
+
+void reach_add_unit(ReachProgram *rp, Node *unit)
+{
+    if (!rp || !unit || unit->kind != ND_UNIT)
+        return;
+    for (int i = 0; i < unit->stmt_count; ++i)
+    {
+        Node *decl = unit->stmts[i];
+        if (!decl)
+            continue;
+        if (decl->kind == ND_FUNC)
+        {
+            reach_add_name(rp, decl->name, decl, -1);
+        }
+        else if (decl->kind == ND_VAR_DECL && decl->var_is_global)
+        {
+            reach_add_name(rp, decl->var_name, decl, -1);
+        }
+        else
+        {
+            continue;
+        }
+        reach_add_name(rp, decl->metadata.backend_name, decl, -1);
+        rp->decls = (Node **)reach_grow(rp->decls, &rp->decl_cap, rp->decl_count + 1, sizeof(Node *));
+        rp->decls[rp->decl_count++] = decl;
+    }
+}
+
+void reach_add_library_module(ReachProgram *rp, const CclibModule *mod)
+{
+    if (!rp || !mod || !mod->ccbin_data || mod->ccbin_size == 0)
+        return;
+    int index = rp->module_count;
+    int state_cap = rp->module_cap;
+    rp->modules = (const CclibModule **)reach_grow(rp->modules, &rp->module_cap, index + 1,
+                                                   sizeof(const CclibModule *));
+    rp->module_state = (unsigned char *)reach_grow(rp->module_state, &state_cap, index + 1, 1);
+    rp->modules[index] = mod;
+    rp->module_count++;
+
+    /* Only drop a module when every symbol it defines is visible in its own
+       ccbin; otherwise nothing can prove it unused. */
+    ReachTable own = {0};
+    reach_scan_ccbin(rp, mod, &own, 0);
+    int keep = mod->function_count == 0 && mod->global_count == 0;
+    for (uint32_t i = 0; i < mod->function_count; ++i)
+    {
+        const CclibFunction *fn = &mod->functions[i];
+        if (reach_is_runtime_name(fn->name) || reach_is_runtime_name(fn->backend_name))
+            keep = 1;
+        if (!reach_table_contains(&own, fn->backend_name) && !reach_table_contains(&own, fn->name))
+            keep = 1;
+    }
+    for (uint32_t i = 0; i < mod->global_count; ++i)
+    {
+        const char *name = mod->globals[i].name;
+        if (reach_is_runtime_name(name) || !reach_table_contains(&own, name))
+            keep = 1;
+    }
+    free(own.slots);
+    reach_add_module_names(rp, index);
+    rp->module_state[index] = keep ? REACH_MODULE_PENDING : REACH_MODULE_UNSEEN;
+}
+
+void reach_prune_units(ReachProgram *rp)
+{
+    if (!rp)
+        return;
+    for (int i = 0; i < rp->decl_count; ++i)
+        rp->decls[i]->is_unreachable = 1;
+    for (int i = 0; i < rp->decl_count; ++i)
+    {
+        if (reach_is_root(rp, rp->decls[i]))
+            reach_mark_decl(rp, rp->decls[i]);
+    }
+    for (int m = 0; m < rp->module_count; ++m)
+        reach_scan_ccbin(rp, rp->modules[m], NULL, 0);
+    while (rp->work_count > 0)
+        reach_scan_decl(rp, rp->work[--rp->work_count]);
+
+    int funcs = 0, funcs_kept = 0, globals = 0, globals_kept = 0;
+    for (int i = 0; i < rp->decl_count; ++i)
+    {
+        int kept = !rp->decls[i]->is_unreachable;
+        if (rp->decls[i]->kind == ND_FUNC)
+        {
+            funcs++;
+            funcs_kept += kept;
+        }
+        else
+        {
+            globals++;
+            globals_kept += kept;
+        }
+    }
+    compiler_verbose_logf("reach", "whole-program: kept %d of %d function(s) and %d of %d global(s)",
+                          funcs_kept, funcs, globals_kept, globals);
+
+    /* The driver frees each unit right after its codegen; keep only the
+       library names that later ccb scans still need. */
+    free(rp->names.slots);
+    memset(&rp->names, 0, sizeof(rp->names));
+    rp->ref_count = 0;
+    rp->decl_count = 0;
+    for (int m = 0; m < rp->module_count; ++m)
+        reach_add_module_names(rp, m);
+}
+
+int reach_note_ccb_file(ReachProgram *rp, const char *path)
+{
+    if (!rp || rp->module_count == 0)
+        return 0;
+    FILE *in = fopen(path, "rb");
+    if (!in)
+        return 1;
+    char *text = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    size_t n;
+    do
+    {
+        if (len + 4096 > cap)
+        {
+            cap = cap ? cap * 2 : 65536;
+            char *grown = (char *)realloc(text, cap);
+            if (!grown)
+            {
+                diag_error("out of memory");
+                exit(1);
+            }
+            text = grown;
+        }
+        n = fread(text + len, 1, cap - len, in);
+        len += n;
+    } while (n > 0);
+    int rc = ferror(in) != 0;
+    fclose(in);
+    if (!rc)
+        reach_mark_text(rp, text, len, 1);
+    free(text);
+    return rc;
+}
+
+void reach_resolve_library_modules(ReachProgram *rp)
+{
+    if (!rp || rp->module_count == 0)
+        return;
+    int progressed = 1;
+    while (progressed)
+    {
+        progressed = 0;
+        for (int m = 0; m < rp->module_count; ++m)
+        {
+            if (rp->module_state[m] != REACH_MODULE_PENDING)
+                continue;
+            rp->module_state[m] = REACH_MODULE_SCANNED;
+            reach_scan_ccbin(rp, rp->modules[m], NULL, 1);
+            progressed = 1;
+        }
+    }
+    int kept = 0;
+    for (int m = 0; m < rp->module_count; ++m)
+        kept += rp->module_state[m] != REACH_MODULE_UNSEEN;
+    compiler_verbose_logf("reach", "whole-program: kept %d of %d library module(s)", kept, rp->module_count);
+}
+
+int reach_library_module_needed(const ReachProgram *rp, const CclibModule *mod)
+{
+    if (!rp)
+        return 1;
+    for (int m = 0; m < rp->module_count; ++m)
+    {
+        if (rp->modules[m] == mod)
+            return rp->module_state[m] != REACH_MODULE_UNSEEN;
+    }
+    return 1;
+}
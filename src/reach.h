@@ -0,0 +1,41 @@
+#ifndef CHANCE_REACH_H
+#define CHANCE_REACH_H
+
+#include "ast.h"
+#include "cclib.h"
+
+/* Whole-program reachability for --whole-program.
+
+   CE functions and globals are roots when they are entry points, [Export],
+   [Preserve], section-placed or jump targets, `__cert__` runtime hooks,
+   mentioned by any loaded library module, or exposed while foreign code may
+   still link against the program. Edges are resolved call targets, function
+   references, and names used in expressions, initializers and
+   chancecode/literal bodies. reach_prune_units flags everything else
+   is_unreachable, which codegen skips.
+
+   Library modules are kept when they define runtime hooks, when their own
+   symbol names cannot be found in their ccbin (stripped or obfuscated), or
+   when a name they define is mentioned by emitted CE ccb or by another kept
+   module. */
+
+typedef struct ReachProgram ReachProgram;
+
+ReachProgram *reach_create(int keep_exposed);
+void reach_destroy(ReachProgram *rp);
+
+void reach_add_unit(ReachProgram *rp, Node *unit);
+void reach_add_library_module(ReachProgram *rp, const CclibModule *mod);
+
+/* Call after every unit passed sema and all library modules were added. */
+void reach_prune_units(ReachProgram *rp);
+
+/* Records the library symbols an emitted ccb file refers to. Returns
+   non-zero when the file cannot be read. */
+int reach_note_ccb_file(ReachProgram *rp, const char *path);
+
+/* Call once every ccb file was noted. */
+void reach_resolve_library_modules(ReachProgram *rp);
+int reach_library_module_needed(const ReachProgram *rp, const CclibModule *mod);
+
+#endif
@@ -1,16 +1,24 @@
 #include "ast.h"
 #include "mangle.h"
 #include "module_registry.h"
+#include "profile.h"
+#include "workpool.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <setjmp.h>
 
 static int sema_allow_implicit_voidp = 0;
 static int sema_allow_implicit_sizeof = 0;
 static int sema_allow_implicit_void_function = 0;
+static int sema_parallel_jobs = 1;
+static int sema_share_template_instances = 0;
+static long long sema_eval_step_budget = 50000000;
+static long long sema_eval_memory_budget = 64LL * 1024 * 1024;
 
 void sema_set_allow_implicit_voidp(int enable)
 {
@@ -32,11 +40,33 @@ int sema_get_allow_implicit_void_function(void)
     return sema_allow_implicit_void_function;
 }
 
+void sema_set_parallel_jobs(int jobs)
+{
+    if (jobs <= 0)
+        jobs = workpool_hardware_threads();
+    sema_parallel_jobs = jobs > 0 ? jobs : 1;
+}
+
+void sema_set_share_template_instances(int enable)
+{
+    sema_share_template_instances = enable ? 1 : 0;
+}
+
+void sema_set_eval_budget(long long steps, long long memory_bytes)
+{
+    if (steps > 0)
+        sema_eval_step_budget = steps;
+    if (memory_bytes > 0)
+        sema_eval_memory_budget = memory_bytes;
+}
+
 enum
 {
     INLINE_PARAM_LIMIT = 4,
     INLINE_COST_LIMIT = 40,
-    INLINE_EVAL_MAX_DEPTH = 16
+    INLINE_HOT_COST_LIMIT = 160,
+    INLINE_EVAL_MAX_DEPTH = 16,
+    ESCAPE_STACK_LIMIT = 1024
 };
 
 typedef struct
@@ -54,51 +84,82 @@ typedef struct ImportedFunctionSet
 } ImportedFunctionSet;
 
 static void analyze_inline_candidates(Node *root);
+static void sema_profile_number_sites(Node *node, int *next);
+static void sema_escape_analyze(Node *fn);
+static void sema_null_flow_analyze(Node *fn);
 static int inline_try_fold_call(Node *call_expr);
+static int inline_type_is_unsigned(Type *ty);
+static int inline_type_bit_width(Type *ty);
+static int64_t inline_normalize_value(int64_t value, Type *ty);
 static int template_param_allows(Type *t, TemplateConstraintKind want);
 static int type_is_float(Type *t);
 static int type_is_pointer(Type *t);
 static int type_equal(Type *a, Type *b);
+static Type *type_interned(Type *ty);
+static uint64_t type_intern_mix(uint64_t h, uint64_t v);
+static void populate_symbol_from_function(Symbol *s, Node *fn);
 static int bind_template_type_pattern(Type *pattern, Type *actual,
                                       Type **bindings, int binding_count);
 static int check_exposed_function_signature(const Node *fn);
 static void sema_register_function_local(SemaContext *sc, Node *unit_node, Node *fn);
 static int sema_check_function(SemaContext *sc, Node *fn);
+static void sema_settle_function_signature(Node *fn);
 static void sema_ensure_call_args_checked(SemaContext *sc, Node *call_expr, int *args_checked);
 static const Symbol *sema_resolve_local_overload(SemaContext *sc, const char *name, Node *call_expr, int *args_checked);
 
 static Type ty_u64;
 
-static Type *canonicalize_type_deep(Type *ty)
+static Type *canonicalize_type_deep_impl(Type *ty, int *complete)
 {
     ty = module_registry_canonical_type(ty);
-    if (ty && (ty->kind == TY_PTR || ty->kind == TY_REF) && ty->pointee)
+    if (!ty || ty->is_canonical)
+        return ty;
+    int all_resolved = ty->kind != TY_IMPORT;
+    if ((ty->kind == TY_PTR || ty->kind == TY_REF) && ty->pointee)
     {
-        Type *resolved = canonicalize_type_deep(ty->pointee);
+        Type *resolved = canonicalize_type_deep_impl(ty->pointee, &all_resolved);
         if (resolved && resolved != ty->pointee)
             ty->pointee = resolved;
     }
-    else if (ty && ty->kind == TY_ARRAY && ty->array.elem)
+    else if (ty->kind == TY_ARRAY && ty->array.elem)
     {
-        Type *resolved_elem = canonicalize_type_deep(ty->array.elem);
+        Type *resolved_elem = canonicalize_type_deep_impl(ty->array.elem, &all_resolved);
         if (resolved_elem && resolved_elem != ty->array.elem)
             ty->array.elem = resolved_elem;
     }
-    else if (ty && ty->kind == TY_FUNC && ty->func.params)
+    else if (ty->kind == TY_FUNC && ty->func.params)
     {
         for (int i = 0; i < ty->func.param_count; ++i)
         {
-            Type *resolved_param = canonicalize_type_deep(ty->func.params[i]);
+            Type *resolved_param = canonicalize_type_deep_impl(ty->func.params[i], &all_resolved);
             if (resolved_param && resolved_param != ty->func.params[i])
                 ty->func.params[i] = resolved_param;
         }
         if (ty->func.ret)
         {
-            Type *resolved_ret = canonicalize_type_deep(ty->func.ret);
+            Type *resolved_ret = canonicalize_type_deep_impl(ty->func.ret, &all_resolved);
             if (resolved_ret && resolved_ret != ty->func.ret)
                 ty->func.ret = resolved_ret;
         }
     }
+    /* Once every import underneath has resolved the walk is a no-op, so later
+       calls return immediately instead of re-querying the module registry. */
+    if (all_resolved)
+        workpool_atomic_store_int(&ty->is_canonical, 1);
+    else if (complete)
+        *complete = 0;
+    return ty;
+}
+
+static Type *canonicalize_type_deep(Type *ty)
+{
+    /* The walk rewrites shared type nodes, so only the already-canonical fast
+       path may run without the shared lock during parallel checking. */
+    if (ty && ty->kind != TY_IMPORT && workpool_atomic_load_int(&ty->is_canonical))
+        return ty;
+    workpool_shared_lock();
+    ty = canonicalize_type_deep_impl(ty, NULL);
+    workpool_shared_unlock();
     return ty;
 }
 
@@ -183,9 +244,19 @@ static Type *sema_runtime_helper_signature(const char *name)
     return NULL;
 }
 
+enum
+{
+    SYMTAB_FIRST_CHUNK = 16,
+    SYMTAB_MAX_CHUNKS = 27
+};
+
+/* Symbols live in geometrically growing chunks that are never moved, so a
+   Symbol pointer stays valid for the lifetime of the table and readers can
+   scan up to a published count while another thread appends. Chunk k holds
+   SYMTAB_FIRST_CHUNK << k entries. */
 struct SymTable
 {
-    Symbol *items;
+    Symbol *chunks[SYMTAB_MAX_CHUNKS];
     int count;
     int cap;
 };
@@ -253,35 +324,74 @@ void symtab_destroy(SymTable *st)
 {
     if (!st)
         return;
-    free(st->items);
+    for (int k = 0; k < SYMTAB_MAX_CHUNKS; ++k)
+        free(st->chunks[k]);
     free(st);
 }
 static int symtab_grow(SymTable *st)
 {
-    int ncap = st->cap ? st->cap * 2 : 8;
-    Symbol *ni = (Symbol *)realloc(st->items, ncap * sizeof(Symbol));
-    if (!ni)
+    int k = 0;
+    while (k < SYMTAB_MAX_CHUNKS && st->chunks[k])
+        k++;
+    if (k == SYMTAB_MAX_CHUNKS)
+        return 0;
+    int size = SYMTAB_FIRST_CHUNK << k;
+    Symbol *chunk = (Symbol *)malloc((size_t)size * sizeof(Symbol));
+    if (!chunk)
         return 0;
-    st->items = ni;
-    st->cap = ncap;
+    st->chunks[k] = chunk;
+    st->cap += size;
     return 1;
 }
+static Symbol *symtab_slot(SymTable *st, int index)
+{
+    int k = 0;
+    int size = SYMTAB_FIRST_CHUNK;
+    while (index >= size)
+    {
+        index -= size;
+        size <<= 1;
+        k++;
+    }
+    return &st->chunks[k][index];
+}
 int symtab_add(SymTable *st, Symbol sym)
 {
-    if (st->count == st->cap && !symtab_grow(st))
-        return 0;
-    st->items[st->count++] = sym;
-    return 1;
+    workpool_shared_lock();
+    int ok = st->count < st->cap || symtab_grow(st);
+    if (ok)
+    {
+        *symtab_slot(st, st->count) = sym;
+        workpool_atomic_store_int(&st->count, st->count + 1);
+    }
+    workpool_shared_unlock();
+    return ok;
 }
-const Symbol *symtab_get(SymTable *st, const char *name)
+/* Visits every symbol in insertion order until `visit` returns non-zero. */
+static const Symbol *symtab_scan(SymTable *st, int (*visit)(const Symbol *sym, const void *arg), const void *arg)
 {
-    for (int i = 0; i < st->count; i++)
+    int remaining = workpool_atomic_load_int(&st->count);
+    for (int k = 0; k < SYMTAB_MAX_CHUNKS && remaining > 0; ++k)
     {
-        if (strcmp(st->items[i].name, name) == 0)
-            return &st->items[i];
+        int size = SYMTAB_FIRST_CHUNK << k;
+        int n = remaining < size ? remaining : size;
+        for (int i = 0; i < n; ++i)
+        {
+            if (visit(&st->chunks[k][i], arg))
+                return &st->chunks[k][i];
+        }
+        remaining -= n;
     }
     return NULL;
 }
+static int symtab_name_equals(const Symbol *sym, const void *name)
+{
+    return sym->name && strcmp(sym->name, (const char *)name) == 0;
+}
+const Symbol *symtab_get(SymTable *st, const char *name)
+{
+    return symtab_scan(st, symtab_name_equals, name);
+}
 
 static int symbols_share_body(const Symbol *a, const Symbol *b)
 {
@@ -294,20 +404,18 @@ static int symbols_share_body(const Symbol *a, const Symbol *b)
     return 0;
 }
 
+static int symtab_name_has_module_prefix(const Symbol *sym, const void *prefix)
+{
+    const char *candidate = sym->name;
+    size_t prefix_len = strlen((const char *)prefix);
+    return candidate && strncmp(candidate, (const char *)prefix, prefix_len) == 0 && candidate[prefix_len] == '.';
+}
+
 static int symtab_has_symbol_with_prefix(SymTable *st, const char *prefix)
 {
     if (!st || !prefix || !*prefix)
         return 0;
-    size_t prefix_len = strlen(prefix);
-    for (int i = 0; i < st->count; ++i)
-    {
-        const char *candidate = st->items[i].name;
-        if (!candidate)
-            continue;
-        if (strncmp(candidate, prefix, prefix_len) == 0 && candidate[prefix_len] == '.')
-            return 1;
-    }
-    return 0;
+    return symtab_scan(st, symtab_name_has_module_prefix, prefix) != NULL;
 }
 
 static void append_mangled_type(char **out_buf, size_t *out_len, size_t *out_cap, const Type *ty)
@@ -453,8 +561,141 @@ static void sema_imported_function_insert(SemaContext *sc, const char *name, con
     slot->module_full = module_full;
 }
 
+typedef struct
+{
+    const char *name;
+    const char *module_full;
+    Symbol symbol;
+} SemaDeferredImport;
+
+typedef enum
+{
+    SEMA_TASK_IMPORT,
+    SEMA_TASK_GLOBAL,
+    SEMA_TASK_APPEND,
+    SEMA_TASK_LAMBDA,
+    SEMA_TASK_EVAL,
+    SEMA_TASK_INSTANCE,
+} SemaTaskEventKind;
+
+typedef struct
+{
+    SemaTaskEventKind kind;
+    Node *node;                /* appended node, deferred global or call site */
+    struct SemaTask *instance; /* SEMA_TASK_INSTANCE */
+    size_t diag_mark;          /* captured diagnostics that precede the event */
+    SemaDeferredImport import;
+    Symbol global;
+} SemaTaskEvent;
+
+/* A global, a function body or a template instance first cloned by one of
+   them, checked by a parallel sema_check_unit. Whatever the check would
+   append to the unit, record on the context or print is kept here in the
+   order it happened and replayed in declaration order once every task is
+   done, so the result does not depend on the number of jobs. */
+struct SemaTask
+{
+    Node *fn;
+    struct SemaParallelJob *job;
+    const char *template_name; /* instances only */
+    const char *failure;       /* instances: error reported at the call site */
+    int rc;
+    int aborted;
+    int merged;
+    SemaTaskEvent *events;
+    int event_count;
+    int event_cap;
+    DiagCapture diags;
+};
+
+struct SemaParallelJob
+{
+    SemaContext *sc;
+    struct SemaTask *tasks;
+    int *fn_tasks;
+    struct Scope **scopes;
+    struct SemaTask **instances;
+    int instance_count;
+    int instance_cap;
+};
+
+static void *sema_task_reserve(void *items, int *count, int *cap, size_t item_size)
+{
+    if (*count < *cap)
+        return items;
+    int new_cap = *cap ? *cap * 2 : 4;
+    void *grown = realloc(items, (size_t)new_cap * item_size);
+    if (!grown)
+    {
+        diag_error("out of memory while deferring semantic results");
+        exit(1);
+    }
+    *cap = new_cap;
+    return grown;
+}
+
+static SemaTaskEvent *sema_task_event(struct SemaTask *task, SemaTaskEventKind kind)
+{
+    task->events = (SemaTaskEvent *)sema_task_reserve(task->events, &task->event_count, &task->event_cap, sizeof(SemaTaskEvent));
+    SemaTaskEvent *ev = &task->events[task->event_count++];
+    memset(ev, 0, sizeof(*ev));
+    ev->kind = kind;
+    ev->diag_mark = task->diags.len;
+    return ev;
+}
+
+/* Where sema_abort unwinds to while this thread runs a task. */
+static WORKPOOL_THREAD_LOCAL jmp_buf *sema_abort_point = NULL;
+static WORKPOOL_THREAD_LOCAL struct SemaTask *sema_abort_task = NULL;
+
+/* Gives up after a fatal diagnostic. A task only records the failure; it is
+   reported when the task is merged, at the point sequential checking would
+   have stopped. */
+static _Noreturn void sema_abort(void)
+{
+    if (sema_abort_point)
+    {
+        sema_abort_task->aborted = 1;
+        longjmp(*sema_abort_point, 1);
+    }
+    exit(1);
+}
+
+static struct SemaTask *sema_task_switch(SemaContext *sc, struct SemaTask *task)
+{
+    struct SemaTask *previous = sc->task;
+    sc->task = task;
+    sema_abort_task = task;
+    diag_capture_set(task ? &task->diags : NULL);
+    return previous;
+}
+
+static void sema_task_run(SemaContext *sc, struct SemaTask *task, int (*check)(SemaContext *, Node *))
+{
+    jmp_buf abort_point;
+    sema_abort_point = &abort_point;
+    sema_task_switch(sc, task);
+    if (setjmp(abort_point) == 0)
+        task->rc = check(sc, task->fn);
+    else
+    {
+        workpool_shared_release();
+        task->rc = 1;
+    }
+    sema_task_switch(sc, NULL);
+    sema_abort_point = NULL;
+}
+
 void sema_track_imported_function(SemaContext *sc, const char *name, const char *module_full, const Symbol *symbol)
 {
+    if (sc && sc->task && name && symbol)
+    {
+        SemaTaskEvent *ev = sema_task_event(sc->task, SEMA_TASK_IMPORT);
+        ev->import.name = name;
+        ev->import.module_full = module_full;
+        ev->import.symbol = *symbol;
+        return;
+    }
     sema_imported_function_insert(sc, name, module_full, symbol);
 }
 
@@ -540,6 +781,11 @@ static void sema_track_imported_global_usage(SemaContext *sc, const Symbol *sym)
 {
     if (!sc || !sym || sym->kind != SYM_GLOBAL || !sym->is_extern)
         return;
+    if (sc->task)
+    {
+        sema_task_event(sc->task, SEMA_TASK_GLOBAL)->global = *sym;
+        return;
+    }
     const char *name = symbol_effective_name(sym);
     if (!name || !*name)
         return;
@@ -557,7 +803,7 @@ static void sema_track_imported_global_usage(SemaContext *sc, const Symbol *sym)
         if (!grown)
         {
             diag_error("out of memory while tracking imported globals");
-            exit(1);
+            sema_abort();
         }
         sc->imported_globals = grown;
         sc->imported_global_cap = new_cap;
@@ -595,7 +841,7 @@ static const ImportedFunctionCandidate *sema_get_unique_imported_candidate(SemaC
             const char *mod_a = set->candidates[0].module_full ? set->candidates[0].module_full : "<unknown>";
             const char *mod_b = set->candidates[1].module_full ? set->candidates[1].module_full : "<unknown>";
             diag_error("ambiguous reference to function '%s'; candidates exist in modules '%s' and '%s'", name, mod_a, mod_b);
-            exit(1);
+            sema_abort();
         }
     }
     return NULL;
@@ -614,12 +860,28 @@ struct VarBind
     int is_static;
     const char *backend_name;
     const char *managed_length_name;
+    int shadowed; /* previous binding of the same name, -1 if none */
 };
+struct ScopeSlot
+{
+    const char *name; /* slots are never emptied, only rehashed */
+    size_t hash;
+    int top; /* innermost visible binding, -1 when out of scope */
+};
+/* All lexical scopes of a context share one binding stack. scope_push records
+   a watermark, scope_pop unwinds back to it, and `slots` maps each name to its
+   innermost binding so lookups never walk enclosing scopes. */
 struct Scope
 {
-    struct VarBind locals[128];
-    int local_count;
-    struct Scope *parent;
+    struct VarBind *binds;
+    int bind_count;
+    int bind_cap;
+    int *marks;
+    int mark_count;
+    int mark_cap;
+    struct ScopeSlot *slots;
+    int slot_cap;
+    int slot_used;
 };
 struct SemaContext
 {
@@ -652,6 +914,7 @@ SemaContext *sema_create(void)
     sc->lambda_counter = 0;
     return sc;
 }
+static void scope_destroy(struct Scope *s);
 void sema_destroy(SemaContext *sc)
 {
     if (!sc)
@@ -666,6 +929,7 @@ void sema_destroy(SemaContext *sc)
         free(sc->imported_funcs);
     }
     free(sc->imported_globals);
+    scope_destroy(sc->scope);
     symtab_destroy(sc->syms);
     free(sc);
 }
@@ -928,6 +1192,22 @@ static int type_is_string_ptr(Type *t)
     return (pointee->kind == TY_CHAR || pointee->kind == TY_I8 || pointee->kind == TY_U8);
 }
 
+/* Switch and match compare string labels with strcmp, so only the bytes up
+   to the first NUL take part. */
+static int string_label_length(const Node *n)
+{
+    int len = 0;
+    while (len < n->str_len && n->str_data[len] != '\0')
+        len++;
+    return len;
+}
+
+static int string_labels_equal(const Node *a, const Node *b)
+{
+    int len = string_label_length(a);
+    return len == string_label_length(b) && memcmp(a->str_data, b->str_data, (size_t)len) == 0;
+}
+
 static int type_is_pointer_like(Type *t)
 {
     t = canonicalize_type_deep(t);
@@ -1141,7 +1421,7 @@ static Type *instantiate_type_with_bindings(const Type *orig,
             if (!grown)
             {
                 diag_error("out of memory while caching type instantiations");
-                exit(1);
+                sema_abort();
             }
             *cache = grown;
             *cache_cap = new_cap;
@@ -1320,11 +1600,11 @@ static char *constraint_name(TemplateConstraintKind kind)
     }
 }
 
-static char *make_template_instance_name(const Symbol *sym, Type **bindings, int binding_count)
+static char *make_template_instance_name(const char *base_name, Type **bindings, int binding_count)
 {
-    if (!sym || !sym->name)
+    if (!base_name)
         return NULL;
-    size_t base_len = strlen(sym->name);
+    size_t base_len = strlen(base_name);
     size_t total = base_len + 8;
     char **chunks = NULL;
     if (binding_count > 0)
@@ -1351,7 +1631,7 @@ static char *make_template_instance_name(const Symbol *sym, Type **bindings, int
     }
     char *name = (char *)xmalloc(total + 1);
     name[0] = '\0';
-    strncat(name, sym->name, total);
+    strncat(name, base_name, total);
     strncat(name, "__inst", total - strlen(name));
     for (int i = 0; i < binding_count; ++i)
     {
@@ -1379,7 +1659,7 @@ static void unit_append_function(Node *unit, Node *fn)
     if (!grown)
     {
         diag_error("out of memory while registering instantiated function");
-        exit(1);
+        sema_abort();
     }
     unit->stmts = grown;
     unit->stmts[unit->stmt_count] = fn;
@@ -1397,13 +1677,26 @@ static void unit_append_decl(Node *unit, Node *decl)
     if (!grown)
     {
         diag_error("out of memory while appending declaration");
-        exit(1);
+        sema_abort();
     }
     unit->stmts = grown;
     unit->stmts[unit->stmt_count] = decl;
     unit->stmt_count = new_count;
 }
 
+static void sema_unit_append(SemaContext *sc, Node *node)
+{
+    if (sc->task)
+    {
+        sema_task_event(sc->task, SEMA_TASK_APPEND)->node = node;
+        return;
+    }
+    if (node->kind == ND_FUNC)
+        unit_append_function(sc->unit, node);
+    else
+        unit_append_decl(sc->unit, node);
+}
+
 static char *make_static_local_backend_name(const Node *fn, const char *var_name)
 {
     const char *base = NULL;
@@ -1420,12 +1713,19 @@ static char *make_static_local_backend_name(const Node *fn, const char *var_name
     return buf;
 }
 
+#define SEMA_LAMBDA_NAME_CAP 32
+
+/* A task cannot know how many lambdas precede it, so it uses a placeholder
+   that is unique to the buffer; the merge numbers the lambda in place, which
+   renames every reference that shares the buffer. */
 static char *sema_make_lambda_name(SemaContext *sc)
 {
-    int index = sc ? sc->lambda_counter++ : 0;
-    char buf[64];
-    snprintf(buf, sizeof(buf), "__lambda_%d", index);
-    return xstrdup(buf);
+    char *name = (char *)xmalloc(SEMA_LAMBDA_NAME_CAP);
+    if (sc && sc->task)
+        snprintf(name, SEMA_LAMBDA_NAME_CAP, "__lambda_%p", (void *)name);
+    else
+        snprintf(name, SEMA_LAMBDA_NAME_CAP, "__lambda_%d", sc ? sc->lambda_counter++ : 0);
+    return name;
 }
 
 static Type *sema_make_func_type_from_node(const Node *fn)
@@ -1448,12 +1748,13 @@ static void sema_lower_lambda(SemaContext *sc, Node *lambda)
     {
         diag_error_at(lambda->src, lambda->line, lambda->col,
                       "lambda expressions require a translation unit context");
-        exit(1);
+        sema_abort();
     }
 
     Node *fn = (Node *)xcalloc(1, sizeof(Node));
+    char *name = sema_make_lambda_name(sc);
     fn->kind = ND_FUNC;
-    fn->name = sema_make_lambda_name(sc);
+    fn->name = name;
     fn->line = lambda->line;
     fn->col = lambda->col;
     fn->src = lambda->src;
@@ -1475,9 +1776,12 @@ static void sema_lower_lambda(SemaContext *sc, Node *lambda)
     fn->is_noreturn = 0;
     fn->metadata.declared_param_count = -1;
     fn->metadata.declared_local_count = -1;
-    fn->metadata.backend_name = fn->name ? xstrdup(fn->name) : NULL;
+    fn->metadata.backend_name = name;
 
-    unit_append_function(sc->unit, fn);
+    if (sc->task)
+        sema_task_event(sc->task, SEMA_TASK_LAMBDA)->node = fn;
+    else
+        sema_unit_append(sc, fn);
     sema_register_function_local(sc, sc->unit, fn);
 
     Type *func_ty = sema_make_func_type_from_node(fn);
@@ -1485,7 +1789,7 @@ static void sema_lower_lambda(SemaContext *sc, Node *lambda)
 
     Node *fn_ref = (Node *)xcalloc(1, sizeof(Node));
     fn_ref->kind = ND_VAR;
-    fn_ref->var_ref = fn->name ? xstrdup(fn->name) : NULL;
+    fn_ref->var_ref = fn->name;
     fn_ref->var_is_const = 1;
     fn_ref->var_is_function = 1;
     fn_ref->referenced_function = fn;
@@ -1507,7 +1811,7 @@ static Node *clone_function_var_ref(const Node *var)
         return NULL;
     Node *clone = (Node *)xcalloc(1, sizeof(Node));
     clone->kind = ND_VAR;
-    clone->var_ref = var->var_ref ? xstrdup(var->var_ref) : NULL;
+    clone->var_ref = var->var_ref; /* shared so a lambda rename reaches it */
     clone->var_type = var->var_type;
     clone->type = var->type;
     clone->var_is_const = var->var_is_const;
@@ -1550,6 +1854,171 @@ static Node *clone_function_pointer_expr(const Node *expr)
     return NULL;
 }
 
+/* Template instances shared by every SemaContext in the process. The first
+   unit to instantiate a template with a given binding set owns the clone: it
+   is type-checked and emitted there once, and other units call it through an
+   extern symbol instead of cloning it again. */
+typedef struct
+{
+    const Node *template_fn;
+    Type **bindings; /* interned representatives */
+    int binding_count;
+    uint64_t hash;
+    Node *owner_unit;
+    Node *inst_fn;
+} TemplateInstanceEntry;
+
+static TemplateInstanceEntry *template_instances = NULL;
+static size_t template_instance_cap = 0;
+static size_t template_instance_count = 0;
+
+static uint64_t template_instance_hash(const Node *template_fn, Type **bindings, int binding_count)
+{
+    uint64_t h = type_intern_mix(0, (uint64_t)(uintptr_t)template_fn);
+    for (int i = 0; i < binding_count; ++i)
+        h = type_intern_mix(h, (uint64_t)(uintptr_t)bindings[i]);
+    return h;
+}
+
+static TemplateInstanceEntry *template_instance_find(const Node *template_fn, Type **bindings, int binding_count, uint64_t hash)
+{
+    if (template_instance_cap == 0)
+        return NULL;
+    size_t mask = template_instance_cap - 1;
+    for (size_t at = (size_t)hash & mask; template_instances[at].template_fn; at = (at + 1) & mask)
+    {
+        TemplateInstanceEntry *entry = &template_instances[at];
+        if (entry->hash != hash || entry->template_fn != template_fn || entry->binding_count != binding_count)
+            continue;
+        if (binding_count == 0 || memcmp(entry->bindings, bindings, (size_t)binding_count * sizeof(Type *)) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+static void template_instance_grow(void)
+{
+    size_t ncap = template_instance_cap ? template_instance_cap * 2 : 64;
+    TemplateInstanceEntry *grown = (TemplateInstanceEntry *)xcalloc(ncap, sizeof(TemplateInstanceEntry));
+    for (size_t i = 0; i < template_instance_cap; ++i)
+    {
+        if (!template_instances[i].template_fn)
+            continue;
+        size_t at = (size_t)template_instances[i].hash & (ncap - 1);
+        while (grown[at].template_fn)
+            at = (at + 1) & (ncap - 1);
+        grown[at] = template_instances[i];
+    }
+    free(template_instances);
+    template_instances = grown;
+    template_instance_cap = ncap;
+}
+
+static void template_instance_add(const Node *template_fn, Type **bindings, int binding_count, uint64_t hash,
+                                  Node *owner_unit, Node *inst_fn)
+{
+    if ((template_instance_count + 1) * 2 > template_instance_cap)
+        template_instance_grow();
+    size_t at = (size_t)hash & (template_instance_cap - 1);
+    while (template_instances[at].template_fn)
+        at = (at + 1) & (template_instance_cap - 1);
+    TemplateInstanceEntry *entry = &template_instances[at];
+    entry->template_fn = template_fn;
+    entry->bindings = NULL;
+    if (binding_count > 0)
+    {
+        entry->bindings = (Type **)xmalloc((size_t)binding_count * sizeof(Type *));
+        memcpy(entry->bindings, bindings, (size_t)binding_count * sizeof(Type *));
+    }
+    entry->binding_count = binding_count;
+    entry->hash = hash;
+    entry->owner_unit = owner_unit;
+    entry->inst_fn = inst_fn;
+    template_instance_count++;
+}
+
+static const Symbol *sema_reuse_template_instance(SemaContext *sc, const TemplateInstanceEntry *entry,
+                                                  const char *local_name, Node *call_expr)
+{
+    Node *inst_fn = entry->inst_fn;
+    const Symbol *sym = symtab_get(sc->syms, inst_fn->name);
+    if (!sym && entry->owner_unit != sc->unit)
+    {
+        Symbol s = {0};
+        populate_symbol_from_function(&s, inst_fn);
+        s.is_extern = 1;
+        symtab_add(sc->syms, s);
+        sym = symtab_get(sc->syms, inst_fn->name);
+        if (compiler_verbose_enabled())
+            compiler_verbose_logf("sema", "reuse template instance '%s' from another unit", inst_fn->name);
+    }
+    if (!sym)
+        return NULL;
+    if (local_name && strcmp(local_name, inst_fn->name) != 0 && !symtab_get(sc->syms, local_name))
+    {
+        Symbol alias = *sym;
+        alias.name = xstrdup(local_name);
+        symtab_add(sc->syms, alias);
+    }
+    call_expr->call_name = sym->name;
+    call_expr->call_target = inst_fn;
+    call_expr->call_is_indirect = 0;
+    return sym;
+}
+
+static int sema_task_merge(SemaContext *sc, struct SemaTask *task, const Node *site);
+
+static struct SemaTask *sema_task_find_instance(struct SemaParallelJob *job, const Node *inst_fn)
+{
+    for (int i = 0; job && i < job->instance_count; ++i)
+    {
+        if (job->instances[i]->fn == inst_fn)
+            return job->instances[i];
+    }
+    return NULL;
+}
+
+/* A task starts recording into a fresh record for each instance it clones,
+   so the instance lands in the unit where sequential checking would first
+   have instantiated it, whichever task got there first. Called with the
+   shared lock held. Returns the task to switch back to afterwards. */
+static struct SemaTask *sema_task_begin_instance(SemaContext *sc, Node *inst_fn, const char *template_name, Node *call_expr)
+{
+    if (!sc->task)
+    {
+        sema_unit_append(sc, inst_fn);
+        return NULL;
+    }
+    struct SemaParallelJob *job = sc->task->job;
+    struct SemaTask *inst = (struct SemaTask *)xcalloc(1, sizeof(struct SemaTask));
+    inst->fn = inst_fn;
+    inst->job = job;
+    inst->template_name = template_name;
+    job->instances = (struct SemaTask **)sema_task_reserve(job->instances, &job->instance_count, &job->instance_cap, sizeof(struct SemaTask *));
+    job->instances[job->instance_count++] = inst;
+    SemaTaskEvent *ev = sema_task_event(sc->task, SEMA_TASK_INSTANCE);
+    ev->node = call_expr;
+    ev->instance = inst;
+    return sema_task_switch(sc, inst);
+}
+
+/* Called with the shared lock held when a call reuses an instance. */
+static void sema_task_use_instance(SemaContext *sc, const Node *inst_fn, Node *call_expr)
+{
+    struct SemaParallelJob *job = sc->task ? sc->task->job : sc->merge_job;
+    struct SemaTask *inst = sema_task_find_instance(job, inst_fn);
+    if (!inst)
+        return;
+    if (!sc->task)
+    {
+        sema_task_merge(sc, inst, call_expr);
+        return;
+    }
+    SemaTaskEvent *ev = sema_task_event(sc->task, SEMA_TASK_INSTANCE);
+    ev->node = call_expr;
+    ev->instance = inst;
+}
+
 static const Symbol *sema_instantiate_generic_call(SemaContext *sc,
                                                    const Symbol *template_sym,
                                                    Node *call_expr,
@@ -1569,7 +2038,7 @@ static const Symbol *sema_instantiate_generic_call(SemaContext *sc,
         diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                       "function '%s' expects %d template argument(s) but %d provided",
                       template_sym->name, template_arg_count, call_expr->call_type_arg_count);
-        exit(1);
+        sema_abort();
     }
 
     for (int i = 0; i < call_expr->call_type_arg_count && i < template_arg_count; ++i)
@@ -1580,7 +2049,7 @@ static const Symbol *sema_instantiate_generic_call(SemaContext *sc,
             diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                           "invalid explicit template argument for parameter %d",
                           i + 1);
-            exit(1);
+            sema_abort();
         }
         bindings[i] = explicit_ty;
     }
@@ -1612,7 +2081,7 @@ static const Symbol *sema_instantiate_generic_call(SemaContext *sc,
             diag_error_at(arg_node->src, arg_node->line, arg_node->col,
                           "cannot match argument type %s to template parameter %s of '%s'",
                           got, param_name ? param_name : "", template_sym->name);
-            exit(1);
+            sema_abort();
         }
     }
 
@@ -1631,7 +2100,7 @@ static const Symbol *sema_instantiate_generic_call(SemaContext *sc,
             diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                           "unable to deduce template parameter '%s' for call to '%s'",
                           pname ? pname : "T", template_sym->name);
-            exit(1);
+            sema_abort();
         }
         TemplateConstraintKind constraint = placeholder ? placeholder->template_constraint_kind : TEMPLATE_CONSTRAINT_NONE;
         if (constraint != TEMPLATE_CONSTRAINT_NONE && !type_matches_constraint(bindings[i], constraint))
@@ -1645,20 +2114,30 @@ static const Symbol *sema_instantiate_generic_call(SemaContext *sc,
                           "template parameter '%s' of '%s' requires %s type but argument is %s",
                           pname ? pname : "T", template_sym->name,
                           constraint_name(constraint), tybuf);
-            exit(1);
+            sema_abort();
         }
     }
 
-    char *inst_name = make_template_instance_name(template_sym, bindings, template_arg_count);
+    /* Name instances after the template's module-qualified backend name so the
+       same instance gets the same symbol in every unit that references it. */
+    const char *inst_base = (template_fn->metadata.backend_name && template_fn->metadata.backend_name[0])
+                                ? template_fn->metadata.backend_name
+                                : template_sym->name;
+    char *inst_name = make_template_instance_name(inst_base, bindings, template_arg_count);
     if (!inst_name)
     {
         diag_error("failed to mangle template instance name for '%s'", template_sym->name);
-        exit(1);
+        sema_abort();
     }
 
+    /* Held until the instance is registered so concurrent function checks
+       agree on a single instance; released before its body is checked. */
+    workpool_shared_lock();
     const Symbol *existing = symtab_get(sc->syms, inst_name);
     if (existing && existing->kind == SYM_FUNC)
     {
+        sema_task_use_instance(sc, existing->ast_node, call_expr);
+        workpool_shared_unlock();
         free(bindings);
         call_expr->call_name = existing->name;
         call_expr->call_target = existing->ast_node;
@@ -1667,27 +2146,63 @@ static const Symbol *sema_instantiate_generic_call(SemaContext *sc,
         return existing;
     }
 
+    /* Another unit can only call the instance when they end up in one linked
+       output and the symbol is visible outside its module. Bindings that are
+       still template parameters (checking a generic body) intern to one
+       class, so they stay unit-local too. */
+    int shareable = sema_share_template_instances && template_fn->is_exposed;
+    Type **interned_bindings = (Type **)xcalloc((size_t)template_arg_count, sizeof(Type *));
+    for (int i = 0; i < template_arg_count; ++i)
+    {
+        if (type_contains_template_param(bindings[i]))
+            shareable = 0;
+        interned_bindings[i] = type_interned(bindings[i]);
+    }
+    uint64_t inst_hash = template_instance_hash(template_fn, interned_bindings, template_arg_count);
+    TemplateInstanceEntry *shared = shareable ? template_instance_find(template_fn, interned_bindings, template_arg_count, inst_hash) : NULL;
+    if (shared)
+    {
+        const Symbol *reused = sema_reuse_template_instance(sc, shared, inst_name, call_expr);
+        if (reused)
+        {
+            workpool_shared_unlock();
+            free(interned_bindings);
+            free(bindings);
+            free(inst_name);
+            return reused;
+        }
+    }
+
     Node *inst_fn = instantiate_function_template(template_fn, inst_name, bindings, template_arg_count);
-    unit_append_function(sc->unit, inst_fn);
+    if (shareable)
+        template_instance_add(template_fn, interned_bindings, template_arg_count, inst_hash, sc->unit, inst_fn);
+    free(interned_bindings);
+    sema_settle_function_signature(inst_fn);
+    struct SemaTask *outer = sema_task_begin_instance(sc, inst_fn, template_sym->name, call_expr);
     sema_register_function_local(sc, sc->unit, inst_fn);
+    workpool_shared_unlock();
+    const char *failure = NULL;
     if (check_exposed_function_signature(inst_fn))
+        failure = "instantiated template '%s' violates exposure rules";
+    else if (sema_check_function(sc, inst_fn))
+        failure = "failed to type-check instantiated template '%s'";
+    if (outer)
     {
-        diag_error_at(call_expr->src, call_expr->line, call_expr->col,
-                      "instantiated template '%s' violates exposure rules", template_sym->name);
-        exit(1);
+        sc->task->failure = failure;
+        sema_task_switch(sc, outer);
     }
-    if (sema_check_function(sc, inst_fn))
+    if (failure)
     {
-        diag_error_at(call_expr->src, call_expr->line, call_expr->col,
-                      "failed to type-check instantiated template '%s'", template_sym->name);
-        exit(1);
+        if (!outer)
+            diag_error_at(call_expr->src, call_expr->line, call_expr->col, failure, template_sym->name);
+        sema_abort();
     }
 
     const Symbol *inst_sym = symtab_get(sc->syms, inst_fn->name);
     if (!inst_sym)
     {
         diag_error("internal error: missing symbol for instantiated template '%s'", inst_fn->name);
-        exit(1);
+        sema_abort();
     }
 
     call_expr->call_name = inst_fn->name;
@@ -1840,7 +2355,7 @@ static ImportedFunctionCandidate *sema_resolve_imported_call(SemaContext *sc, co
                 diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                               "ambiguous call to '%s'; both modules '%s' and '%s' provide identical overloads",
                               name, mod_a, mod_b);
-                exit(1);
+                sema_abort();
             }
             else
             {
@@ -1849,7 +2364,7 @@ static ImportedFunctionCandidate *sema_resolve_imported_call(SemaContext *sc, co
                 diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                               "ambiguous call to '%s'; matches found in modules '%s' and '%s'",
                               name, mod_a, mod_b);
-                exit(1);
+                sema_abort();
             }
         }
 
@@ -1889,7 +2404,7 @@ static ImportedFunctionCandidate *sema_resolve_imported_call(SemaContext *sc, co
             diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                           "ambiguous call to '%s'; both modules '%s' and '%s' provide identical overloads",
                           name, mod_a, mod_b);
-            exit(1);
+            sema_abort();
         }
         else
         {
@@ -1898,7 +2413,7 @@ static ImportedFunctionCandidate *sema_resolve_imported_call(SemaContext *sc, co
             diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                           "ambiguous call to '%s'; matches found in modules '%s' and '%s'",
                           name, mod_a, mod_b);
-            exit(1);
+            sema_abort();
         }
     }
 
@@ -1918,7 +2433,7 @@ static ImportedFunctionCandidate *sema_resolve_imported_call(SemaContext *sc, co
                              "candidate: %s.%s", mod, set->candidates[i].symbol.name);
             }
         }
-        exit(1);
+        sema_abort();
     }
 
     return match;
@@ -1953,9 +2468,10 @@ static const Symbol *sema_resolve_local_overload(SemaContext *sc,
     const Symbol *template_candidate = NULL;
     int candidate_count = 0;
 
-    for (int i = 0; i < sc->syms->count; ++i)
+    int symbol_count = workpool_atomic_load_int(&sc->syms->count);
+    for (int i = 0; i < symbol_count; ++i)
     {
-        const Symbol *sym = &sc->syms->items[i];
+        const Symbol *sym = symtab_slot(sc->syms, i);
         if (!sym || sym->kind != SYM_FUNC || !sym->name)
             continue;
         if (strcmp(sym->name, name) != 0)
@@ -1972,7 +2488,7 @@ static const Symbol *sema_resolve_local_overload(SemaContext *sc,
                 diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                               "ambiguous call to '%s'; multiple template overloads available",
                               name);
-                exit(1);
+                sema_abort();
             }
             continue;
         }
@@ -1987,7 +2503,7 @@ static const Symbol *sema_resolve_local_overload(SemaContext *sc,
             diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                           "ambiguous call to '%s'; multiple overloads match provided arguments",
                           name);
-            exit(1);
+            sema_abort();
         }
 
         match = sym;
@@ -2004,7 +2520,7 @@ static const Symbol *sema_resolve_local_overload(SemaContext *sc,
 
     diag_error_at(call_expr->src, call_expr->line, call_expr->col,
                   "no overload of '%s' matches provided arguments", name);
-    exit(1);
+    sema_abort();
 
     return NULL;
 }
@@ -2060,87 +2576,218 @@ static int check_exposed_function_signature(const Node *fn)
     }
     return 0;
 }
-static int type_equal(Type *a, Type *b)
+/* Hash-consing of types for type_equal. Every canonical type maps to one
+   representative per equivalence class: pointers and arrays by their element
+   representative, functions by their signature representatives, named structs
+   by name. Representatives are cached in Type.interned once the type's imports
+   are resolved, so comparing two types is a pointer compare. */
+typedef struct
 {
-    a = canonicalize_type_deep(a);
-    b = canonicalize_type_deep(b);
-    if (a == b)
-        return 1;
-    if (!a || !b)
-        return 0;
-    if (a->kind != b->kind)
+    TypeKind kind;
+    int length;
+    int flags;
+    const void *ref; /* child representative, interned struct name or anonymous struct */
+    Type **params;
+    int param_count;
+} TypeInternKey;
+
+typedef struct
+{
+    TypeInternKey key;
+    uint64_t hash;
+    Type *rep;
+} TypeInternSlot;
+
+static TypeInternSlot *type_intern_slots = NULL;
+static size_t type_intern_cap = 0;
+static size_t type_intern_count = 0;
+
+static Type *type_interned(Type *ty);
+
+static uint64_t type_intern_mix(uint64_t h, uint64_t v)
+{
+    h ^= v + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+static uint64_t type_intern_hash(const TypeInternKey *key)
+{
+    uint64_t h = (uint64_t)key->kind;
+    h = type_intern_mix(h, (uint64_t)(uint32_t)key->length);
+    h = type_intern_mix(h, (uint64_t)(uint32_t)key->flags);
+    h = type_intern_mix(h, (uint64_t)(uintptr_t)key->ref);
+    for (int i = 0; i < key->param_count; ++i)
+        h = type_intern_mix(h, (uint64_t)(uintptr_t)key->params[i]);
+    return h;
+}
+
+static int type_intern_key_equal(const TypeInternKey *a, const TypeInternKey *b)
+{
+    if (a->kind != b->kind || a->length != b->length || a->flags != b->flags ||
+        a->ref != b->ref || a->param_count != b->param_count)
         return 0;
-    if (a->kind == TY_PTR)
-        return type_equal(a->pointee, b->pointee);
-    if (a->kind == TY_ARRAY)
-    {
-        if (a->array.is_unsized != b->array.is_unsized)
-            return 0;
-        if (!a->array.is_unsized && a->array.length != b->array.length)
-            return 0;
-        return type_equal(a->array.elem, b->array.elem);
-    }
-    if (a->kind == TY_FUNC)
+    for (int i = 0; i < a->param_count; ++i)
     {
-        if (a->func.param_count != b->func.param_count)
+        if (a->params[i] != b->params[i])
             return 0;
-        if (a->func.is_varargs != b->func.is_varargs)
-            return 0;
-        if (!!a->func.ret != !!b->func.ret)
-            return 0;
-        if (a->func.ret && !type_equal(a->func.ret, b->func.ret))
-            return 0;
-        for (int i = 0; i < a->func.param_count; ++i)
-        {
-            Type *ap = a->func.params ? a->func.params[i] : NULL;
-            Type *bp = b->func.params ? b->func.params[i] : NULL;
-            if (!type_equal(ap, bp))
-                return 0;
-        }
-        return 1;
-    }
-    if (a->kind == TY_STRUCT)
-    {
-        if (a->struct_name && b->struct_name)
-            return strcmp(a->struct_name, b->struct_name) == 0;
-        return a == b;
     }
     return 1;
 }
 
-static int funcsig_equal(const FuncSig *a, const FuncSig *b)
+static void type_intern_grow(void)
 {
-    if (a == b)
-        return 1;
-    if (!a || !b)
-        return 0;
-    if (a->param_count != b->param_count)
-        return 0;
-    if (a->is_varargs != b->is_varargs)
-        return 0;
-    if (!!a->ret != !!b->ret)
-        return 0;
-    if (a->ret && !type_equal(a->ret, b->ret))
-        return 0;
-    for (int i = 0; i < a->param_count; ++i)
+    size_t ncap = type_intern_cap ? type_intern_cap * 2 : 256;
+    TypeInternSlot *nslots = (TypeInternSlot *)xcalloc(ncap, sizeof(TypeInternSlot));
+    for (size_t i = 0; i < type_intern_cap; ++i)
     {
-        Type *ap = (a->params && i < a->param_count) ? a->params[i] : NULL;
-        Type *bp = (b->params && i < b->param_count) ? b->params[i] : NULL;
-        if (!type_equal(ap, bp))
-            return 0;
+        if (!type_intern_slots[i].rep)
+            continue;
+        size_t at = (size_t)type_intern_slots[i].hash & (ncap - 1);
+        while (nslots[at].rep)
+            at = (at + 1) & (ncap - 1);
+        nslots[at] = type_intern_slots[i];
     }
-    return 1;
+    free(type_intern_slots);
+    type_intern_slots = nslots;
+    type_intern_cap = ncap;
 }
 
-static int sizeof_type_bytes(Type *ty)
+static Type *type_intern_lookup_or_insert(TypeInternKey *key, Type *candidate)
 {
-    ty = canonicalize_type_deep(ty);
-    if (!ty)
-        return 8;
-    switch (ty->kind)
+    if ((type_intern_count + 1) * 2 > type_intern_cap)
+        type_intern_grow();
+    uint64_t hash = type_intern_hash(key);
+    size_t at = (size_t)hash & (type_intern_cap - 1);
+    while (type_intern_slots[at].rep)
     {
-    case TY_I8:
-    case TY_U8:
+        TypeInternSlot *slot = &type_intern_slots[at];
+        if (slot->hash == hash && type_intern_key_equal(&slot->key, key))
+            return slot->rep;
+        at = (at + 1) & (type_intern_cap - 1);
+    }
+    if (key->param_count > 0)
+    {
+        Type **owned = (Type **)xmalloc((size_t)key->param_count * sizeof(Type *));
+        memcpy(owned, key->params, (size_t)key->param_count * sizeof(Type *));
+        key->params = owned;
+    }
+    type_intern_slots[at].key = *key;
+    type_intern_slots[at].hash = hash;
+    type_intern_slots[at].rep = candidate;
+    type_intern_count++;
+    return candidate;
+}
+
+static Type *type_interned_locked(Type *ty)
+{
+    if (ty->interned)
+        return ty->interned;
+
+    TypeInternKey key;
+    memset(&key, 0, sizeof(key));
+    key.kind = ty->kind;
+    Type *param_buf[16];
+    Type **params = NULL;
+    switch (ty->kind)
+    {
+    case TY_PTR:
+        key.ref = type_interned(ty->pointee);
+        break;
+    case TY_ARRAY:
+        key.flags = ty->array.is_unsized ? 1 : 0;
+        key.length = ty->array.is_unsized ? 0 : ty->array.length;
+        key.ref = type_interned(ty->array.elem);
+        break;
+    case TY_FUNC:
+        key.length = ty->func.param_count;
+        key.flags = (ty->func.is_varargs ? 1 : 0) | (ty->func.ret ? 2 : 0);
+        key.ref = ty->func.ret ? type_interned(ty->func.ret) : NULL;
+        if (ty->func.param_count > 0)
+        {
+            params = ty->func.param_count <= (int)(sizeof(param_buf) / sizeof(param_buf[0]))
+                         ? param_buf
+                         : (Type **)xmalloc((size_t)ty->func.param_count * sizeof(Type *));
+            for (int i = 0; i < ty->func.param_count; ++i)
+                params[i] = type_interned(ty->func.params ? ty->func.params[i] : NULL);
+            key.params = params;
+            key.param_count = ty->func.param_count;
+        }
+        break;
+    case TY_STRUCT:
+        if (ty->struct_name)
+            key.ref = xintern(ty->struct_name);
+        else
+        {
+            key.flags = 1;
+            key.ref = ty;
+        }
+        break;
+    default:
+        break;
+    }
+
+    Type *rep = type_intern_lookup_or_insert(&key, ty);
+    if (params && params != param_buf)
+        free(params);
+    if (ty->is_canonical)
+        workpool_atomic_store_ptr((void **)&ty->interned, rep);
+    return rep;
+}
+
+static Type *type_interned(Type *ty)
+{
+    ty = canonicalize_type_deep(ty);
+    if (!ty)
+        return NULL;
+    Type *cached = (Type *)workpool_atomic_load_ptr((void *const *)&ty->interned);
+    if (cached)
+        return cached;
+    workpool_shared_lock();
+    Type *rep = type_interned_locked(ty);
+    workpool_shared_unlock();
+    return rep;
+}
+
+static int type_equal(Type *a, Type *b)
+{
+    if (a == b)
+        return 1;
+    return type_interned(a) == type_interned(b);
+}
+
+static int funcsig_equal(const FuncSig *a, const FuncSig *b)
+{
+    if (a == b)
+        return 1;
+    if (!a || !b)
+        return 0;
+    if (a->param_count != b->param_count)
+        return 0;
+    if (a->is_varargs != b->is_varargs)
+        return 0;
+    if (!!a->ret != !!b->ret)
+        return 0;
+    if (a->ret && !type_equal(a->ret, b->ret))
+        return 0;
+    for (int i = 0; i < a->param_count; ++i)
+    {
+        Type *ap = (a->params && i < a->param_count) ? a->params[i] : NULL;
+        Type *bp = (b->params && i < b->param_count) ? b->params[i] : NULL;
+        if (!type_equal(ap, bp))
+            return 0;
+    }
+    return 1;
+}
+
+static int sizeof_type_bytes(Type *ty)
+{
+    ty = canonicalize_type_deep(ty);
+    if (!ty)
+        return 8;
+    switch (ty->kind)
+    {
+    case TY_I8:
+    case TY_U8:
     case TY_CHAR:
         return 1;
     case TY_BOOL:
@@ -2273,7 +2920,7 @@ static void populate_symbol_from_function(Symbol *s, Node *fn)
             diag_error_at(fn->src, fn->line, fn->col,
                           "return type mismatch between declaration ('%s') and metadata ('%s')",
                           decl_buf, meta_buf);
-            exit(1);
+            sema_abort();
         }
         s->sig.ret = meta_ret;
     }
@@ -2305,7 +2952,7 @@ static void populate_symbol_from_function(Symbol *s, Node *fn)
                 {
                     diag_error_at(fn->src, fn->line, fn->col,
                                   "unable to determine type for parameter %d", i + 1);
-                    exit(1);
+                    sema_abort();
                 }
                 meta_params[i] = meta_ty;
             }
@@ -2427,7 +3074,7 @@ static void sema_register_global_local(SemaContext *sc, Node *unit_node, Node *d
     {
         diag_error_at(decl->src, decl->line, decl->col,
                       "global variable missing name");
-        exit(1);
+        sema_abort();
     }
 
     const Symbol *existing = symtab_get(sc->syms, s.name);
@@ -2435,7 +3082,7 @@ static void sema_register_global_local(SemaContext *sc, Node *unit_node, Node *d
     {
         diag_error_at(decl->src, decl->line, decl->col,
                       "duplicate symbol '%s'", s.name);
-        exit(1);
+        sema_abort();
     }
 
     symtab_add(sc->syms, s);
@@ -3190,7 +3837,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
             {
                 diag_error_at(init->src, init->line, init->col,
                               "unsized arrays do not support initializer lists");
-                exit(1);
+                sema_abort();
             }
             check_expr(sc, init);
             Type *ptr_ty = type_ptr(elem ? elem : &ty_i32);
@@ -3198,7 +3845,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
             {
                 diag_error_at(init->src, init->line, init->col,
                               "initializer expression is not compatible with dynamic array type");
-                exit(1);
+                sema_abort();
             }
             init->type = ptr_ty;
             return;
@@ -3217,7 +3864,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
                 diag_error_at(init->src, init->line, init->col,
                               "initializer has %d elements but array length is %d",
                               init->init.count, expected_len);
-                exit(1);
+                sema_abort();
             }
 
             int elem_is_aggregate = elem &&
@@ -3231,7 +3878,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
                 {
                     diag_error_at(init->src, init->line, init->col,
                                   "missing initializer expression for array element %d", i);
-                    exit(1);
+                    sema_abort();
                 }
                 if (elem_init->kind == ND_INIT_LIST)
                 {
@@ -3239,7 +3886,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
                     {
                         diag_error_at(elem_init->src, elem_init->line, elem_init->col,
                                       "nested initializer lists are not supported for array elements yet");
-                        exit(1);
+                        sema_abort();
                     }
                     check_initializer_for_type(sc, elem_init, elem);
                 }
@@ -3251,7 +3898,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
                     {
                         diag_error_at(elem_init->src, elem_init->line, elem_init->col,
                                       "initializer element type mismatch");
-                        exit(1);
+                        sema_abort();
                     }
                 }
             }
@@ -3263,7 +3910,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
         {
             diag_error_at(init->src, init->line, init->col,
                           "initializer expression type mismatch");
-            exit(1);
+            sema_abort();
         }
         init->type = target;
         return;
@@ -3275,7 +3922,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
         {
             diag_error_at(init->src, init->line, init->col,
                           "initializer expression type mismatch");
-            exit(1);
+            sema_abort();
         }
         init->type = target;
         return;
@@ -3314,7 +3961,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
                         free(indices);
                     if (used)
                         free(used);
-                    exit(1);
+                    sema_abort();
                 }
             }
             else
@@ -3327,7 +3974,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
                         free(indices);
                     if (used)
                         free(used);
-                    exit(1);
+                    sema_abort();
                 }
                 field_index = next_field++;
             }
@@ -3339,7 +3986,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
                 if (indices)
                     free(indices);
                 free(used);
-                exit(1);
+                sema_abort();
             }
             if (used)
                 used[field_index] = 1;
@@ -3352,7 +3999,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
                     free(indices);
                 if (used)
                     free(used);
-                exit(1);
+                sema_abort();
             }
             Type *ft = (field_index >= 0 && field_index < field_count)
                            ? target->strct.field_types[field_index]
@@ -3373,7 +4020,7 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
                         free(indices);
                     if (used)
                         free(used);
-                    exit(1);
+                    sema_abort();
                 }
             }
             if (indices)
@@ -3392,34 +4039,34 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
         {
             diag_error_at(init->src, init->line, init->col,
                           "brace initializer for this type requires exactly one element");
-            exit(1);
+            sema_abort();
         }
         const char *designator = init->init.designators ? init->init.designators[0] : NULL;
         if (designator)
         {
             diag_error_at(init->src, init->line, init->col,
                           "designators are not supported for this initializer");
-            exit(1);
+            sema_abort();
         }
         Node *elem = (init->init.elems && init->init.count > 0) ? init->init.elems[0] : NULL;
         if (!elem)
         {
             diag_error_at(init->src, init->line, init->col,
                           "missing initializer expression");
-            exit(1);
+            sema_abort();
         }
         if (elem->kind == ND_INIT_LIST)
         {
             diag_error_at(elem->src, elem->line, elem->col,
                           "nested initializer lists are not supported for this type");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, elem);
         if (target && !can_assign(target, elem))
         {
             diag_error_at(elem->src, elem->line, elem->col,
                           "initializer expression type mismatch");
-            exit(1);
+            sema_abort();
         }
         init->type = target;
         return;
@@ -3427,62 +4074,171 @@ static void check_initializer_for_type(SemaContext *sc, Node *init, Type *target
     init->type = target;
 }
 
+/* Keyed by name text rather than interned pointers: xintern() takes the
+   shared lock, so interning every looked-up name would serialize parallel
+   body checks on it, while hashing the text keeps lookups private to the
+   context. */
+static size_t scope_slot_hash(const char *name)
+{
+    uint64_t h = 1469598103934665603ULL;
+    while (*name)
+    {
+        h ^= (uint8_t)(*name++);
+        h *= 1099511628211ULL;
+    }
+    return (size_t)(h ^ (h >> 32));
+}
+
+static struct ScopeSlot *scope_slot_find(struct Scope *s, const char *name, size_t hash)
+{
+    if (!s || s->slot_cap == 0)
+        return NULL;
+    size_t mask = (size_t)s->slot_cap - 1;
+    for (size_t at = hash & mask;; at = (at + 1) & mask)
+    {
+        struct ScopeSlot *slot = &s->slots[at];
+        if (!slot->name)
+            return NULL;
+        if (slot->hash == hash && (slot->name == name || strcmp(slot->name, name) == 0))
+            return slot;
+    }
+}
+
+static void scope_slots_rehash(struct Scope *s)
+{
+    int live = 0;
+    for (int i = 0; i < s->slot_cap; ++i)
+        if (s->slots[i].name && s->slots[i].top >= 0)
+            live++;
+    int ncap = s->slot_cap ? s->slot_cap : 64;
+    while (ncap < (live + 1) * 4)
+        ncap *= 2;
+    struct ScopeSlot *nslots = (struct ScopeSlot *)xcalloc((size_t)ncap, sizeof(struct ScopeSlot));
+    size_t mask = (size_t)ncap - 1;
+    for (int i = 0; i < s->slot_cap; ++i)
+    {
+        if (!s->slots[i].name || s->slots[i].top < 0)
+            continue;
+        size_t at = s->slots[i].hash & mask;
+        while (nslots[at].name)
+            at = (at + 1) & mask;
+        nslots[at] = s->slots[i];
+    }
+    free(s->slots);
+    s->slots = nslots;
+    s->slot_cap = ncap;
+    s->slot_used = live;
+}
+
+static struct ScopeSlot *scope_slot_insert(struct Scope *s, const char *name, size_t hash)
+{
+    struct ScopeSlot *slot = scope_slot_find(s, name, hash);
+    if (slot)
+        return slot;
+    if ((s->slot_used + 1) * 2 > s->slot_cap)
+        scope_slots_rehash(s);
+    size_t mask = (size_t)s->slot_cap - 1;
+    size_t at = hash & mask;
+    while (s->slots[at].name)
+        at = (at + 1) & mask;
+    s->slots[at].name = name;
+    s->slots[at].hash = hash;
+    s->slots[at].top = -1;
+    s->slot_used++;
+    return &s->slots[at];
+}
+
 static void scope_push(SemaContext *sc)
 {
-    struct Scope *s = (struct Scope *)xcalloc(1, sizeof(struct Scope));
-    s->parent = sc->scope;
-    sc->scope = s;
+    if (!sc->scope)
+        sc->scope = (struct Scope *)xcalloc(1, sizeof(struct Scope));
+    struct Scope *s = sc->scope;
+    if (s->mark_count == s->mark_cap)
+    {
+        int ncap = s->mark_cap ? s->mark_cap * 2 : 16;
+        int *grown = (int *)realloc(s->marks, (size_t)ncap * sizeof(int));
+        if (!grown)
+        {
+            diag_error("out of memory while pushing scope");
+            sema_abort();
+        }
+        s->marks = grown;
+        s->mark_cap = ncap;
+    }
+    s->marks[s->mark_count++] = s->bind_count;
 }
 static void scope_pop(SemaContext *sc)
 {
-    if (!sc || !sc->scope)
+    if (!sc || !sc->scope || sc->scope->mark_count == 0)
+        return;
+    struct Scope *s = sc->scope;
+    int mark = s->marks[--s->mark_count];
+    while (s->bind_count > mark)
+    {
+        struct VarBind *b = &s->binds[--s->bind_count];
+        struct ScopeSlot *slot = scope_slot_find(s, b->name, scope_slot_hash(b->name));
+        if (slot)
+            slot->top = b->shadowed;
+    }
+}
+static void scope_destroy(struct Scope *s)
+{
+    if (!s)
         return;
-    struct Scope *p = sc->scope->parent;
-    free(sc->scope);
-    sc->scope = p;
+    free(s->binds);
+    free(s->marks);
+    free(s->slots);
+    free(s);
 }
 static int scope_find(SemaContext *sc, const char *name)
 {
-    if (!sc || !sc->scope)
+    if (!sc || !sc->scope || sc->scope->mark_count == 0 || !name)
         return 0;
     struct Scope *s = sc->scope;
-    for (int i = 0; i < s->local_count; i++)
-    {
-        if (strcmp(s->locals[i].name, name) == 0)
-            return 1;
-    }
-    return 0;
+    struct ScopeSlot *slot = scope_slot_find(s, name, scope_slot_hash(name));
+    return slot && slot->top >= s->marks[s->mark_count - 1];
 }
 static const struct VarBind *scope_get_binding(SemaContext *sc, const char *name)
 {
-    for (struct Scope *s = sc ? sc->scope : NULL; s; s = s->parent)
-    {
-        for (int i = 0; i < s->local_count; i++)
-        {
-            if (strcmp(s->locals[i].name, name) == 0)
-                return &s->locals[i];
-        }
-    }
-    return NULL;
+    if (!sc || !sc->scope || !name)
+        return NULL;
+    struct ScopeSlot *slot = scope_slot_find(sc->scope, name, scope_slot_hash(name));
+    if (!slot || slot->top < 0)
+        return NULL;
+    return &sc->scope->binds[slot->top];
 }
 static void scope_add(SemaContext *sc, const char *name, Type *ty,
                       int is_const, int is_static, const char *backend_name,
                       const char *managed_length_name)
 {
-    if (!sc->scope)
+    if (!name)
+        return;
+    if (!sc->scope || sc->scope->mark_count == 0)
         scope_push(sc);
     ty = canonicalize_type_deep(ty);
     struct Scope *s = sc->scope;
-    if (s->local_count < 128)
+    if (s->bind_count == s->bind_cap)
     {
-        s->locals[s->local_count].name = name;
-        s->locals[s->local_count].type = ty;
-        s->locals[s->local_count].is_const = is_const;
-        s->locals[s->local_count].is_static = is_static;
-        s->locals[s->local_count].backend_name = backend_name;
-        s->locals[s->local_count].managed_length_name = managed_length_name;
-        s->local_count++;
+        int ncap = s->bind_cap ? s->bind_cap * 2 : 64;
+        struct VarBind *grown = (struct VarBind *)realloc(s->binds, (size_t)ncap * sizeof(struct VarBind));
+        if (!grown)
+        {
+            diag_error("out of memory while adding local '%s'", name ? name : "<null>");
+            sema_abort();
+        }
+        s->binds = grown;
+        s->bind_cap = ncap;
     }
+    struct ScopeSlot *slot = scope_slot_insert(s, name, scope_slot_hash(name));
+    struct VarBind *b = &s->binds[s->bind_count];
+    b->name = name;
+    b->type = ty;
+    b->is_const = is_const;
+    b->is_static = is_static;
+    b->backend_name = backend_name;
+    b->managed_length_name = managed_length_name;
+    b->shadowed = slot->top;
+    slot->top = s->bind_count++;
 }
 
 static int type_is_unsized_array(Type *ty)
@@ -3847,7 +4603,7 @@ static Type *sema_prepare_assignment_lhs(SemaContext *sc, Node *assign_expr, Nod
     {
         diag_error_at(assign_expr ? assign_expr->src : NULL, assign_expr ? assign_expr->line : 0, assign_expr ? assign_expr->col : 0,
                       "assignment missing left-hand side");
-        exit(1);
+        sema_abort();
     }
 
     Node *lhs_expr = assign_expr->lhs;
@@ -3861,7 +4617,7 @@ static Type *sema_prepare_assignment_lhs(SemaContext *sc, Node *assign_expr, Nod
     {
         diag_error_at(assign_expr->src, assign_expr->line, assign_expr->col,
                       "lvalue required as left operand of assignment");
-        exit(1);
+        sema_abort();
     }
 
     const Node *const_origin = NULL;
@@ -3872,7 +4628,7 @@ static Type *sema_prepare_assignment_lhs(SemaContext *sc, Node *assign_expr, Nod
             diag_error_at(lhs_base->src, lhs_base->line, lhs_base->col,
                           "cannot assign to constant variable '%s'",
                           lhs_base->var_ref ? lhs_base->var_ref : "<unnamed>");
-            exit(1);
+            sema_abort();
         }
     }
     else
@@ -3907,14 +4663,14 @@ static Type *sema_prepare_assignment_lhs(SemaContext *sc, Node *assign_expr, Nod
             diag_error_at(lhs_base->src, lhs_base->line, lhs_base->col,
                           "unknown variable '%s' on left-hand side of assignment",
                           lhs_base->var_ref ? lhs_base->var_ref : "<unnamed>");
-            exit(1);
+            sema_abort();
         }
         if (lhs_base->var_type && lhs_base->var_type->kind == TY_ARRAY && !lhs_base->var_type->array.is_unsized)
         {
             diag_error_at(lhs_base->src, lhs_base->line, lhs_base->col,
                           "cannot assign to array variable '%s'",
                           lhs_base->var_ref ? lhs_base->var_ref : "<unnamed>");
-            exit(1);
+            sema_abort();
         }
     }
 
@@ -3962,7 +4718,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(src, line, col,
                           "lambda immediate invocation requires an addressable target");
-            exit(1);
+            sema_abort();
         }
 
         e->rhs = lambda_value;
@@ -4019,7 +4775,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "initializer list requires a target type");
-            exit(1);
+            sema_abort();
         }
         target = canonicalize_type_deep(target);
         check_initializer_for_type(sc, e, target);
@@ -4066,7 +4822,7 @@ static void check_expr(SemaContext *sc, Node *e)
                     diag_error_at(e->src, e->line, e->col,
                                   "ambiguous reference to '%s'; modules '%s' and '%s' both provide candidates",
                                   orig_name ? orig_name : "<unnamed>", mod_a, mod_b);
-                    exit(1);
+                    sema_abort();
                 }
             }
             int import_parts = 0;
@@ -4086,7 +4842,7 @@ static void check_expr(SemaContext *sc, Node *e)
             }
             diag_error_at(e->src, e->line, e->col, "unknown variable '%s'",
                           orig_name ? orig_name : "<null>");
-            exit(1);
+            sema_abort();
         }
         if (resolved_sym && resolved_sym->kind == SYM_GLOBAL)
             sema_track_imported_global_usage(sc, resolved_sym);
@@ -4183,7 +4939,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "alignof operand must resolve to a concrete type");
-            exit(1);
+            sema_abort();
         }
         int align = alignof_type(ty);
         if (align <= 0)
@@ -4199,20 +4955,20 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "offsetof requires a struct type operand");
-            exit(1);
+            sema_abort();
         }
         if (!e->field_name || !*e->field_name)
         {
             diag_error_at(e->src, e->line, e->col,
                           "offsetof requires a field designator");
-            exit(1);
+            sema_abort();
         }
         if (st->kind == TY_STRUCT && (!st->strct.field_types || st->strct.field_count <= 0))
         {
             diag_error_at(e->src, e->line, e->col,
                           "struct '%s' is incomplete",
                           st->struct_name ? st->struct_name : "<anonymous>");
-            exit(1);
+            sema_abort();
         }
         int idx = struct_find_field(st, e->field_name);
         if (idx < 0)
@@ -4221,14 +4977,14 @@ static void check_expr(SemaContext *sc, Node *e)
                           "unknown field '%s' on struct '%s'",
                           e->field_name,
                           st->struct_name ? st->struct_name : "<anonymous>");
-            exit(1);
+            sema_abort();
         }
         if (!st->strct.field_offsets)
         {
             diag_error_at(e->src, e->line, e->col,
                           "struct '%s' is missing offset metadata",
                           st->struct_name ? st->struct_name : "<anonymous>");
-            exit(1);
+            sema_abort();
         }
         e->int_val = st->strct.field_offsets[idx];
         e->type = &ty_i32;
@@ -4345,34 +5101,34 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "new expression missing target type");
-            exit(1);
+            sema_abort();
         }
         Type *ptr_ty = canonicalize_type_deep(e->type);
         if (!ptr_ty || ptr_ty->kind != TY_PTR || !ptr_ty->pointee)
         {
             diag_error_at(e->src, e->line, e->col,
                           "'new' requires a pointer target type");
-            exit(1);
+            sema_abort();
         }
         Type *elem = canonicalize_type_deep(ptr_ty->pointee);
         if (!elem)
         {
             diag_error_at(e->src, e->line, e->col,
                           "cannot allocate incomplete type");
-            exit(1);
+            sema_abort();
         }
         if (elem->kind == TY_VOID)
         {
             diag_error_at(e->src, e->line, e->col,
                           "cannot allocate object of type 'void'");
-            exit(1);
+            sema_abort();
         }
         int elem_size = sizeof_type_bytes(elem);
         if (elem_size <= 0)
         {
             diag_error_at(e->src, e->line, e->col,
                           "cannot allocate object of incomplete type");
-            exit(1);
+            sema_abort();
         }
         if (e->lhs)
         {
@@ -4381,13 +5137,13 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->lhs->src, e->lhs->line, e->lhs->col,
                               "array count in 'new' must be an integer");
-                exit(1);
+                sema_abort();
             }
             if (e->lhs->kind == ND_INT && e->lhs->int_val < 0)
             {
                 diag_error_at(e->lhs->src, e->lhs->line, e->lhs->col,
                               "negative array size in 'new'");
-                exit(1);
+                sema_abort();
             }
         }
         e->type = ptr_ty;
@@ -4398,7 +5154,7 @@ static void check_expr(SemaContext *sc, Node *e)
         if (!e->lhs)
         {
             diag_error_at(e->src, e->line, e->col, "member access missing base expression");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         Node *base_node = e->lhs;
@@ -4416,7 +5172,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 diag_error_at(e->src, e->line, e->col,
                               "incomplete enum reference for '%s'",
                               value_name ? value_name : "<value>");
-                exit(1);
+                sema_abort();
             }
             int enum_value = 0;
             if (!module_registry_lookup_enum_value(module_full, enum_name, value_name, &enum_value))
@@ -4424,7 +5180,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 diag_error_at(e->src, e->line, e->col,
                               "unknown enum value '%s' on '%s.%s'",
                               value_name, module_full, enum_name);
-                exit(1);
+                sema_abort();
             }
             Type *enum_ty = canonicalize_type_deep(base_node->type);
             e->kind = ND_INT;
@@ -4448,7 +5204,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "invalid module-qualified reference");
-                exit(1);
+                sema_abort();
             }
 
             if (consumed < imp->part_count)
@@ -4458,7 +5214,7 @@ static void check_expr(SemaContext *sc, Node *e)
                     diag_error_at(e->src, e->line, e->col,
                                   "unknown module path segment '%s' in '%s'",
                                   field, imp->full_name ? imp->full_name : "<module>");
-                    exit(1);
+                    sema_abort();
                 }
                 e->module_ref = imp;
                 e->module_ref_parts = consumed + 1;
@@ -4479,7 +5235,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "module path missing for qualified reference");
-                exit(1);
+                sema_abort();
             }
 
             Type *struct_ty = module_registry_lookup_struct(module_full, field);
@@ -4586,7 +5342,7 @@ static void check_expr(SemaContext *sc, Node *e)
             diag_error_at(e->src, e->line, e->col,
                           "unknown member '%s' on module '%s'",
                           field, module_full);
-            exit(1);
+            sema_abort();
         }
 
         Type *base = sema_resolve_import_type(canonicalize_type_deep(e->lhs->type));
@@ -4602,7 +5358,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "dynamic array length is only available for managed array values with length metadata");
-                exit(1);
+                sema_abort();
             }
             return;
         }
@@ -4621,7 +5377,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "'->' requires pointer to struct");
-                exit(1);
+                sema_abort();
             }
             base = sema_resolve_import_type(canonicalize_type_deep(base->pointee));
         }
@@ -4633,14 +5389,14 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "'.' requires struct value");
-                exit(1);
+                sema_abort();
             }
         }
         if (!base || base->kind != TY_STRUCT)
         {
             diag_error_at(e->src, e->line, e->col,
                           "member access requires struct type");
-            exit(1);
+            sema_abort();
         }
         int idx = struct_find_field(base, e->field_name);
         if (idx < 0)
@@ -4649,7 +5405,7 @@ static void check_expr(SemaContext *sc, Node *e)
                           "unknown field '%s' on struct '%s'",
                           e->field_name ? e->field_name : "<anon>",
                           base->struct_name ? base->struct_name : "<anon>");
-            exit(1);
+            sema_abort();
         }
         e->field_index = idx;
         e->field_offset = base->strct.field_offsets ? base->strct.field_offsets[idx] : 0;
@@ -4659,7 +5415,7 @@ static void check_expr(SemaContext *sc, Node *e)
             diag_error_at(e->src, e->line, e->col,
                           "incomplete type for field '%s'",
                           base->strct.field_names[idx]);
-            exit(1);
+            sema_abort();
         }
         if (e->type->kind == TY_ARRAY && !e->type->array.is_unsized)
         {
@@ -4676,14 +5432,14 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "address-of operator requires an operand");
-            exit(1);
+            sema_abort();
         }
         Node *target = e->lhs;
         if (target->kind != ND_VAR && target->kind != ND_MEMBER && target->kind != ND_INDEX && target->kind != ND_DEREF)
         {
             diag_error_at(target->src, target->line, target->col,
                           "operand of '&' must be an lvalue");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, target);
         if (!target->type && target->kind == ND_VAR)
@@ -4692,7 +5448,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(target->src, target->line, target->col,
                           "cannot determine operand type for '&'");
-            exit(1);
+            sema_abort();
         }
         Type *addr_type = target->type;
         if (target->var_type && target->var_type->kind == TY_ARRAY && !target->var_type->array.is_unsized)
@@ -4706,7 +5462,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "managed array adapter requires both a source array and a .length expression");
-            exit(1);
+            sema_abort();
         }
 
         check_expr(sc, e->lhs);
@@ -4716,7 +5472,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->rhs->src, e->rhs->line, e->rhs->col,
                           "managed array adapter length must be an integer expression");
-            exit(1);
+            sema_abort();
         }
 
         Type *src_array = node_array_source_type(e->lhs);
@@ -4734,7 +5490,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->lhs->src, e->lhs->line, e->lhs->col,
                           "managed array adapter source must be an array or pointer value");
-            exit(1);
+            sema_abort();
         }
 
         e->var_type = canonicalize_type_deep(type_array(elem, -1));
@@ -4786,7 +5542,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "pointer addition requires an integer offset, not another pointer");
-                exit(1);
+                sema_abort();
             }
             if (lhs_is_ptr && type_is_int(rhs_type))
             {
@@ -4800,7 +5556,7 @@ static void check_expr(SemaContext *sc, Node *e)
             }
             diag_error_at(e->src, e->line, e->col,
                           "pointer addition requires exactly one pointer and one integer operand");
-            exit(1);
+            sema_abort();
         }
         if (!type_equal(lhs_type, rhs_type))
         {
@@ -4816,7 +5572,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "'+' requires both operands to have the same type");
-                exit(1);
+                sema_abort();
             }
         }
         e->type = lhs_type;
@@ -4840,7 +5596,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 {
                     diag_error_at(e->src, e->line, e->col,
                                   "pointer subtraction requires both operands to point to the same type");
-                    exit(1);
+                    sema_abort();
                 }
                 e->type = &ty_i64;
                 return;
@@ -4852,7 +5608,7 @@ static void check_expr(SemaContext *sc, Node *e)
             }
             diag_error_at(e->src, e->line, e->col,
                           "pointer subtraction requires a pointer minus an integer or pointer minus pointer of the same type");
-            exit(1);
+            sema_abort();
         }
         if (!type_equal(lhs_type, rhs_type))
         {
@@ -4868,7 +5624,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "'-' requires both operands to have the same type");
-                exit(1);
+                sema_abort();
             }
         }
         e->type = lhs_type;
@@ -4879,13 +5635,13 @@ static void check_expr(SemaContext *sc, Node *e)
         if (!e->lhs)
         {
             diag_error_at(e->src, e->line, e->col, "negation missing operand");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         if (!(type_is_int(e->lhs->type) || type_is_float(e->lhs->type)))
         {
             diag_error_at(e->src, e->line, e->col, "unary '-' requires integer or floating-point operand");
-            exit(1);
+            sema_abort();
         }
         e->type = e->lhs->type;
         return;
@@ -4913,7 +5669,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "'%s' requires both operands to have the same type", op);
-                exit(1);
+                sema_abort();
             }
         }
         int lhs_is_int = type_is_int(e->lhs->type);
@@ -4924,7 +5680,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "integer type required for '%%'");
-                exit(1);
+                sema_abort();
             }
         }
         else if (!(lhs_is_int || lhs_is_float))
@@ -4933,7 +5689,7 @@ static void check_expr(SemaContext *sc, Node *e)
             diag_error_at(e->src, e->line, e->col,
                           "numeric type required for '%s'",
                           op);
-            exit(1);
+            sema_abort();
         }
         e->type = e->lhs->type;
         return;
@@ -4946,7 +5702,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "shift operands must be integers");
-            exit(1);
+            sema_abort();
         }
         
         e->type = e->lhs->type;
@@ -4966,7 +5722,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "'%s' requires integer operands", op_symbol);
-            exit(1);
+            sema_abort();
         }
         if (!type_equal(lhs_type, rhs_type))
         {
@@ -4983,7 +5739,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "'%s' requires both operands to have the same type", op_symbol);
-            exit(1);
+            sema_abort();
         }
         e->type = lhs_type;
         return;
@@ -4994,7 +5750,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "bitwise '~' requires an operand");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         Type *operand_type = canonicalize_type_deep(e->lhs->type);
@@ -5003,7 +5759,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "bitwise '~' requires integer operand");
-            exit(1);
+            sema_abort();
         }
         e->type = operand_type;
         return;
@@ -5014,14 +5770,14 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "logical '!' requires an operand");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         if (!type_is_int(e->lhs->type))
         {
             diag_error_at(e->src, e->line, e->col,
                           "logical '!' requires integer operand");
-            exit(1);
+            sema_abort();
         }
         e->type = type_bool();
         return;
@@ -5040,7 +5796,7 @@ static void check_expr(SemaContext *sc, Node *e)
         if (!((lhs_is_int && rhs_is_int) || (lhs_is_float && rhs_is_float) || (lhs_is_ptr && rhs_is_ptr)))
         {
             diag_error_at(e->src, e->line, e->col, "relational operator requires integer, floating-point, or pointer operands of the same category");
-            exit(1);
+            sema_abort();
         }
         e->type = type_bool();
         return;
@@ -5053,7 +5809,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col, "%s requires integer operands",
                           e->kind == ND_LAND ? "&&" : "||");
-            exit(1);
+            sema_abort();
         }
         e->type = type_bool();
         return;
@@ -5073,7 +5829,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "equality requires both operands to be integers, floats, or pointers");
-            exit(1);
+            sema_abort();
         }
         e->type = type_bool();
         return;
@@ -5084,20 +5840,20 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "'is' requires a left-hand expression");
-            exit(1);
+            sema_abort();
         }
         if (!e->is_type)
         {
             diag_error_at(e->src, e->line, e->col,
                           "'is' requires a target type");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         if (!type_is_object(e->lhs->type))
         {
             diag_error_at(e->src, e->line, e->col,
                           "'is' currently requires an object-typed left operand");
-            exit(1);
+            sema_abort();
         }
         e->type = type_bool();
         return;
@@ -5124,7 +5880,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 if (!target)
                 {
                     diag_error_at(e->src, e->line, e->col, "typeof expression did not resolve to a type");
-                    exit(1);
+                    sema_abort();
                 }
                 e->type = target;
                 return;
@@ -5132,7 +5888,7 @@ static void check_expr(SemaContext *sc, Node *e)
             else
             {
                 diag_error_at(e->src, e->line, e->col, "invalid type expression after 'as'");
-                exit(1);
+                sema_abort();
             }
         }
         if (!e->type)
@@ -5144,7 +5900,7 @@ static void check_expr(SemaContext *sc, Node *e)
         if (!e->lhs)
         {
             diag_error_at(e->src, e->line, e->col, "dereference missing operand");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         Type *ptr_type = canonicalize_type_deep(e->lhs->type);
@@ -5152,7 +5908,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "'*' requires pointer operand");
-            exit(1);
+            sema_abort();
         }
         Type *elem_type = canonicalize_type_deep(ptr_type->pointee);
         if (elem_type && elem_type->kind == TY_STRUCT)
@@ -5172,21 +5928,21 @@ static void check_expr(SemaContext *sc, Node *e)
         if (!e->lhs || !e->rhs)
         {
             diag_error_at(e->src, e->line, e->col, "invalid index expression");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         check_expr(sc, e->rhs);
         if (!type_is_int(e->rhs->type))
         {
             diag_error_at(e->src, e->line, e->col, "array index is not an integer");
-            exit(1);
+            sema_abort();
         }
         Type *lhs_type = canonicalize_type_deep(e->lhs->type);
         if (!lhs_type)
         {
             diag_error_at(e->src, e->line, e->col,
                           "subscripted value is not an array or pointer");
-            exit(1);
+            sema_abort();
         }
         Type *elem_type = NULL;
         if (lhs_type->kind == TY_PTR && lhs_type->pointee)
@@ -5202,7 +5958,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "subscripted value is not an array or pointer");
-            exit(1);
+            sema_abort();
         }
         
         if (elem_type && elem_type->kind == TY_STRUCT)
@@ -5260,7 +6016,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 diag_error_at(e->src, e->line, e->col,
                               "cannot assign '%s' to '%s' without cast",
                               got, want);
-                exit(1);
+                sema_abort();
             }
             e->rhs->type = lhs_type;
         }
@@ -5272,7 +6028,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 diag_error_at(e->rhs->src, e->rhs->line, e->rhs->col,
                               "assignment to managed dynamic array '%s' requires length metadata; use (managed[]: .length = expr)",
                               lhs_base->var_ref ? lhs_base->var_ref : "<array>");
-                exit(1);
+                sema_abort();
             }
             e->managed_length_name = lhs_base->managed_length_name;
         }
@@ -5286,7 +6042,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "delete missing operand");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         Type *ptr_ty = canonicalize_type_deep(e->lhs->type);
@@ -5294,14 +6050,14 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->lhs->src, e->lhs->line, e->lhs->col,
                           "delete requires a pointer operand");
-            exit(1);
+            sema_abort();
         }
         Type *elem = canonicalize_type_deep(ptr_ty->pointee);
         if (!elem || elem->kind == TY_VOID)
         {
             diag_error_at(e->lhs->src, e->lhs->line, e->lhs->col,
                           "cannot delete pointer to incomplete or void type");
-            exit(1);
+            sema_abort();
         }
         e->type = &ty_i32; 
         return;
@@ -5340,7 +6096,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 diag_error_at(e->src, e->line, e->col,
                               "cannot assign '%s' to '%s' without cast",
                               got, want);
-                exit(1);
+                sema_abort();
             }
             e->rhs->type = lhs_type;
         }
@@ -5395,7 +6151,7 @@ static void check_expr(SemaContext *sc, Node *e)
             allow_float = 0;
             break;
         default:
-            exit(1);
+            sema_abort();
         }
 
         e->type = lhs_type ? lhs_type : (e->rhs->type ? e->rhs->type : &ty_i32);
@@ -5409,7 +6165,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "operand of ++/-- must be an lvalue");
-            exit(1);
+            sema_abort();
         }
 
         check_expr(sc, e->lhs);
@@ -5437,7 +6193,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "operand of ++/-- must be a variable or dereference");
-            exit(1);
+            sema_abort();
         }
 
         if (e->lhs->kind == ND_VAR && e->lhs->var_is_const)
@@ -5445,7 +6201,7 @@ static void check_expr(SemaContext *sc, Node *e)
             diag_error_at(e->lhs->src, e->lhs->line, e->lhs->col,
                           "cannot modify constant variable '%s'",
                           e->lhs->var_ref ? e->lhs->var_ref : "<unnamed>");
-            exit(1);
+            sema_abort();
         }
 
         Type *t = e->lhs->type;
@@ -5457,7 +6213,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "++/-- requires integer or pointer lvalue");
-            exit(1);
+            sema_abort();
         }
 
         e->type = t;
@@ -5568,25 +6324,25 @@ static void check_expr(SemaContext *sc, Node *e)
                 diag_error_at(e->src, e->line, e->col,
                               "missing metadata for function '%s'",
                               resolved_name);
-                exit(1);
+                sema_abort();
             }
             if (sym_lookup && sym_lookup->kind != SYM_FUNC)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "symbol '%s' is not callable",
                               resolved_name ? resolved_name : (original_name ? original_name : "<unnamed>"));
-                exit(1);
+                sema_abort();
             }
             if (resolved_name && !direct_sym)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "unknown function '%s'",
                               resolved_name);
-                exit(1);
+                sema_abort();
             }
             diag_error_at(e->src, e->line, e->col,
                           "call target is not callable");
-            exit(1);
+            sema_abort();
         }
 
         func_sig = canonicalize_type_deep(func_sig);
@@ -5594,7 +6350,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "call target is not a function type");
-            exit(1);
+            sema_abort();
         }
 
         const char *call_display_name =
@@ -5636,7 +6392,7 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "cannot call function pointer without a signature");
-            exit(1);
+            sema_abort();
         }
 
         if (!args_checked)
@@ -5655,7 +6411,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 diag_error_at(e->src, e->line, e->col,
                               "function call to '%s' expects %d argument(s) but %d provided",
                               diag_name, expected, e->arg_count);
-                exit(1);
+                sema_abort();
             }
         }
         else if (e->arg_count < expected)
@@ -5663,7 +6419,7 @@ static void check_expr(SemaContext *sc, Node *e)
             diag_error_at(e->src, e->line, e->col,
                           "function call to '%s' expects at least %d argument(s) before varargs",
                           diag_name, expected);
-            exit(1);
+            sema_abort();
         }
 
         int check_count = expected;
@@ -5686,7 +6442,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 diag_error_at(e->args[i]->src, e->args[i]->line, e->args[i]->col,
                               "argument %d type mismatch: expected %s, got %s",
                               i + 1, want, got);
-                exit(1);
+                sema_abort();
             }
 
             int param_is_const = 0;
@@ -5724,7 +6480,7 @@ static void check_expr(SemaContext *sc, Node *e)
                     diag_error_at(e->args[i]->src, e->args[i]->line, e->args[i]->col,
                                   "argument %d to '%s' passes pointer derived from constant '%s'; cast to a mutable pointer to override",
                                   i + 1, diag_name, const_name);
-                    exit(1);
+                    sema_abort();
                 }
             }
             else
@@ -5771,7 +6527,7 @@ static void check_expr(SemaContext *sc, Node *e)
             {
                 diag_error_at(e->src, e->line, e->col,
                               "jump calls cannot pass arguments");
-                exit(1);
+                sema_abort();
             }
 
             if (!call_is_indirect)
@@ -5780,7 +6536,7 @@ static void check_expr(SemaContext *sc, Node *e)
                 {
                     diag_error_at(e->src, e->line, e->col,
                                   "direct jump target must be a function marked with [JumpTarget]");
-                    exit(1);
+                    sema_abort();
                 }
             }
         }
@@ -5801,20 +6557,20 @@ static void check_expr(SemaContext *sc, Node *e)
         if (!e->lhs)
         {
             diag_error_at(e->src, e->line, e->col, "va_arg requires a va_list expression");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         
         if (e->lhs->type && canonicalize_type_deep(e->lhs->type) && canonicalize_type_deep(e->lhs->type)->kind != TY_VA_LIST)
         {
             diag_error_at(e->lhs->src, e->lhs->line, e->lhs->col, "first argument to va_arg must be a va_list");
-            exit(1);
+            sema_abort();
         }
         
         if (!e->var_type)
         {
             diag_error_at(e->src, e->line, e->col, "va_arg missing target type");
-            exit(1);
+            sema_abort();
         }
         e->type = canonicalize_type_deep(e->var_type);
         return;
@@ -5825,7 +6581,7 @@ static void check_expr(SemaContext *sc, Node *e)
         if (!e->lhs)
         {
             diag_error_at(e->src, e->line, e->col, "va_end requires a va_list expression");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         e->type = &ty_void;
@@ -5837,7 +6593,7 @@ static void check_expr(SemaContext *sc, Node *e)
         if (!e->lhs || !e->rhs || !e->body)
         {
             diag_error_at(e->src, e->line, e->col, "malformed ternary expression");
-            exit(1);
+            sema_abort();
         }
         check_expr(sc, e->lhs);
         check_expr(sc, e->rhs);
@@ -5847,7 +6603,7 @@ static void check_expr(SemaContext *sc, Node *e)
         if (!cond_ok)
         {
             diag_error_at(e->lhs->src, e->lhs->line, e->lhs->col, "ternary condition must be integer or pointer");
-            exit(1);
+            sema_abort();
         }
         Type *then_type = canonicalize_type_deep(e->rhs->type);
         Type *else_type = canonicalize_type_deep(e->body->type);
@@ -5889,7 +6645,7 @@ static void check_expr(SemaContext *sc, Node *e)
         }
 
         diag_error_at(e->src, e->line, e->col, "ternary branches must have compatible types");
-        exit(1);
+        sema_abort();
     }
     if (e->kind == ND_MATCH)
     {
@@ -5897,22 +6653,23 @@ static void check_expr(SemaContext *sc, Node *e)
         {
             diag_error_at(e->src, e->line, e->col,
                           "match expression missing scrutinee");
-            exit(1);
+            sema_abort();
         }
         if (e->match_stmt.arm_count <= 0 || !e->match_stmt.arms)
         {
             diag_error_at(e->src, e->line, e->col,
                           "match expression requires at least one arm");
-            exit(1);
+            sema_abort();
         }
 
         check_expr(sc, e->match_stmt.expr);
         Type *scrut_type = canonicalize_type_deep(e->match_stmt.expr->type);
-        if (!type_is_int(scrut_type))
+        int scrut_is_string = type_is_string_ptr(scrut_type);
+        if (!type_is_int(scrut_type) && !scrut_is_string)
         {
             diag_error_at(e->match_stmt.expr->src, e->match_stmt.expr->line, e->match_stmt.expr->col,
-                          "match expression scrutinee must be integral");
-            exit(1);
+                          "match expression scrutinee must be integral or a string");
+            sema_abort();
         }
 
         int arm_count = e->match_stmt.arm_count;
@@ -5931,10 +6688,32 @@ static void check_expr(SemaContext *sc, Node *e)
                               "match arm is null");
                 if (pattern_values)
                     free(pattern_values);
-                exit(1);
+                sema_abort();
             }
 
-            if (arm->pattern)
+            if (arm->pattern && scrut_is_string)
+            {
+                check_expr(sc, arm->pattern);
+                if (arm->pattern->kind != ND_STRING)
+                {
+                    diag_error_at(arm->pattern->src, arm->pattern->line, arm->pattern->col,
+                                  "match patterns on a string must be string literals");
+                    free(pattern_values);
+                    sema_abort();
+                }
+                for (int j = 0; j < i; ++j)
+                {
+                    if (arms[j].pattern && string_labels_equal(arms[j].pattern, arm->pattern))
+                    {
+                        diag_error_at(arm->pattern->src, arm->pattern->line, arm->pattern->col,
+                                      "duplicate match pattern \"%.*s\"",
+                                      string_label_length(arm->pattern), arm->pattern->str_data);
+                        free(pattern_values);
+                        sema_abort();
+                    }
+                }
+            }
+            else if (arm->pattern)
             {
                 check_expr(sc, arm->pattern);
                 if (!type_is_int(arm->pattern->type))
@@ -5945,7 +6724,7 @@ static void check_expr(SemaContext *sc, Node *e)
                                       "match patterns must be integer literals compatible with scrutinee");
                         if (pattern_values)
                             free(pattern_values);
-                        exit(1);
+                        sema_abort();
                     }
                 }
                 if (!node_force_int_literal(arm->pattern))
@@ -5954,7 +6733,7 @@ static void check_expr(SemaContext *sc, Node *e)
                                   "match patterns must be integer constants");
                     if (pattern_values)
                         free(pattern_values);
-                    exit(1);
+                    sema_abort();
                 }
                 if (arm->pattern->kind != ND_INT)
                 {
@@ -5962,7 +6741,7 @@ static void check_expr(SemaContext *sc, Node *e)
                                   "match patterns must be integer constants");
                     if (pattern_values)
                         free(pattern_values);
-                    exit(1);
+                    sema_abort();
                 }
                 int64_t val = arm->pattern->int_val;
                 for (int j = 0; j < value_count; ++j)
@@ -5972,7 +6751,7 @@ static void check_expr(SemaContext *sc, Node *e)
                         diag_error_at(arm->pattern->src, arm->pattern->line, arm->pattern->col,
                                       "duplicate match pattern value '%lld'", (long long)val);
                         free(pattern_values);
-                        exit(1);
+                        sema_abort();
                     }
                 }
                 pattern_values[value_count++] = val;
@@ -5985,7 +6764,7 @@ static void check_expr(SemaContext *sc, Node *e)
                                   "match expression may contain only one '_' arm");
                     if (pattern_values)
                         free(pattern_values);
-                    exit(1);
+                    sema_abort();
                 }
                 wildcard_index = i;
                 if (i != arm_count - 1)
@@ -5994,7 +6773,7 @@ static void check_expr(SemaContext *sc, Node *e)
                                   "wildcard '_' arm must be the last arm in a match expression");
                     if (pattern_values)
                         free(pattern_values);
-                    exit(1);
+                    sema_abort();
                 }
             }
 
@@ -6004,7 +6783,7 @@ static void check_expr(SemaContext *sc, Node *e)
                               "match guards are not supported yet");
                 if (pattern_values)
                     free(pattern_values);
-                exit(1);
+                sema_abort();
             }
 
             if (!arm->body)
@@ -6013,7 +6792,7 @@ static void check_expr(SemaContext *sc, Node *e)
                               "match arm missing result expression");
                 if (pattern_values)
                     free(pattern_values);
-                exit(1);
+                sema_abort();
             }
 
             check_expr(sc, arm->body);
@@ -6035,7 +6814,7 @@ static void check_expr(SemaContext *sc, Node *e)
                                   "all match arms must yield the same type");
                     if (pattern_values)
                         free(pattern_values);
-                    exit(1);
+                    sema_abort();
                 }
             }
         }
@@ -6046,7 +6825,7 @@ static void check_expr(SemaContext *sc, Node *e)
                           "match expression must include a trailing '_' arm");
             if (pattern_values)
                 free(pattern_values);
-            exit(1);
+            sema_abort();
         }
 
         if (!result_type)
@@ -6058,7 +6837,7 @@ static void check_expr(SemaContext *sc, Node *e)
     }
     diag_error_at(e->src, e->line, e->col, "unsupported expression: %s",
                   nodekind_name(e->kind));
-    exit(1);
+    sema_abort();
 }
 
 static int sema_check_statement(SemaContext *sc, Node *stmt, Node *fn, int *found_ret);
@@ -6201,7 +6980,7 @@ static int sema_check_statement(SemaContext *sc, Node *stmt, Node *fn, int *foun
                 return 1;
 
             sema_register_global_local(sc, sc->unit, hoisted);
-            unit_append_decl(sc->unit, hoisted);
+            sema_unit_append(sc, hoisted);
             scope_add(sc, stmt->var_name, stmt->var_type, stmt->var_is_const, 1, backend, stmt->managed_length_name);
 
             stmt->rhs = NULL;
@@ -6376,10 +7155,11 @@ static int sema_check_statement(SemaContext *sc, Node *stmt, Node *fn, int *foun
         }
         check_expr(sc, stmt->switch_stmt.expr);
         Type *cond_type = canonicalize_type_deep(stmt->switch_stmt.expr->type);
-        if (!type_is_int(cond_type))
+        int cond_is_string = type_is_string_ptr(cond_type);
+        if (!type_is_int(cond_type) && !cond_is_string)
         {
             diag_error_at(stmt->switch_stmt.expr->src, stmt->switch_stmt.expr->line, stmt->switch_stmt.expr->col,
-                          "switch selector must be an integral type");
+                          "switch selector must be an integral type or a string");
             return 1;
         }
 
@@ -6418,6 +7198,30 @@ static int sema_check_statement(SemaContext *sc, Node *stmt, Node *fn, int *foun
             }
 
             check_expr(sc, entry->value);
+            if (cond_is_string)
+            {
+                if (entry->value->kind != ND_STRING)
+                {
+                    diag_error_at(entry->value->src, entry->value->line, entry->value->col,
+                                  "switch case labels on a string must be string literals");
+                    if (case_values)
+                        free(case_values);
+                    return 1;
+                }
+                for (int j = 0; j < i; ++j)
+                {
+                    if (!cases[j].is_default && cases[j].value && string_labels_equal(cases[j].value, entry->value))
+                    {
+                        diag_error_at(entry->value->src, entry->value->line, entry->value->col,
+                                      "duplicate switch case label \"%.*s\"",
+                                      string_label_length(entry->value), entry->value->str_data);
+                        if (case_values)
+                            free(case_values);
+                        return 1;
+                    }
+                }
+                continue;
+            }
             if (!type_is_int(entry->value->type))
             {
                 if (!coerce_int_literal_to_type(entry->value, cond_type, "switch case"))
@@ -6571,582 +7375,1166 @@ static int sema_global_initializer_is_const(const Node *expr)
     }
 }
 
-static int sema_check_global_decl(SemaContext *sc, Node *decl)
+/* Compile-time evaluation of calls to [Eval] / `constant fun` functions in
+   global initializers. The interpreter walks checked function bodies with
+   value semantics only: locals, arrays, structs, integers, floats and
+   read-only string literals. Anything that would observe memory or the
+   outside world (pointers, mutable globals, calls without a body) stops the
+   evaluation with a diagnostic, so every function it completes is pure and
+   its results can be memoized. */
+
+enum
 {
-    if (!decl || decl->kind != ND_VAR_DECL || !decl->var_is_global)
-        return 0;
+    CEVAL_MAX_CALL_DEPTH = 512,
+    CEVAL_MEMO_BUCKETS = 1024
+};
 
-    if (!decl->var_name)
-    {
-        diag_error_at(decl->src, decl->line, decl->col,
-                      "global variable requires a name");
-        return 1;
-    }
+typedef enum
+{
+    CEVAL_INT,
+    CEVAL_FLOAT,
+    CEVAL_STRING,
+    CEVAL_AGGREGATE
+} CevalKind;
 
-    decl->var_type = canonicalize_type_deep(decl->var_type);
-    Type *ty = decl->var_type;
-    if (!ty)
-    {
-        diag_error_at(decl->src, decl->line, decl->col,
-                      "unable to determine type for global '%s'",
-                      decl->var_name);
-        return 1;
-    }
-    if (ty->kind == TY_VOID)
-    {
-        diag_error_at(decl->src, decl->line, decl->col,
-                      "global '%s' cannot have type void",
-                      decl->var_name);
+typedef struct CevalValue
+{
+    CevalKind kind;
+    int64_t i;
+    double f;
+    const char *str;
+    int str_len;
+    struct CevalValue *elems;
+    int count;
+} CevalValue;
+
+typedef struct
+{
+    const char *name;
+    Type *type;
+    CevalValue value;
+} CevalLocal;
+
+typedef struct CevalMemo
+{
+    const Node *fn;
+    CevalValue *args;
+    int arg_count;
+    size_t hash;
+    CevalValue result;
+    struct CevalMemo *next;
+} CevalMemo;
+
+typedef struct CevalGlobal
+{
+    const Node *decl;
+    CevalValue value;
+    struct CevalGlobal *next;
+} CevalGlobal;
+
+typedef enum
+{
+    CEVAL_FLOW_NEXT,
+    CEVAL_FLOW_BREAK,
+    CEVAL_FLOW_CONTINUE,
+    CEVAL_FLOW_RETURN,
+    CEVAL_FLOW_FAIL
+} CevalFlow;
+
+typedef struct
+{
+    SemaContext *sc;
+    const Node *fn;
+    CevalLocal *locals;
+    int local_count;
+    int local_cap;
+    int frame_base;
+    int depth;
+    long long steps;
+    long long bytes;
+    CevalValue ret;
+    CevalMemo *memo[CEVAL_MEMO_BUCKETS];
+    int memo_hits;
+    CevalGlobal *globals;
+    const Node *fail_node;
+    char fail_msg[256];
+} CevalMachine;
+
+typedef struct
+{
+    Node *decl;
+    int state; /* 0 pending, 1 evaluating, 2 done */
+} SemaEvalPending;
+
+static SemaEvalPending *sema_eval_pending = NULL;
+static int sema_eval_pending_count = 0;
+static int sema_eval_pending_cap = 0;
+
+static int ceval_expr(CevalMachine *m, const Node *e, CevalValue *out);
+static CevalFlow ceval_stmt(CevalMachine *m, const Node *s);
+static int sema_eval_fold_global(CevalMachine *m, SemaEvalPending *p);
+
+static int ceval_fail(CevalMachine *m, const Node *at, const char *fmt, ...)
+{
+    if (m->fail_msg[0])
+        return 0;
+    m->fail_node = at;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(m->fail_msg, sizeof(m->fail_msg), fmt, ap);
+    va_end(ap);
+    return 0;
+}
+
+static int ceval_tick(CevalMachine *m, const Node *at)
+{
+    if (++m->steps <= sema_eval_step_budget)
         return 1;
-    }
-    
-    
-    
-    if (ty->kind == TY_PTR && decl->rhs && decl->rhs->kind == ND_INIT_LIST && !decl->rhs->init.is_zero)
+    return ceval_fail(m, at, "step budget of %lld exceeded (raise it with --eval-steps)",
+                      sema_eval_step_budget);
+}
+
+static int ceval_reserve(CevalMachine *m, const Node *at, int count)
+{
+    long long need = (long long)count * (long long)sizeof(CevalValue);
+    if (m->bytes + need > sema_eval_memory_budget)
+        return ceval_fail(m, at, "memory budget of %lld bytes exceeded (raise it with --eval-memory)",
+                          sema_eval_memory_budget);
+    m->bytes += need;
+    return 1;
+}
+
+static void ceval_release(CevalMachine *m, CevalValue *v)
+{
+    if (!v || v->kind != CEVAL_AGGREGATE)
+        return;
+    for (int i = 0; i < v->count; ++i)
+        ceval_release(m, &v->elems[i]);
+    m->bytes -= (long long)v->count * (long long)sizeof(CevalValue);
+    free(v->elems);
+    v->elems = NULL;
+    v->count = 0;
+}
+
+/* Allocates `count` zeroed elements; on failure `v` owns nothing. */
+static int ceval_alloc_aggregate(CevalMachine *m, const Node *at, CevalValue *v, int count)
+{
+    memset(v, 0, sizeof(*v));
+    v->kind = CEVAL_AGGREGATE;
+    if (count <= 0)
+        return 1;
+    if (!ceval_reserve(m, at, count))
+        return 0;
+    v->elems = (CevalValue *)xcalloc((size_t)count, sizeof(CevalValue));
+    v->count = count;
+    return 1;
+}
+
+static int ceval_copy(CevalMachine *m, const Node *at, const CevalValue *src, CevalValue *dst)
+{
+    if (src->kind != CEVAL_AGGREGATE)
     {
-        int elem_count = decl->rhs->init.count;
-        if (elem_count > 0)
-        {
-            Type *elem_ty = ty->pointee ? canonicalize_type_deep(ty->pointee) : &ty_i32;
-            decl->var_type = canonicalize_type_deep(type_array(elem_ty, elem_count));
-            ty = decl->var_type;
-        }
+        *dst = *src;
+        return 1;
     }
-    if (ty->kind == TY_ARRAY && ty->array.is_unsized && decl->rhs && decl->rhs->kind == ND_INIT_LIST)
+    if (!ceval_alloc_aggregate(m, at, dst, src->count))
+        return 0;
+    for (int i = 0; i < src->count; ++i)
     {
-        int elem_count = decl->rhs->init.count;
-        if (elem_count <= 0)
+        if (!ceval_copy(m, at, &src->elems[i], &dst->elems[i]))
         {
-            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
-                          "unsized arrays require at least one initializer element to determine their length");
-            return 1;
+            ceval_release(m, dst);
+            return 0;
         }
-        Type *elem_ty = ty->array.elem ? ty->array.elem : type_i32();
-        decl->var_type = canonicalize_type_deep(type_array(elem_ty, elem_count));
-        ty = decl->var_type;
     }
+    return 1;
+}
 
-    if (ty->kind == TY_STRUCT)
-    {
-        if (ty->strct.size_bytes <= 0)
-        {
-            diag_error_at(decl->src, decl->line, decl->col,
-                          "struct global '%s' has incomplete size",
-                          decl->var_name);
-            return 1;
-        }
+static Type *ceval_canonical(Type *ty)
+{
+    ty = canonicalize_type_deep(ty);
+    while (ty && ty->kind == TY_REF && ty->pointee)
+        ty = canonicalize_type_deep(ty->pointee);
+    return ty;
+}
 
-        if (!decl->rhs)
-            return 0;
+static int ceval_zero(CevalMachine *m, const Node *at, Type *ty, CevalValue *out);
 
-        if (decl->rhs->kind != ND_INIT_LIST)
+static int ceval_field_default(CevalMachine *m, const Node *at, const char *spec, Type *ty, CevalValue *out)
+{
+    memset(out, 0, sizeof(*out));
+    switch (spec[0])
+    {
+    case 'N':
+        out->kind = CEVAL_INT;
+        return 1;
+    case 'I':
+        out->kind = CEVAL_INT;
+        out->i = inline_normalize_value((int64_t)strtoll(spec + 1, NULL, 10), ty);
+        return 1;
+    case 'U':
+        out->kind = CEVAL_INT;
+        out->i = inline_normalize_value((int64_t)strtoull(spec + 1, NULL, 10), ty);
+        return 1;
+    case 'F':
+        out->kind = CEVAL_FLOAT;
+        out->f = strtod(spec + 1, NULL);
+        if (ty && ty->kind == TY_F32)
+            out->f = (double)(float)out->f;
+        return 1;
+    case 'S':
+    {
+        char *endptr = NULL;
+        unsigned long long len = strtoull(spec + 1, &endptr, 10);
+        out->kind = CEVAL_STRING;
+        if (endptr && *endptr == ':')
         {
-            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
-                          "struct global '%s' must use an initializer list",
-                          decl->var_name);
-            return 1;
+            out->str = endptr + 1;
+            out->str_len = (int)len;
         }
-
-        check_initializer_for_type(sc, decl->rhs, ty);
-        if (!sema_global_initializer_is_const(decl->rhs))
+        else
         {
-            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
-                          "global initializer for '%s' must be a constant expression",
-                          decl->var_name);
-            return 1;
+            out->str = spec + 1;
+            out->str_len = (int)strlen(spec + 1);
         }
-        return 0;
+        return 1;
     }
+    default:
+        return ceval_fail(m, at, "unsupported struct field default '%s'", spec);
+    }
+}
 
-    if (!decl->rhs)
-        return 0;
-
-    if (ty->kind == TY_ARRAY && decl->rhs->kind == ND_INIT_LIST)
+static int ceval_zero(CevalMachine *m, const Node *at, Type *ty, CevalValue *out)
+{
+    memset(out, 0, sizeof(*out));
+    ty = ceval_canonical(ty);
+    if (!ty)
+        return ceval_fail(m, at, "value has no type");
+    if (type_is_float(ty))
     {
-        check_initializer_for_type(sc, decl->rhs, ty);
-        if (!sema_global_initializer_is_const(decl->rhs))
-        {
-            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
-                          "global initializer for '%s' must be a constant expression",
-                          decl->var_name);
-            return 1;
-        }
-        return 0;
+        out->kind = CEVAL_FLOAT;
+        return 1;
     }
-
-    if (decl->rhs->kind == ND_INIT_LIST)
+    if (ty->kind == TY_STRUCT)
     {
-        check_initializer_for_type(sc, decl->rhs, ty);
-        if (!sema_global_initializer_is_const(decl->rhs))
+        if (!ceval_alloc_aggregate(m, at, out, ty->strct.field_count))
+            return 0;
+        for (int i = 0; i < ty->strct.field_count; ++i)
         {
-            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
-                          "global initializer for '%s' must be a constant expression",
-                          decl->var_name);
-            return 1;
+            Type *field_ty = ty->strct.field_types ? ceval_canonical(ty->strct.field_types[i]) : NULL;
+            const char *spec = ty->strct.field_default_values ? ty->strct.field_default_values[i] : NULL;
+            int ok = spec ? ceval_field_default(m, at, spec, field_ty, &out->elems[i])
+                          : ceval_zero(m, at, field_ty, &out->elems[i]);
+            if (!ok)
+            {
+                ceval_release(m, out);
+                return 0;
+            }
         }
-        if (!decl->rhs->type)
-            decl->rhs->type = ty;
-        return 0;
+        return 1;
     }
-
-    check_expr(sc, decl->rhs);
-    if (!can_assign(ty, decl->rhs))
+    if (ty->kind == TY_ARRAY)
     {
-        diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
-                      "cannot initialize global '%s' with incompatible type",
-                      decl->var_name);
+        if (ty->array.is_unsized || ty->array.length < 0)
+            return ceval_fail(m, at, "unsized arrays cannot be evaluated at compile time");
+        if (!ceval_alloc_aggregate(m, at, out, ty->array.length))
+            return 0;
+        for (int i = 0; i < ty->array.length; ++i)
+        {
+            if (!ceval_zero(m, at, ty->array.elem, &out->elems[i]))
+            {
+                ceval_release(m, out);
+                return 0;
+            }
+        }
         return 1;
     }
-    decl->rhs->type = ty;
-
-    if (!sema_global_initializer_is_const(decl->rhs))
+    if (ty->kind == TY_PTR && type_is_string_ptr(ty))
     {
-        diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
-                      "global initializer for '%s' must be a constant expression",
-                      decl->var_name);
+        out->kind = CEVAL_STRING;
         return 1;
     }
-
-    return 0;
+    out->kind = CEVAL_INT;
+    return 1;
 }
 
-static int sema_check_function(SemaContext *sc, Node *fn)
+static int ceval_coerce(CevalMachine *m, const Node *at, CevalValue *v, Type *from, Type *to)
 {
-    if (!fn->ret_type)
-        fn->ret_type = &ty_i32;
-    if (fn->is_jump_target)
+    to = ceval_canonical(to);
+    if (!to)
+        return 1;
+    if (type_is_float(to))
     {
-        if (fn->param_count != 0)
+        if (v->kind == CEVAL_INT)
         {
-            diag_error_at(fn->src, fn->line, fn->col,
-                          "[JumpTarget] functions cannot have parameters");
-            return 1;
+            v->f = inline_type_is_unsigned(from) ? (double)(uint64_t)v->i : (double)v->i;
+            v->kind = CEVAL_FLOAT;
         }
-        if (fn->is_varargs)
+        else if (v->kind != CEVAL_FLOAT)
         {
-            diag_error_at(fn->src, fn->line, fn->col,
-                          "[JumpTarget] functions cannot be variadic");
-            return 1;
+            return ceval_fail(m, at, "cannot convert value to a floating-point type");
         }
+        if (to->kind == TY_F32)
+            v->f = (double)(float)v->f;
+        return 1;
     }
-    if (fn->is_chancecode || fn->is_literal)
-        return 0;
-    Node *body = fn->body;
-    if (!body)
+    if (type_is_int(to))
     {
-        diag_error_at(fn->src, fn->line, fn->col, "missing function body");
+        if (v->kind == CEVAL_FLOAT)
+        {
+            if (to->kind == TY_BOOL)
+                v->i = v->f != 0.0;
+            else if (!(v->f > -9223372036854775808.0 && v->f < 18446744073709551616.0))
+                return ceval_fail(m, at, "floating-point value is out of range for an integer conversion");
+            else if (v->f >= 9223372036854775808.0)
+                v->i = (int64_t)(uint64_t)v->f;
+            else
+                v->i = (int64_t)v->f;
+            v->kind = CEVAL_INT;
+        }
+        else if (v->kind == CEVAL_STRING)
+        {
+            return ceval_fail(m, at, "string pointers cannot be converted to integers at compile time");
+        }
+        else if (v->kind != CEVAL_INT)
+        {
+            return ceval_fail(m, at, "cannot convert aggregate value to an integer type");
+        }
+        v->i = inline_normalize_value(v->i, to);
         return 1;
     }
-    scope_push(sc);
-    for (int i = 0; i < fn->param_count; i++)
+    if (to->kind == TY_PTR && v->kind == CEVAL_INT && v->i != 0)
+        return ceval_fail(m, at, "integer to pointer conversions cannot be evaluated at compile time");
+    if (to->kind == TY_PTR && v->kind == CEVAL_AGGREGATE)
+        return ceval_fail(m, at, "arrays decay to pointers, which cannot be evaluated at compile time");
+    return 1;
+}
+
+static int ceval_expr_as(CevalMachine *m, const Node *e, Type *ty, CevalValue *out)
+{
+    if (!ceval_expr(m, e, out))
+        return 0;
+    if (!ceval_coerce(m, e, out, e->type, ty))
     {
-        fn->param_types[i] = canonicalize_type_deep(fn->param_types[i]);
-        int param_is_const = (fn->param_const_flags && i < fn->param_count) ? fn->param_const_flags[i] : 0;
-        scope_add(sc, fn->param_names[i], fn->param_types[i], param_is_const, 0, NULL,
-              (fn->is_managed && type_is_unsized_array(fn->param_types[i])) ? make_managed_length_name(fn->param_names[i]) : NULL);
+        ceval_release(m, out);
+        return 0;
     }
-    int has_return = 0;
-    int rc;
-    if (body->kind == ND_BLOCK)
-        rc = sema_check_block(sc, body, fn, &has_return, 0);
-    else
-        rc = sema_check_statement(sc, body, fn, &has_return);
-    scope_pop(sc);
-    if (rc)
-        return rc;
-    if ((!fn->ret_type || fn->ret_type->kind != TY_VOID) && !has_return)
+    return 1;
+}
+
+static int ceval_truth(CevalMachine *m, const Node *e, int *out)
+{
+    CevalValue v;
+    if (!ceval_expr(m, e, &v))
+        return 0;
+    switch (v.kind)
     {
-        diag_error_at(fn->src, fn->line, fn->col,
-                      "function body must contain a return statement");
+    case CEVAL_INT:
+        *out = v.i != 0;
+        return 1;
+    case CEVAL_FLOAT:
+        *out = v.f != 0.0;
+        return 1;
+    case CEVAL_STRING:
+        *out = v.str != NULL;
         return 1;
+    default:
+        ceval_release(m, &v);
+        return ceval_fail(m, e, "aggregate value used as a condition");
     }
-    return 0;
 }
 
-int sema_check_unit(SemaContext *sc, Node *unit)
+static Type *ceval_common_int_type(Type *lhs, Type *rhs)
 {
-    if (!unit)
+    int lw = inline_type_bit_width(lhs);
+    int rw = inline_type_bit_width(rhs);
+    if (lw <= 0)
+        return rhs;
+    if (rw <= 0 || lw > rw)
+        return lhs;
+    if (rw > lw)
+        return rhs;
+    return inline_type_is_unsigned(lhs) ? lhs : rhs;
+}
+
+static int ceval_binary(CevalMachine *m, const Node *at, NodeKind op,
+                        const CevalValue *lhs, Type *lhs_ty,
+                        const CevalValue *rhs, Type *rhs_ty,
+                        Type *result_ty, CevalValue *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->kind = CEVAL_INT;
+    int is_compare = (op == ND_EQ || op == ND_STRICT_EQ || op == ND_NE || op == ND_LT ||
+                      op == ND_LE || op == ND_GT_EXPR || op == ND_GE);
+
+    if (lhs->kind == CEVAL_STRING || rhs->kind == CEVAL_STRING)
     {
-        diag_error("null unit");
-        return 1;
+        if (op == ND_EQ || op == ND_STRICT_EQ || op == ND_NE)
+        {
+            int same = 0;
+            if (lhs->kind == CEVAL_STRING && rhs->kind == CEVAL_STRING)
+                same = lhs->str == rhs->str;
+            else if (lhs->kind == CEVAL_INT && lhs->i == 0)
+                same = rhs->str == NULL;
+            else if (rhs->kind == CEVAL_INT && rhs->i == 0)
+                same = lhs->str == NULL;
+            else
+                return ceval_fail(m, at, "pointer comparison cannot be evaluated at compile time");
+            out->i = same == (op != ND_NE);
+            return ceval_coerce(m, at, out, NULL, result_ty);
+        }
+        return ceval_fail(m, at, "pointer arithmetic cannot be evaluated at compile time");
     }
-    Node *previous_unit = sc->unit;
-    sc->unit = unit;
-    if (unit->kind == ND_FUNC)
+    if (lhs->kind == CEVAL_AGGREGATE || rhs->kind == CEVAL_AGGREGATE)
+        return ceval_fail(m, at, "%s does not apply to aggregate values", node_kind_name(op));
+
+    if (lhs->kind == CEVAL_FLOAT || rhs->kind == CEVAL_FLOAT)
     {
-        
-        
-        sema_register_function_local(sc, NULL, unit);
-        if (check_exposed_function_signature(unit))
-            return 1;
-        int rc = sema_check_function(sc, unit);
-        if (!rc)
-            analyze_inline_candidates(unit);
-        return rc;
-    }
-    if (unit->kind != ND_UNIT)
-    {
-        fprintf(stderr, "sema: expected unit\n");
-        return 1;
-    }
-    
-    for (int i = 0; i < unit->stmt_count; i++)
-    {
-        Node *decl = unit->stmts[i];
-        if (!decl)
-            continue;
-        if (decl->kind == ND_FUNC)
-        {
-            sema_register_function_local(sc, unit, decl);
-        }
-        else if (decl->kind == ND_VAR_DECL && decl->var_is_global)
+        double a = lhs->kind == CEVAL_FLOAT ? lhs->f
+                   : inline_type_is_unsigned(lhs_ty) ? (double)(uint64_t)lhs->i
+                                                     : (double)lhs->i;
+        double b = rhs->kind == CEVAL_FLOAT ? rhs->f
+                   : inline_type_is_unsigned(rhs_ty) ? (double)(uint64_t)rhs->i
+                                                     : (double)rhs->i;
+        if (is_compare)
         {
-            sema_register_global_local(sc, unit, decl);
+            switch (op)
+            {
+            case ND_EQ:
+            case ND_STRICT_EQ:
+                out->i = a == b;
+                break;
+            case ND_NE:
+                out->i = a != b;
+                break;
+            case ND_LT:
+                out->i = a < b;
+                break;
+            case ND_LE:
+                out->i = a <= b;
+                break;
+            case ND_GT_EXPR:
+                out->i = a > b;
+                break;
+            default:
+                out->i = a >= b;
+                break;
+            }
+            return ceval_coerce(m, at, out, NULL, result_ty);
         }
-        else
+        out->kind = CEVAL_FLOAT;
+        switch (op)
         {
-            diag_error_at(decl ? decl->src : unit->src,
-                          decl ? decl->line : unit->line,
-                          decl ? decl->col : unit->col,
-                          "unsupported top-level declaration");
-            return 1;
+        case ND_ADD:
+            out->f = a + b;
+            break;
+        case ND_SUB:
+            out->f = a - b;
+            break;
+        case ND_MUL:
+            out->f = a * b;
+            break;
+        case ND_DIV:
+            out->f = a / b;
+            break;
+        default:
+            return ceval_fail(m, at, "%s does not apply to floating-point values", node_kind_name(op));
         }
+        return ceval_coerce(m, at, out, NULL, result_ty);
     }
 
-    
-    for (int i = 0; i < unit->stmt_count; i++)
+    int64_t a = lhs->i;
+    int64_t b = rhs->i;
+    if (is_compare)
     {
-        Node *decl = unit->stmts[i];
-        if (!decl)
-            continue;
-        if (decl->kind == ND_FUNC)
-        {
-            if (check_exposed_function_signature(decl))
-                return 1;
-            if (sema_check_function(sc, decl))
-                return 1;
-        }
-        else if (decl->kind == ND_VAR_DECL && decl->var_is_global)
+        Type *common = ceval_common_int_type(ceval_canonical(lhs_ty), ceval_canonical(rhs_ty));
+        int is_unsigned = inline_type_is_unsigned(common);
+        a = inline_normalize_value(a, common);
+        b = inline_normalize_value(b, common);
+        int lt = is_unsigned ? (uint64_t)a < (uint64_t)b : a < b;
+        switch (op)
         {
-            if (sema_check_global_decl(sc, decl))
-                return 1;
+        case ND_EQ:
+        case ND_STRICT_EQ:
+            out->i = a == b;
+            break;
+        case ND_NE:
+            out->i = a != b;
+            break;
+        case ND_LT:
+            out->i = lt;
+            break;
+        case ND_LE:
+            out->i = lt || a == b;
+            break;
+        case ND_GT_EXPR:
+            out->i = !lt && a != b;
+            break;
+        default:
+            out->i = !lt;
+            break;
         }
+        return ceval_coerce(m, at, out, NULL, result_ty);
     }
 
-    analyze_inline_candidates(unit);
-    sc->unit = previous_unit;
-    return 0;
+    int is_unsigned = inline_type_is_unsigned(result_ty);
+    uint64_t ua = (uint64_t)a;
+    uint64_t ub = (uint64_t)b;
+    switch (op)
+    {
+    case ND_ADD:
+        out->i = (int64_t)(ua + ub);
+        break;
+    case ND_SUB:
+        out->i = (int64_t)(ua - ub);
+        break;
+    case ND_MUL:
+        out->i = (int64_t)(ua * ub);
+        break;
+    case ND_DIV:
+    case ND_MOD:
+        if (b == 0)
+            return ceval_fail(m, at, "division by zero");
+        if (is_unsigned)
+            out->i = (int64_t)(op == ND_DIV ? ua / ub : ua % ub);
+        else if (b == -1)
+            out->i = op == ND_DIV ? (int64_t)(0 - ua) : 0;
+        else
+            out->i = op == ND_DIV ? a / b : a % b;
+        break;
+    case ND_SHL:
+        out->i = (int64_t)(ua << (b & 63));
+        break;
+    case ND_SHR:
+        if (inline_type_is_unsigned(lhs_ty))
+            out->i = (int64_t)(ua >> (b & 63));
+        else
+            out->i = a >> (b & 63);
+        break;
+    case ND_BITAND:
+        out->i = a & b;
+        break;
+    case ND_BITOR:
+        out->i = a | b;
+        break;
+    case ND_BITXOR:
+        out->i = a ^ b;
+        break;
+    default:
+        return ceval_fail(m, at, "%s cannot be evaluated at compile time", node_kind_name(op));
+    }
+    return ceval_coerce(m, at, out, NULL, result_ty);
 }
 
-static int inline_type_supported(Type *ty)
+static CevalLocal *ceval_find_local(CevalMachine *m, const char *name)
 {
-    if (!ty)
-        return 1;
-    ty = canonicalize_type_deep(ty);
-    if (!ty)
-        return 1;
-    if (ty->kind == TY_STRUCT || ty->kind == TY_ARRAY)
-        return 0;
-    return 1;
+    if (!name)
+        return NULL;
+    for (int i = m->local_count - 1; i >= m->frame_base; --i)
+    {
+        if (m->locals[i].name && strcmp(m->locals[i].name, name) == 0)
+            return &m->locals[i];
+    }
+    return NULL;
 }
 
-static int inline_type_is_unsigned(Type *ty)
+static void ceval_push_local(CevalMachine *m, const char *name, Type *ty, CevalValue value)
 {
-    ty = canonicalize_type_deep(ty);
-    if (!ty)
-        return 0;
-    switch (ty->kind)
+    if (m->local_count == m->local_cap)
     {
-    case TY_U8:
-    case TY_U16:
-    case TY_U32:
-    case TY_U64:
-        return 1;
-    default:
-        return 0;
+        int new_cap = m->local_cap ? m->local_cap * 2 : 32;
+        CevalLocal *grown = (CevalLocal *)realloc(m->locals, (size_t)new_cap * sizeof(CevalLocal));
+        if (!grown)
+        {
+            diag_error("out of memory during compile-time evaluation");
+            sema_abort();
+        }
+        m->locals = grown;
+        m->local_cap = new_cap;
     }
+    CevalLocal *local = &m->locals[m->local_count++];
+    local->name = name;
+    local->type = ty;
+    local->value = value;
 }
 
-static int inline_type_bit_width(Type *ty)
+static void ceval_pop_locals(CevalMachine *m, int mark)
 {
-    ty = canonicalize_type_deep(ty);
-    if (!ty)
+    while (m->local_count > mark)
+        ceval_release(m, &m->locals[--m->local_count].value);
+}
+
+static int ceval_init_list(CevalMachine *m, const Node *init, Type *ty, CevalValue *out)
+{
+    ty = ceval_canonical(ty);
+    if (!ceval_zero(m, init, ty, out))
         return 0;
-    switch (ty->kind)
-    {
-    case TY_BOOL:
+    if (init->init.is_zero)
         return 1;
-    case TY_CHAR:
-    case TY_I8:
-    case TY_U8:
-        return 8;
-    case TY_I16:
-    case TY_U16:
-        return 16;
-    case TY_I32:
-    case TY_U32:
-        return 32;
-    case TY_I64:
-    case TY_U64:
-        return 64;
-    default:
-        return 0;
+    if (out->kind != CEVAL_AGGREGATE)
+    {
+        ceval_release(m, out);
+        return ceval_fail(m, init, "initializer list for a non-aggregate type");
+    }
+    for (int i = 0; i < init->init.count; ++i)
+    {
+        const Node *elem = init->init.elems ? init->init.elems[i] : NULL;
+        int slot = i;
+        if (ty->kind == TY_STRUCT && init->init.field_indices)
+            slot = init->init.field_indices[i];
+        if (!elem || slot < 0 || slot >= out->count)
+        {
+            ceval_release(m, out);
+            return ceval_fail(m, init, "too many initializer elements");
+        }
+        Type *elem_ty = ty->kind == TY_STRUCT ? ty->strct.field_types[slot] : ty->array.elem;
+        CevalValue v;
+        int ok = elem->kind == ND_INIT_LIST ? ceval_init_list(m, elem, elem_ty, &v)
+                                            : ceval_expr_as(m, elem, elem_ty, &v);
+        if (!ok)
+        {
+            ceval_release(m, out);
+            return 0;
+        }
+        ceval_release(m, &out->elems[slot]);
+        out->elems[slot] = v;
     }
+    return 1;
 }
 
-static int64_t inline_normalize_value(int64_t value, Type *ty)
+static int ceval_global(CevalMachine *m, const Node *e, CevalValue **out_ref)
 {
-    if (!ty)
-        return value;
-    ty = canonicalize_type_deep(ty);
-    if (!ty)
-        return value;
-    int width = inline_type_bit_width(ty);
-    if (width <= 0)
-        return value;
-    if (width == 1 || ty->kind == TY_BOOL)
-        return value ? 1 : 0;
-    if (width >= 64)
-        return value;
-    uint64_t mask = (1ULL << width) - 1ULL;
-    uint64_t uv = ((uint64_t)value) & mask;
-    if (inline_type_is_unsigned(ty))
-        return (int64_t)uv;
-    uint64_t sign_bit = 1ULL << (width - 1);
-    if (uv & sign_bit)
-        uv |= (~mask);
-    return (int64_t)uv;
-}
+    const Symbol *sym = (m->sc && m->sc->syms && e->var_ref) ? symtab_get(m->sc->syms, e->var_ref) : NULL;
+    Node *decl = (sym && sym->kind == SYM_GLOBAL) ? sym->ast_node : NULL;
+    if (!decl || !decl->var_is_const)
+        return ceval_fail(m, e, "only constant globals can be read at compile time ('%s')",
+                          e->var_ref ? e->var_ref : "<global>");
 
-static Node *inline_make_conditional(Node *cond, Node *then_expr, Node *else_expr, Type *ret_type)
-{
-    if (!cond || !then_expr || !else_expr)
-        return NULL;
-    Node *n = (Node *)xcalloc(1, sizeof(Node));
-    n->kind = ND_COND;
-    n->lhs = cond;
-    n->rhs = then_expr;
-    n->body = else_expr;
-    n->type = canonicalize_type_deep(ret_type);
-    if (cond->src)
+    for (CevalGlobal *g = m->globals; g; g = g->next)
     {
-        n->src = cond->src;
-        n->line = cond->line;
-        n->col = cond->col;
+        if (g->decl == decl)
+        {
+            *out_ref = &g->value;
+            return 1;
+        }
     }
-    else if (then_expr->src)
+
+    for (int i = 0; i < sema_eval_pending_count; ++i)
     {
-        n->src = then_expr->src;
-        n->line = then_expr->line;
-        n->col = then_expr->col;
+        if (sema_eval_pending[i].decl == decl && !sema_eval_fold_global(m, &sema_eval_pending[i]))
+            return 0;
     }
-    else if (else_expr->src)
+
+    CevalValue value;
+    int saved_base = m->frame_base;
+    m->frame_base = m->local_count;
+    int ok;
+    if (!decl->rhs)
+        ok = ceval_zero(m, e, decl->var_type, &value);
+    else if (decl->rhs->kind == ND_INIT_LIST)
+        ok = ceval_init_list(m, decl->rhs, decl->var_type, &value);
+    else
+        ok = ceval_expr_as(m, decl->rhs, decl->var_type, &value);
+    m->frame_base = saved_base;
+    if (!ok)
+        return 0;
+
+    CevalGlobal *g = (CevalGlobal *)xcalloc(1, sizeof(CevalGlobal));
+    g->decl = decl;
+    g->value = value;
+    g->next = m->globals;
+    m->globals = g;
+    *out_ref = &g->value;
+    return 1;
+}
+
+static int ceval_index_value(CevalMachine *m, const Node *e, int64_t *out_index)
+{
+    CevalValue idx;
+    if (!ceval_expr(m, e->rhs, &idx))
+        return 0;
+    if (idx.kind != CEVAL_INT)
     {
-        n->src = else_expr->src;
-        n->line = else_expr->line;
-        n->col = else_expr->col;
+        ceval_release(m, &idx);
+        return ceval_fail(m, e->rhs, "array index is not an integer");
     }
-    return n;
+    *out_index = idx.i;
+    if (inline_type_is_unsigned(e->rhs->type) && idx.i < 0)
+        *out_index = INT64_MAX;
+    return 1;
 }
 
-static Node *inline_stmt_to_expr(const Node *stmt, Node *tail_expr, Type *ret_type)
+/* Resolves an addressable expression to the storage it names. Index operands
+   are evaluated before the base is looked up: evaluating them may call
+   functions, which grows the local stack and would move the base. */
+static CevalValue *ceval_lvalue(CevalMachine *m, const Node *e)
 {
-    if (!stmt)
-        return NULL;
-
-    switch (stmt->kind)
+    switch (e->kind)
     {
-    case ND_BLOCK:
+    case ND_VAR:
     {
-        Node *expr = tail_expr;
-        for (int i = stmt->stmt_count - 1; i >= 0; --i)
+        if (e->var_is_global)
         {
-            expr = inline_stmt_to_expr(stmt->stmts[i], expr, ret_type);
-            if (!expr)
-                return NULL;
+            ceval_fail(m, e, "global '%s' cannot be modified at compile time", e->var_ref ? e->var_ref : "<global>");
+            return NULL;
         }
-        return expr;
+        CevalLocal *local = ceval_find_local(m, e->var_ref);
+        if (!local)
+            ceval_fail(m, e, "unknown variable '%s'", e->var_ref ? e->var_ref : "<null>");
+        return local ? &local->value : NULL;
     }
-    case ND_RET:
-        if (!stmt->lhs)
-            return NULL;
-        if (tail_expr)
-            return NULL;
-        return stmt->lhs;
-    case ND_IF:
+    case ND_INDEX:
     {
-        Node *cond = stmt->lhs ? (Node *)stmt->lhs : NULL;
-        if (!cond)
+        int64_t index = 0;
+        if (!ceval_index_value(m, e, &index))
             return NULL;
-        Node *then_expr = inline_stmt_to_expr(stmt->rhs, NULL, ret_type);
-        if (!then_expr)
+        CevalValue *base = ceval_lvalue(m, e->lhs);
+        if (!base)
             return NULL;
-        Node *else_expr = NULL;
-        if (stmt->body)
+        if (base->kind != CEVAL_AGGREGATE)
         {
-            if (tail_expr)
-                return NULL;
-            else_expr = inline_stmt_to_expr(stmt->body, NULL, ret_type);
-            if (!else_expr)
-                return NULL;
+            ceval_fail(m, e, "only array elements can be assigned at compile time");
+            return NULL;
         }
-        else
+        if (index < 0 || index >= base->count)
         {
-            if (!tail_expr)
-                return NULL;
-            else_expr = tail_expr;
+            ceval_fail(m, e, "index %lld is out of bounds for length %d", (long long)index, base->count);
+            return NULL;
         }
-        return inline_make_conditional(cond, then_expr, else_expr, ret_type);
+        return &base->elems[index];
+    }
+    case ND_MEMBER:
+    {
+        if (e->is_pointer_deref)
+        {
+            ceval_fail(m, e, "'->' cannot be evaluated at compile time");
+            return NULL;
+        }
+        CevalValue *base = ceval_lvalue(m, e->lhs);
+        if (!base)
+            return NULL;
+        if (base->kind != CEVAL_AGGREGATE || e->field_index < 0 || e->field_index >= base->count)
+        {
+            ceval_fail(m, e, "field '%s' cannot be assigned at compile time", e->field_name ? e->field_name : "<anon>");
+            return NULL;
+        }
+        return &base->elems[e->field_index];
     }
+    case ND_DEREF:
+        ceval_fail(m, e, "pointer dereference cannot be evaluated at compile time");
+        return NULL;
     default:
+        ceval_fail(m, e, "expression is not assignable at compile time");
         return NULL;
     }
 }
 
-static const Node *inline_extract_return_expr(const Node *fn)
+/* Like ceval_lvalue but for reads: returns storage inside a local or global
+   where possible so indexing a large table does not copy it, falling back to
+   evaluating into `tmp`. The caller releases `tmp` after using the result. */
+static const CevalValue *ceval_ref(CevalMachine *m, const Node *e, CevalValue *tmp)
 {
-    if (!fn || fn->kind != ND_FUNC || !fn->body)
-        return NULL;
-    const Node *body = fn->body;
-    if (body->kind != ND_BLOCK)
-        return NULL;
-    Node *expr = NULL;
-    for (int i = body->stmt_count - 1; i >= 0; --i)
+    memset(tmp, 0, sizeof(*tmp));
+    switch (e->kind)
     {
-        const Node *stmt = body->stmts ? body->stmts[i] : NULL;
-        expr = inline_stmt_to_expr(stmt, expr, fn->ret_type);
-        if (!expr)
+    case ND_VAR:
+        if (e->var_is_function)
+        {
+            ceval_fail(m, e, "function values cannot be evaluated at compile time");
+            return NULL;
+        }
+        if (e->var_is_global)
+        {
+            CevalValue *ref = NULL;
+            return ceval_global(m, e, &ref) ? ref : NULL;
+        }
+        return ceval_lvalue(m, e);
+    case ND_INDEX:
+    {
+        int64_t index = 0;
+        if (!ceval_index_value(m, e, &index))
+            return NULL;
+        const CevalValue *base = ceval_ref(m, e->lhs, tmp);
+        if (!base)
+            return NULL;
+        if (base->kind == CEVAL_STRING)
+        {
+            if (!base->str || index < 0 || index > base->str_len)
+            {
+                ceval_fail(m, e, "string index %lld is out of bounds", (long long)index);
+                return NULL;
+            }
+            int64_t ch = index < base->str_len ? (unsigned char)base->str[index] : 0;
+            ceval_release(m, tmp);
+            memset(tmp, 0, sizeof(*tmp));
+            tmp->i = inline_normalize_value(ch, e->type);
+            return tmp;
+        }
+        if (base->kind != CEVAL_AGGREGATE)
+        {
+            ceval_fail(m, e, "pointer indexing cannot be evaluated at compile time");
+            return NULL;
+        }
+        if (index < 0 || index >= base->count)
+        {
+            ceval_fail(m, e, "index %lld is out of bounds for length %d", (long long)index, base->count);
             return NULL;
+        }
+        return &base->elems[index];
+    }
+    case ND_MEMBER:
+    {
+        if (e->is_pointer_deref)
+        {
+            ceval_fail(m, e, "'->' cannot be evaluated at compile time");
+            return NULL;
+        }
+        const CevalValue *base = ceval_ref(m, e->lhs, tmp);
+        if (!base)
+            return NULL;
+        if (e->field_index < 0)
+        {
+            int64_t length = base->kind == CEVAL_STRING ? base->str_len : base->count;
+            if (base->kind == CEVAL_INT || base->kind == CEVAL_FLOAT ||
+                (base->kind == CEVAL_STRING && !base->str))
+            {
+                ceval_fail(m, e, "'.%s' cannot be evaluated at compile time", e->field_name ? e->field_name : "length");
+                return NULL;
+            }
+            ceval_release(m, tmp);
+            tmp->kind = CEVAL_INT;
+            tmp->i = inline_normalize_value(length, e->type);
+            return tmp;
+        }
+        if (base->kind != CEVAL_AGGREGATE || e->field_index >= base->count)
+        {
+            ceval_fail(m, e, "field '%s' cannot be read at compile time", e->field_name ? e->field_name : "<anon>");
+            return NULL;
+        }
+        return &base->elems[e->field_index];
+    }
+    default:
+        return ceval_expr(m, e, tmp) ? tmp : NULL;
     }
-    return expr;
 }
 
-typedef struct InlineBinding
+static NodeKind ceval_compound_op(NodeKind kind)
 {
-    const char *name;
-    int64_t value;
-    Type *type;
-} InlineBinding;
+    switch (kind)
+    {
+    case ND_ADD_ASSIGN:
+        return ND_ADD;
+    case ND_SUB_ASSIGN:
+        return ND_SUB;
+    case ND_MUL_ASSIGN:
+        return ND_MUL;
+    case ND_DIV_ASSIGN:
+        return ND_DIV;
+    case ND_MOD_ASSIGN:
+        return ND_MOD;
+    case ND_BITAND_ASSIGN:
+        return ND_BITAND;
+    case ND_BITOR_ASSIGN:
+        return ND_BITOR;
+    case ND_BITXOR_ASSIGN:
+        return ND_BITXOR;
+    case ND_SHL_ASSIGN:
+        return ND_SHL;
+    case ND_SHR_ASSIGN:
+        return ND_SHR;
+    default:
+        return kind;
+    }
+}
 
-static int inline_lookup_binding(const InlineBinding *bindings, int count, const char *name, int64_t *out_value, Type **out_type)
+/* Assignments, compound assignments and ++/--. `out` may be NULL when the
+   result is discarded, which saves copying aggregates in statement position. */
+static int ceval_update(CevalMachine *m, const Node *e, CevalValue *out)
 {
-    if (!bindings || count <= 0 || !name)
-        return 0;
-    for (int i = 0; i < count; ++i)
+    Type *target_ty = e->lhs ? e->lhs->type : NULL;
+    CevalValue *slot = NULL;
+    if (e->kind == ND_ASSIGN)
     {
-        if (bindings[i].name && strcmp(bindings[i].name, name) == 0)
+        CevalValue v;
+        if (!ceval_expr_as(m, e->rhs, target_ty, &v))
+            return 0;
+        slot = ceval_lvalue(m, e->lhs);
+        if (!slot)
         {
-            if (out_value)
-                *out_value = bindings[i].value;
-            if (out_type)
-                *out_type = bindings[i].type;
-            return 1;
+            ceval_release(m, &v);
+            return 0;
         }
+        ceval_release(m, slot);
+        *slot = v;
+        return out ? ceval_copy(m, e, slot, out) : 1;
     }
-    return 0;
-}
 
-static int inline_eval_const_expr(const Node *expr,
-                                  const InlineBinding *bindings,
-                                  int binding_count,
-                                  int depth,
-                                  int64_t *out_value);
+    if (e->kind == ND_PREINC || e->kind == ND_PREDEC || e->kind == ND_POSTINC || e->kind == ND_POSTDEC)
+    {
+        slot = ceval_lvalue(m, e->lhs);
+        if (!slot)
+            return 0;
+        CevalValue old = *slot;
+        int delta = (e->kind == ND_PREINC || e->kind == ND_POSTINC) ? 1 : -1;
+        if (slot->kind == CEVAL_INT)
+        {
+            slot->i = inline_normalize_value((int64_t)((uint64_t)slot->i + (uint64_t)(int64_t)delta), target_ty);
+        }
+        else if (slot->kind == CEVAL_FLOAT)
+        {
+            slot->f += delta;
+            ceval_coerce(m, e, slot, NULL, target_ty);
+        }
+        else
+            return ceval_fail(m, e, "%s cannot be evaluated at compile time on this operand",
+                              node_kind_name(e->kind));
+        if (out)
+            *out = (e->kind == ND_PREINC || e->kind == ND_PREDEC) ? *slot : old;
+        return 1;
+    }
 
-static int inline_eval_inline_call(const Node *call_expr,
-                                   const InlineBinding *bindings,
-                                   int binding_count,
-                                   int depth,
-                                   int64_t *out_value)
-{
-    if (!call_expr || !out_value)
+    CevalValue rhs;
+    if (!ceval_expr(m, e->rhs, &rhs))
         return 0;
-    if (!call_expr->call_target || call_expr->call_is_indirect)
-        return 0;
-    const Node *fn = call_expr->call_target;
-    if (!fn->inline_candidate || !fn->inline_expr)
-        return 0;
-    if (!fn->ret_type || !type_is_int(fn->ret_type))
-        return 0;
-    if (fn->param_count != call_expr->arg_count)
+    slot = ceval_lvalue(m, e->lhs);
+    if (!slot)
+    {
+        ceval_release(m, &rhs);
         return 0;
-    if (fn->param_count > INLINE_PARAM_LIMIT)
+    }
+    CevalValue result;
+    int ok = ceval_binary(m, e, ceval_compound_op(e->kind), slot, target_ty, &rhs,
+                          e->rhs ? e->rhs->type : NULL, target_ty, &result);
+    ceval_release(m, &rhs);
+    if (!ok)
         return 0;
+    *slot = result;
+    if (out)
+        *out = result;
+    return 1;
+}
 
-    InlineBinding params[INLINE_PARAM_LIMIT];
-    for (int i = 0; i < fn->param_count; ++i)
+static size_t ceval_memo_hash(const Node *fn, const CevalValue *args, int count)
+{
+    size_t h = (size_t)1469598103934665603ULL ^ (size_t)(uintptr_t)fn;
+    for (int i = 0; i < count; ++i)
     {
-        const Node *arg = (call_expr->args && i < call_expr->arg_count) ? call_expr->args[i] : NULL;
-        if (!arg)
-            return 0;
-        const char *param_name = (fn->param_names && i < fn->param_count) ? fn->param_names[i] : NULL;
-        if (!param_name)
+        uint64_t bits = 0;
+        if (args[i].kind == CEVAL_FLOAT)
+            memcpy(&bits, &args[i].f, sizeof(bits));
+        else if (args[i].kind == CEVAL_STRING)
+            bits = (uint64_t)(uintptr_t)args[i].str;
+        else
+            bits = (uint64_t)args[i].i;
+        h = (h ^ (size_t)args[i].kind) * (size_t)1099511628211ULL;
+        h = (h ^ (size_t)bits) * (size_t)1099511628211ULL;
+        h = (h ^ (size_t)(bits >> 32)) * (size_t)1099511628211ULL;
+    }
+    return h;
+}
+
+static int ceval_memo_equal(const CevalMemo *memo, const Node *fn, const CevalValue *args, int count, size_t hash)
+{
+    if (memo->fn != fn || memo->hash != hash || memo->arg_count != count)
+        return 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const CevalValue *a = &memo->args[i];
+        const CevalValue *b = &args[i];
+        if (a->kind != b->kind || a->i != b->i || a->str != b->str ||
+            memcmp(&a->f, &b->f, sizeof(a->f)) != 0)
             return 0;
-        int64_t arg_value = 0;
-        if (!inline_eval_const_expr(arg, bindings, binding_count, depth + 1, &arg_value))
+    }
+    return 1;
+}
+
+static int ceval_call(CevalMachine *m, const Node *call, CevalValue *out)
+{
+    const Node *fn = call->call_target;
+    if (call->call_is_indirect || call->call_is_jump || !fn || fn->kind != ND_FUNC)
+        return ceval_fail(m, call, "only direct calls can be evaluated at compile time");
+    const char *name = fn->name ? fn->name : "<anon>";
+    if (!fn->body || fn->is_chancecode || fn->is_literal || !fn->eval_checked)
+        return ceval_fail(m, call, "'%s' has no body that can be evaluated at compile time", name);
+    if (fn->is_varargs || call->arg_count != fn->param_count)
+        return ceval_fail(m, call, "variadic call to '%s' cannot be evaluated at compile time", name);
+    if (m->depth >= CEVAL_MAX_CALL_DEPTH)
+        return ceval_fail(m, call, "call depth limit of %d exceeded in '%s'", CEVAL_MAX_CALL_DEPTH, name);
+
+    int count = fn->param_count;
+    CevalValue *args = (CevalValue *)xcalloc((size_t)(count > 0 ? count : 1), sizeof(CevalValue));
+    int memoizable = 1;
+    for (int i = 0; i < count; ++i)
+    {
+        if (!ceval_expr_as(m, call->args[i], fn->param_types[i], &args[i]))
+        {
+            for (int k = 0; k < i; ++k)
+                ceval_release(m, &args[k]);
+            free(args);
             return 0;
-        Type *param_type = (fn->param_types && i < fn->param_count) ? fn->param_types[i] : NULL;
-        params[i].name = param_name;
-        params[i].value = inline_normalize_value(arg_value, param_type);
-        params[i].type = param_type;
+        }
+        if (args[i].kind == CEVAL_AGGREGATE)
+            memoizable = 0;
     }
 
-    int64_t result = 0;
-    if (!inline_eval_const_expr(fn->inline_expr, params, fn->param_count, depth + 1, &result))
+    size_t hash = memoizable ? ceval_memo_hash(fn, args, count) : 0;
+    if (memoizable)
+    {
+        for (CevalMemo *memo = m->memo[hash % CEVAL_MEMO_BUCKETS]; memo; memo = memo->next)
+        {
+            if (ceval_memo_equal(memo, fn, args, count, hash))
+            {
+                free(args);
+                m->memo_hits++;
+                return ceval_copy(m, call, &memo->result, out);
+            }
+        }
+    }
+
+    CevalValue *key = NULL;
+    if (memoizable)
+    {
+        key = (CevalValue *)xcalloc((size_t)(count > 0 ? count : 1), sizeof(CevalValue));
+        memcpy(key, args, (size_t)count * sizeof(CevalValue));
+    }
+
+    int saved_base = m->frame_base;
+    const Node *saved_fn = m->fn;
+    int base = m->local_count;
+    for (int i = 0; i < count; ++i)
+        ceval_push_local(m, fn->param_names[i], fn->param_types[i], args[i]);
+    free(args);
+    m->frame_base = base;
+    m->fn = fn;
+    m->depth++;
+    CevalFlow flow = ceval_stmt(m, fn->body);
+    m->depth--;
+    ceval_pop_locals(m, base);
+    m->frame_base = saved_base;
+    m->fn = saved_fn;
+
+    int ok = 1;
+    if (flow == CEVAL_FLOW_FAIL)
+    {
+        ok = 0;
+    }
+    else if (flow == CEVAL_FLOW_RETURN)
+    {
+        *out = m->ret;
+        memset(&m->ret, 0, sizeof(m->ret));
+    }
+    else if (ceval_canonical(fn->ret_type) && ceval_canonical(fn->ret_type)->kind == TY_VOID)
+    {
+        memset(out, 0, sizeof(*out));
+    }
+    else
+    {
+        ok = ceval_fail(m, call, "'%s' finished without returning a value", name);
+    }
+
+    if (!ok || !memoizable)
+    {
+        free(key);
+        return ok;
+    }
+    CevalMemo *memo = (CevalMemo *)xcalloc(1, sizeof(CevalMemo));
+    if (!ceval_copy(m, call, out, &memo->result))
+    {
+        free(memo);
+        free(key);
+        ceval_release(m, out);
         return 0;
-    *out_value = inline_normalize_value(result, fn->ret_type);
+    }
+    memo->fn = fn;
+    memo->args = key;
+    memo->arg_count = count;
+    memo->hash = hash;
+    memo->next = m->memo[hash % CEVAL_MEMO_BUCKETS];
+    m->memo[hash % CEVAL_MEMO_BUCKETS] = memo;
     return 1;
 }
 
-static int inline_eval_const_expr(const Node *expr,
-                                  const InlineBinding *bindings,
-                                  int binding_count,
-                                  int depth,
-                                  int64_t *out_value)
+static int ceval_expr(CevalMachine *m, const Node *e, CevalValue *out)
 {
-    if (!expr || !out_value)
-        return 0;
-    if (depth > INLINE_EVAL_MAX_DEPTH)
+    memset(out, 0, sizeof(*out));
+    if (!e)
+        return ceval_fail(m, NULL, "missing expression");
+    if (!ceval_tick(m, e))
         return 0;
 
-    switch (expr->kind)
+    switch (e->kind)
     {
     case ND_INT:
-        *out_value = inline_normalize_value(expr->int_val, expr->type);
+    case ND_SIZEOF:
+    case ND_ALIGNOF:
+    case ND_OFFSETOF:
+    {
+        int64_t value = e->int_val;
+        if (e->kind == ND_INT && inline_type_is_unsigned(e->type) && e->int_uval)
+            value = (int64_t)e->int_uval;
+        out->i = inline_normalize_value(value, e->type);
+        return 1;
+    }
+    case ND_FLOAT:
+        out->kind = CEVAL_FLOAT;
+        out->f = e->float_val;
+        return ceval_coerce(m, e, out, NULL, e->type);
+    case ND_STRING:
+        out->kind = CEVAL_STRING;
+        out->str = e->str_data;
+        out->str_len = e->str_len;
+        return 1;
+    case ND_NULL:
         return 1;
     case ND_VAR:
+    case ND_INDEX:
+    case ND_MEMBER:
     {
-        int64_t value = 0;
-        Type *ty = expr->type;
-        if (expr->var_ref && inline_lookup_binding(bindings, binding_count, expr->var_ref, &value, &ty))
+        CevalValue tmp;
+        const CevalValue *ref = ceval_ref(m, e, &tmp);
+        if (!ref)
         {
-            *out_value = inline_normalize_value(value, ty ? ty : expr->type);
+            ceval_release(m, &tmp);
+            return 0;
+        }
+        if (ref == &tmp)
+        {
+            *out = tmp;
             return 1;
         }
-        return 0;
+        int ok = ceval_copy(m, e, ref, out);
+        ceval_release(m, &tmp);
+        return ok;
     }
+    case ND_INIT_LIST:
+        return ceval_init_list(m, e, e->type, out);
     case ND_NEG:
-    {
-        int64_t lhs = 0;
-        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
-            return 0;
-        *out_value = inline_normalize_value(-lhs, expr->type);
-        return 1;
-    }
     case ND_BITNOT:
-    {
-        int64_t lhs = 0;
-        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
-            return 0;
-        *out_value = inline_normalize_value(~lhs, expr->type);
-        return 1;
-    }
     case ND_LNOT:
     {
-        int64_t lhs = 0;
-        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
+        if (e->kind == ND_LNOT)
+        {
+            int truth = 0;
+            if (!ceval_truth(m, e->lhs, &truth))
+                return 0;
+            out->i = !truth;
+            return ceval_coerce(m, e, out, NULL, e->type);
+        }
+        if (!ceval_expr(m, e->lhs, out))
             return 0;
-        *out_value = inline_normalize_value(!lhs, expr->type);
-        return 1;
+        if (out->kind == CEVAL_FLOAT && e->kind == ND_NEG)
+        {
+            out->f = -out->f;
+            return ceval_coerce(m, e, out, NULL, e->type);
+        }
+        if (out->kind != CEVAL_INT)
+        {
+            ceval_release(m, out);
+            return ceval_fail(m, e, "%s cannot be evaluated at compile time on this operand",
+                              node_kind_name(e->kind));
+        }
+        out->i = e->kind == ND_NEG ? (int64_t)(0 - (uint64_t)out->i) : ~out->i;
+        return ceval_coerce(m, e, out, e->lhs->type, e->type);
     }
     case ND_ADD:
     case ND_SUB:
@@ -7158,291 +8546,2292 @@ static int inline_eval_const_expr(const Node *expr,
     case ND_BITAND:
     case ND_BITOR:
     case ND_BITXOR:
+    case ND_EQ:
+    case ND_STRICT_EQ:
+    case ND_NE:
+    case ND_LT:
+    case ND_LE:
+    case ND_GT_EXPR:
+    case ND_GE:
     {
-        int64_t lhs = 0;
-        int64_t rhs = 0;
-        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
+        CevalValue lhs;
+        CevalValue rhs;
+        if (!ceval_expr(m, e->lhs, &lhs))
             return 0;
-        if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, &rhs))
+        if (!ceval_expr(m, e->rhs, &rhs))
+        {
+            ceval_release(m, &lhs);
             return 0;
-        int64_t result = 0;
-        switch (expr->kind)
+        }
+        int ok = ceval_binary(m, e, e->kind, &lhs, e->lhs->type, &rhs, e->rhs->type, e->type, out);
+        ceval_release(m, &lhs);
+        ceval_release(m, &rhs);
+        return ok;
+    }
+    case ND_LAND:
+    case ND_LOR:
+    {
+        int truth = 0;
+        if (!ceval_truth(m, e->lhs, &truth))
+            return 0;
+        if (truth == (e->kind == ND_LAND) && !ceval_truth(m, e->rhs, &truth))
+            return 0;
+        out->i = truth;
+        return ceval_coerce(m, e, out, NULL, e->type);
+    }
+    case ND_COND:
+    {
+        int truth = 0;
+        if (!ceval_truth(m, e->lhs, &truth))
+            return 0;
+        return ceval_expr_as(m, truth ? e->rhs : e->body, e->type, out);
+    }
+    case ND_CAST:
+        return ceval_expr_as(m, e->lhs, e->type, out);
+    case ND_ASSIGN:
+    case ND_ADD_ASSIGN:
+    case ND_SUB_ASSIGN:
+    case ND_MUL_ASSIGN:
+    case ND_DIV_ASSIGN:
+    case ND_MOD_ASSIGN:
+    case ND_BITAND_ASSIGN:
+    case ND_BITOR_ASSIGN:
+    case ND_BITXOR_ASSIGN:
+    case ND_SHL_ASSIGN:
+    case ND_SHR_ASSIGN:
+    case ND_PREINC:
+    case ND_PREDEC:
+    case ND_POSTINC:
+    case ND_POSTDEC:
+        return ceval_update(m, e, out);
+    case ND_CALL:
+        return ceval_call(m, e, out);
+    default:
+        return ceval_fail(m, e, "%s cannot be evaluated at compile time", node_kind_name(e->kind));
+    }
+}
+
+static int ceval_is_update(const Node *e)
+{
+    switch (e->kind)
+    {
+    case ND_ASSIGN:
+    case ND_ADD_ASSIGN:
+    case ND_SUB_ASSIGN:
+    case ND_MUL_ASSIGN:
+    case ND_DIV_ASSIGN:
+    case ND_MOD_ASSIGN:
+    case ND_BITAND_ASSIGN:
+    case ND_BITOR_ASSIGN:
+    case ND_BITXOR_ASSIGN:
+    case ND_SHL_ASSIGN:
+    case ND_SHR_ASSIGN:
+    case ND_PREINC:
+    case ND_PREDEC:
+    case ND_POSTINC:
+    case ND_POSTDEC:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static CevalFlow ceval_switch(CevalMachine *m, const Node *s)
+{
+    CevalValue selector;
+    if (!ceval_expr(m, s->switch_stmt.expr, &selector))
+        return CEVAL_FLOW_FAIL;
+    if (selector.kind != CEVAL_INT)
+    {
+        ceval_release(m, &selector);
+        ceval_fail(m, s, "switch selector is not an integer");
+        return CEVAL_FLOW_FAIL;
+    }
+    Type *selector_ty = s->switch_stmt.expr->type;
+    int start = -1;
+    int fallback = -1;
+    for (int i = 0; i < s->switch_stmt.case_count && start < 0; ++i)
+    {
+        const SwitchCase *entry = &s->switch_stmt.cases[i];
+        if (entry->is_default)
         {
-        case ND_ADD:
-            result = lhs + rhs;
-            break;
-        case ND_SUB:
-            result = lhs - rhs;
-            break;
-        case ND_MUL:
-            result = lhs * rhs;
-            break;
-        case ND_DIV:
-            if (rhs == 0)
-                return 0;
-            result = lhs / rhs;
-            break;
-        case ND_MOD:
-            if (rhs == 0)
-                return 0;
-            result = lhs % rhs;
-            break;
-        case ND_SHL:
-            result = lhs << (int)(rhs & 63);
-            break;
-        case ND_SHR:
-            if (inline_type_is_unsigned(expr->lhs ? expr->lhs->type : NULL))
-                result = ((uint64_t)lhs) >> (int)(rhs & 63);
-            else
-                result = lhs >> (int)(rhs & 63);
-            break;
-        case ND_BITAND:
-            result = lhs & rhs;
-            break;
-        case ND_BITOR:
-            result = lhs | rhs;
-            break;
-        case ND_BITXOR:
-            result = lhs ^ rhs;
+            fallback = i;
+            continue;
+        }
+        CevalValue value;
+        if (!ceval_expr_as(m, entry->value, selector_ty, &value))
+            return CEVAL_FLOW_FAIL;
+        if (value.kind == CEVAL_INT && value.i == selector.i)
+            start = i;
+    }
+    if (start < 0)
+    {
+        for (int i = 0; i < s->switch_stmt.case_count && fallback < 0; ++i)
+        {
+            if (s->switch_stmt.cases[i].is_default)
+                fallback = i;
+        }
+        start = fallback;
+    }
+    if (start < 0)
+        return CEVAL_FLOW_NEXT;
+    for (int i = start; i < s->switch_stmt.case_count; ++i)
+    {
+        CevalFlow flow = ceval_stmt(m, s->switch_stmt.cases[i].body);
+        if (flow == CEVAL_FLOW_BREAK)
+            return CEVAL_FLOW_NEXT;
+        if (flow != CEVAL_FLOW_NEXT)
+            return flow;
+    }
+    return CEVAL_FLOW_NEXT;
+}
+
+static CevalFlow ceval_stmt(CevalMachine *m, const Node *s)
+{
+    if (!s)
+        return CEVAL_FLOW_NEXT;
+    if (!ceval_tick(m, s))
+        return CEVAL_FLOW_FAIL;
+
+    switch (s->kind)
+    {
+    case ND_BLOCK:
+    {
+        int mark = m->local_count;
+        CevalFlow flow = CEVAL_FLOW_NEXT;
+        for (int i = 0; i < s->stmt_count && flow == CEVAL_FLOW_NEXT; ++i)
+            flow = ceval_stmt(m, s->stmts[i]);
+        ceval_pop_locals(m, mark);
+        return flow;
+    }
+    case ND_VAR_DECL:
+    {
+        if (s->var_is_static || s->var_is_global)
+        {
+            ceval_fail(m, s, "static local '%s' cannot be evaluated at compile time",
+                       s->var_name ? s->var_name : "<unnamed>");
+            return CEVAL_FLOW_FAIL;
+        }
+        CevalValue value;
+        int ok;
+        if (!s->rhs)
+            ok = ceval_zero(m, s, s->var_type, &value);
+        else if (s->rhs->kind == ND_INIT_LIST)
+            ok = ceval_init_list(m, s->rhs, s->var_type, &value);
+        else
+            ok = ceval_expr_as(m, s->rhs, s->var_type, &value);
+        if (!ok)
+            return CEVAL_FLOW_FAIL;
+        ceval_push_local(m, s->var_name, s->var_type, value);
+        return CEVAL_FLOW_NEXT;
+    }
+    case ND_EXPR_STMT:
+    {
+        if (!s->lhs)
+            return CEVAL_FLOW_NEXT;
+        if (ceval_is_update(s->lhs))
+            return ceval_update(m, s->lhs, NULL) ? CEVAL_FLOW_NEXT : CEVAL_FLOW_FAIL;
+        CevalValue discard;
+        if (!ceval_expr(m, s->lhs, &discard))
+            return CEVAL_FLOW_FAIL;
+        ceval_release(m, &discard);
+        return CEVAL_FLOW_NEXT;
+    }
+    case ND_IF:
+    {
+        int truth = 0;
+        if (!ceval_truth(m, s->lhs, &truth))
+            return CEVAL_FLOW_FAIL;
+        return ceval_stmt(m, truth ? s->rhs : s->body);
+    }
+    case ND_WHILE:
+        for (;;)
+        {
+            int truth = 0;
+            if (!ceval_truth(m, s->lhs, &truth))
+                return CEVAL_FLOW_FAIL;
+            if (!truth)
+                return CEVAL_FLOW_NEXT;
+            CevalFlow flow = ceval_stmt(m, s->rhs);
+            if (flow == CEVAL_FLOW_BREAK)
+                return CEVAL_FLOW_NEXT;
+            if (flow == CEVAL_FLOW_RETURN || flow == CEVAL_FLOW_FAIL)
+                return flow;
+            flow = ceval_stmt(m, s->body);
+            if (flow != CEVAL_FLOW_NEXT)
+                return flow;
+        }
+    case ND_BREAK:
+        return CEVAL_FLOW_BREAK;
+    case ND_CONTINUE:
+        return CEVAL_FLOW_CONTINUE;
+    case ND_SWITCH:
+        return ceval_switch(m, s);
+    case ND_RET:
+    {
+        CevalValue value;
+        memset(&value, 0, sizeof(value));
+        if (s->lhs && !ceval_expr_as(m, s->lhs, m->fn ? m->fn->ret_type : s->lhs->type, &value))
+            return CEVAL_FLOW_FAIL;
+        ceval_release(m, &m->ret);
+        m->ret = value;
+        return CEVAL_FLOW_RETURN;
+    }
+    default:
+        ceval_fail(m, s, "%s cannot be evaluated at compile time", node_kind_name(s->kind));
+        return CEVAL_FLOW_FAIL;
+    }
+}
+
+static Node *ceval_make_literal(CevalMachine *m, const Node *at, const CevalValue *v, Type *ty)
+{
+    ty = ceval_canonical(ty);
+    Node *n = (Node *)xcalloc(1, sizeof(Node));
+    n->src = at->src;
+    n->line = at->line;
+    n->col = at->col;
+    n->type = ty;
+    if (ty && (ty->kind == TY_STRUCT || ty->kind == TY_ARRAY))
+    {
+        if (v->kind != CEVAL_AGGREGATE)
+        {
+            ceval_fail(m, at, "evaluated value does not match the aggregate type");
+            return NULL;
+        }
+        n->kind = ND_INIT_LIST;
+        n->init.count = v->count;
+        n->init.is_zero = v->count == 0;
+        if (v->count > 0)
+            n->init.elems = (Node **)xcalloc((size_t)v->count, sizeof(Node *));
+        for (int i = 0; i < v->count; ++i)
+        {
+            Type *elem_ty = ty->kind == TY_STRUCT ? ty->strct.field_types[i] : ty->array.elem;
+            n->init.elems[i] = ceval_make_literal(m, at, &v->elems[i], elem_ty);
+            if (!n->init.elems[i])
+                return NULL;
+        }
+        return n;
+    }
+    switch (v->kind)
+    {
+    case CEVAL_INT:
+        if (ty && ty->kind == TY_PTR)
+        {
+            n->kind = ND_NULL;
+            return n;
+        }
+        n->kind = ND_INT;
+        n->int_val = v->i;
+        n->int_uval = (uint64_t)v->i;
+        n->int_is_unsigned = inline_type_is_unsigned(ty);
+        return n;
+    case CEVAL_FLOAT:
+        n->kind = ND_FLOAT;
+        n->float_val = v->f;
+        return n;
+    case CEVAL_STRING:
+        n->kind = v->str ? ND_STRING : ND_NULL;
+        n->str_data = v->str;
+        n->str_len = v->str_len;
+        return n;
+    default:
+        ceval_fail(m, at, "aggregate value cannot initialize a scalar");
+        return NULL;
+    }
+}
+
+static int sema_eval_wants_fold(const Node *e)
+{
+    if (!e)
+        return 0;
+    if (e->kind == ND_CALL && !e->call_is_indirect && e->call_target && e->call_target->is_eval)
+        return 1;
+    if (sema_eval_wants_fold(e->lhs) || sema_eval_wants_fold(e->rhs) || sema_eval_wants_fold(e->body))
+        return 1;
+    if (e->kind == ND_CALL)
+    {
+        for (int i = 0; i < e->arg_count; ++i)
+            if (sema_eval_wants_fold(e->args[i]))
+                return 1;
+    }
+    if (e->kind == ND_INIT_LIST)
+    {
+        for (int i = 0; i < e->init.count; ++i)
+            if (e->init.elems && sema_eval_wants_fold(e->init.elems[i]))
+                return 1;
+    }
+    return 0;
+}
+
+static void sema_eval_queue(Node *decl)
+{
+    workpool_shared_lock();
+    if (sema_eval_pending_count == sema_eval_pending_cap)
+    {
+        int new_cap = sema_eval_pending_cap ? sema_eval_pending_cap * 2 : 8;
+        SemaEvalPending *grown = (SemaEvalPending *)realloc(sema_eval_pending, (size_t)new_cap * sizeof(SemaEvalPending));
+        if (!grown)
+        {
+            workpool_shared_unlock();
+            diag_error("out of memory while deferring global initializers");
+            sema_abort();
+        }
+        sema_eval_pending = grown;
+        sema_eval_pending_cap = new_cap;
+    }
+    sema_eval_pending[sema_eval_pending_count].decl = decl;
+    sema_eval_pending[sema_eval_pending_count].state = 0;
+    sema_eval_pending_count++;
+    workpool_shared_unlock();
+}
+
+/* Queues a checked global whose initializer calls an [Eval] function; the
+   initializer is replaced with literal data once every body in the unit has
+   been checked. Returns 0 when the initializer has nothing to evaluate. */
+static int sema_eval_defer_initializer(SemaContext *sc, Node *decl)
+{
+    if (!decl->rhs || !sema_eval_wants_fold(decl->rhs))
+        return 0;
+    if (sc->task)
+        sema_task_event(sc->task, SEMA_TASK_EVAL)->node = decl;
+    else
+        sema_eval_queue(decl);
+    return 1;
+}
+
+static int sema_eval_fold_global(CevalMachine *m, SemaEvalPending *p)
+{
+    Node *decl = p->decl;
+    if (p->state == 2)
+        return 1;
+    if (p->state == 1)
+        return ceval_fail(m, decl->rhs, "initializer of '%s' depends on itself", decl->var_name);
+    p->state = 1;
+    int saved_base = m->frame_base;
+    m->frame_base = m->local_count;
+    CevalValue value;
+    int ok = decl->rhs->kind == ND_INIT_LIST ? ceval_init_list(m, decl->rhs, decl->var_type, &value)
+                                             : ceval_expr_as(m, decl->rhs, decl->var_type, &value);
+    m->frame_base = saved_base;
+    if (ok)
+    {
+        Node *literal = ceval_make_literal(m, decl->rhs, &value, decl->var_type);
+        ceval_release(m, &value);
+        if (literal)
+            decl->rhs = literal;
+        else
+            ok = 0;
+    }
+    p->state = 2;
+    return ok;
+}
+
+static int sema_eval_fold_pending(SemaContext *sc)
+{
+    if (sema_eval_pending_count == 0)
+        return 0;
+    CevalMachine *m = (CevalMachine *)xcalloc(1, sizeof(CevalMachine));
+    m->sc = sc;
+    int rc = 0;
+    int folded = 0;
+    long long total_steps = 0;
+    for (int i = 0; i < sema_eval_pending_count && !rc; ++i)
+    {
+        SemaEvalPending *p = &sema_eval_pending[i];
+        if (p->state == 2)
+            continue;
+        Node *decl = p->decl;
+        const Node *site = decl->rhs;
+        m->steps = 0;
+        if (!sema_eval_fold_global(m, p))
+        {
+            diag_error_at(site->src, site->line, site->col,
+                          "cannot evaluate initializer of '%s' at compile time: %s",
+                          decl->var_name, m->fail_msg[0] ? m->fail_msg : "unsupported expression");
+            if (m->fail_node && m->fail_node != site && m->fail_node->src && m->fail_node->line > 0)
+                diag_note_at(m->fail_node->src, m->fail_node->line, m->fail_node->col,
+                             "evaluation stopped here");
+            rc = 1;
             break;
-        default:
-            return 0;
         }
-        *out_value = inline_normalize_value(result, expr->type);
+        total_steps += m->steps;
+        folded++;
+        if (!sema_global_initializer_is_const(decl->rhs))
+        {
+            diag_error_at(site->src, site->line, site->col,
+                          "global initializer for '%s' must be a constant expression",
+                          decl->var_name);
+            rc = 1;
+        }
+    }
+    if (!rc && compiler_verbose_enabled())
+        compiler_verbose_logf("sema", "evaluated %d global initializer(s) at compile time in %lld steps (%d memoized call(s))",
+                              folded, total_steps, m->memo_hits);
+
+    for (int b = 0; b < CEVAL_MEMO_BUCKETS; ++b)
+    {
+        CevalMemo *memo = m->memo[b];
+        while (memo)
+        {
+            CevalMemo *next = memo->next;
+            ceval_release(m, &memo->result);
+            free(memo->args);
+            free(memo);
+            memo = next;
+        }
+    }
+    while (m->globals)
+    {
+        CevalGlobal *next = m->globals->next;
+        ceval_release(m, &m->globals->value);
+        free(m->globals);
+        m->globals = next;
+    }
+    ceval_release(m, &m->ret);
+    ceval_pop_locals(m, 0);
+    free(m->locals);
+    free(m);
+    sema_eval_pending_count = 0;
+    return rc;
+}
+
+static int sema_check_global_decl(SemaContext *sc, Node *decl)
+{
+    if (!decl || decl->kind != ND_VAR_DECL || !decl->var_is_global)
+        return 0;
+
+    if (!decl->var_name)
+    {
+        diag_error_at(decl->src, decl->line, decl->col,
+                      "global variable requires a name");
         return 1;
     }
-    case ND_LAND:
+
+    decl->var_type = canonicalize_type_deep(decl->var_type);
+    Type *ty = decl->var_type;
+    if (!ty)
     {
-        int64_t lhs = 0;
-        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
-            return 0;
-        if (!lhs)
+        diag_error_at(decl->src, decl->line, decl->col,
+                      "unable to determine type for global '%s'",
+                      decl->var_name);
+        return 1;
+    }
+    if (ty->kind == TY_VOID)
+    {
+        diag_error_at(decl->src, decl->line, decl->col,
+                      "global '%s' cannot have type void",
+                      decl->var_name);
+        return 1;
+    }
+    
+    
+    
+    if (ty->kind == TY_PTR && decl->rhs && decl->rhs->kind == ND_INIT_LIST && !decl->rhs->init.is_zero)
+    {
+        int elem_count = decl->rhs->init.count;
+        if (elem_count > 0)
         {
-            *out_value = inline_normalize_value(0, expr->type);
+            Type *elem_ty = ty->pointee ? canonicalize_type_deep(ty->pointee) : &ty_i32;
+            decl->var_type = canonicalize_type_deep(type_array(elem_ty, elem_count));
+            ty = decl->var_type;
+        }
+    }
+    if (ty->kind == TY_ARRAY && ty->array.is_unsized && decl->rhs && decl->rhs->kind == ND_INIT_LIST)
+    {
+        int elem_count = decl->rhs->init.count;
+        if (elem_count <= 0)
+        {
+            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
+                          "unsized arrays require at least one initializer element to determine their length");
             return 1;
         }
-        int64_t rhs = 0;
-        if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, &rhs))
-            return 0;
-        *out_value = inline_normalize_value(rhs ? 1 : 0, expr->type);
-        return 1;
+        Type *elem_ty = ty->array.elem ? ty->array.elem : type_i32();
+        decl->var_type = canonicalize_type_deep(type_array(elem_ty, elem_count));
+        ty = decl->var_type;
+    }
+
+    if (ty->kind == TY_STRUCT)
+    {
+        if (ty->strct.size_bytes <= 0)
+        {
+            diag_error_at(decl->src, decl->line, decl->col,
+                          "struct global '%s' has incomplete size",
+                          decl->var_name);
+            return 1;
+        }
+
+        if (!decl->rhs)
+            return 0;
+
+        if (decl->rhs->kind != ND_INIT_LIST)
+        {
+            if (decl->rhs->kind == ND_CALL)
+            {
+                check_expr(sc, decl->rhs);
+                if (can_assign(ty, decl->rhs) && sema_eval_defer_initializer(sc, decl))
+                    return 0;
+            }
+            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
+                          "struct global '%s' must use an initializer list",
+                          decl->var_name);
+            return 1;
+        }
+
+        check_initializer_for_type(sc, decl->rhs, ty);
+        if (!sema_global_initializer_is_const(decl->rhs) && !sema_eval_defer_initializer(sc, decl))
+        {
+            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
+                          "global initializer for '%s' must be a constant expression",
+                          decl->var_name);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!decl->rhs)
+        return 0;
+
+    if (ty->kind == TY_ARRAY && decl->rhs->kind == ND_INIT_LIST)
+    {
+        check_initializer_for_type(sc, decl->rhs, ty);
+        if (!sema_global_initializer_is_const(decl->rhs) && !sema_eval_defer_initializer(sc, decl))
+        {
+            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
+                          "global initializer for '%s' must be a constant expression",
+                          decl->var_name);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (decl->rhs->kind == ND_INIT_LIST)
+    {
+        check_initializer_for_type(sc, decl->rhs, ty);
+        if (!sema_global_initializer_is_const(decl->rhs) && !sema_eval_defer_initializer(sc, decl))
+        {
+            diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
+                          "global initializer for '%s' must be a constant expression",
+                          decl->var_name);
+            return 1;
+        }
+        if (!decl->rhs->type)
+            decl->rhs->type = ty;
+        return 0;
+    }
+
+    check_expr(sc, decl->rhs);
+    if (!can_assign(ty, decl->rhs))
+    {
+        diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
+                      "cannot initialize global '%s' with incompatible type",
+                      decl->var_name);
+        return 1;
+    }
+    decl->rhs->type = ty;
+
+    if (!sema_global_initializer_is_const(decl->rhs) && !sema_eval_defer_initializer(sc, decl))
+    {
+        diag_error_at(decl->rhs->src, decl->rhs->line, decl->rhs->col,
+                      "global initializer for '%s' must be a constant expression",
+                      decl->var_name);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Fills in the parts of a function signature that sema_check_function would
+   otherwise rewrite while checking the body. Done up front for functions whose
+   symbol other threads may read concurrently. */
+static void sema_settle_function_signature(Node *fn)
+{
+    if (!fn->ret_type)
+        fn->ret_type = &ty_i32;
+    if (fn->is_chancecode || fn->is_literal || !fn->body)
+        return;
+    for (int i = 0; i < fn->param_count; i++)
+    {
+        Type *canon = canonicalize_type_deep(fn->param_types[i]);
+        if (canon != fn->param_types[i])
+            fn->param_types[i] = canon;
+    }
+}
+
+static int sema_check_function(SemaContext *sc, Node *fn)
+{
+    sema_settle_function_signature(fn);
+    if (fn->is_jump_target)
+    {
+        if (fn->param_count != 0)
+        {
+            diag_error_at(fn->src, fn->line, fn->col,
+                          "[JumpTarget] functions cannot have parameters");
+            return 1;
+        }
+        if (fn->is_varargs)
+        {
+            diag_error_at(fn->src, fn->line, fn->col,
+                          "[JumpTarget] functions cannot be variadic");
+            return 1;
+        }
+    }
+    if (fn->is_chancecode || fn->is_literal)
+        return 0;
+    Node *body = fn->body;
+    if (!body)
+    {
+        diag_error_at(fn->src, fn->line, fn->col, "missing function body");
+        return 1;
+    }
+    if (profile_sites_enabled())
+    {
+        int next_site = 0;
+        sema_profile_number_sites(body, &next_site);
+    }
+    scope_push(sc);
+    for (int i = 0; i < fn->param_count; i++)
+    {
+        int param_is_const = (fn->param_const_flags && i < fn->param_count) ? fn->param_const_flags[i] : 0;
+        scope_add(sc, fn->param_names[i], fn->param_types[i], param_is_const, 0, NULL,
+              (fn->is_managed && type_is_unsized_array(fn->param_types[i])) ? make_managed_length_name(fn->param_names[i]) : NULL);
+    }
+    int has_return = 0;
+    int rc;
+    if (body->kind == ND_BLOCK)
+        rc = sema_check_block(sc, body, fn, &has_return, 0);
+    else
+        rc = sema_check_statement(sc, body, fn, &has_return);
+    scope_pop(sc);
+    if (rc)
+        return rc;
+    if ((!fn->ret_type || fn->ret_type->kind != TY_VOID) && !has_return)
+    {
+        diag_error_at(fn->src, fn->line, fn->col,
+                      "function body must contain a return statement");
+        return 1;
+    }
+    sema_escape_analyze(fn);
+    sema_null_flow_analyze(fn);
+    if (fn->generic_param_count == 0)
+        fn->eval_checked = 1;
+    return 0;
+}
+
+static int sema_check_task_function(SemaContext *sc, Node *fn)
+{
+    if (check_exposed_function_signature(fn))
+        return 1;
+    return sema_check_function(sc, fn);
+}
+
+static void sema_parallel_check_task(void *ctx, int task_index, int worker)
+{
+    struct SemaParallelJob *job = (struct SemaParallelJob *)ctx;
+    struct SemaTask *task = &job->tasks[job->fn_tasks[task_index]];
+    SemaContext local = *job->sc;
+    local.scope = job->scopes[worker];
+    local.loop_depth = 0;
+    local.switch_depth = 0;
+    sema_task_run(&local, task, sema_check_task_function);
+    if (task->rc)
+    {
+        /* An abort leaves the binding stack mid-function. */
+        scope_destroy(local.scope);
+        local.scope = NULL;
+    }
+    job->scopes[worker] = local.scope;
+}
+
+/* Replays a task into the unit and the context as if it had been checked
+   right now, printing its diagnostics as it goes. Instances are replayed at
+   their first use; `site` is that call. Exits where sequential checking
+   would have. */
+static int sema_task_merge(SemaContext *sc, struct SemaTask *task, const Node *site)
+{
+    if (task->merged)
+        return 0;
+    task->merged = 1;
+    if (task->template_name)
+        sema_unit_append(sc, task->fn);
+    size_t printed = 0;
+    for (int i = 0; i < task->event_count; ++i)
+    {
+        SemaTaskEvent *ev = &task->events[i];
+        diag_capture_print(&task->diags, printed, ev->diag_mark);
+        printed = ev->diag_mark;
+        switch (ev->kind)
+        {
+        case SEMA_TASK_IMPORT:
+            sema_imported_function_insert(sc, ev->import.name, ev->import.module_full, &ev->import.symbol);
+            break;
+        case SEMA_TASK_GLOBAL:
+            sema_track_imported_global_usage(sc, &ev->global);
+            break;
+        case SEMA_TASK_APPEND:
+            sema_unit_append(sc, ev->node);
+            break;
+        case SEMA_TASK_LAMBDA:
+            snprintf(ev->node->metadata.backend_name, SEMA_LAMBDA_NAME_CAP, "__lambda_%d", sc->lambda_counter++);
+            sema_unit_append(sc, ev->node);
+            break;
+        case SEMA_TASK_EVAL:
+            sema_eval_queue(ev->node);
+            break;
+        case SEMA_TASK_INSTANCE:
+            sema_task_merge(sc, ev->instance, ev->node);
+            break;
+        }
+    }
+    diag_capture_print(&task->diags, printed, task->diags.len);
+    if (task->failure && site)
+        diag_error_at(site->src, site->line, site->col, task->failure, task->template_name);
+    if (task->aborted || task->failure)
+        exit(1);
+    return task->rc;
+}
+
+static void sema_task_release(struct SemaTask *task)
+{
+    free(task->events);
+    diag_capture_free(&task->diags);
+}
+
+/* Checks the unit's top-level declarations as tasks: globals first and in
+   order, since function bodies read them, then the non-template function
+   bodies on a work-stealing pool. Template bodies are checked while the
+   tasks are merged back in declaration order, at their own position. */
+static int sema_check_unit_parallel(SemaContext *sc, Node *unit, int declared)
+{
+    struct SemaParallelJob job;
+    memset(&job, 0, sizeof(job));
+    job.sc = sc;
+    job.tasks = (struct SemaTask *)xcalloc((size_t)(declared > 0 ? declared : 1), sizeof(struct SemaTask));
+    job.fn_tasks = (int *)xcalloc((size_t)(declared > 0 ? declared : 1), sizeof(int));
+    for (int i = 0; i < declared; i++)
+    {
+        job.tasks[i].fn = unit->stmts[i];
+        job.tasks[i].job = &job;
+        if (unit->stmts[i] && unit->stmts[i]->kind == ND_FUNC)
+            sema_settle_function_signature(unit->stmts[i]);
+    }
+
+    /* Declarations after a failing global are never checked sequentially. */
+    int limit = declared;
+    for (int i = 0; i < declared && limit == declared; i++)
+    {
+        Node *decl = unit->stmts[i];
+        if (!decl || decl->kind != ND_VAR_DECL || !decl->var_is_global)
+            continue;
+        sema_task_run(sc, &job.tasks[i], sema_check_global_decl);
+        if (job.tasks[i].rc)
+            limit = i;
+    }
+
+    int fn_count = 0;
+    for (int i = 0; i < limit; i++)
+    {
+        Node *decl = unit->stmts[i];
+        if (decl && decl->kind == ND_FUNC && decl->generic_param_count == 0)
+            job.fn_tasks[fn_count++] = i;
+    }
+    int jobs = sema_parallel_jobs < fn_count ? sema_parallel_jobs : fn_count;
+    if (fn_count > 0)
+    {
+        job.scopes = (struct Scope **)xcalloc((size_t)jobs, sizeof(struct Scope *));
+        workpool_run(fn_count, jobs, sema_parallel_check_task, &job);
+        for (int w = 0; w < jobs; ++w)
+            scope_destroy(job.scopes[w]);
+        free(job.scopes);
+    }
+    if (compiler_verbose_enabled())
+        compiler_verbose_logf("sema", "checked %d function bodies on %d thread(s)", fn_count, jobs > 0 ? jobs : 1);
+
+    int rc = 0;
+    sc->merge_job = &job;
+    for (int i = 0; i <= limit && i < declared && !rc; i++)
+    {
+        Node *decl = unit->stmts[i];
+        if (!decl)
+            continue;
+        if (decl->kind == ND_FUNC && decl->generic_param_count > 0)
+            rc = check_exposed_function_signature(decl) || sema_check_function(sc, decl);
+        else
+            rc = sema_task_merge(sc, &job.tasks[i], NULL);
+    }
+    sc->merge_job = NULL;
+
+    for (int i = 0; i < declared; i++)
+        sema_task_release(&job.tasks[i]);
+    for (int i = 0; i < job.instance_count; ++i)
+    {
+        sema_task_release(job.instances[i]);
+        free(job.instances[i]);
+    }
+    free(job.instances);
+    free(job.fn_tasks);
+    free(job.tasks);
+    return rc;
+}
+
+int sema_check_unit(SemaContext *sc, Node *unit)
+{
+    if (!unit)
+    {
+        diag_error("null unit");
+        return 1;
+    }
+    Node *previous_unit = sc->unit;
+    sc->unit = unit;
+    if (unit->kind == ND_FUNC)
+    {
+        
+        
+        sema_register_function_local(sc, NULL, unit);
+        if (check_exposed_function_signature(unit))
+            return 1;
+        int rc = sema_check_function(sc, unit);
+        if (!rc)
+            analyze_inline_candidates(unit);
+        return rc;
+    }
+    if (unit->kind != ND_UNIT)
+    {
+        fprintf(stderr, "sema: expected unit\n");
+        return 1;
+    }
+    
+    for (int i = 0; i < unit->stmt_count; i++)
+    {
+        Node *decl = unit->stmts[i];
+        if (!decl)
+            continue;
+        if (decl->kind == ND_FUNC)
+        {
+            sema_register_function_local(sc, unit, decl);
+        }
+        else if (decl->kind == ND_VAR_DECL && decl->var_is_global)
+        {
+            sema_register_global_local(sc, unit, decl);
+        }
+        else
+        {
+            diag_error_at(decl ? decl->src : unit->src,
+                          decl ? decl->line : unit->line,
+                          decl ? decl->col : unit->col,
+                          "unsupported top-level declaration");
+            return 1;
+        }
+    }
+
+    int first = 0;
+    if (sema_parallel_jobs > 1 && !sc->task)
+    {
+        first = unit->stmt_count;
+        if (sema_check_unit_parallel(sc, unit, first))
+            return 1;
+    }
+
+    for (int i = first; i < unit->stmt_count; i++)
+    {
+        Node *decl = unit->stmts[i];
+        if (!decl)
+            continue;
+        if (decl->kind == ND_FUNC)
+        {
+            if (check_exposed_function_signature(decl))
+                return 1;
+            if (sema_check_function(sc, decl))
+                return 1;
+        }
+        else if (decl->kind == ND_VAR_DECL && decl->var_is_global)
+        {
+            if (sema_check_global_decl(sc, decl))
+                return 1;
+        }
+    }
+
+    if (sema_eval_fold_pending(sc))
+        return 1;
+
+    analyze_inline_candidates(unit);
+    sc->unit = previous_unit;
+    return 0;
+}
+
+static int inline_type_supported(Type *ty)
+{
+    if (!ty)
+        return 1;
+    ty = canonicalize_type_deep(ty);
+    if (!ty)
+        return 1;
+    if (ty->kind == TY_STRUCT || ty->kind == TY_ARRAY)
+        return 0;
+    return 1;
+}
+
+static int inline_type_is_unsigned(Type *ty)
+{
+    ty = canonicalize_type_deep(ty);
+    if (!ty)
+        return 0;
+    switch (ty->kind)
+    {
+    case TY_U8:
+    case TY_U16:
+    case TY_U32:
+    case TY_U64:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int inline_type_bit_width(Type *ty)
+{
+    ty = canonicalize_type_deep(ty);
+    if (!ty)
+        return 0;
+    switch (ty->kind)
+    {
+    case TY_BOOL:
+        return 1;
+    case TY_CHAR:
+    case TY_I8:
+    case TY_U8:
+        return 8;
+    case TY_I16:
+    case TY_U16:
+        return 16;
+    case TY_I32:
+    case TY_U32:
+        return 32;
+    case TY_I64:
+    case TY_U64:
+        return 64;
+    default:
+        return 0;
+    }
+}
+
+static int64_t inline_normalize_value(int64_t value, Type *ty)
+{
+    if (!ty)
+        return value;
+    ty = canonicalize_type_deep(ty);
+    if (!ty)
+        return value;
+    int width = inline_type_bit_width(ty);
+    if (width <= 0)
+        return value;
+    if (width == 1 || ty->kind == TY_BOOL)
+        return value ? 1 : 0;
+    if (width >= 64)
+        return value;
+    uint64_t mask = (1ULL << width) - 1ULL;
+    uint64_t uv = ((uint64_t)value) & mask;
+    if (inline_type_is_unsigned(ty))
+        return (int64_t)uv;
+    uint64_t sign_bit = 1ULL << (width - 1);
+    if (uv & sign_bit)
+        uv |= (~mask);
+    return (int64_t)uv;
+}
+
+static Node *inline_make_conditional(Node *cond, Node *then_expr, Node *else_expr, Type *ret_type)
+{
+    if (!cond || !then_expr || !else_expr)
+        return NULL;
+    Node *n = (Node *)xcalloc(1, sizeof(Node));
+    n->kind = ND_COND;
+    n->lhs = cond;
+    n->rhs = then_expr;
+    n->body = else_expr;
+    n->type = canonicalize_type_deep(ret_type);
+    if (cond->src)
+    {
+        n->src = cond->src;
+        n->line = cond->line;
+        n->col = cond->col;
+    }
+    else if (then_expr->src)
+    {
+        n->src = then_expr->src;
+        n->line = then_expr->line;
+        n->col = then_expr->col;
+    }
+    else if (else_expr->src)
+    {
+        n->src = else_expr->src;
+        n->line = else_expr->line;
+        n->col = else_expr->col;
+    }
+    return n;
+}
+
+static Node *inline_stmt_to_expr(const Node *stmt, Node *tail_expr, Type *ret_type)
+{
+    if (!stmt)
+        return NULL;
+
+    switch (stmt->kind)
+    {
+    case ND_BLOCK:
+    {
+        Node *expr = tail_expr;
+        for (int i = stmt->stmt_count - 1; i >= 0; --i)
+        {
+            expr = inline_stmt_to_expr(stmt->stmts[i], expr, ret_type);
+            if (!expr)
+                return NULL;
+        }
+        return expr;
+    }
+    case ND_RET:
+        if (!stmt->lhs)
+            return NULL;
+        if (tail_expr)
+            return NULL;
+        return stmt->lhs;
+    case ND_IF:
+    {
+        Node *cond = stmt->lhs ? (Node *)stmt->lhs : NULL;
+        if (!cond)
+            return NULL;
+        Node *then_expr = inline_stmt_to_expr(stmt->rhs, NULL, ret_type);
+        if (!then_expr)
+            return NULL;
+        Node *else_expr = NULL;
+        if (stmt->body)
+        {
+            if (tail_expr)
+                return NULL;
+            else_expr = inline_stmt_to_expr(stmt->body, NULL, ret_type);
+            if (!else_expr)
+                return NULL;
+        }
+        else
+        {
+            if (!tail_expr)
+                return NULL;
+            else_expr = tail_expr;
+        }
+        return inline_make_conditional(cond, then_expr, else_expr, ret_type);
+    }
+    default:
+        return NULL;
+    }
+}
+
+static const Node *inline_extract_return_expr(const Node *fn)
+{
+    if (!fn || fn->kind != ND_FUNC || !fn->body)
+        return NULL;
+    const Node *body = fn->body;
+    if (body->kind != ND_BLOCK)
+        return NULL;
+    Node *expr = NULL;
+    for (int i = body->stmt_count - 1; i >= 0; --i)
+    {
+        const Node *stmt = body->stmts ? body->stmts[i] : NULL;
+        expr = inline_stmt_to_expr(stmt, expr, fn->ret_type);
+        if (!expr)
+            return NULL;
+    }
+    return expr;
+}
+
+typedef struct InlineBinding
+{
+    const char *name;
+    int64_t value;
+    Type *type;
+} InlineBinding;
+
+static int inline_lookup_binding(const InlineBinding *bindings, int count, const char *name, int64_t *out_value, Type **out_type)
+{
+    if (!bindings || count <= 0 || !name)
+        return 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (bindings[i].name && strcmp(bindings[i].name, name) == 0)
+        {
+            if (out_value)
+                *out_value = bindings[i].value;
+            if (out_type)
+                *out_type = bindings[i].type;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int inline_eval_const_expr(const Node *expr,
+                                  const InlineBinding *bindings,
+                                  int binding_count,
+                                  int depth,
+                                  int64_t *out_value);
+
+static int inline_eval_inline_call(const Node *call_expr,
+                                   const InlineBinding *bindings,
+                                   int binding_count,
+                                   int depth,
+                                   int64_t *out_value)
+{
+    if (!call_expr || !out_value)
+        return 0;
+    if (!call_expr->call_target || call_expr->call_is_indirect)
+        return 0;
+    const Node *fn = call_expr->call_target;
+    if (!fn->inline_candidate || !fn->inline_expr)
+        return 0;
+    if (!fn->ret_type || !type_is_int(fn->ret_type))
+        return 0;
+    if (fn->param_count != call_expr->arg_count)
+        return 0;
+    if (fn->param_count > INLINE_PARAM_LIMIT)
+        return 0;
+
+    InlineBinding params[INLINE_PARAM_LIMIT];
+    for (int i = 0; i < fn->param_count; ++i)
+    {
+        const Node *arg = (call_expr->args && i < call_expr->arg_count) ? call_expr->args[i] : NULL;
+        if (!arg)
+            return 0;
+        const char *param_name = (fn->param_names && i < fn->param_count) ? fn->param_names[i] : NULL;
+        if (!param_name)
+            return 0;
+        int64_t arg_value = 0;
+        if (!inline_eval_const_expr(arg, bindings, binding_count, depth + 1, &arg_value))
+            return 0;
+        Type *param_type = (fn->param_types && i < fn->param_count) ? fn->param_types[i] : NULL;
+        params[i].name = param_name;
+        params[i].value = inline_normalize_value(arg_value, param_type);
+        params[i].type = param_type;
+    }
+
+    int64_t result = 0;
+    if (!inline_eval_const_expr(fn->inline_expr, params, fn->param_count, depth + 1, &result))
+        return 0;
+    *out_value = inline_normalize_value(result, fn->ret_type);
+    return 1;
+}
+
+static int inline_eval_const_expr(const Node *expr,
+                                  const InlineBinding *bindings,
+                                  int binding_count,
+                                  int depth,
+                                  int64_t *out_value)
+{
+    if (!expr || !out_value)
+        return 0;
+    if (depth > INLINE_EVAL_MAX_DEPTH)
+        return 0;
+
+    switch (expr->kind)
+    {
+    case ND_INT:
+        *out_value = inline_normalize_value(expr->int_val, expr->type);
+        return 1;
+    case ND_VAR:
+    {
+        int64_t value = 0;
+        Type *ty = expr->type;
+        if (expr->var_ref && inline_lookup_binding(bindings, binding_count, expr->var_ref, &value, &ty))
+        {
+            *out_value = inline_normalize_value(value, ty ? ty : expr->type);
+            return 1;
+        }
+        return 0;
+    }
+    case ND_NEG:
+    {
+        int64_t lhs = 0;
+        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
+            return 0;
+        *out_value = inline_normalize_value(-lhs, expr->type);
+        return 1;
+    }
+    case ND_BITNOT:
+    {
+        int64_t lhs = 0;
+        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
+            return 0;
+        *out_value = inline_normalize_value(~lhs, expr->type);
+        return 1;
+    }
+    case ND_LNOT:
+    {
+        int64_t lhs = 0;
+        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
+            return 0;
+        *out_value = inline_normalize_value(!lhs, expr->type);
+        return 1;
+    }
+    case ND_ADD:
+    case ND_SUB:
+    case ND_MUL:
+    case ND_DIV:
+    case ND_MOD:
+    case ND_SHL:
+    case ND_SHR:
+    case ND_BITAND:
+    case ND_BITOR:
+    case ND_BITXOR:
+    {
+        int64_t lhs = 0;
+        int64_t rhs = 0;
+        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
+            return 0;
+        if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, &rhs))
+            return 0;
+        int64_t result = 0;
+        switch (expr->kind)
+        {
+        case ND_ADD:
+            result = lhs + rhs;
+            break;
+        case ND_SUB:
+            result = lhs - rhs;
+            break;
+        case ND_MUL:
+            result = lhs * rhs;
+            break;
+        case ND_DIV:
+            if (rhs == 0)
+                return 0;
+            result = lhs / rhs;
+            break;
+        case ND_MOD:
+            if (rhs == 0)
+                return 0;
+            result = lhs % rhs;
+            break;
+        case ND_SHL:
+            result = lhs << (int)(rhs & 63);
+            break;
+        case ND_SHR:
+            if (inline_type_is_unsigned(expr->lhs ? expr->lhs->type : NULL))
+                result = ((uint64_t)lhs) >> (int)(rhs & 63);
+            else
+                result = lhs >> (int)(rhs & 63);
+            break;
+        case ND_BITAND:
+            result = lhs & rhs;
+            break;
+        case ND_BITOR:
+            result = lhs | rhs;
+            break;
+        case ND_BITXOR:
+            result = lhs ^ rhs;
+            break;
+        default:
+            return 0;
+        }
+        *out_value = inline_normalize_value(result, expr->type);
+        return 1;
+    }
+    case ND_LAND:
+    {
+        int64_t lhs = 0;
+        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
+            return 0;
+        if (!lhs)
+        {
+            *out_value = inline_normalize_value(0, expr->type);
+            return 1;
+        }
+        int64_t rhs = 0;
+        if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, &rhs))
+            return 0;
+        *out_value = inline_normalize_value(rhs ? 1 : 0, expr->type);
+        return 1;
+    }
+    case ND_LOR:
+    {
+        int64_t lhs = 0;
+        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
+            return 0;
+        if (lhs)
+        {
+            *out_value = inline_normalize_value(1, expr->type);
+            return 1;
+        }
+        int64_t rhs = 0;
+        if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, &rhs))
+            return 0;
+        *out_value = inline_normalize_value(rhs ? 1 : 0, expr->type);
+        return 1;
+    }
+    case ND_EQ:
+    case ND_STRICT_EQ:
+    case ND_NE:
+    case ND_LT:
+    case ND_LE:
+    case ND_GE:
+    case ND_GT_EXPR:
+    {
+        int64_t lhs = 0;
+        int64_t rhs = 0;
+        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
+            return 0;
+        if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, &rhs))
+            return 0;
+        int64_t result = 0;
+        switch (expr->kind)
+        {
+        case ND_EQ:
+        case ND_STRICT_EQ:
+            result = (lhs == rhs);
+            break;
+        case ND_NE:
+            result = (lhs != rhs);
+            break;
+        case ND_LT:
+            result = lhs < rhs;
+            break;
+        case ND_LE:
+            result = lhs <= rhs;
+            break;
+        case ND_GT_EXPR:
+            result = lhs > rhs;
+            break;
+        case ND_GE:
+            result = lhs >= rhs;
+            break;
+        default:
+            return 0;
+        }
+        *out_value = inline_normalize_value(result ? 1 : 0, expr->type);
+        return 1;
+    }
+    case ND_COND:
+    {
+        int64_t cond = 0;
+        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &cond))
+            return 0;
+        if (cond)
+        {
+            if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, out_value))
+                return 0;
+            *out_value = inline_normalize_value(*out_value, expr->type);
+            return 1;
+        }
+        if (!inline_eval_const_expr(expr->body, bindings, binding_count, depth + 1, out_value))
+            return 0;
+        *out_value = inline_normalize_value(*out_value, expr->type);
+        return 1;
+    }
+    case ND_CAST:
+    {
+        int64_t val = 0;
+        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &val))
+            return 0;
+        *out_value = inline_normalize_value(val, expr->type);
+        return 1;
+    }
+    case ND_CALL:
+        return inline_eval_inline_call(expr, bindings, binding_count, depth + 1, out_value);
+    default:
+        return 0;
+    }
+}
+
+static int inline_try_fold_call(Node *call_expr)
+{
+    if (!call_expr || call_expr->kind != ND_CALL)
+        return 0;
+    if (call_expr->call_is_jump)
+        return 0;
+    if (call_expr->call_is_indirect)
+        return 0;
+    if (!call_expr->call_target)
+        return 0;
+    const Node *fn = call_expr->call_target;
+    if (!fn->inline_candidate || !fn->inline_expr)
+        return 0;
+    if (!fn->ret_type || !type_is_int(fn->ret_type))
+        return 0;
+    if (fn->param_count != call_expr->arg_count)
+        return 0;
+    if (fn->param_count > INLINE_PARAM_LIMIT)
+        return 0;
+
+    InlineBinding bindings[INLINE_PARAM_LIMIT];
+    for (int i = 0; i < fn->param_count; ++i)
+    {
+        const Node *arg = (call_expr->args && i < call_expr->arg_count) ? call_expr->args[i] : NULL;
+        if (!arg)
+            return 0;
+        const char *param_name = (fn->param_names && i < fn->param_count) ? fn->param_names[i] : NULL;
+        if (!param_name)
+            return 0;
+        int64_t value = 0;
+        if (!inline_eval_const_expr(arg, NULL, 0, 0, &value))
+            return 0;
+        Type *param_type = (fn->param_types && i < fn->param_count) ? fn->param_types[i] : NULL;
+        bindings[i].name = param_name;
+        bindings[i].value = inline_normalize_value(value, param_type);
+        bindings[i].type = param_type;
+    }
+
+    int64_t result = 0;
+    if (!inline_eval_const_expr(fn->inline_expr, bindings, fn->param_count, 0, &result))
+        return 0;
+
+    Type *ret_type = canonicalize_type_deep(fn->ret_type);
+    result = inline_normalize_value(result, ret_type);
+
+    call_expr->kind = ND_INT;
+    call_expr->int_val = result;
+    call_expr->lhs = NULL;
+    call_expr->rhs = NULL;
+    call_expr->body = NULL;
+    call_expr->args = NULL;
+    call_expr->arg_count = 0;
+    call_expr->call_target = NULL;
+    call_expr->call_name = NULL;
+    call_expr->call_func_type = NULL;
+    call_expr->call_is_indirect = 0;
+    call_expr->call_is_varargs = 0;
+    call_expr->type = ret_type;
+    return 1;
+}
+
+static int inline_expr_cost(const Node *expr)
+{
+    if (!expr)
+        return 0;
+    int cost = 1;
+    cost += inline_expr_cost(expr->lhs);
+    cost += inline_expr_cost(expr->rhs);
+    cost += inline_expr_cost(expr->body);
+    if (expr->kind == ND_BLOCK && expr->stmts)
+    {
+        for (int i = 0; i < expr->stmt_count; ++i)
+            cost += inline_expr_cost(expr->stmts[i]);
+    }
+    if (expr->kind == ND_CALL && expr->args)
+    {
+        for (int i = 0; i < expr->arg_count; ++i)
+            cost += inline_expr_cost(expr->args[i]);
+    }
+    if (expr->kind == ND_INIT_LIST && expr->init.elems)
+    {
+        for (int i = 0; i < expr->init.count; ++i)
+            cost += inline_expr_cost(expr->init.elems[i]);
+    }
+    return cost;
+}
+
+static void inline_walk_usage(Node *current_fn, const Node *node, const Node *parent)
+{
+    if (!node)
+        return;
+
+    if (node->kind == ND_CALL)
+    {
+        if (node->call_target && node->call_target == current_fn)
+            current_fn->inline_recursive = 1;
+    }
+
+    if (node->kind == ND_VAR && node->referenced_function)
+    {
+        int is_call_target = parent && parent->kind == ND_CALL && parent->lhs == node;
+        if (!is_call_target)
+            node->referenced_function->inline_address_taken = 1;
+    }
+
+    inline_walk_usage(current_fn, node->lhs, node);
+    inline_walk_usage(current_fn, node->rhs, node);
+    inline_walk_usage(current_fn, node->body, node);
+
+    if (node->kind == ND_BLOCK && node->stmts)
+    {
+        for (int i = 0; i < node->stmt_count; ++i)
+            inline_walk_usage(current_fn, node->stmts[i], node);
+    }
+
+    if (node->kind == ND_CALL && node->args)
+    {
+        for (int i = 0; i < node->arg_count; ++i)
+            inline_walk_usage(current_fn, node->args[i], node);
+    }
+
+    if (node->kind == ND_INIT_LIST && node->init.elems)
+    {
+        for (int i = 0; i < node->init.count; ++i)
+            inline_walk_usage(current_fn, node->init.elems[i], node);
+    }
+}
+
+/* Numbers if statements and calls in pre-order so instrumented and
+   profile-using builds of the same source agree on counter keys. Runs before
+   the body is checked, so folding done by sema cannot shift the numbering. */
+static void sema_profile_number_sites(Node *node, int *next)
+{
+    if (!node)
+        return;
+    if (node->kind == ND_IF || node->kind == ND_CALL)
+        node->profile_site = ++*next;
+
+    sema_profile_number_sites(node->lhs, next);
+    sema_profile_number_sites(node->rhs, next);
+    sema_profile_number_sites(node->body, next);
+
+    if (node->kind == ND_BLOCK && node->stmts)
+    {
+        for (int i = 0; i < node->stmt_count; ++i)
+            sema_profile_number_sites(node->stmts[i], next);
+    }
+    if (node->kind == ND_CALL && node->args)
+    {
+        for (int i = 0; i < node->arg_count; ++i)
+            sema_profile_number_sites(node->args[i], next);
+    }
+    if (node->kind == ND_INIT_LIST && node->init.elems)
+    {
+        for (int i = 0; i < node->init.count; ++i)
+            sema_profile_number_sites(node->init.elems[i], next);
+    }
+    if (node->kind == ND_SWITCH)
+    {
+        sema_profile_number_sites(node->switch_stmt.expr, next);
+        for (int i = 0; i < node->switch_stmt.case_count; ++i)
+        {
+            sema_profile_number_sites(node->switch_stmt.cases[i].value, next);
+            sema_profile_number_sites(node->switch_stmt.cases[i].body, next);
+        }
+    }
+    if (node->kind == ND_MATCH)
+    {
+        sema_profile_number_sites(node->match_stmt.expr, next);
+        for (int i = 0; i < node->match_stmt.arm_count; ++i)
+        {
+            sema_profile_number_sites(node->match_stmt.arms[i].pattern, next);
+            sema_profile_number_sites(node->match_stmt.arms[i].guard, next);
+            sema_profile_number_sites(node->match_stmt.arms[i].body, next);
+        }
+    }
+}
+
+typedef struct
+{
+    const char *name;
+    Node *decl; /* NULL once the name is known to escape or be ambiguous */
+} EscapeVar;
+
+typedef struct
+{
+    EscapeVar *vars;
+    int count;
+    int cap;
+    Node **path;
+    int depth;
+    int path_cap;
+} EscapeState;
+
+static EscapeVar *escape_find(EscapeState *st, const char *name)
+{
+    for (int i = 0; i < st->count; ++i)
+    {
+        if (strcmp(st->vars[i].name, name) == 0)
+            return &st->vars[i];
+    }
+    return NULL;
+}
+
+static void escape_declare(EscapeState *st, const char *name, Node *decl)
+{
+    EscapeVar *v = escape_find(st, name);
+    if (v)
+    {
+        /* Shadowed names are resolved by name in codegen; give up on both. */
+        v->decl = NULL;
+        return;
+    }
+    if (st->count == st->cap)
+    {
+        st->cap = st->cap ? st->cap * 2 : 8;
+        st->vars = (EscapeVar *)realloc(st->vars, (size_t)st->cap * sizeof(EscapeVar));
+        if (!st->vars)
+        {
+            diag_error("out of memory");
+            sema_abort();
+        }
+    }
+    st->vars[st->count].name = name;
+    st->vars[st->count].decl = decl;
+    st->count++;
+}
+
+static int escape_new_fits_stack(const Node *expr)
+{
+    Type *ptr = canonicalize_type_deep(expr->type);
+    if (!ptr || ptr->kind != TY_PTR || !ptr->pointee)
+        return 0;
+    long long count = 1;
+    if (expr->lhs)
+    {
+        if (expr->lhs->kind != ND_INT)
+            return 0;
+        count = expr->lhs->int_val;
+    }
+    long long size = sizeof_type_bytes(ptr->pointee);
+    return size > 0 && count > 0 && count <= ESCAPE_STACK_LIMIT / size;
+}
+
+static void escape_collect(EscapeState *st, Node *node, int loop_depth, int in_lambda)
+{
+    if (!node)
+        return;
+    if (node->kind == ND_WHILE)
+        loop_depth++;
+    if (node->kind == ND_LAMBDA)
+    {
+        in_lambda = 1;
+        for (int i = 0; i < node->param_count; ++i)
+        {
+            if (node->param_names && node->param_names[i])
+                escape_declare(st, node->param_names[i], NULL);
+        }
+    }
+    if (node->kind == ND_VAR_DECL && node->var_name)
+    {
+        /* A stack slot lives until the function returns, so allocations that
+           can run more than once per call stay on the heap. */
+        int eligible = !in_lambda && loop_depth == 0 && !node->var_is_static && !node->var_is_global &&
+                       node->rhs && node->rhs->kind == ND_NEW && escape_new_fits_stack(node->rhs);
+        escape_declare(st, node->var_name, eligible ? node : NULL);
+    }
+
+    escape_collect(st, node->lhs, loop_depth, in_lambda);
+    escape_collect(st, node->rhs, loop_depth, in_lambda);
+    escape_collect(st, node->body, loop_depth, in_lambda);
+    for (int i = 0; node->stmts && i < node->stmt_count; ++i)
+        escape_collect(st, node->stmts[i], loop_depth, in_lambda);
+    for (int i = 0; node->args && i < node->arg_count; ++i)
+        escape_collect(st, node->args[i], loop_depth, in_lambda);
+    if (node->kind == ND_INIT_LIST && node->init.elems)
+    {
+        for (int i = 0; i < node->init.count; ++i)
+            escape_collect(st, node->init.elems[i], loop_depth, in_lambda);
+    }
+    if (node->kind == ND_SWITCH)
+    {
+        escape_collect(st, node->switch_stmt.expr, loop_depth, in_lambda);
+        for (int i = 0; i < node->switch_stmt.case_count; ++i)
+        {
+            escape_collect(st, node->switch_stmt.cases[i].value, loop_depth, in_lambda);
+            escape_collect(st, node->switch_stmt.cases[i].body, loop_depth, in_lambda);
+        }
+    }
+    if (node->kind == ND_MATCH)
+    {
+        escape_collect(st, node->match_stmt.expr, loop_depth, in_lambda);
+        for (int i = 0; i < node->match_stmt.arm_count; ++i)
+        {
+            escape_collect(st, node->match_stmt.arms[i].pattern, loop_depth, in_lambda);
+            escape_collect(st, node->match_stmt.arms[i].guard, loop_depth, in_lambda);
+            escape_collect(st, node->match_stmt.arms[i].body, loop_depth, in_lambda);
+        }
+    }
+}
+
+static int escape_is_place_step(const Node *parent, const Node *child)
+{
+    return (parent->kind == ND_DEREF || parent->kind == ND_MEMBER || parent->kind == ND_INDEX) &&
+           parent->lhs == child;
+}
+
+/* The variable at the top of the path may be deleted, tested, compared or
+   dereferenced. Anything else (copies, calls, returns, casts, address-of an
+   interior place, array fields decaying to pointers) lets it escape. */
+static int escape_use_is_safe(const EscapeState *st)
+{
+    int i = st->depth - 1;
+    const Node *var = st->path[i];
+    const Node *parent = i > 0 ? st->path[i - 1] : NULL;
+    if (!parent)
+        return 0;
+    switch (parent->kind)
+    {
+    case ND_DELETE:
+    case ND_EXPR_STMT:
+    case ND_EQ:
+    case ND_STRICT_EQ:
+    case ND_NE:
+    case ND_LNOT:
+    case ND_LAND:
+    case ND_LOR:
+        return 1;
+    case ND_IF:
+    case ND_WHILE:
+    case ND_COND:
+        return parent->lhs == var;
+    default:
+        break;
+    }
+
+    while (i > 0 && escape_is_place_step(st->path[i - 1], st->path[i]))
+        i--;
+    if (i == st->depth - 1)
+        return 0;
+    const Node *top = st->path[i];
+    if (top->var_is_array || (top->type && top->type->kind == TY_ARRAY))
+        return 0;
+    return !(i > 0 && st->path[i - 1]->kind == ND_ADDR);
+}
+
+static void escape_scan(EscapeState *st, Node *node, int in_lambda)
+{
+    if (!node)
+        return;
+    if (st->depth == st->path_cap)
+    {
+        st->path_cap = st->path_cap ? st->path_cap * 2 : 32;
+        st->path = (Node **)realloc(st->path, (size_t)st->path_cap * sizeof(Node *));
+        if (!st->path)
+        {
+            diag_error("out of memory");
+            sema_abort();
+        }
+    }
+    st->path[st->depth++] = node;
+    if (node->kind == ND_LAMBDA)
+        in_lambda = 1;
+    if (node->kind == ND_VAR && node->var_ref && !node->var_is_global && !node->var_is_function)
+    {
+        EscapeVar *v = escape_find(st, node->var_ref);
+        if (v && v->decl && (in_lambda || !escape_use_is_safe(st)))
+            v->decl = NULL;
+    }
+    /* Reassigning the variable would make its delete free something else. */
+    if (node->kind == ND_ASSIGN && node->lhs && node->lhs->kind == ND_VAR && node->lhs->var_ref)
+    {
+        EscapeVar *v = escape_find(st, node->lhs->var_ref);
+        if (v)
+            v->decl = NULL;
+    }
+
+    escape_scan(st, node->lhs, in_lambda);
+    escape_scan(st, node->rhs, in_lambda);
+    escape_scan(st, node->body, in_lambda);
+    for (int i = 0; node->stmts && i < node->stmt_count; ++i)
+        escape_scan(st, node->stmts[i], in_lambda);
+    for (int i = 0; node->args && i < node->arg_count; ++i)
+        escape_scan(st, node->args[i], in_lambda);
+    if (node->kind == ND_INIT_LIST && node->init.elems)
+    {
+        for (int i = 0; i < node->init.count; ++i)
+            escape_scan(st, node->init.elems[i], in_lambda);
+    }
+    if (node->kind == ND_SWITCH)
+    {
+        escape_scan(st, node->switch_stmt.expr, in_lambda);
+        for (int i = 0; i < node->switch_stmt.case_count; ++i)
+        {
+            escape_scan(st, node->switch_stmt.cases[i].value, in_lambda);
+            escape_scan(st, node->switch_stmt.cases[i].body, in_lambda);
+        }
+    }
+    if (node->kind == ND_MATCH)
+    {
+        escape_scan(st, node->match_stmt.expr, in_lambda);
+        for (int i = 0; i < node->match_stmt.arm_count; ++i)
+        {
+            escape_scan(st, node->match_stmt.arms[i].pattern, in_lambda);
+            escape_scan(st, node->match_stmt.arms[i].guard, in_lambda);
+            escape_scan(st, node->match_stmt.arms[i].body, in_lambda);
+        }
+    }
+    st->depth--;
+}
+
+static void escape_mark_deletes(EscapeState *st, Node *node)
+{
+    if (!node)
+        return;
+    if (node->kind == ND_DELETE && node->lhs && node->lhs->kind == ND_VAR && node->lhs->var_ref &&
+        !node->lhs->var_is_global)
+    {
+        EscapeVar *v = escape_find(st, node->lhs->var_ref);
+        if (v && v->decl)
+            node->new_on_stack = 1;
+    }
+    escape_mark_deletes(st, node->lhs);
+    escape_mark_deletes(st, node->rhs);
+    escape_mark_deletes(st, node->body);
+    for (int i = 0; node->stmts && i < node->stmt_count; ++i)
+        escape_mark_deletes(st, node->stmts[i]);
+    if (node->kind == ND_SWITCH)
+    {
+        for (int i = 0; i < node->switch_stmt.case_count; ++i)
+            escape_mark_deletes(st, node->switch_stmt.cases[i].body);
+    }
+    if (node->kind == ND_MATCH)
+    {
+        for (int i = 0; i < node->match_stmt.arm_count; ++i)
+            escape_mark_deletes(st, node->match_stmt.arms[i].body);
+    }
+}
+
+/* Marks `T *p = new T;` allocations whose pointer never leaves the function,
+   so codegen can give them a stack slot and drop the matching delete. Only
+   locals bound once, outside loops and lambdas, and used in the ways
+   escape_use_is_safe allows qualify. */
+static void sema_escape_analyze(Node *fn)
+{
+    if (!fn || !fn->body)
+        return;
+    EscapeState st = {0};
+    for (int i = 0; i < fn->param_count; ++i)
+    {
+        if (fn->param_names && fn->param_names[i])
+            escape_declare(&st, fn->param_names[i], NULL);
+    }
+    escape_collect(&st, fn->body, 0, 0);
+    escape_scan(&st, fn->body, 0);
+
+    int lowered = 0;
+    for (int i = 0; i < st.count; ++i)
+    {
+        if (!st.vars[i].decl)
+            continue;
+        st.vars[i].decl->rhs->new_on_stack = 1;
+        lowered++;
+    }
+    if (lowered)
+    {
+        escape_mark_deletes(&st, fn->body);
+        compiler_verbose_logf("sema", "escape: %d new expression(s) in '%s' do not escape",
+                              lowered, fn->name ? fn->name : "<anon>");
+    }
+    free(st.vars);
+    free(st.path);
+}
+
+/* Proven-non-null tracking for `ref?` locals. Facts are a bitmask over the
+   first 64 tracked variables; an unreachable point holds every fact so that
+   joins (bitwise and) ignore it. A checked access only proves its operand
+   non-null inside a try block, where a failed check jumps to the handler;
+   elsewhere the runtime may continue after the fallback with the operand
+   still null, so only explicit tests and non-null assignments count. */
+#define NF_UNREACHABLE (~(uint64_t)0)
+
+typedef struct
+{
+    const char *name;
+    int tracked;
+} NullFlowVar;
+
+typedef struct
+{
+    NullFlowVar *vars;
+    int count;
+    int cap;
+    int try_depth;
+    int checks;
+    int elided;
+} NullFlow;
+
+static NullFlowVar *nf_find(NullFlow *nf, const char *name)
+{
+    for (int i = 0; i < nf->count; ++i)
+    {
+        if (strcmp(nf->vars[i].name, name) == 0)
+            return &nf->vars[i];
+    }
+    return NULL;
+}
+
+static void nf_declare(NullFlow *nf, const char *name, Type *type)
+{
+    NullFlowVar *v = nf_find(nf, name);
+    if (v)
+    {
+        v->tracked = 0;
+        return;
+    }
+    if (nf->count == nf->cap)
+    {
+        nf->cap = nf->cap ? nf->cap * 2 : 8;
+        nf->vars = (NullFlowVar *)realloc(nf->vars, (size_t)nf->cap * sizeof(NullFlowVar));
+        if (!nf->vars)
+        {
+            diag_error("out of memory");
+            sema_abort();
+        }
+    }
+    Type *canon = canonicalize_type_deep(type);
+    nf->vars[nf->count].name = name;
+    nf->vars[nf->count].tracked = nf->count < 64 && canon && canon->kind == TY_REF && canon->ref_nullability == 1;
+    nf->count++;
+}
+
+static uint64_t nf_bit(NullFlow *nf, const Node *e)
+{
+    while (e && e->kind == ND_CAST)
+        e = e->lhs;
+    if (!e || e->kind != ND_VAR || !e->var_ref || e->var_is_global || e->var_is_function)
+        return 0;
+    NullFlowVar *v = nf_find(nf, e->var_ref);
+    if (!v || !v->tracked)
+        return 0;
+    return (uint64_t)1 << (v - nf->vars);
+}
+
+static int nf_is_null(const Node *e)
+{
+    while (e && e->kind == ND_CAST)
+        e = e->lhs;
+    return e && e->kind == ND_NULL;
+}
+
+static int nf_is_nonnull_value(const Node *e)
+{
+    while (e && e->kind == ND_CAST)
+        e = e->lhs;
+    return e && (e->kind == ND_ADDR || e->kind == ND_NEW || e->kind == ND_STRING);
+}
+
+/* Declarations, address-of and lambda captures decide which names are
+   tracked at all. */
+static void nf_collect(NullFlow *nf, Node *node, int in_lambda)
+{
+    if (!node)
+        return;
+    if (node->kind == ND_LAMBDA)
+        in_lambda = 1;
+    if (node->kind == ND_VAR_DECL && node->var_name)
+    {
+        nf_declare(nf, node->var_name, node->var_type);
+        if (in_lambda || node->var_is_static)
+            nf_find(nf, node->var_name)->tracked = 0;
     }
-    case ND_LOR:
+    if (node->kind == ND_ADDR || (in_lambda && node->kind == ND_VAR))
     {
-        int64_t lhs = 0;
-        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
-            return 0;
-        if (lhs)
+        const Node *target = node->kind == ND_ADDR ? node->lhs : node;
+        if (target && target->kind == ND_VAR && target->var_ref)
         {
-            *out_value = inline_normalize_value(1, expr->type);
-            return 1;
+            NullFlowVar *v = nf_find(nf, target->var_ref);
+            if (v)
+                v->tracked = 0;
         }
-        int64_t rhs = 0;
-        if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, &rhs))
-            return 0;
-        *out_value = inline_normalize_value(rhs ? 1 : 0, expr->type);
-        return 1;
     }
-    case ND_EQ:
-    case ND_STRICT_EQ:
-    case ND_NE:
-    case ND_LT:
-    case ND_LE:
-    case ND_GE:
-    case ND_GT_EXPR:
+
+    nf_collect(nf, node->lhs, in_lambda);
+    nf_collect(nf, node->rhs, in_lambda);
+    nf_collect(nf, node->body, in_lambda);
+    for (int i = 0; node->stmts && i < node->stmt_count; ++i)
+        nf_collect(nf, node->stmts[i], in_lambda);
+    for (int i = 0; node->args && i < node->arg_count; ++i)
+        nf_collect(nf, node->args[i], in_lambda);
+    if (node->kind == ND_INIT_LIST && node->init.elems)
     {
-        int64_t lhs = 0;
-        int64_t rhs = 0;
-        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &lhs))
-            return 0;
-        if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, &rhs))
-            return 0;
-        int64_t result = 0;
-        switch (expr->kind)
-        {
-        case ND_EQ:
-        case ND_STRICT_EQ:
-            result = (lhs == rhs);
-            break;
-        case ND_NE:
-            result = (lhs != rhs);
-            break;
-        case ND_LT:
-            result = lhs < rhs;
-            break;
-        case ND_LE:
-            result = lhs <= rhs;
-            break;
-        case ND_GT_EXPR:
-            result = lhs > rhs;
-            break;
-        case ND_GE:
-            result = lhs >= rhs;
-            break;
-        default:
-            return 0;
-        }
-        *out_value = inline_normalize_value(result ? 1 : 0, expr->type);
-        return 1;
+        for (int i = 0; i < node->init.count; ++i)
+            nf_collect(nf, node->init.elems[i], in_lambda);
     }
-    case ND_COND:
+    if (node->kind == ND_SWITCH)
     {
-        int64_t cond = 0;
-        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &cond))
-            return 0;
-        if (cond)
+        nf_collect(nf, node->switch_stmt.expr, in_lambda);
+        for (int i = 0; i < node->switch_stmt.case_count; ++i)
         {
-            if (!inline_eval_const_expr(expr->rhs, bindings, binding_count, depth + 1, out_value))
-                return 0;
-            *out_value = inline_normalize_value(*out_value, expr->type);
-            return 1;
+            nf_collect(nf, node->switch_stmt.cases[i].value, in_lambda);
+            nf_collect(nf, node->switch_stmt.cases[i].body, in_lambda);
         }
-        if (!inline_eval_const_expr(expr->body, bindings, binding_count, depth + 1, out_value))
-            return 0;
-        *out_value = inline_normalize_value(*out_value, expr->type);
-        return 1;
     }
-    case ND_CAST:
+    if (node->kind == ND_MATCH)
     {
-        int64_t val = 0;
-        if (!inline_eval_const_expr(expr->lhs, bindings, binding_count, depth + 1, &val))
-            return 0;
-        *out_value = inline_normalize_value(val, expr->type);
-        return 1;
-    }
-    case ND_CALL:
-        return inline_eval_inline_call(expr, bindings, binding_count, depth + 1, out_value);
-    default:
-        return 0;
+        nf_collect(nf, node->match_stmt.expr, in_lambda);
+        for (int i = 0; i < node->match_stmt.arm_count; ++i)
+        {
+            nf_collect(nf, node->match_stmt.arms[i].pattern, in_lambda);
+            nf_collect(nf, node->match_stmt.arms[i].guard, in_lambda);
+            nf_collect(nf, node->match_stmt.arms[i].body, in_lambda);
+        }
     }
 }
 
-static int inline_try_fold_call(Node *call_expr)
+/* Tracked variables that may be rebound anywhere below `node`. */
+static uint64_t nf_assigned(NullFlow *nf, const Node *node)
 {
-    if (!call_expr || call_expr->kind != ND_CALL)
-        return 0;
-    if (call_expr->call_is_jump)
-        return 0;
-    if (call_expr->call_is_indirect)
-        return 0;
-    if (!call_expr->call_target)
-        return 0;
-    const Node *fn = call_expr->call_target;
-    if (!fn->inline_candidate || !fn->inline_expr)
-        return 0;
-    if (!fn->ret_type || !type_is_int(fn->ret_type))
-        return 0;
-    if (fn->param_count != call_expr->arg_count)
+    if (!node || node->kind == ND_LAMBDA)
         return 0;
-    if (fn->param_count > INLINE_PARAM_LIMIT)
-        return 0;
-
-    InlineBinding bindings[INLINE_PARAM_LIMIT];
-    for (int i = 0; i < fn->param_count; ++i)
+    uint64_t mask = 0;
+    switch (node->kind)
     {
-        const Node *arg = (call_expr->args && i < call_expr->arg_count) ? call_expr->args[i] : NULL;
-        if (!arg)
-            return 0;
-        const char *param_name = (fn->param_names && i < fn->param_count) ? fn->param_names[i] : NULL;
-        if (!param_name)
-            return 0;
-        int64_t value = 0;
-        if (!inline_eval_const_expr(arg, NULL, 0, 0, &value))
-            return 0;
-        Type *param_type = (fn->param_types && i < fn->param_count) ? fn->param_types[i] : NULL;
-        bindings[i].name = param_name;
-        bindings[i].value = inline_normalize_value(value, param_type);
-        bindings[i].type = param_type;
+    case ND_ASSIGN:
+    case ND_ADD_ASSIGN:
+    case ND_SUB_ASSIGN:
+    case ND_MUL_ASSIGN:
+    case ND_DIV_ASSIGN:
+    case ND_MOD_ASSIGN:
+    case ND_BITAND_ASSIGN:
+    case ND_BITOR_ASSIGN:
+    case ND_BITXOR_ASSIGN:
+    case ND_SHL_ASSIGN:
+    case ND_SHR_ASSIGN:
+    case ND_PREINC:
+    case ND_PREDEC:
+    case ND_POSTINC:
+    case ND_POSTDEC:
+    case ND_DELETE:
+        mask |= nf_bit(nf, node->lhs);
+        break;
+    case ND_VAR_DECL:
+        if (node->var_name)
+        {
+            NullFlowVar *v = nf_find(nf, node->var_name);
+            if (v && v->tracked)
+                mask |= (uint64_t)1 << (v - nf->vars);
+        }
+        break;
+    default:
+        break;
     }
 
-    int64_t result = 0;
-    if (!inline_eval_const_expr(fn->inline_expr, bindings, fn->param_count, 0, &result))
-        return 0;
-
-    Type *ret_type = canonicalize_type_deep(fn->ret_type);
-    result = inline_normalize_value(result, ret_type);
-
-    call_expr->kind = ND_INT;
-    call_expr->int_val = result;
-    call_expr->lhs = NULL;
-    call_expr->rhs = NULL;
-    call_expr->body = NULL;
-    call_expr->args = NULL;
-    call_expr->arg_count = 0;
-    call_expr->call_target = NULL;
-    call_expr->call_name = NULL;
-    call_expr->call_func_type = NULL;
-    call_expr->call_is_indirect = 0;
-    call_expr->call_is_varargs = 0;
-    call_expr->type = ret_type;
-    return 1;
+    mask |= nf_assigned(nf, node->lhs);
+    mask |= nf_assigned(nf, node->rhs);
+    mask |= nf_assigned(nf, node->body);
+    for (int i = 0; node->stmts && i < node->stmt_count; ++i)
+        mask |= nf_assigned(nf, node->stmts[i]);
+    for (int i = 0; node->args && i < node->arg_count; ++i)
+        mask |= nf_assigned(nf, node->args[i]);
+    if (node->kind == ND_INIT_LIST && node->init.elems)
+    {
+        for (int i = 0; i < node->init.count; ++i)
+            mask |= nf_assigned(nf, node->init.elems[i]);
+    }
+    if (node->kind == ND_SWITCH)
+    {
+        mask |= nf_assigned(nf, node->switch_stmt.expr);
+        for (int i = 0; i < node->switch_stmt.case_count; ++i)
+            mask |= nf_assigned(nf, node->switch_stmt.cases[i].body);
+    }
+    if (node->kind == ND_MATCH)
+    {
+        mask |= nf_assigned(nf, node->match_stmt.expr);
+        for (int i = 0; i < node->match_stmt.arm_count; ++i)
+        {
+            mask |= nf_assigned(nf, node->match_stmt.arms[i].guard);
+            mask |= nf_assigned(nf, node->match_stmt.arms[i].body);
+        }
+    }
+    return mask;
 }
 
-static int inline_expr_cost(const Node *expr)
+static uint64_t nf_expr(NullFlow *nf, Node *e, uint64_t in);
+
+static void nf_cond(NullFlow *nf, Node *e, uint64_t in, uint64_t *when_true, uint64_t *when_false)
 {
-    if (!expr)
-        return 0;
-    int cost = 1;
-    cost += inline_expr_cost(expr->lhs);
-    cost += inline_expr_cost(expr->rhs);
-    cost += inline_expr_cost(expr->body);
-    if (expr->kind == ND_BLOCK && expr->stmts)
+    uint64_t at, af, bt, bf;
+    if (e && e->kind == ND_LAND)
     {
-        for (int i = 0; i < expr->stmt_count; ++i)
-            cost += inline_expr_cost(expr->stmts[i]);
+        nf_cond(nf, e->lhs, in, &at, &af);
+        nf_cond(nf, e->rhs, at, &bt, &bf);
+        *when_true = bt;
+        *when_false = af & bf;
+        return;
     }
-    if (expr->kind == ND_CALL && expr->args)
+    if (e && e->kind == ND_LOR)
     {
-        for (int i = 0; i < expr->arg_count; ++i)
-            cost += inline_expr_cost(expr->args[i]);
+        nf_cond(nf, e->lhs, in, &at, &af);
+        nf_cond(nf, e->rhs, af, &bt, &bf);
+        *when_true = at & bt;
+        *when_false = bf;
+        return;
     }
-    if (expr->kind == ND_INIT_LIST && expr->init.elems)
+    if (e && e->kind == ND_LNOT)
     {
-        for (int i = 0; i < expr->init.count; ++i)
-            cost += inline_expr_cost(expr->init.elems[i]);
+        nf_cond(nf, e->lhs, in, when_false, when_true);
+        return;
+    }
+
+    uint64_t out = nf_expr(nf, e, in);
+    *when_true = out;
+    *when_false = out;
+    if (!e)
+        return;
+    if (e->kind == ND_NE || e->kind == ND_EQ || e->kind == ND_STRICT_EQ)
+    {
+        uint64_t bit = 0;
+        if (nf_is_null(e->rhs))
+            bit = nf_bit(nf, e->lhs);
+        else if (nf_is_null(e->lhs))
+            bit = nf_bit(nf, e->rhs);
+        if (e->kind == ND_NE)
+            *when_true |= bit;
+        else
+            *when_false |= bit;
+    }
+    else
+    {
+        *when_true |= nf_bit(nf, e);
     }
-    return cost;
 }
 
-static void inline_walk_usage(Node *current_fn, const Node *node, const Node *parent)
+/* Children are walked from the same incoming facts because sema does not
+   pin down their evaluation order. Callers strip variables rebound inside
+   the expression before walking it. */
+static uint64_t nf_expr(NullFlow *nf, Node *e, uint64_t in)
 {
-    if (!node)
-        return;
+    if (!e || e->kind == ND_LAMBDA)
+        return in;
+    if (e->kind == ND_LAND || e->kind == ND_LOR || e->kind == ND_LNOT)
+    {
+        uint64_t t, f;
+        nf_cond(nf, e, in, &t, &f);
+        return t & f;
+    }
+    if (e->kind == ND_COND)
+    {
+        uint64_t t, f;
+        nf_cond(nf, e->lhs, in, &t, &f);
+        return nf_expr(nf, e->rhs, t) & nf_expr(nf, e->body, f);
+    }
 
-    if (node->kind == ND_CALL)
+    uint64_t out = in;
+    out |= nf_expr(nf, e->lhs, in);
+    out |= nf_expr(nf, e->rhs, in);
+    out |= nf_expr(nf, e->body, in);
+    for (int i = 0; e->args && i < e->arg_count; ++i)
+        out |= nf_expr(nf, e->args[i], in);
+    if (e->kind == ND_INIT_LIST && e->init.elems)
     {
-        if (node->call_target && node->call_target == current_fn)
-            current_fn->inline_recursive = 1;
+        for (int i = 0; i < e->init.count; ++i)
+            out |= nf_expr(nf, e->init.elems[i], in);
     }
 
-    if (node->kind == ND_VAR && node->referenced_function)
+    const Node *base = e->lhs;
+    int checked = base && base->type && base->type->kind == TY_REF && base->type->ref_nullability == 1 &&
+                  (e->kind == ND_DEREF || (e->kind == ND_MEMBER && !e->is_pointer_deref));
+    if (checked)
     {
-        int is_call_target = parent && parent->kind == ND_CALL && parent->lhs == node;
-        if (!is_call_target)
-            node->referenced_function->inline_address_taken = 1;
+        nf->checks++;
+        uint64_t bit = nf_bit(nf, base);
+        if (bit && (in & bit))
+        {
+            e->null_check_elided = 1;
+            nf->elided++;
+        }
+        else if (nf->try_depth > 0)
+        {
+            out |= bit;
+        }
     }
+    return out;
+}
 
-    inline_walk_usage(current_fn, node->lhs, node);
-    inline_walk_usage(current_fn, node->rhs, node);
-    inline_walk_usage(current_fn, node->body, node);
+static uint64_t nf_root_expr(NullFlow *nf, Node *e, uint64_t in)
+{
+    uint64_t assigned = nf_assigned(nf, e);
+    uint64_t out = nf_expr(nf, e, in & ~assigned) & ~assigned;
+    if (e && e->kind == ND_ASSIGN && nf_is_nonnull_value(e->rhs))
+        out |= nf_bit(nf, e->lhs);
+    return out;
+}
 
-    if (node->kind == ND_BLOCK && node->stmts)
+static uint64_t nf_stmt(NullFlow *nf, Node *s, uint64_t in)
+{
+    if (!s)
+        return in;
+    switch (s->kind)
     {
-        for (int i = 0; i < node->stmt_count; ++i)
-            inline_walk_usage(current_fn, node->stmts[i], node);
+    case ND_BLOCK:
+    {
+        uint64_t cur = in;
+        for (int i = 0; s->stmts && i < s->stmt_count; ++i)
+            cur = nf_stmt(nf, s->stmts[i], cur);
+        return cur;
     }
-
-    if (node->kind == ND_CALL && node->args)
+    case ND_VAR_DECL:
     {
-        for (int i = 0; i < node->arg_count; ++i)
-            inline_walk_usage(current_fn, node->args[i], node);
+        uint64_t out = nf_root_expr(nf, s->rhs, in) & ~nf_assigned(nf, s);
+        if (s->rhs && nf_is_nonnull_value(s->rhs) && s->var_name)
+        {
+            NullFlowVar *v = nf_find(nf, s->var_name);
+            if (v && v->tracked)
+                out |= (uint64_t)1 << (v - nf->vars);
+        }
+        return out;
+    }
+    case ND_IF:
+    {
+        uint64_t assigned = nf_assigned(nf, s->lhs);
+        uint64_t t, f;
+        nf_cond(nf, s->lhs, in & ~assigned, &t, &f);
+        t &= ~assigned;
+        f &= ~assigned;
+        return nf_stmt(nf, s->rhs, t) & nf_stmt(nf, s->body, f);
+    }
+    case ND_WHILE:
+    {
+        uint64_t head = in & ~nf_assigned(nf, s);
+        uint64_t t, f;
+        nf_cond(nf, s->lhs, head, &t, &f);
+        nf_stmt(nf, s->body, nf_stmt(nf, s->rhs, t));
+        return head;
+    }
+    case ND_RET:
+    case ND_THROW:
+    case ND_BREAK:
+    case ND_CONTINUE:
+        nf_root_expr(nf, s->lhs, in);
+        return NF_UNREACHABLE;
+    case ND_EXPR_STMT:
+        return nf_root_expr(nf, s->lhs, in);
+    case ND_TRY:
+    {
+        uint64_t base = in & ~nf_assigned(nf, s);
+        nf->try_depth++;
+        nf_stmt(nf, s->lhs, base);
+        nf->try_depth--;
+        nf_stmt(nf, s->rhs, base);
+        nf_stmt(nf, s->body, base);
+        return base;
+    }
+    case ND_SWITCH:
+    {
+        uint64_t assigned = nf_assigned(nf, s);
+        uint64_t base = nf_expr(nf, s->switch_stmt.expr, in & ~assigned) & ~assigned;
+        for (int i = 0; i < s->switch_stmt.case_count; ++i)
+            nf_stmt(nf, s->switch_stmt.cases[i].body, base);
+        return base;
+    }
+    case ND_MATCH:
+    {
+        uint64_t assigned = nf_assigned(nf, s);
+        uint64_t base = nf_expr(nf, s->match_stmt.expr, in & ~assigned) & ~assigned;
+        for (int i = 0; i < s->match_stmt.arm_count; ++i)
+        {
+            uint64_t t, f;
+            nf_cond(nf, s->match_stmt.arms[i].guard, base, &t, &f);
+            nf_stmt(nf, s->match_stmt.arms[i].body, s->match_stmt.arms[i].guard ? t & ~assigned : base);
+        }
+        return base;
+    }
+    default:
+        return nf_root_expr(nf, s, in);
     }
+}
 
-    if (node->kind == ND_INIT_LIST && node->init.elems)
+static void sema_null_flow_analyze(Node *fn)
+{
+    if (!fn || !fn->body)
+        return;
+    NullFlow nf = {0};
+    for (int i = 0; i < fn->param_count; ++i)
     {
-        for (int i = 0; i < node->init.count; ++i)
-            inline_walk_usage(current_fn, node->init.elems[i], node);
+        if (fn->param_names && fn->param_names[i])
+            nf_declare(&nf, fn->param_names[i], fn->param_types ? fn->param_types[i] : NULL);
     }
+    nf_collect(&nf, fn->body, 0);
+    nf_stmt(&nf, fn->body, 0);
+    if (nf.elided)
+        compiler_verbose_logf("sema", "nullflow: elided %d of %d null check(s) in '%s'",
+                              nf.elided, nf.checks, fn->name ? fn->name : "<anon>");
+    free(nf.vars);
 }
 
 static void analyze_inline_candidates(Node *root)
@@ -7514,7 +10903,9 @@ static void analyze_inline_candidates(Node *root)
         Node *fn = functions[i];
         const char *fn_name = fn->name ? fn->name : "<anon>";
 
-        if (!fn->wants_inline)
+        long long entry_count = profile_count(PROFILE_FUNCTION, profile_function_key(fn), 0, 0);
+        int profile_hot = profile_is_hot(entry_count);
+        if (!fn->wants_inline && !profile_hot)
         {
             compiler_verbose_logf("inline", "skip %s: function not marked inline", fn_name);
             continue;
@@ -7575,10 +10966,11 @@ static void analyze_inline_candidates(Node *root)
             continue;
         }
         int cost = inline_expr_cost(ret_expr);
-        if (cost > INLINE_COST_LIMIT)
+        int cost_limit = profile_hot ? INLINE_HOT_COST_LIMIT : INLINE_COST_LIMIT;
+        if (cost > cost_limit)
         {
             compiler_verbose_logf("inline", "skip %s: inline cost %d exceeds limit %d", fn_name, cost,
-                                  INLINE_COST_LIMIT);
+                                  cost_limit);
             continue;
         }
         fn->inline_candidate = 1;
@@ -7586,7 +10978,11 @@ static void analyze_inline_candidates(Node *root)
         fn->inline_expr = ret_expr;
         if (!fn->is_exposed && !fn->is_entrypoint)
             fn->inline_needs_body = 0;
-        compiler_verbose_logf("inline", "select %s as inline candidate (cost=%d)", fn_name, cost);
+        if (profile_hot)
+            compiler_verbose_logf("inline", "select %s as inline candidate (cost=%d, profile: %lld calls)", fn_name,
+                                  cost, entry_count);
+        else
+            compiler_verbose_logf("inline", "select %s as inline candidate (cost=%d)", fn_name, cost);
     }
 
     free(functions);
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include "ast.h"
+#include "workpool.h"
 
 #define ANSI_RESET "\x1b[0m"
 #define ANSI_BOLD_RED "\x1b[1;31m"
@@ -112,7 +113,9 @@ void compiler_verbose_logf(const char *phase, const char *fmt, ...)
     const VerbosePhaseInfo *info = compiler_verbose_lookup(phase);
     va_list ap;
     va_start(ap, fmt);
+    workpool_shared_lock();
     compiler_verbose_vprint(info, " ", fmt, ap);
+    workpool_shared_unlock();
     va_end(ap);
 }
 
@@ -126,7 +129,9 @@ void compiler_verbose_treef(const char *phase, const char *branch, const char *f
     const VerbosePhaseInfo *info = compiler_verbose_lookup(phase);
     va_list ap;
     va_start(ap, fmt);
+    workpool_shared_lock();
     compiler_verbose_vprint(info, suffix, fmt, ap);
+    workpool_shared_unlock();
     va_end(ap);
 }
 
@@ -143,9 +148,91 @@ static const char *diag_color_for(const char *sev)
     return ANSI_BOLD_WHITE;
 }
 
-static void diag_json_write_string(FILE *out, const char *value)
+static WORKPOOL_THREAD_LOCAL DiagCapture *g_diag_capture = NULL;
+
+DiagCapture *diag_capture_set(DiagCapture *capture)
 {
-    fputc('"', out);
+    DiagCapture *previous = g_diag_capture;
+    g_diag_capture = capture;
+    return previous;
+}
+
+void diag_capture_print(const DiagCapture *capture, size_t from, size_t to)
+{
+    if (!capture || to > capture->len || from >= to)
+        return;
+    fwrite(capture->text + from, 1, to - from, stderr);
+}
+
+void diag_capture_free(DiagCapture *capture)
+{
+    if (!capture)
+        return;
+    free(capture->text);
+    capture->text = NULL;
+    capture->len = capture->cap = 0;
+}
+
+/* Diagnostics go to stderr unless the calling thread installed a capture. */
+static void diag_out_write(DiagCapture *out, const char *s, size_t n)
+{
+    if (!out)
+    {
+        fwrite(s, 1, n, stderr);
+        return;
+    }
+    if (out->len + n + 1 > out->cap)
+    {
+        size_t ncap = out->cap ? out->cap : 256;
+        while (ncap < out->len + n + 1)
+            ncap *= 2;
+        char *grown = (char *)realloc(out->text, ncap);
+        if (!grown)
+            return;
+        out->text = grown;
+        out->cap = ncap;
+    }
+    memcpy(out->text + out->len, s, n);
+    out->len += n;
+    out->text[out->len] = '\0';
+}
+
+static void diag_out_putc(DiagCapture *out, char ch)
+{
+    diag_out_write(out, &ch, 1);
+}
+
+static void diag_out_puts(DiagCapture *out, const char *s)
+{
+    diag_out_write(out, s, strlen(s));
+}
+
+static char *diag_format_message(const char *fmt, va_list ap);
+
+static void diag_out_vprintf(DiagCapture *out, const char *fmt, va_list ap)
+{
+    if (!out)
+    {
+        vfprintf(stderr, fmt, ap);
+        return;
+    }
+    char *text = diag_format_message(fmt, ap);
+    if (text)
+        diag_out_puts(out, text);
+    free(text);
+}
+
+static void diag_out_printf(DiagCapture *out, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    diag_out_vprintf(out, fmt, ap);
+    va_end(ap);
+}
+
+static void diag_json_write_string(DiagCapture *out, const char *value)
+{
+    diag_out_putc(out, '"');
     if (value)
     {
         const unsigned char *p = (const unsigned char *)value;
@@ -155,30 +242,30 @@ static void diag_json_write_string(FILE *out, const char *value)
             switch (ch)
             {
             case '"':
-                fputs("\\\"", out);
+                diag_out_puts(out, "\\\"");
                 break;
             case '\\':
-                fputs("\\\\", out);
+                diag_out_puts(out, "\\\\");
                 break;
             case '\n':
-                fputs("\\n", out);
+                diag_out_puts(out, "\\n");
                 break;
             case '\r':
-                fputs("\\r", out);
+                diag_out_puts(out, "\\r");
                 break;
             case '\t':
-                fputs("\\t", out);
+                diag_out_puts(out, "\\t");
                 break;
             default:
                 if (ch < 0x20)
-                    fprintf(out, "\\u%04x", (unsigned int)ch);
+                    diag_out_printf(out, "\\u%04x", (unsigned int)ch);
                 else
-                    fputc((int)ch, out);
+                    diag_out_putc(out, (char)ch);
                 break;
             }
         }
     }
-    fputc('"', out);
+    diag_out_putc(out, '"');
 }
 
 static char *diag_format_message(const char *fmt, va_list ap)
@@ -207,17 +294,18 @@ static void diag_emit_data_log(const char *sev, const SourceBuffer *src,
 {
     int safe_line = line > 0 ? line : 0;
     int safe_col = col > 0 ? col : 0;
-    fprintf(stderr, "data-log:{\"severity\":");
-    diag_json_write_string(stderr, sev ? sev : "");
-    fprintf(stderr, ",\"file\":");
+    DiagCapture *out = g_diag_capture;
+    diag_out_puts(out, "data-log:{\"severity\":");
+    diag_json_write_string(out, sev ? sev : "");
+    diag_out_puts(out, ",\"file\":");
     if (src && src->filename)
-        diag_json_write_string(stderr, src->filename);
+        diag_json_write_string(out, src->filename);
     else
-        fputs("null", stderr);
-    fprintf(stderr, ",\"line\":%d,\"col\":%d,\"message\":", safe_line,
-            safe_col);
-    diag_json_write_string(stderr, message ? message : "");
-    fputs("}\n", stderr);
+        diag_out_puts(out, "null");
+    diag_out_printf(out, ",\"line\":%d,\"col\":%d,\"message\":", safe_line,
+                    safe_col);
+    diag_json_write_string(out, message ? message : "");
+    diag_out_puts(out, "}\n");
 }
 
 void *xmalloc(size_t sz)
@@ -248,6 +336,64 @@ char *xstrdup(const char *s)
     return p;
 }
 
+static char **g_intern_slots = NULL;
+static size_t g_intern_cap = 0;
+static size_t g_intern_count = 0;
+
+static uint64_t intern_hash(const char *s)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    while (*s)
+    {
+        hash ^= (uint8_t)(*s++);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void intern_grow(void)
+{
+    size_t ncap = g_intern_cap ? g_intern_cap * 2 : 1024;
+    char **nslots = (char **)xcalloc(ncap, sizeof(char *));
+    for (size_t i = 0; i < g_intern_cap; ++i)
+    {
+        char *str = g_intern_slots[i];
+        if (!str)
+            continue;
+        size_t at = (size_t)intern_hash(str) & (ncap - 1);
+        while (nslots[at])
+            at = (at + 1) & (ncap - 1);
+        nslots[at] = str;
+    }
+    free(g_intern_slots);
+    g_intern_slots = nslots;
+    g_intern_cap = ncap;
+}
+
+const char *xintern(const char *s)
+{
+    if (!s)
+        return NULL;
+    workpool_shared_lock();
+    if ((g_intern_count + 1) * 2 > g_intern_cap)
+        intern_grow();
+    size_t at = (size_t)intern_hash(s) & (g_intern_cap - 1);
+    while (g_intern_slots[at])
+    {
+        if (strcmp(g_intern_slots[at], s) == 0)
+            break;
+        at = (at + 1) & (g_intern_cap - 1);
+    }
+    if (!g_intern_slots[at])
+    {
+        g_intern_slots[at] = xstrdup(s);
+        g_intern_count++;
+    }
+    const char *interned = g_intern_slots[at];
+    workpool_shared_unlock();
+    return interned;
+}
+
 static void ast_free_rec(Node *n)
 {
     if (!n)
@@ -1023,18 +1169,19 @@ static void vdiag_at(const SourceBuffer *src, int line, int col, const char *sev
         free(message);
         return;
     }
+    DiagCapture *out = g_diag_capture;
     const char *file = src && src->filename ? src->filename : "<input>";
     if (diag_use_ansi)
     {
         const char *color = diag_color_for(sev);
-        fprintf(stderr, "%s:%d:%d: %s%s%s: ", file, line, col, color, sev, ANSI_RESET);
+        diag_out_printf(out, "%s:%d:%d: %s%s%s: ", file, line, col, color, sev, ANSI_RESET);
     }
     else
     {
-        fprintf(stderr, "%s:%d:%d: %s: ", file, line, col, sev);
+        diag_out_printf(out, "%s:%d:%d: %s: ", file, line, col, sev);
     }
-    vfprintf(stderr, fmt, ap);
-    fputc('\n', stderr);
+    diag_out_vprintf(out, fmt, ap);
+    diag_out_putc(out, '\n');
     
     if (src && src->src && src->length > 0 && line > 0)
     {
@@ -1061,20 +1208,20 @@ static void vdiag_at(const SourceBuffer *src, int line, int col, const char *sev
             q++;
         if (line_start < src->src + src->length)
         {
-            fwrite(line_start, 1, (size_t)(q - line_start), stderr);
-            fputc('\n', stderr);
+            diag_out_write(out, line_start, (size_t)(q - line_start));
+            diag_out_putc(out, '\n');
             int caret = col > 1 ? col - 1 : 0;
             for (int k = 0; k < caret; k++)
-                fputc(' ', stderr);
+                diag_out_putc(out, ' ');
             if (diag_use_ansi)
             {
                 const char *color = diag_color_for(sev);
-                fprintf(stderr, "%s^%s\n", color, ANSI_RESET);
+                diag_out_printf(out, "%s^%s\n", color, ANSI_RESET);
             }
             else
             {
-                fputc('^', stderr);
-                fputc('\n', stderr);
+                diag_out_putc(out, '^');
+                diag_out_putc(out, '\n');
             }
         }
     }
@@ -1089,64 +1236,77 @@ static void vdiag(const char *sev, const char *fmt, va_list ap)
         free(message);
         return;
     }
+    DiagCapture *out = g_diag_capture;
     if (diag_use_ansi)
     {
         const char *color = diag_color_for(sev);
-        fprintf(stderr, "%s%s%s: ", color, sev, ANSI_RESET);
+        diag_out_printf(out, "%s%s%s: ", color, sev, ANSI_RESET);
     }
     else
     {
-        fprintf(stderr, "%s: ", sev);
+        diag_out_printf(out, "%s: ", sev);
     }
-    vfprintf(stderr, fmt, ap);
-    fputc('\n', stderr);
+    diag_out_vprintf(out, fmt, ap);
+    diag_out_putc(out, '\n');
 }
 
 void diag_error_at(const SourceBuffer *src, int line, int col, const char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
+    workpool_shared_lock();
     vdiag_at(src, line, col, "error", fmt, ap);
     va_end(ap);
     g_errs++;
+    workpool_shared_unlock();
 }
 void diag_warning_at(const SourceBuffer *src, int line, int col, const char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
+    workpool_shared_lock();
     vdiag_at(src, line, col, "warning", fmt, ap);
     va_end(ap);
     g_warns++;
+    workpool_shared_unlock();
 }
 void diag_note_at(const SourceBuffer *src, int line, int col, const char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
+    workpool_shared_lock();
     vdiag_at(src, line, col, "note", fmt, ap);
     va_end(ap);
+    workpool_shared_unlock();
 }
 void diag_error(const char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
+    workpool_shared_lock();
     vdiag("error", fmt, ap);
     va_end(ap);
     g_errs++;
+    workpool_shared_unlock();
 }
 void diag_warning(const char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
+    workpool_shared_lock();
     vdiag("warning", fmt, ap);
     va_end(ap);
     g_warns++;
+    workpool_shared_unlock();
 }
 void diag_note(const char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
+    workpool_shared_lock();
     vdiag("note", fmt, ap);
     va_end(ap);
+    workpool_shared_unlock();
 }
 int diag_error_count(void) { return g_errs; }
 int diag_warning_count(void) { return g_warns; }
@@ -0,0 +1,303 @@
+#if !defined(_WIN32) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 700
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "workpool.h"
+#include "ast.h"
+
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION WorkpoolMutex;
+typedef HANDLE WorkpoolThread;
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_mutex_t WorkpoolMutex;
+typedef pthread_t WorkpoolThread;
+#endif
+
+/* Sema recurses once per expression level; give workers the same headroom
+   the main thread usually has instead of the platform default. */
+#define WORKPOOL_STACK_SIZE (8u * 1024u * 1024u)
+
+typedef struct
+{
+    WorkpoolMutex lock;
+    int head;
+    int tail;
+} WorkpoolDeque;
+
+typedef struct
+{
+    WorkpoolDeque *deques;
+    int worker_count;
+    WorkpoolTaskFn fn;
+    void *ctx;
+} WorkpoolJob;
+
+typedef struct
+{
+    WorkpoolJob *job;
+    int worker;
+} WorkpoolWorker;
+
+static WorkpoolMutex g_shared_lock;
+static int g_shared_lock_ready = 0;
+static int g_workpool_active = 0;
+static WORKPOOL_THREAD_LOCAL int g_shared_depth = 0;
+
+static void workpool_mutex_init(WorkpoolMutex *m, int recursive)
+{
+#ifdef _WIN32
+    (void)recursive;
+    InitializeCriticalSection(m);
+#else
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if (recursive)
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(m, &attr);
+    pthread_mutexattr_destroy(&attr);
+#endif
+}
+
+static void workpool_mutex_destroy(WorkpoolMutex *m)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(m);
+#else
+    pthread_mutex_destroy(m);
+#endif
+}
+
+static void workpool_mutex_lock(WorkpoolMutex *m)
+{
+#ifdef _WIN32
+    EnterCriticalSection(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+static void workpool_mutex_unlock(WorkpoolMutex *m)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+int workpool_hardware_threads(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+int workpool_active(void)
+{
+    return g_workpool_active;
+}
+
+void workpool_shared_lock(void)
+{
+    if (g_workpool_active)
+    {
+        workpool_mutex_lock(&g_shared_lock);
+        g_shared_depth++;
+    }
+}
+
+void workpool_shared_unlock(void)
+{
+    if (g_workpool_active && g_shared_depth > 0)
+    {
+        g_shared_depth--;
+        workpool_mutex_unlock(&g_shared_lock);
+    }
+}
+
+void workpool_shared_release(void)
+{
+    while (g_shared_depth > 0)
+    {
+        g_shared_depth--;
+        workpool_mutex_unlock(&g_shared_lock);
+    }
+}
+
+int workpool_atomic_load_int(const int *p)
+{
+#ifdef _MSC_VER
+    return (int)InterlockedCompareExchange((volatile LONG *)p, 0, 0);
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void workpool_atomic_store_int(int *p, int value)
+{
+#ifdef _MSC_VER
+    InterlockedExchange((volatile LONG *)p, (LONG)value);
+#else
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+#endif
+}
+
+void *workpool_atomic_load_ptr(void *const *p)
+{
+#ifdef _MSC_VER
+    return InterlockedCompareExchangePointer((PVOID volatile *)p, NULL, NULL);
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void workpool_atomic_store_ptr(void **p, void *value)
+{
+#ifdef _MSC_VER
+    InterlockedExchangePointer((PVOID volatile *)p, value);
+#else
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+#endif
+}
+
+static int workpool_take_front(WorkpoolDeque *dq)
+{
+    int task = -1;
+    workpool_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail)
+        task = dq->head++;
+    workpool_mutex_unlock(&dq->lock);
+    return task;
+}
+
+static int workpool_steal_back(WorkpoolDeque *dq)
+{
+    int task = -1;
+    workpool_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail)
+        task = --dq->tail;
+    workpool_mutex_unlock(&dq->lock);
+    return task;
+}
+
+static void workpool_worker_loop(WorkpoolJob *job, int worker)
+{
+    for (;;)
+    {
+        int task = workpool_take_front(&job->deques[worker]);
+        for (int i = 1; task < 0 && i < job->worker_count; ++i)
+            task = workpool_steal_back(&job->deques[(worker + i) % job->worker_count]);
+        if (task < 0)
+            return;
+        job->fn(job->ctx, task, worker);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI workpool_thread_main(LPVOID arg)
+{
+    WorkpoolWorker *w = (WorkpoolWorker *)arg;
+    workpool_worker_loop(w->job, w->worker);
+    return 0;
+}
+#else
+static void *workpool_thread_main(void *arg)
+{
+    WorkpoolWorker *w = (WorkpoolWorker *)arg;
+    workpool_worker_loop(w->job, w->worker);
+    return NULL;
+}
+#endif
+
+static int workpool_thread_start(WorkpoolThread *thread, WorkpoolWorker *w)
+{
+#ifdef _WIN32
+    *thread = CreateThread(NULL, WORKPOOL_STACK_SIZE, workpool_thread_main, w,
+                           STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
+    return *thread != NULL;
+#else
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WORKPOOL_STACK_SIZE);
+    int rc = pthread_create(thread, &attr, workpool_thread_main, w);
+    pthread_attr_destroy(&attr);
+    return rc == 0;
+#endif
+}
+
+static void workpool_thread_join(WorkpoolThread thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+void workpool_run(int task_count, int jobs, WorkpoolTaskFn fn, void *ctx)
+{
+    if (!fn || task_count <= 0)
+        return;
+    if (jobs > task_count)
+        jobs = task_count;
+    if (jobs <= 1 || g_workpool_active)
+    {
+        for (int i = 0; i < task_count; ++i)
+            fn(ctx, i, 0);
+        return;
+    }
+
+    if (!g_shared_lock_ready)
+    {
+        workpool_mutex_init(&g_shared_lock, 1);
+        g_shared_lock_ready = 1;
+    }
+
+    WorkpoolJob job;
+    job.deques = (WorkpoolDeque *)xcalloc((size_t)jobs, sizeof(WorkpoolDeque));
+    job.worker_count = jobs;
+    job.fn = fn;
+    job.ctx = ctx;
+    for (int w = 0; w < jobs; ++w)
+    {
+        workpool_mutex_init(&job.deques[w].lock, 0);
+        job.deques[w].head = (int)((long long)task_count * w / jobs);
+        job.deques[w].tail = (int)((long long)task_count * (w + 1) / jobs);
+    }
+
+    WorkpoolWorker *workers = (WorkpoolWorker *)xcalloc((size_t)jobs, sizeof(WorkpoolWorker));
+    WorkpoolThread *threads = (WorkpoolThread *)xcalloc((size_t)jobs, sizeof(WorkpoolThread));
+    int started = 1;
+    g_workpool_active = 1;
+    for (int w = 1; w < jobs; ++w)
+    {
+        workers[w].job = &job;
+        workers[w].worker = w;
+        if (!workpool_thread_start(&threads[w], &workers[w]))
+            break;
+        started++;
+    }
+
+    /* Deques of workers that failed to start are drained by stealing. */
+    workpool_worker_loop(&job, 0);
+    for (int w = 1; w < started; ++w)
+        workpool_thread_join(threads[w]);
+    g_workpool_active = 0;
+
+    for (int w = 0; w < jobs; ++w)
+        workpool_mutex_destroy(&job.deques[w].lock);
+    free(threads);
+    free(workers);
+    free(job.deques);
+}
@@ -0,0 +1,41 @@
+#ifndef CHANCE_WORKPOOL_H
+#define CHANCE_WORKPOOL_H
+
+/* Small fork/join pool used to fan independent compiler work out over
+   threads. Each worker owns a deque of task indices, takes work from the
+   front of its own deque and steals from the back of others once it runs
+   dry. The calling thread participates as worker 0. */
+
+typedef void (*WorkpoolTaskFn)(void *ctx, int task, int worker);
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define WORKPOOL_THREAD_LOCAL __declspec(thread)
+#else
+#define WORKPOOL_THREAD_LOCAL _Thread_local
+#endif
+
+int workpool_hardware_threads(void);
+
+/* Runs fn for every task in [0, task_count) on up to `jobs` threads and
+   returns once all tasks finished. Falls back to running inline when only
+   one job is requested, threads cannot be created, or a pool is already
+   running. */
+void workpool_run(int task_count, int jobs, WorkpoolTaskFn fn, void *ctx);
+
+/* Non-zero while workpool_run has more than one thread in flight. */
+int workpool_active(void);
+
+/* Process-wide recursive lock guarding shared compiler state. A no-op
+   outside of workpool_run so single-threaded paths pay nothing. */
+void workpool_shared_lock(void);
+void workpool_shared_unlock(void);
+/* Drops every level of the shared lock the calling thread still holds, for
+   callers that unwind out of a task instead of returning. */
+void workpool_shared_release(void);
+
+int workpool_atomic_load_int(const int *p);
+void workpool_atomic_store_int(int *p, int value);
+void *workpool_atomic_load_ptr(void *const *p);
+void workpool_atomic_store_ptr(void **p, void *value);
+
+#endif
@@ -0,0 +1,8 @@
+f M15_scale_i32 0 0 100
+f M15_check_i32 0 0 101
+b M15_check_i32 1 1 1
+b M15_check_i32 1 0 100
+c M15_check_i32 2 0 100
+f __cert__entry_main 0 0 1
+c __cert__entry_main 1 0 100
+c __cert__entry_main 2 0 1